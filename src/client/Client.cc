@@ -287,17 +287,27 @@ Client::Client(Messenger *m, MonClient *mc)
   objecter = new Objecter(cct, messenger, monclient, NULL,
 			  0, 0);
   objecter->set_client_incarnation(0);  // client always 0, for now.
-  writeback_handler = new ObjecterWriteback(objecter, &objecter_finisher,
-					    &client_lock);
-  objectcacher = new ObjectCacher(cct, "libcephfs", *writeback_handler, client_lock,
-				  client_flush_set_callback,    // all commit callback
-				  (void*)this,
-				  cct->_conf->client_oc_size,
-				  cct->_conf->client_oc_max_objects,
-				  cct->_conf->client_oc_max_dirty,
-				  cct->_conf->client_oc_target_dirty,
-				  cct->_conf->client_oc_max_dirty_age,
-				  true);
+  // the cache limits are split evenly between the shards
+  int num_oc_shards = MAX(cct->_conf->client_oc_shards, 1);
+  for (int i = 0; i < num_oc_shards; ++i) {
+    ObjectCacherShard *shard = new ObjectCacherShard;
+    shard->writeback_handler = new ObjecterWriteback(objecter, &objecter_finisher,
+						     &shard->lock);
+    string name = "libcephfs";
+    if (i > 0)
+      name += "-" + stringify(i);
+    shard->objectcacher = new ObjectCacher(cct, name, *shard->writeback_handler,
+					   shard->lock,
+					   client_flush_set_callback,    // all commit callback
+					   (void*)this,
+					   cct->_conf->client_oc_size / num_oc_shards,
+					   MAX(cct->_conf->client_oc_max_objects / num_oc_shards, 1),
+					   cct->_conf->client_oc_max_dirty / num_oc_shards,
+					   cct->_conf->client_oc_target_dirty / num_oc_shards,
+					   cct->_conf->client_oc_max_dirty_age,
+					   true);
+    oc_shards.push_back(shard);
+  }
   objecter_finisher.start();
   filer = new Filer(objecter, &objecter_finisher);
 }
@@ -309,8 +319,13 @@ Client::~Client()
 
   tear_down_cache();
 
-  delete objectcacher;
-  delete writeback_handler;
+  for (vector<ObjectCacherShard*>::iterator p = oc_shards.begin();
+       p != oc_shards.end();
+       ++p) {
+    delete (*p)->objectcacher;
+    delete (*p)->writeback_handler;
+    delete *p;
+  }
 
   delete filer;
   delete objecter;
@@ -471,7 +486,8 @@ void Client::dump_status(Formatter *f)
 int Client::init()
 {
   timer.init();
-  objectcacher->start();
+  for (unsigned i = 0; i < oc_shards.size(); ++i)
+    oc_shards[i]->objectcacher->start();
   objecter->init();
 
   client_lock.Lock();
@@ -487,7 +503,8 @@ int Client::init()
     timer.shutdown();
     client_lock.Unlock();
     objecter->shutdown();
-    objectcacher->stop();
+    for (unsigned i = 0; i < oc_shards.size(); ++i)
+      oc_shards[i]->objectcacher->stop();
     monclient->shutdown();
     return r;
   }
@@ -600,7 +617,9 @@ void Client::shutdown()
     remount_finisher.stop();
   }
 
-  objectcacher->stop();  // outside of client_lock! this does a join.
+  // outside of client_lock! this does a join.
+  for (unsigned i = 0; i < oc_shards.size(); ++i)
+    oc_shards[i]->objectcacher->stop();
 
   client_lock.Lock();
   assert(initialized);
@@ -740,7 +759,11 @@ void Client::update_inode_file_bits(Inode *in,
       ldout(cct, 10) << "truncate_seq " << in->truncate_seq << " -> "
 	       << truncate_seq << dendl;
       in->truncate_seq = truncate_seq;
-      in->oset.truncate_seq = truncate_seq;
+      {
+	ObjectCacherShard *shard = get_oc_shard(in);
+	Mutex::Locker l(shard->lock);
+	in->oset.truncate_seq = truncate_seq;
+      }
 
       // truncate cached file data
       if (prior_size > size) {
@@ -761,6 +784,8 @@ void Client::update_inode_file_bits(Inode *in,
       ldout(cct, 10) << "truncate_size " << in->truncate_size << " -> "
 	       << truncate_size << dendl;
       in->truncate_size = truncate_size;
+      ObjectCacherShard *shard = get_oc_shard(in);
+      Mutex::Locker l(shard->lock);
       in->oset.truncate_size = truncate_size;
     } else {
       ldout(cct, 0) << "Hmmm, truncate_seq && truncate_size changed on non-file inode!" << dendl;
@@ -2381,11 +2406,14 @@ void Client::_handle_full_flag(int64_t pool)
        i != inode_map.end(); ++i)
   {
     Inode *inode = i->second;
-    if (inode->oset.dirty_or_tx
-        && (pool == -1 || inode->layout.pool_id == pool)) {
+    if (pool != -1 && inode->layout.pool_id != pool)
+      continue;
+    ObjectCacherShard *shard = get_oc_shard(inode);
+    Mutex::Locker l(shard->lock);
+    if (inode->oset.dirty_or_tx) {
       ldout(cct, 4) << __func__ << ": FULL: inode 0x" << std::hex << i->first << std::dec
         << " has dirty objects, purging and setting ENOSPC" << dendl;
-      objectcacher->purge_set(&inode->oset);
+      shard->objectcacher->purge_set(&inode->oset);
       inode->async_err = -ENOSPC;
     }
   }
@@ -2859,7 +2887,10 @@ void Client::put_inode(Inode *in, int n)
     remove_all_caps(in);
 
     ldout(cct, 10) << "put_inode deleting " << *in << dendl;
-    bool unclean = objectcacher->release_set(&in->oset);
+    ObjectCacherShard *shard = get_oc_shard(in);
+    shard->lock.Lock();
+    bool unclean = shard->objectcacher->release_set(&in->oset);
+    shard->lock.Unlock();
     assert(!unclean);
     inode_map.erase(in->vino());
     if (use_faked_inos())
@@ -3160,9 +3191,12 @@ int Client::get_caps(Inode *in, int need, int want, int *phave, loff_t endoff)
 int Client::get_caps_used(Inode *in)
 {
   unsigned used = in->caps_used();
-  if (!(used & CEPH_CAP_FILE_CACHE) &&
-      !objectcacher->set_is_empty(&in->oset))
-    used |= CEPH_CAP_FILE_CACHE;
+  if (!(used & CEPH_CAP_FILE_CACHE)) {
+    ObjectCacherShard *shard = get_oc_shard(in);
+    Mutex::Locker l(shard->lock);
+    if (!shard->objectcacher->set_is_empty(&in->oset))
+      used |= CEPH_CAP_FILE_CACHE;
+  }
   return used;
 }
 
@@ -3658,8 +3692,11 @@ void Client::_invalidate_inode_cache(Inode *in)
   ldout(cct, 10) << "_invalidate_inode_cache " << *in << dendl;
 
   // invalidate our userspace inode cache
-  if (cct->_conf->client_oc)
-    objectcacher->release_set(&in->oset);
+  if (cct->_conf->client_oc) {
+    ObjectCacherShard *shard = get_oc_shard(in);
+    Mutex::Locker l(shard->lock);
+    shard->objectcacher->release_set(&in->oset);
+  }
 
   _schedule_invalidate_callback(in, 0, 0);
 }
@@ -3672,7 +3709,9 @@ void Client::_invalidate_inode_cache(Inode *in, int64_t off, int64_t len)
   if (cct->_conf->client_oc) {
     vector<ObjectExtent> ls;
     Striper::file_to_extents(cct, in->ino, &in->layout, off, len, in->truncate_size, ls);
-    objectcacher->discard_set(&in->oset, ls);
+    ObjectCacherShard *shard = get_oc_shard(in);
+    Mutex::Locker l(shard->lock);
+    shard->objectcacher->discard_set(&in->oset, ls);
   }
 
   _schedule_invalidate_callback(in, off, len);
@@ -3692,7 +3731,10 @@ bool Client::_flush(Inode *in, Context *onfinish)
 {
   ldout(cct, 10) << "_flush " << *in << dendl;
 
+  ObjectCacherShard *shard = get_oc_shard(in);
+  shard->lock.Lock();
   if (!in->oset.dirty_or_tx) {
+    shard->lock.Unlock();
     ldout(cct, 10) << " nothing to flush" << dendl;
     onfinish->complete(0);
     return true;
@@ -3700,20 +3742,26 @@ bool Client::_flush(Inode *in, Context *onfinish)
 
   if (objecter->osdmap_pool_full(in->layout.pool_id)) {
     ldout(cct, 1) << __func__ << ": FULL, purging for ENOSPC" << dendl;
-    objectcacher->purge_set(&in->oset);
+    shard->objectcacher->purge_set(&in->oset);
+    shard->lock.Unlock();
     if (onfinish) {
       onfinish->complete(-ENOSPC);
     }
     return true;
   }
 
-  return objectcacher->flush_set(&in->oset, onfinish);
+  bool ret = shard->objectcacher->flush_set(&in->oset, _oc_callback(onfinish));
+  shard->lock.Unlock();
+  return ret;
 }
 
 void Client::_flush_range(Inode *in, int64_t offset, uint64_t size)
 {
   assert(client_lock.is_locked());
+  ObjectCacherShard *shard = get_oc_shard(in);
+  shard->lock.Lock();
   if (!in->oset.dirty_or_tx) {
+    shard->lock.Unlock();
     ldout(cct, 10) << " nothing to flush" << dendl;
     return;
   }
@@ -3722,8 +3770,10 @@ void Client::_flush_range(Inode *in, int64_t offset, uint64_t size)
   Cond cond;
   bool safe = false;
   Context *onflush = new C_SafeCond(&flock, &cond, &safe);
-  bool ret = objectcacher->file_flush(&in->oset, &in->layout, in->snaprealm->get_snap_context(),
-				      offset, size, onflush);
+  bool ret = shard->objectcacher->file_flush(&in->oset, &in->layout,
+					     in->snaprealm->get_snap_context(),
+					     offset, size, onflush);
+  shard->lock.Unlock();
   if (!ret) {
     // wait for flush
     client_lock.Unlock();
@@ -3735,13 +3785,37 @@ void Client::_flush_range(Inode *in, int64_t offset, uint64_t size)
   }
 }
 
+class C_Client_Flushed : public Context {
+  Client *client;
+  Inode *in;  // pinned by the FILE_CACHE|FILE_BUFFER ref _flushed() puts
+public:
+  C_Client_Flushed(Client *c, Inode *i) : client(c), in(i) {}
+  void finish(int r) {
+    assert(client->client_lock.is_locked_by_me());
+    client->_flushed(in);
+  }
+};
+
 void Client::flush_set_callback(ObjectCacher::ObjectSet *oset)
 {
-  //  Mutex::Locker l(client_lock);
-  assert(client_lock.is_locked());   // will be called via dispatch() -> objecter -> ...
+  // called with the shard lock held, which client_lock nests outside of
   Inode *in = static_cast<Inode *>(oset->parent);
   assert(in);
-  _flushed(in);
+  _oc_callback(new C_Client_Flushed(this, in))->complete(0);
+}
+
+Client::ObjectCacherShard *Client::get_oc_shard(Inode *in)
+{
+  return oc_shards[in->ino % oc_shards.size()];
+}
+
+/*
+ * Wrap a context that needs client_lock for the ObjectCacher, which
+ * completes it with only the shard lock held.
+ */
+Context *Client::_oc_callback(Context *c)
+{
+  return new C_OnFinisher(new C_Lock(&client_lock, c), &objecter_finisher);
 }
 
 void Client::_flushed(Inode *in)
@@ -7321,25 +7395,32 @@ int Client::_readdir_cache_cb(dir_result_t *dirp, add_dirent_cb_t cb, void *p)
     return 0;
   }
 
-  vector<Dentry*>::iterator pd = std::lower_bound(dir->readdir_cache.begin(),
-						  dir->readdir_cache.end(),
-						  dirp->offset, dentry_off_lt());
+  // client_lock is dropped around cb, and the cache may be rebuilt (or the
+  // dentries trimmed) meanwhile; keep a position rather than an iterator
+  // and re-validate it after relocking.
+  size_t pos = std::lower_bound(dir->readdir_cache.begin(),
+				dir->readdir_cache.end(),
+				dirp->offset, dentry_off_lt()) -
+	       dir->readdir_cache.begin();
 
   string dn_name;
   while (true) {
     if (!dirp->inode->is_complete_and_ordered())
       return -EAGAIN;
-    if (pd == dir->readdir_cache.end())
+    dir = dirp->inode->dir;
+    if (!dir)
+      return -EAGAIN;
+    if (pos >= dir->readdir_cache.size())
       break;
-    Dentry *dn = *pd;
+    Dentry *dn = dir->readdir_cache[pos];
     if (dn->inode == NULL) {
       ldout(cct, 15) << " skipping null '" << dn->name << "'" << dendl;
-      ++pd;
+      ++pos;
       continue;
     }
     if (dn->cap_shared_gen != dir->parent_inode->shared_gen) {
       ldout(cct, 15) << " skipping mismatch shared gen '" << dn->name << "'" << dendl;
-      ++pd;
+      ++pos;
       continue;
     }
 
@@ -7347,9 +7428,10 @@ int Client::_readdir_cache_cb(dir_result_t *dirp, add_dirent_cb_t cb, void *p)
     struct dirent de;
     int stmask = fill_stat(dn->inode, &st);
 
-    uint64_t next_off = dn->offset + 1;
-    ++pd;
-    if (pd == dir->readdir_cache.end())
+    uint64_t dn_off = dn->offset;
+    uint64_t next_off = dn_off + 1;
+    ++pos;
+    if (pos == dir->readdir_cache.size())
       next_off = dir_result_t::END;
 
     fill_dirent(&de, dn->name.c_str(), st.st_mode, st.st_ino, next_off);
@@ -7359,7 +7441,7 @@ int Client::_readdir_cache_cb(dir_result_t *dirp, add_dirent_cb_t cb, void *p)
     client_lock.Unlock();
     int r = cb(p, &de, &st, stmask, next_off);  // _next_ offset
     client_lock.Lock();
-    ldout(cct, 15) << " de " << de.d_name << " off " << hex << dn->offset << dec
+    ldout(cct, 15) << " de " << de.d_name << " off " << hex << dn_off << dec
 		   << " = " << r << dendl;
     if (r < 0) {
       return r;
@@ -8226,22 +8308,26 @@ int Client::uninline_data(Inode *in, Context *onfinish)
 
 int Client::read(int fd, char *buf, loff_t size, loff_t offset)
 {
-  Mutex::Locker lock(client_lock);
-  tout(cct) << "read" << std::endl;
-  tout(cct) << fd << std::endl;
-  tout(cct) << size << std::endl;
-  tout(cct) << offset << std::endl;
+  bufferlist bl;
+  int r;
+  {
+    Mutex::Locker lock(client_lock);
+    tout(cct) << "read" << std::endl;
+    tout(cct) << fd << std::endl;
+    tout(cct) << size << std::endl;
+    tout(cct) << offset << std::endl;
 
-  Fh *f = get_filehandle(fd);
-  if (!f)
-    return -EBADF;
+    Fh *f = get_filehandle(fd);
+    if (!f)
+      return -EBADF;
 #if defined(__linux__) && defined(O_PATH)
-  if (f->flags & O_PATH)
-    return -EBADF;
+    if (f->flags & O_PATH)
+      return -EBADF;
 #endif
-  bufferlist bl;
-  int r = _read(f, offset, size, &bl);
-  ldout(cct, 3) << "read(" << fd << ", " << (void*)buf << ", " << size << ", " << offset << ") = " << r << dendl;
+    r = _read(f, offset, size, &bl);
+    ldout(cct, 3) << "read(" << fd << ", " << (void*)buf << ", " << size << ", " << offset << ") = " << r << dendl;
+  }
+  // the buffers are ours now; copy them out without holding client_lock
   if (r >= 0) {
     bl.copy(0, bl.length(), buf);
     r = bl.length();
@@ -8426,38 +8512,43 @@ int Client::_read_async(Fh *f, uint64_t off, uint64_t len, bufferlist *bl)
                  << " max_bytes=" << f->readahead.get_max_readahead_size()
                  << " max_periods=" << conf->client_readahead_max_periods << dendl;
 
-  // read (and possibly block)
+  // read (and possibly block), with only the shard locked
+  ObjectCacherShard *shard = get_oc_shard(in);
+  file_layout_t layout = in->layout;
   int r, rvalue = 0;
   Mutex flock("Client::_read_async flock");
   Cond cond;
   bool done = false;
   Context *onfinish = new C_SafeCond(&flock, &cond, &done, &rvalue);
-  r = objectcacher->file_read(&in->oset, &in->layout, in->snapid,
-			      off, len, bl, 0, onfinish);
+  get_cap_ref(in, CEPH_CAP_FILE_CACHE);
+  client_lock.Unlock();
+  shard->lock.Lock();
+  r = shard->objectcacher->file_read(&in->oset, &layout, in->snapid,
+				     off, len, bl, 0, onfinish);
+  shard->lock.Unlock();
   if (r == 0) {
-    get_cap_ref(in, CEPH_CAP_FILE_CACHE);
-    client_lock.Unlock();
     flock.Lock();
     while (!done)
       cond.Wait(flock);
     flock.Unlock();
-    client_lock.Lock();
-    put_cap_ref(in, CEPH_CAP_FILE_CACHE);
     r = rvalue;
   } else {
     // it was cached.
     delete onfinish;
   }
+  client_lock.Lock();
+  put_cap_ref(in, CEPH_CAP_FILE_CACHE);
 
   if(f->readahead.get_min_readahead_size() > 0) {
     pair<uint64_t, uint64_t> readahead_extent = f->readahead.update(off, len, in->size);
     if (readahead_extent.second > 0) {
       ldout(cct, 20) << "readahead " << readahead_extent.first << "~" << readahead_extent.second
 		     << " (caller wants " << off << "~" << len << ")" << dendl;
-      Context *onfinish2 = new C_Readahead(this, f);
-      int r2 = objectcacher->file_read(&in->oset, &in->layout, in->snapid,
-				       readahead_extent.first, readahead_extent.second,
-				       NULL, 0, onfinish2);
+      Context *onfinish2 = _oc_callback(new C_Readahead(this, f));
+      Mutex::Locker l(shard->lock);
+      int r2 = shard->objectcacher->file_read(&in->oset, &in->layout, in->snapid,
+					      readahead_extent.first, readahead_extent.second,
+					      NULL, 0, onfinish2);
       if (r2 == 0) {
 	ldout(cct, 20) << "readahead initiated, c " << onfinish2 << dendl;
 	get_cap_ref(in, CEPH_CAP_FILE_RD | CEPH_CAP_FILE_CACHE);
@@ -8602,54 +8693,81 @@ int Client::pwritev(int fd, const struct iovec *iov, int iovcnt, int64_t offset)
 
 int Client::_preadv_pwritev(int fd, const struct iovec *iov, unsigned iovcnt, int64_t offset, bool write)
 {
-    Mutex::Locker lock(client_lock);
-    tout(cct) << fd << std::endl;
-    tout(cct) << offset << std::endl;
-
-    Fh *fh = get_filehandle(fd);
-    if (!fh)
-        return -EBADF;
-#if defined(__linux__) && defined(O_PATH)
-    if (fh->flags & O_PATH)
-        return -EBADF;
-#endif
     loff_t totallen = 0;
     for (unsigned i = 0; i < iovcnt; i++) {
         totallen += iov[i].iov_len;
     }
-    if (write) {
-        int w = _write(fh, offset, totallen, NULL, iov, iovcnt);
-        ldout(cct, 3) << "pwritev(" << fd << ", \"...\", " << totallen << ", " << offset << ") = " << w << dendl;
-        return w;
-    } else {
-        bufferlist bl;
-        int r = _read(fh, offset, totallen, &bl);
-        ldout(cct, 3) << "preadv(" << fd << ", " <<  offset << ") = " << r << dendl;
-        if (r <= 0)
-          return r;
-
-        int bufoff = 0;
-        for (unsigned j = 0, resid = r; j < iovcnt && resid > 0; j++) {
-               /*
-                * This piece of code aims to handle the case that bufferlist does not have enough data 
-                * to fill in the iov 
-                */
-               if (resid < iov[j].iov_len) {
-                    bl.copy(bufoff, resid, (char *)iov[j].iov_base);
-                    break;
-               } else {
-                    bl.copy(bufoff, iov[j].iov_len, (char *)iov[j].iov_base);
-               }
-               resid -= iov[j].iov_len;
-               bufoff += iov[j].iov_len;
+
+    int r;
+    bufferlist bl;
+    {
+        Mutex::Locker lock(client_lock);
+        tout(cct) << fd << std::endl;
+        tout(cct) << offset << std::endl;
+
+        Fh *fh = get_filehandle(fd);
+        if (!fh)
+            return -EBADF;
+#if defined(__linux__) && defined(O_PATH)
+        if (fh->flags & O_PATH)
+            return -EBADF;
+#endif
+        if (write) {
+            int w = _write(fh, offset, totallen, NULL, iov, iovcnt);
+            ldout(cct, 3) << "pwritev(" << fd << ", \"...\", " << totallen << ", " << offset << ") = " << w << dendl;
+            return w;
         }
-        return r;  
+        r = _read(fh, offset, totallen, &bl);
+        ldout(cct, 3) << "preadv(" << fd << ", " <<  offset << ") = " << r << dendl;
+    }
+    if (r <= 0)
+        return r;
+
+    // scatter into the caller's buffers without holding client_lock
+    int bufoff = 0;
+    for (unsigned j = 0, resid = r; j < iovcnt && resid > 0; j++) {
+           /*
+            * This piece of code aims to handle the case that bufferlist does not have enough data 
+            * to fill in the iov 
+            */
+           if (resid < iov[j].iov_len) {
+                bl.copy(bufoff, resid, (char *)iov[j].iov_base);
+                break;
+           } else {
+                bl.copy(bufoff, iov[j].iov_len, (char *)iov[j].iov_base);
+           }
+           resid -= iov[j].iov_len;
+           bufoff += iov[j].iov_len;
+    }
+    return r;  
+}
+
+/*
+ * Copy the data of a write into fresh buffers, since the write may be
+ * resubmitted or completed asynchronously.  _write() does this once
+ * the write is checked, and for all but inline data without
+ * client_lock, so that the copy does not serialize writers to
+ * different files.
+ */
+void Client::copy_write_data(const char *buf, const struct iovec *iov,
+			     int iovcnt, uint64_t size, bufferlist *bl)
+{
+  if (buf) {
+    if (size > 0)
+      bl->append(buffer::copy(buf, size));
+  } else if (iov) {
+    for (int i = 0; i < iovcnt; i++) {
+      if (iov[i].iov_len > 0)
+	bl->append(buffer::copy((char*)iov[i].iov_base, iov[i].iov_len));
     }
+  }
 }
 
 int Client::_write(Fh *f, int64_t offset, uint64_t size, const char *buf,
                   const struct iovec *iov, int iovcnt)
 {
+  if ((int64_t)size < 0)
+    return -EINVAL;
   if ((uint64_t)(offset+size) > mdsmap->get_max_filesize()) //too large!
     return -EFBIG;
 
@@ -8706,32 +8824,12 @@ int Client::_write(Fh *f, int64_t offset, uint64_t size, const char *buf,
     assert(in->inline_version > 0);
   }
 
-  // copy into fresh buffer (since our write may be resub, async)
-  bufferlist bl;
-  bufferptr *bparr = NULL;
-  if (buf) {
-      bufferptr bp;
-      if (size > 0) bp = buffer::copy(buf, size);
-      bl.push_back( bp );
-  } else if (iov){
-      //iov case 
-      bparr = new bufferptr[iovcnt];
-      for (int i = 0; i < iovcnt; i++) {
-        if (iov[i].iov_len > 0) {
-            bparr[i] = buffer::copy((char*)iov[i].iov_base, iov[i].iov_len);
-        }
-        bl.push_back( bparr[i] );
-      }
-  }
-
   utime_t lat;
   uint64_t totalwritten;
   int have;
   int r = get_caps(in, CEPH_CAP_FILE_WR, CEPH_CAP_FILE_BUFFER, &have, endoff);
-  if (r < 0) {
-    delete[] bparr;
+  if (r < 0)
     return r;
-  }
 
   if (f->flags & O_DIRECT)
     have &= ~CEPH_CAP_FILE_BUFFER;
@@ -8743,6 +8841,7 @@ int Client::_write(Fh *f, int64_t offset, uint64_t size, const char *buf,
   bool uninline_done = false;
   int uninline_ret = 0;
   Context *onuninline = NULL;
+  bufferlist bl;
 
   if (in->inline_version < CEPH_INLINE_NONE) {
     if (endoff > cct->_conf->client_max_inline_size ||
@@ -8756,6 +8855,8 @@ int Client::_write(Fh *f, int64_t offset, uint64_t size, const char *buf,
     } else {
       get_cap_ref(in, CEPH_CAP_FILE_BUFFER);
 
+      // small enough to copy under client_lock
+      copy_write_data(buf, iov, iovcnt, size, &bl);
       uint32_t len = in->inline_data.length();
 
       if (endoff < len)
@@ -8776,17 +8877,30 @@ int Client::_write(Fh *f, int64_t offset, uint64_t size, const char *buf,
   }
 
   if (cct->_conf->client_oc && (have & CEPH_CAP_FILE_BUFFER)) {
-    // do buffered write
-    if (!in->oset.dirty_or_tx)
-      get_cap_ref(in, CEPH_CAP_FILE_CACHE | CEPH_CAP_FILE_BUFFER);
-
+    // do buffered write, with only the shard locked
+    ObjectCacherShard *shard = get_oc_shard(in);
+    file_layout_t layout = in->layout;
+    SnapContext snapc = in->snaprealm->get_snap_context();
+
+    // the dirty set holds a FILE_CACHE|FILE_BUFFER ref, which
+    // flush_set_callback puts once it is clean again.  Take one for it
+    // up front, and keep it if this write is what dirtied the set.
+    get_cap_ref(in, CEPH_CAP_FILE_CACHE | CEPH_CAP_FILE_BUFFER);
     get_cap_ref(in, CEPH_CAP_FILE_BUFFER);
+    client_lock.Unlock();
 
+    copy_write_data(buf, iov, iovcnt, size, &bl);
+    shard->lock.Lock();
+    bool was_dirty = in->oset.dirty_or_tx > 0;
     // async, caching, non-blocking.
-    r = objectcacher->file_write(&in->oset, &in->layout,
-				 in->snaprealm->get_snap_context(),
-				 offset, size, bl, ceph::real_clock::now(cct),
-				 0);
+    r = shard->objectcacher->file_write(&in->oset, &layout, snapc,
+					offset, size, bl, ceph::real_clock::now(cct),
+					0);
+    shard->lock.Unlock();
+
+    client_lock.Lock();
+    if (was_dirty || size == 0)
+      put_cap_ref(in, CEPH_CAP_FILE_CACHE | CEPH_CAP_FILE_BUFFER);
     put_cap_ref(in, CEPH_CAP_FILE_BUFFER);
 
     if (r < 0)
@@ -8812,11 +8926,18 @@ int Client::_write(Fh *f, int64_t offset, uint64_t size, const char *buf,
     unsafe_sync_write++;
     get_cap_ref(in, CEPH_CAP_FILE_BUFFER);  // released by onsafe callback
 
-    filer->write_trunc(in->ino, &in->layout, in->snaprealm->get_snap_context(),
+    // copy and submit without client_lock
+    file_layout_t layout = in->layout;
+    SnapContext snapc = in->snaprealm->get_snap_context();
+    uint64_t truncate_size = in->truncate_size;
+    __u32 truncate_seq = in->truncate_seq;
+    client_lock.Unlock();
+
+    copy_write_data(buf, iov, iovcnt, size, &bl);
+    filer->write_trunc(in->ino, &layout, snapc,
 			   offset, size, bl, ceph::real_clock::now(cct), 0,
-			   in->truncate_size, in->truncate_seq,
+			   truncate_size, truncate_seq,
 			   onfinish, new C_OnFinisher(onsafe, &objecter_finisher));
-    client_lock.Unlock();
     flock.Lock();
 
     while (!done)
@@ -8878,7 +8999,6 @@ done:
   }
 
   put_cap_ref(in, CEPH_CAP_FILE_WR);
-  delete[] bparr; 
   return r;
 }
 
@@ -9563,9 +9683,14 @@ int Client::_sync_fs()
   Mutex lock("Client::_fsync::lock");
   Cond cond;
   bool flush_done = false;
-  if (cct->_conf->client_oc)
-    objectcacher->flush_all(new C_SafeCond(&lock, &cond, &flush_done));
-  else
+  if (cct->_conf->client_oc) {
+    C_GatherBuilder gather(cct, new C_SafeCond(&lock, &cond, &flush_done));
+    for (unsigned i = 0; i < oc_shards.size(); ++i) {
+      Mutex::Locker l(oc_shards[i]->lock);
+      oc_shards[i]->objectcacher->flush_all(gather.new_sub());
+    }
+    gather.activate();
+  } else
     flush_done = true;
 
   // flush caps
@@ -9599,7 +9724,12 @@ int Client::sync_fs()
 int64_t Client::drop_caches()
 {
   Mutex::Locker l(client_lock);
-  return objectcacher->release_all();
+  int64_t unclean = 0;
+  for (unsigned i = 0; i < oc_shards.size(); ++i) {
+    Mutex::Locker sl(oc_shards[i]->lock);
+    unclean += oc_shards[i]->objectcacher->release_all();
+  }
+  return unclean;
 }
 
 
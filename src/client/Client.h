@@ -403,9 +403,28 @@ public:
 
 protected:
   Filer                 *filer;     
-  ObjectCacher          *objectcacher;
   Objecter              *objecter;     // (non-blocking) osd interface
-  WritebackHandler      *writeback_handler;
+
+  /*
+   * File data is cached by client_oc_shards ObjectCachers, each with a
+   * lock of its own; an inode's shard is picked by its number.  The
+   * read and write paths call into the cache under the shard lock only,
+   * so that I/O to different files does not serialize on client_lock.
+   * Where both are held, client_lock is taken first, so cache callbacks
+   * that need client_lock are requeued on objecter_finisher.
+   */
+  struct ObjectCacherShard {
+    Mutex lock;
+    WritebackHandler *writeback_handler;
+    ObjectCacher *objectcacher;
+    ObjectCacherShard()
+      : lock("Client::ObjectCacherShard::lock"),
+	writeback_handler(NULL), objectcacher(NULL) {}
+  };
+  vector<ObjectCacherShard*> oc_shards;
+
+  ObjectCacherShard *get_oc_shard(Inode *in);
+  Context *_oc_callback(Context *c);
 
   // cache
   ceph::unordered_map<vinodeno_t, Inode*> inode_map;
@@ -493,6 +512,7 @@ protected:
   void close_dir(Dir *dir);
 
   friend class C_Client_FlushComplete; // calls put_inode()
+  friend class C_Client_Flushed; // calls _flushed()
   friend class C_Client_CacheInvalidate;  // calls ino_invalidate_cb
   friend class C_Client_DentryInvalidate;  // calls dentry_invalidate_cb
   friend class C_Block_Sync; // Calls block map and protected helpers
@@ -810,6 +830,8 @@ private:
 
   loff_t _lseek(Fh *fh, loff_t offset, int whence);
   int _read(Fh *fh, int64_t offset, uint64_t size, bufferlist *bl);
+  static void copy_write_data(const char *buf, const struct iovec *iov,
+			      int iovcnt, uint64_t size, bufferlist *bl);
   int _write(Fh *fh, int64_t offset, uint64_t size, const char *buf,
           const struct iovec *iov, int iovcnt);
   int _preadv_pwritev(int fd, const struct iovec *iov, unsigned iovcnt, int64_t offset, bool write);
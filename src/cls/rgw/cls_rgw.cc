@@ -42,6 +42,7 @@ cls_method_handle_t h_rgw_obj_check_attrs_prefix;
 cls_method_handle_t h_rgw_obj_check_mtime;
 cls_method_handle_t h_rgw_bi_get_op;
 cls_method_handle_t h_rgw_bi_put_op;
+cls_method_handle_t h_rgw_bi_put_exclusive_op;
 cls_method_handle_t h_rgw_bi_list_op;
 cls_method_handle_t h_rgw_bi_log_list_op;
 cls_method_handle_t h_rgw_dir_suggest_changes;
@@ -2259,7 +2260,7 @@ static int rgw_bi_get_op(cls_method_context_t hctx, bufferlist *in, bufferlist *
   return 0;
 }
 
-static int rgw_bi_put_op(cls_method_context_t hctx, bufferlist *in, bufferlist *out)
+static int bi_put(cls_method_context_t hctx, bufferlist *in, bool exclusive)
 {
   // decode request
   rgw_cls_bi_put_op op;
@@ -2273,6 +2274,35 @@ static int rgw_bi_put_op(cls_method_context_t hctx, bufferlist *in, bufferlist *
 
   rgw_cls_bi_entry& entry = op.entry;
 
+  if (exclusive) {
+    if (entry.idx.empty()) {
+      /* a probe for this method */
+      return 0;
+    }
+    bufferlist bl;
+    int r = cls_cxx_map_get_val(hctx, entry.idx, &bl);
+    if (r == 0) {
+      /* an entry left behind by a cancelled operation may still be replaced */
+      bool stale = false;
+      if (entry.type == PlainIdx) {
+        struct rgw_bucket_dir_entry cur;
+        bufferlist::iterator iter = bl.begin();
+        try {
+          ::decode(cur, iter);
+          stale = (!cur.exists && cur.pending_map.empty());
+        } catch (buffer::error& err) {
+          CLS_LOG(1, "ERROR: %s(): failed to decode entry %s", __func__, entry.idx.c_str());
+        }
+      }
+      if (!stale) {
+        CLS_LOG(20, "%s(): entry %s exists, skipping", __func__, entry.idx.c_str());
+        return 0;
+      }
+    } else if (r != -ENOENT) {
+      return r;
+    }
+  }
+
   int r = cls_cxx_map_set_val(hctx, entry.idx, &entry.data);
   if (r < 0) {
     CLS_LOG(0, "ERROR: %s(): cls_cxx_map_set_val() returned r=%d", __func__, r);
@@ -2281,6 +2311,21 @@ static int rgw_bi_put_op(cls_method_context_t hctx, bufferlist *in, bufferlist *
   return 0;
 }
 
+static int rgw_bi_put_op(cls_method_context_t hctx, bufferlist *in, bufferlist *out)
+{
+  return bi_put(hctx, in, false);
+}
+
+/*
+ * Like bi_put, but leaves an existing entry alone, unless it is a plain
+ * entry left behind by a cancelled operation.  A method of its own, so
+ * that OSDs which do not know it fail the call instead of overwriting.
+ */
+static int rgw_bi_put_exclusive_op(cls_method_context_t hctx, bufferlist *in, bufferlist *out)
+{
+  return bi_put(hctx, in, true);
+}
+
 static int list_plain_entries(cls_method_context_t hctx, const string& name, const string& marker, uint32_t max,
                               list<rgw_cls_bi_entry> *entries)
 {
@@ -3530,6 +3575,7 @@ void __cls_init()
 
   cls_register_cxx_method(h_class, "bi_get", CLS_METHOD_RD, rgw_bi_get_op, &h_rgw_bi_get_op);
   cls_register_cxx_method(h_class, "bi_put", CLS_METHOD_RD | CLS_METHOD_WR, rgw_bi_put_op, &h_rgw_bi_put_op);
+  cls_register_cxx_method(h_class, "bi_put_exclusive", CLS_METHOD_RD | CLS_METHOD_WR, rgw_bi_put_exclusive_op, &h_rgw_bi_put_exclusive_op);
   cls_register_cxx_method(h_class, "bi_list", CLS_METHOD_RD, rgw_bi_list_op, &h_rgw_bi_list_op);
 
   cls_register_cxx_method(h_class, "bi_log_list", CLS_METHOD_RD, rgw_bi_log_list, &h_rgw_bi_log_list_op);
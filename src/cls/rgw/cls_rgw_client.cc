@@ -188,10 +188,11 @@ void cls_rgw_bucket_complete_op(ObjectWriteOperation& o, RGWModifyOp op, string&
   o.exec("rgw", "bucket_complete_op", in);
 }
 
-static bool issue_bucket_list_op(librados::IoCtx& io_ctx,
-    const string& oid, const cls_rgw_obj_key& start_obj, const string& filter_prefix,
-    uint32_t num_entries, bool list_versions, BucketIndexAioManager *manager,
-    struct rgw_cls_list_ret *pdata) {
+void cls_rgw_bucket_list_op(librados::ObjectReadOperation& op,
+                            const cls_rgw_obj_key& start_obj, const string& filter_prefix,
+                            uint32_t num_entries, bool list_versions,
+                            struct rgw_cls_list_ret *result, int *prval)
+{
   bufferlist in;
   struct rgw_cls_list_op call;
   call.start_obj = start_obj;
@@ -200,8 +201,15 @@ static bool issue_bucket_list_op(librados::IoCtx& io_ctx,
   call.list_versions = list_versions;
   ::encode(call, in);
 
+  op.exec("rgw", "bucket_list", in, new ClsBucketIndexOpCtx<struct rgw_cls_list_ret>(result, prval));
+}
+
+static bool issue_bucket_list_op(librados::IoCtx& io_ctx,
+    const string& oid, const cls_rgw_obj_key& start_obj, const string& filter_prefix,
+    uint32_t num_entries, bool list_versions, BucketIndexAioManager *manager,
+    struct rgw_cls_list_ret *pdata) {
   librados::ObjectReadOperation op;
-  op.exec("rgw", "bucket_list", in, new ClsBucketIndexOpCtx<struct rgw_cls_list_ret>(pdata, NULL));
+  cls_rgw_bucket_list_op(op, start_obj, filter_prefix, num_entries, list_versions, pdata, NULL);
   return manager->aio_operate(io_ctx, oid, &op);
 }
 
@@ -288,13 +296,24 @@ int cls_rgw_bi_put(librados::IoCtx& io_ctx, const string oid, rgw_cls_bi_entry&
   return 0;
 }
 
-void cls_rgw_bi_put(ObjectWriteOperation& op, const string oid, rgw_cls_bi_entry& entry)
+void cls_rgw_bi_put(ObjectWriteOperation& op, const string oid, rgw_cls_bi_entry& entry,
+                    bool exclusive)
 {
   bufferlist in, out;
   struct rgw_cls_bi_put_op call;
   call.entry = entry;
   ::encode(call, in);
-  op.exec("rgw", "bi_put", in);
+  op.exec("rgw", (exclusive ? "bi_put_exclusive" : "bi_put"), in);
+}
+
+int cls_rgw_bi_put_exclusive_probe(librados::IoCtx& io_ctx, const string& oid)
+{
+  bufferlist in;
+  struct rgw_cls_bi_put_op call; /* an empty entry is not put */
+  ::encode(call, in);
+  librados::ObjectWriteOperation op;
+  op.exec("rgw", "bi_put_exclusive", in);
+  return io_ctx.operate(oid, &op);
 }
 
 int cls_rgw_bi_list(librados::IoCtx& io_ctx, const string oid,
@@ -327,7 +327,14 @@ int cls_rgw_bi_get(librados::IoCtx& io_ctx, const string oid,
                    BIIndexType index_type, cls_rgw_obj_key& key,
                    rgw_cls_bi_entry *entry);
 int cls_rgw_bi_put(librados::IoCtx& io_ctx, const string oid, rgw_cls_bi_entry& entry);
-void cls_rgw_bi_put(librados::ObjectWriteOperation& op, const string oid, rgw_cls_bi_entry& entry);
+/*
+ * exclusive: leave an entry that already exists alone, unless it is a
+ * plain entry left behind by a cancelled operation
+ */
+void cls_rgw_bi_put(librados::ObjectWriteOperation& op, const string oid, rgw_cls_bi_entry& entry,
+                    bool exclusive = false);
+/* -EOPNOTSUPP if the OSD holding oid predates the exclusive bi_put */
+int cls_rgw_bi_put_exclusive_probe(librados::IoCtx& io_ctx, const string& oid);
 int cls_rgw_bi_list(librados::IoCtx& io_ctx, const string oid,
                    const string& name, const string& marker, uint32_t max,
                    list<rgw_cls_bi_entry> *entries, bool *is_truncated);
@@ -344,6 +351,16 @@ int cls_rgw_get_olh_log(librados::IoCtx& io_ctx, string& oid, librados::ObjectRe
 void cls_rgw_trim_olh_log(librados::ObjectWriteOperation& op, const cls_rgw_obj_key& olh, uint64_t ver, const string& olh_tag);
 int cls_rgw_clear_olh(librados::IoCtx& io_ctx, string& oid, const cls_rgw_obj_key& olh, const string& olh_tag);
 
+/**
+ * List up to num_entries entries of a single bucket index object, after
+ * start_obj.  The result is decoded into *result, and *prval is set, once
+ * the operation completes.
+ */
+void cls_rgw_bucket_list_op(librados::ObjectReadOperation& op,
+                            const cls_rgw_obj_key& start_obj, const string& filter_prefix,
+                            uint32_t num_entries, bool list_versions,
+                            struct rgw_cls_list_ret *result, int *prval);
+
 /**
  * List the bucket with the starting object and filter prefix.
  * NOTE: this method do listing requests for each bucket index shards identified by
@@ -99,6 +99,9 @@ OPTION(xio_max_send_inline, OPT_INT, 512) // xio maximum threshold to send inlin
 
 OPTION(compressor_zlib_isal, OPT_BOOL, false)
 OPTION(compressor_zlib_level, OPT_INT, 5) //regular zlib compression level, not applicable to isa-l optimized version
+OPTION(compressor_zstd_level, OPT_INT, 1) // zstd compression level (1-22); higher is smaller and slower
+OPTION(compressor_zstd_dict, OPT_STR, "") // path to a zstd dictionary; data written with another one fails to decompress
+OPTION(compressor_lz4_acceleration, OPT_INT, 1) // lz4 acceleration factor; higher is faster and weaker
 
 OPTION(async_compressor_enabled, OPT_BOOL, false)
 OPTION(async_compressor_type, OPT_STR, "snappy")
@@ -213,6 +216,10 @@ OPTION(ms_async_set_affinity, OPT_BOOL, true)
 // core
 OPTION(ms_async_affinity_cores, OPT_STR, "")
 OPTION(ms_async_send_inline, OPT_BOOL, false)
+// Workers spin on their event loop instead of sleeping in epoll, and other
+// threads hand them work through a lock-free ring without waking them.
+// Burns one core per worker; best combined with ms_async_affinity_cores.
+OPTION(ms_async_busy_poll, OPT_BOOL, false)
 
 OPTION(inject_early_sigterm, OPT_BOOL, false)
 
@@ -397,6 +404,7 @@ OPTION(client_oc_max_dirty, OPT_INT, 1024*1024* 100)    // MB * n  (dirty OR tx.
 OPTION(client_oc_target_dirty, OPT_INT, 1024*1024* 8) // target dirty (keep this smallish)
 OPTION(client_oc_max_dirty_age, OPT_DOUBLE, 5.0)      // max age in cache before writeback
 OPTION(client_oc_max_objects, OPT_INT, 1000)      // max objects in cache
+OPTION(client_oc_shards, OPT_INT, 4)      // caches, each locked on its own; the limits above are split between them
 OPTION(client_debug_getattr_caps, OPT_BOOL, false) // check if MDS reply contains wanted caps
 OPTION(client_debug_force_sync_read, OPT_BOOL, false)     // always read synchronously (go to osds)
 OPTION(client_debug_inject_tick_delay, OPT_INT, 0) // delay the client tick for a number of seconds
@@ -451,6 +459,7 @@ OPTION(journaler_batch_max, OPT_U64, 0)  // max bytes we'll delay flushing; disa
 OPTION(mds_data, OPT_STR, "/var/lib/ceph/mds/$cluster-$id")
 OPTION(mds_max_file_size, OPT_U64, 1ULL << 40) // Used when creating new CephFS. Change with 'ceph mds set max_file_size <size>' afterwards
 OPTION(mds_cache_size, OPT_INT, 100000)
+OPTION(mds_cache_memory_limit, OPT_U64, 0) // bytes of cache metadata to trim to; 0 to go by mds_cache_size only
 OPTION(mds_cache_mid, OPT_FLOAT, .7)
 OPTION(mds_max_file_recover, OPT_U32, 32)
 OPTION(mds_dir_max_commit_size, OPT_INT, 10) // MB
@@ -473,15 +482,18 @@ OPTION(mds_dirstat_min_interval, OPT_FLOAT, 1)    // try to avoid propagating mo
 OPTION(mds_scatter_nudge_interval, OPT_FLOAT, 5)  // how quickly dirstat changes propagate up the hierarchy
 OPTION(mds_client_prealloc_inos, OPT_INT, 1000)
 OPTION(mds_early_reply, OPT_BOOL, true)
+OPTION(mds_batch_getattr, OPT_BOOL, true) // answer identical getattr/lookups together
 OPTION(mds_default_dir_hash, OPT_INT, CEPH_STR_HASH_RJENKINS)
 OPTION(mds_log, OPT_BOOL, true)
 OPTION(mds_log_pause, OPT_BOOL, false)
 OPTION(mds_log_skip_corrupt_events, OPT_BOOL, false)
+OPTION(mds_log_replay_threads, OPT_INT, 1) // threads decoding events during replay; 1 decodes on the replay thread
 OPTION(mds_log_max_events, OPT_INT, -1)
 OPTION(mds_log_events_per_segment, OPT_INT, 1024)
 OPTION(mds_log_segment_size, OPT_INT, 0)  // segment size for mds log, default to default file_layout_t
 OPTION(mds_log_max_segments, OPT_U32, 30)
 OPTION(mds_log_max_expiring, OPT_INT, 20)
+OPTION(mds_log_group_commit, OPT_BOOL, true) // flush appended events whenever the previous flush is safe
 OPTION(mds_bal_sample_interval, OPT_DOUBLE, 3.0)  // every 3 seconds
 OPTION(mds_bal_replicate_threshold, OPT_FLOAT, 8000)
 OPTION(mds_bal_unreplicate_threshold, OPT_FLOAT, 0)
@@ -686,6 +698,8 @@ OPTION(osd_map_max_advance, OPT_INT, 150) // make this < cache_size!
 OPTION(osd_map_cache_size, OPT_INT, 200)
 OPTION(osd_map_message_max, OPT_INT, 100)  // max maps per MOSDMap message
 OPTION(osd_map_share_max_epochs, OPT_INT, 100)  // cap on # of inc maps we send to peers, clients
+OPTION(osd_map_mapping_cache, OPT_BOOL, false) // precompute pg mappings of each map epoch (clients, mon)
+OPTION(osd_map_mapping_threads, OPT_INT, 0) // threads to build them with; 0 = one per cpu
 OPTION(osd_inject_bad_map_crc_probability, OPT_FLOAT, 0)
 OPTION(osd_inject_failure_on_pg_removal, OPT_BOOL, false)
 // shutdown the OSD if stuatus flipping more than max_markdown_count times in recent max_markdown_period seconds
@@ -693,6 +707,7 @@ OPTION(osd_max_markdown_period , OPT_INT, 600)
 OPTION(osd_max_markdown_count, OPT_INT, 5)
 
 OPTION(osd_op_threads, OPT_INT, 2)    // 0 == no threading
+OPTION(osd_load_pgs_threads, OPT_INT, 0) // threads reading pgs at startup; 0 = one per cpu
 OPTION(osd_peering_wq_batch_size, OPT_U64, 20)
 OPTION(osd_op_pq_max_tokens_per_priority, OPT_U64, 4194304)
 OPTION(osd_op_pq_min_cost, OPT_U64, 65536)
@@ -703,14 +718,45 @@ OPTION(osd_recovery_threads, OPT_INT, 1)
 OPTION(osd_recover_clone_overlap, OPT_BOOL, true)   // preserve clone_overlap during recovery/migration
 OPTION(osd_op_num_threads_per_shard, OPT_INT, 2)
 OPTION(osd_op_num_shards, OPT_INT, 5)
-OPTION(osd_op_queue, OPT_STR, "wpq") // PrioritzedQueue (prio), Weighted Priority Queue (wpq), or debug_random
+OPTION(osd_op_queue, OPT_STR, "wpq") // PrioritzedQueue (prio), Weighted Priority Queue (wpq), mClock by op class (mclock_opclass), mClock by client (mclock_client), or debug_random
 OPTION(osd_op_queue_cut_off, OPT_STR, "low") // Min priority to go to strict queue. (low, high, debug_random)
+// mClock reservation (ops/s), weight and limit (ops/s, 0 = none) per op
+// shard, used by the mclock_opclass and mclock_client op queues
+OPTION(osd_op_queue_mclock_client_op_res, OPT_DOUBLE, 1000.0)
+OPTION(osd_op_queue_mclock_client_op_wgt, OPT_DOUBLE, 500.0)
+OPTION(osd_op_queue_mclock_client_op_lim, OPT_DOUBLE, 0.0)
+// the mclock_client queue schedules every client entity separately with
+// these instead: reservations add up across clients, so only set one when
+// the number of clients per OSD is bounded
+OPTION(osd_op_queue_mclock_client_res, OPT_DOUBLE, 0.0)
+OPTION(osd_op_queue_mclock_client_wgt, OPT_DOUBLE, 500.0)
+OPTION(osd_op_queue_mclock_client_lim, OPT_DOUBLE, 0.0)
+OPTION(osd_op_queue_mclock_osd_subop_res, OPT_DOUBLE, 1000.0)
+OPTION(osd_op_queue_mclock_osd_subop_wgt, OPT_DOUBLE, 500.0)
+OPTION(osd_op_queue_mclock_osd_subop_lim, OPT_DOUBLE, 0.0)
+OPTION(osd_op_queue_mclock_snap_res, OPT_DOUBLE, 0.0)
+OPTION(osd_op_queue_mclock_snap_wgt, OPT_DOUBLE, 1.0)
+OPTION(osd_op_queue_mclock_snap_lim, OPT_DOUBLE, 0.001)
+// recovery and scrub get a small reservation and no limit: a limit only
+// applies while there is competing work, so under sustained client load
+// it would starve them, while the reservation guarantees progress
+OPTION(osd_op_queue_mclock_recov_res, OPT_DOUBLE, 10.0)
+OPTION(osd_op_queue_mclock_recov_wgt, OPT_DOUBLE, 1.0)
+OPTION(osd_op_queue_mclock_recov_lim, OPT_DOUBLE, 0.0)
+OPTION(osd_op_queue_mclock_scrub_res, OPT_DOUBLE, 1.0)
+OPTION(osd_op_queue_mclock_scrub_wgt, OPT_DOUBLE, 1.0)
+OPTION(osd_op_queue_mclock_scrub_lim, OPT_DOUBLE, 0.0)
 
 // Set to true for testing.  Users should NOT set this.
 // If set to true even after reading enough shards to
 // decode the object, any error will be reported.
 OPTION(osd_read_ec_check_for_errors, OPT_BOOL, false) // return error if any ec shard has an error
 
+// Bytes of recently written stripes each EC pg keeps on its primary, on
+// top of those pinned by writes in flight, to serve partial overwrites
+// and reads (only on pools with allow_ec_overwrites)
+OPTION(osd_ec_extent_cache_size, OPT_U64, 1 << 20)
+
 // Only use clone_overlap for recovery if there are fewer than
 // osd_recover_clone_overlap_limit entries in the overlap set
 OPTION(osd_recover_clone_overlap_limit, OPT_INT, 10)
@@ -859,6 +905,7 @@ OPTION(rocksdb_db_paths, OPT_STR, "")   // path,size( path,size)*
 OPTION(rocksdb_log_to_ceph_log, OPT_BOOL, true)  // log to ceph log
 OPTION(rocksdb_cache_size, OPT_INT, 128*1024*1024)  // default rocksdb cache size
 OPTION(rocksdb_cache_shard_bits, OPT_INT, 4)  // rocksdb block cache shard bits, 4 bit -> 16 shards
+OPTION(rocksdb_cache_stats, OPT_BOOL, false)  // track block cache hits/misses (costs some cpu)
 OPTION(rocksdb_block_size, OPT_INT, 4*1024)  // default rocksdb block size
 // rocksdb options that will be used for omap(if omap_backend is rocksdb)
 OPTION(filestore_rocksdb_options, OPT_STR, "")
@@ -927,6 +974,14 @@ OPTION(bdev_aio, OPT_BOOL, true)
 OPTION(bdev_aio_poll_ms, OPT_INT, 250)  // milliseconds
 OPTION(bdev_aio_max_queue_depth, OPT_INT, 32)
 OPTION(bdev_block_size, OPT_INT, 4096)
+OPTION(bdev_type, OPT_STR, "kernel")  // kernel | io_uring
+
+// io_uring backend (bdev_type = io_uring)
+OPTION(bdev_ioring_queue_depth, OPT_INT, 128)
+OPTION(bdev_ioring_sqthread_poll, OPT_BOOL, false)   // kernel thread polls the submission queue
+OPTION(bdev_ioring_sqthread_idle_ms, OPT_INT, 1000)  // idle time before the sq thread sleeps
+OPTION(bdev_ioring_register_buffers, OPT_INT, 0)     // number of registered bounce buffers for small writes
+OPTION(bdev_ioring_buffer_size, OPT_INT, 65536)      // size of each registered bounce buffer
 
 // if yes, osd will unbind all NVMe devices from kernel driver and bind them
 // to the uio_pci_generic driver. The purpose is to prevent the case where
@@ -943,7 +998,7 @@ OPTION(bluefs_log_compact_min_size, OPT_U64, 16*1048576)  // before we consider
 OPTION(bluefs_min_flush_size, OPT_U64, 65536)  // ignore flush until its this big
 OPTION(bluefs_compact_log_sync, OPT_BOOL, false)  // sync or async log compaction?
 OPTION(bluefs_buffered_io, OPT_BOOL, false)
-OPTION(bluefs_allocator, OPT_STR, "stupid")     // stupid | bitmap
+OPTION(bluefs_allocator, OPT_STR, "stupid")     // stupid | bitmap | hierarchical
 
 OPTION(bluestore_bluefs, OPT_BOOL, true)
 OPTION(bluestore_bluefs_env_mirror, OPT_BOOL, false) // mirror to normal Env for debug
@@ -1000,12 +1055,23 @@ OPTION(bluestore_2q_cache_kin_ratio, OPT_DOUBLE, .5)    // kin page slot size /
 OPTION(bluestore_2q_cache_kout_ratio, OPT_DOUBLE, .5)   // number of kout page slot / total number of page slot
 OPTION(bluestore_onode_cache_size, OPT_U32, 4*1024)
 OPTION(bluestore_buffer_cache_size, OPT_U32, 512*1024*1024)
+// if autotune is enabled, bluestore_onode_cache_size, bluestore_buffer_cache_size
+// and rocksdb_cache_size are ignored and a single byte budget is balanced
+// between the onode, buffer and rocksdb block caches instead.
+OPTION(bluestore_cache_autotune, OPT_BOOL, false)
+OPTION(bluestore_cache_memory_target, OPT_U64, 1024*1024*1024)  // bytes
+OPTION(bluestore_cache_autotune_interval, OPT_DOUBLE, 5)  // seconds
+OPTION(bluestore_cache_autotune_step, OPT_DOUBLE, .05)  // fraction of target moved per interval
+OPTION(bluestore_cache_autotune_min_ratio, OPT_DOUBLE, .1)  // floor for each cache's share
+OPTION(bluestore_cache_meta_ratio, OPT_DOUBLE, .4)  // initial onode share
+OPTION(bluestore_cache_kv_ratio, OPT_DOUBLE, .3)  // initial rocksdb share; buffers get the rest
 OPTION(bluestore_kvbackend, OPT_STR, "rocksdb")
-OPTION(bluestore_allocator, OPT_STR, "bitmap")     // stupid | bitmap
+OPTION(bluestore_allocator, OPT_STR, "bitmap")     // stupid | bitmap | hierarchical
 OPTION(bluestore_freelist_type, OPT_STR, "bitmap") // extent | bitmap
 OPTION(bluestore_freelist_blocks_per_key, OPT_INT, 128)
 OPTION(bluestore_bitmapallocator_blocks_per_zone, OPT_INT, 1024) // must be power of 2 aligned, e.g., 512, 1024, 2048...
 OPTION(bluestore_bitmapallocator_span_size, OPT_INT, 1024) // must be power of 2 aligned, e.g., 512, 1024, 2048...
+OPTION(bluestore_hierarchicalallocator_blocks_per_leaf, OPT_INT, 1024) // power of 2, >= 64; blocks per summary tree leaf
 OPTION(bluestore_rocksdb_options, OPT_STR, "compression=kNoCompression,max_write_buffer_number=16,min_write_buffer_number_to_merge=3,recycle_log_file_num=16")
 OPTION(bluestore_fsck_on_mount, OPT_BOOL, false)
 OPTION(bluestore_fsck_on_umount, OPT_BOOL, false)
@@ -1237,6 +1303,10 @@ OPTION(rbd_validate_pool, OPT_BOOL, true) // true if empty pools should be valid
 OPTION(rbd_validate_names, OPT_BOOL, true) // true if image specs should be validated
 OPTION(rbd_auto_exclusive_lock_until_manual_request, OPT_BOOL, true) // whether to automatically acquire/release exclusive lock until it is explicitly requested, i.e. before we know the user of librbd is properly using the lock API
 OPTION(rbd_mirroring_resync_after_disconnect, OPT_BOOL, false) // automatically start image resync after mirroring is disconnected due to being laggy
+OPTION(rbd_persistent_cache_enabled, OPT_BOOL, false) // log writes to a local persistent cache and ack once they are durable there
+OPTION(rbd_persistent_cache_path, OPT_STR, "/var/lib/ceph/rbd-cache") // directory (on local SSD/NVMe) holding the per-image cache logs
+OPTION(rbd_persistent_cache_size, OPT_U64, 1ULL << 30) // size of each image's cache log in bytes; writes stall once it is full of dirty data
+OPTION(rbd_persistent_cache_writeback_bytes, OPT_U64, 16 << 20) // coalesce up to this many bytes of logged writes into one writeback to the cluster
 
 /*
  * The following options change the behavior for librbd's image creation methods that
@@ -1307,6 +1377,16 @@ OPTION(rgw_override_bucket_index_max_shards, OPT_U32, 0)
  */
 OPTION(rgw_bucket_index_max_aio, OPT_U32, 8)
 
+/**
+ * Dynamic resharding: reshard the index of buckets that hold more than
+ * rgw_max_objs_per_shard objects per shard, while they stay writable.
+ */
+OPTION(rgw_dynamic_resharding, OPT_BOOL, false)
+OPTION(rgw_max_objs_per_shard, OPT_U64, 100000)
+OPTION(rgw_reshard_thread_interval, OPT_INT, 600) // seconds between checks of the buckets
+OPTION(rgw_reshard_dual_write_grace, OPT_INT, 30) // seconds for all gateways to start updating the new index
+OPTION(rgw_reshard_lock_duration, OPT_INT, 120) // seconds, renewed while resharding
+
 /**
  * whether or not the quota/gc threads should be started
  */
@@ -1319,6 +1399,12 @@ OPTION(rgw_data, OPT_STR, "/var/lib/ceph/radosgw/$cluster-$id")
 OPTION(rgw_enable_apis, OPT_STR, "s3, s3website, swift, swift_auth, admin")
 OPTION(rgw_cache_enabled, OPT_BOOL, true)   // rgw cache enabled
 OPTION(rgw_cache_lru_size, OPT_INT, 10000)   // num of entries in rgw cache
+OPTION(rgw_cache_max_bytes, OPT_U64, 256 << 20)   // bytes of entries in rgw cache, 0 for no limit
+OPTION(rgw_cache_shards, OPT_INT, 16)   // rgw cache lock/LRU shards; the limits above are split among them
+OPTION(rgw_datacache_enabled, OPT_BOOL, false)   // cache object data read from rados in local files
+OPTION(rgw_datacache_path, OPT_STR, "/var/lib/ceph/radosgw/$cluster-$id/datacache")   // cache files in it are removed on startup
+OPTION(rgw_datacache_size, OPT_U64, 10ull << 30)   // bytes of object data in the local data cache
+OPTION(rgw_datacache_max_pending_bytes, OPT_U64, 64 << 20)   // bytes read from rados waiting to be written to the data cache
 OPTION(rgw_socket_path, OPT_STR, "")   // path to unix domain socket, if not specified, rgw will not run as external fcgi
 OPTION(rgw_host, OPT_STR, "")  // host for radosgw, can be an IP, default is 0.0.0.0
 OPTION(rgw_port, OPT_STR, "")  // port to listen, format as "8080" "5000", if not specified, rgw will not run external fcgi
@@ -0,0 +1,373 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+/*
+ * Ceph - scalable distributed file system
+ *
+ * This is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License version 2.1, as published by the Free Software
+ * Foundation.  See file COPYING.
+ *
+ */
+
+#ifndef MCLOCK_PRIORITY_QUEUE_H
+#define MCLOCK_PRIORITY_QUEUE_H
+
+#include "OpQueue.h"
+#include "common/Formatter.h"
+#include "include/assert.h"
+
+#include <chrono>
+#include <cmath>
+#include <deque>
+#include <functional>
+#include <limits>
+#include <map>
+#include <set>
+#include <sstream>
+
+/**
+ * Scheduling parameters of one mClock client.  Reservation and limit
+ * are in requests per second (0 means none); weight is relative to the
+ * other clients of the queue.
+ */
+struct mClockClientInfo {
+  double reservation;
+  double weight;
+  double limit;
+
+  mClockClientInfo(double r, double w, double l)
+    : reservation(r), weight(w), limit(l) {}
+
+  double reservation_inv() const {
+    return reservation > 0 ? 1.0 / reservation :
+      std::numeric_limits<double>::infinity();
+  }
+  double weight_inv() const {
+    return weight > 0 ? 1.0 / weight :
+      std::numeric_limits<double>::infinity();
+  }
+  double limit_inv() const {
+    return limit > 0 ? 1.0 / limit : 0.0;
+  }
+};
+
+/**
+ * OpQueue scheduled with the mClock algorithm (Gulati et al., OSDI '10).
+ *
+ * Each client K gets reservation (R), proportional (P) and limit (L)
+ * tags on its requests.  dequeue() first serves any client whose head
+ * R tag is due; otherwise it serves the client with the smallest P tag
+ * among those whose L tag is due.  When every client is over its limit
+ * the limit is broken and the client closest to its limit is served,
+ * so the queue stays work conserving: limits only apply while there
+ * is competing work.
+ *
+ * Strict items bypass mClock entirely and are dequeued first, highest
+ * priority first, FIFO within a priority.  Request cost is ignored;
+ * all rates are in requests.
+ */
+template <typename T, typename K>
+class mClockQueue : public OpQueue<T, K> {
+public:
+  typedef std::function<mClockClientInfo(const K&)> ClientInfoFunc;
+  typedef std::function<double()> ClockFunc;
+
+private:
+  struct Request {
+    double r_tag;
+    double p_tag;
+    double l_tag;
+    T item;
+    Request(double r, double p, double l, const T& i)
+      : r_tag(r), p_tag(p), l_tag(l), item(i) {}
+  };
+
+  struct Client {
+    K key;
+    mClockClientInfo info;
+    double prev_r = 0;
+    double prev_p = 0;
+    double prev_l = 0;
+    std::deque<Request> requests;
+    Client(const K& k, const mClockClientInfo& i) : key(k), info(i) {}
+  };
+
+  typedef std::map<K, Client> Clients;
+  typedef std::pair<double, Client*> Tag;
+
+  // strict items, highest priority first
+  typedef std::map<unsigned, std::deque<std::pair<K, T> >,
+		   std::greater<unsigned> > StrictQueue;
+
+  static const unsigned CLEAN_INTERVAL = 1024;
+
+  ClientInfoFunc client_info_f;
+  ClockFunc clock_f;
+
+  StrictQueue strict;
+  unsigned strict_size = 0;
+
+  Clients clients;
+  unsigned size = 0;
+  unsigned dequeues_since_clean = 0;
+
+  // indexes over the head request of every non-empty client
+  std::set<Tag> by_reservation;  ///< clients with a reservation
+  std::set<Tag> by_limit;        ///< clients whose L tag was not yet due
+  std::set<Tag> ready;           ///< clients under their limit, by P tag
+
+  static double now() {
+    return std::chrono::duration<double>(
+      std::chrono::steady_clock::now().time_since_epoch()).count();
+  }
+
+  void unindex(Client &c) {
+    if (c.requests.empty()) {
+      return;
+    }
+    const Request &head = c.requests.front();
+    by_reservation.erase(Tag(head.r_tag, &c));
+    by_limit.erase(Tag(head.l_tag, &c));
+    ready.erase(Tag(head.p_tag, &c));
+  }
+
+  void index(Client &c) {
+    if (c.requests.empty()) {
+      return;
+    }
+    const Request &head = c.requests.front();
+    if (c.info.reservation > 0) {
+      by_reservation.insert(Tag(head.r_tag, &c));
+    }
+    by_limit.insert(Tag(head.l_tag, &c));
+  }
+
+  Client &get_client(const K& cl) {
+    auto it = clients.find(cl);
+    if (it == clients.end()) {
+      it = clients.emplace(cl, Client(cl, client_info_f(cl))).first;
+    }
+    return it->second;
+  }
+
+  void add_request(K cl, const T& item, bool front) {
+    Client &c = get_client(cl);
+    unindex(c);
+    if (front && !c.requests.empty()) {
+      // a requeued item goes ahead of the head and inherits its tags
+      const Request &head = c.requests.front();
+      c.requests.emplace_front(head.r_tag, head.p_tag, head.l_tag, item);
+    } else {
+      double t = clock_f();
+      c.prev_r = std::max(c.prev_r + c.info.reservation_inv(), t);
+      c.prev_p = std::max(c.prev_p + c.info.weight_inv(), t);
+      c.prev_l = std::max(c.prev_l + c.info.limit_inv(), t);
+      if (front) {
+	c.requests.emplace_front(c.prev_r, c.prev_p, c.prev_l, item);
+      } else {
+	c.requests.emplace_back(c.prev_r, c.prev_p, c.prev_l, item);
+      }
+    }
+    index(c);
+    ++size;
+  }
+
+  T pop_request(Client &c, bool reservation_phase) {
+    unindex(c);
+    T item = c.requests.front().item;
+    c.requests.pop_front();
+    if (!reservation_phase && c.info.reservation > 0) {
+      // weight-based service must not count against the reservation
+      double r_inv = c.info.reservation_inv();
+      for (auto &r : c.requests) {
+	r.r_tag -= r_inv;
+      }
+      c.prev_r -= r_inv;
+    }
+    index(c);
+    --size;
+    return item;
+  }
+
+  void promote_ready(double t) {
+    while (!by_limit.empty() && by_limit.begin()->first <= t) {
+      Client *c = by_limit.begin()->second;
+      by_limit.erase(by_limit.begin());
+      ready.insert(Tag(c->requests.front().p_tag, c));
+    }
+  }
+
+  /// whether the next tag after prev would restart from t anyway
+  static bool tag_idle(double prev, double inv, double t) {
+    // a zero rate has an infinite tag that never matters
+    return std::isinf(inv) || prev + inv <= t;
+  }
+
+  /// forget idle clients whose tags would restart from "now" anyway
+  void clean_clients(double t) {
+    for (auto it = clients.begin(); it != clients.end(); ) {
+      Client &c = it->second;
+      if (c.requests.empty() &&
+	  tag_idle(c.prev_r, c.info.reservation_inv(), t) &&
+	  tag_idle(c.prev_p, c.info.weight_inv(), t) &&
+	  tag_idle(c.prev_l, c.info.limit_inv(), t)) {
+	clients.erase(it++);
+      } else {
+	++it;
+      }
+    }
+  }
+
+  template <typename F>
+  void filter(F f, std::list<T> *out) {
+    for (auto it = strict.begin(); it != strict.end(); ) {
+      auto &q = it->second;
+      for (auto j = q.rbegin(); j != q.rend(); ) {
+	if (f(j->first, j->second)) {
+	  if (out) {
+	    out->push_front(j->second);
+	  }
+	  j = decltype(j)(q.erase(std::next(j).base()));
+	  --strict_size;
+	} else {
+	  ++j;
+	}
+      }
+      if (q.empty()) {
+	strict.erase(it++);
+      } else {
+	++it;
+      }
+    }
+    for (auto &p : clients) {
+      Client &c = p.second;
+      if (c.requests.empty()) {
+	continue;
+      }
+      unindex(c);
+      for (auto j = c.requests.rbegin(); j != c.requests.rend(); ) {
+	if (f(c.key, j->item)) {
+	  if (out) {
+	    out->push_front(j->item);
+	  }
+	  j = decltype(j)(c.requests.erase(std::next(j).base()));
+	  --size;
+	} else {
+	  ++j;
+	}
+      }
+      index(c);
+    }
+  }
+
+public:
+  explicit mClockQueue(ClientInfoFunc info_f, ClockFunc clock = &now)
+    : client_info_f(info_f), clock_f(clock) {}
+
+  unsigned length() const override final {
+    return strict_size + size;
+  }
+
+  void remove_by_filter(std::function<bool (T)> f) override final {
+    filter([&f](const K&, const T& item) { return f(item); }, nullptr);
+  }
+
+  void remove_by_class(K k, std::list<T> *out = 0) override final {
+    filter([&k](const K& cl, const T&) { return cl == k; }, out);
+  }
+
+  void enqueue_strict(K cl, unsigned priority, T item) override final {
+    strict[priority].push_back(std::make_pair(cl, item));
+    ++strict_size;
+  }
+
+  void enqueue_strict_front(K cl, unsigned priority, T item) override final {
+    strict[priority].push_front(std::make_pair(cl, item));
+    ++strict_size;
+  }
+
+  void enqueue(K cl, unsigned priority, unsigned cost, T item) override final {
+    add_request(cl, item, false);
+  }
+
+  void enqueue_front(K cl, unsigned priority, unsigned cost,
+		     T item) override final {
+    add_request(cl, item, true);
+  }
+
+  bool empty() const override final {
+    return length() == 0;
+  }
+
+  T dequeue() override final {
+    assert(!empty());
+
+    if (strict_size) {
+      auto it = strict.begin();
+      T item = it->second.front().second;
+      it->second.pop_front();
+      if (it->second.empty()) {
+	strict.erase(it);
+      }
+      --strict_size;
+      return item;
+    }
+
+    double t = clock_f();
+    if (++dequeues_since_clean >= CLEAN_INTERVAL) {
+      dequeues_since_clean = 0;
+      clean_clients(t);
+    }
+
+    // reservation phase
+    if (!by_reservation.empty() && by_reservation.begin()->first <= t) {
+      return pop_request(*by_reservation.begin()->second, true);
+    }
+
+    // weight phase, among clients under their limit
+    promote_ready(t);
+    if (!ready.empty()) {
+      return pop_request(*ready.begin()->second, false);
+    }
+
+    // everyone is limited: break the limit of whoever is closest to it
+    assert(!by_limit.empty());
+    return pop_request(*by_limit.begin()->second, false);
+  }
+
+  void dump(ceph::Formatter *f) const override final {
+    f->dump_int("total_strict", strict_size);
+    f->open_array_section("high_queues");
+    for (auto &p : strict) {
+      f->open_object_section("subqueue");
+      f->dump_int("priority", p.first);
+      f->dump_int("size", p.second.size());
+      f->close_section();
+    }
+    f->close_section();
+
+    f->dump_int("total_mclock", size);
+    f->open_array_section("clients");
+    for (auto &p : clients) {
+      const Client &c = p.second;
+      f->open_object_section("client");
+      std::ostringstream ss;
+      ss << c.key;
+      f->dump_string("client", ss.str());
+      f->dump_float("reservation", c.info.reservation);
+      f->dump_float("weight", c.info.weight);
+      f->dump_float("limit", c.info.limit);
+      f->dump_int("size", c.requests.size());
+      if (!c.requests.empty()) {
+	f->dump_float("r_tag", c.requests.front().r_tag);
+	f->dump_float("p_tag", c.requests.front().p_tag);
+	f->dump_float("l_tag", c.requests.front().l_tag);
+      }
+      f->close_section();
+    }
+    f->close_section();
+  }
+};
+
+#endif
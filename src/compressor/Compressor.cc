@@ -21,6 +21,8 @@ const char * Compressor::get_comp_alg_name(int a) {
     case COMP_ALG_NONE: return "none";
     case COMP_ALG_SNAPPY: return "snappy";
     case COMP_ALG_ZLIB: return "zlib";
+    case COMP_ALG_ZSTD: return "zstd";
+    case COMP_ALG_LZ4: return "lz4";
     default: return "???";
   }
 }
@@ -30,6 +32,10 @@ boost::optional<Compressor::CompressionAlgorithm> Compressor::get_comp_alg_type(
     return COMP_ALG_SNAPPY;
   if (s == "zlib")
     return COMP_ALG_ZLIB;
+  if (s == "zstd")
+    return COMP_ALG_ZSTD;
+  if (s == "lz4")
+    return COMP_ALG_LZ4;
   if (s == "")
     return COMP_ALG_NONE;
 
@@ -69,7 +75,8 @@ CompressorRef Compressor::create(CephContext *cct, const std::string &type)
   }
   int err = factory->factory(&cs_impl, &ss);
   if (err)
-    lderr(cct) << __func__ << " factory return error " << err << dendl;
+    lderr(cct) << __func__ << " factory return error " << err
+	       << " " << ss.str() << dendl;
   return cs_impl;
 }
 
@@ -29,6 +29,8 @@ public:
     COMP_ALG_NONE = 0,
     COMP_ALG_SNAPPY = 1,
     COMP_ALG_ZLIB = 2,
+    COMP_ALG_ZSTD = 3,
+    COMP_ALG_LZ4 = 4,
     COMP_ALG_LAST	//the last value for range checks
   };
   // compression options
@@ -0,0 +1,125 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+/*
+ * Ceph - scalable distributed file system
+ *
+ * This is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License version 2.1, as published by the Free Software
+ * Foundation.  See file COPYING.
+ *
+ */
+
+#include <lz4.h>
+
+#include "common/debug.h"
+#include "include/encoding.h"
+#include "LZ4Compressor.h"
+
+#define dout_subsys ceph_subsys_compressor
+#undef dout_prefix
+#define dout_prefix *_dout << "LZ4Compressor: "
+
+int LZ4Compressor::compress(const bufferlist &in, bufferlist &out)
+{
+  // every segment is compressed as a block of its own, with its own
+  // worst-case overhead
+  size_t bound = 0;
+  for (std::list<buffer::ptr>::const_iterator i = in.buffers().begin();
+       i != in.buffers().end(); ++i)
+    bound += LZ4_compressBound(i->length());
+  bufferptr outptr = buffer::create_page_aligned(bound);
+  LZ4_stream_t lz4_stream;
+  LZ4_resetStream(&lz4_stream);
+
+  bufferlist header;
+  ::encode((uint32_t)in.buffers().size(), header);
+
+  int pos = 0;
+  for (std::list<buffer::ptr>::const_iterator i = in.buffers().begin();
+       i != in.buffers().end(); ++i) {
+    uint32_t raw_len = i->length();
+    int compressed_len = LZ4_compress_fast_continue(
+      &lz4_stream, i->c_str(), outptr.c_str() + pos, raw_len,
+      outptr.length() - pos, acceleration);
+    if (compressed_len <= 0) {
+      dout(1) << "Compression error: LZ4_compress_fast_continue returned "
+	      << compressed_len << dendl;
+      return -1;
+    }
+    pos += compressed_len;
+    ::encode(raw_len, header);
+    ::encode((uint32_t)compressed_len, header);
+  }
+
+  out.claim_append(header);
+  out.append(outptr, 0, pos);
+  return 0;
+}
+
+int LZ4Compressor::decompress(bufferlist::iterator &p,
+			      size_t compressed_len,
+			      bufferlist &out)
+{
+  uint32_t count;
+  vector<pair<uint32_t, uint32_t> > blocks;  // raw_len, compressed_len
+  uint64_t total_raw = 0, total_compressed = 0;
+  try {
+    ::decode(count, p);
+    // the count is untrusted: check it fits before allocating for it
+    if (sizeof(uint32_t) * (1 + 2 * (uint64_t)count) > compressed_len) {
+      dout(1) << "Decompression error: header claims " << count
+	      << " blocks in " << compressed_len << " bytes" << dendl;
+      return -1;
+    }
+    blocks.resize(count);
+    for (unsigned i = 0; i < count; ++i) {
+      ::decode(blocks[i].first, p);
+      ::decode(blocks[i].second, p);
+      total_raw += blocks[i].first;
+      total_compressed += blocks[i].second;
+    }
+  } catch (buffer::error& e) {
+    dout(1) << "Decompression error: truncated header" << dendl;
+    return -1;
+  }
+  uint64_t header_len = sizeof(uint32_t) * (1 + 2 * (uint64_t)count);
+  if (compressed_len < header_len ||
+      total_compressed > compressed_len - header_len ||
+      total_compressed > p.get_remaining()) {
+    dout(1) << "Decompression error: header claims " << total_compressed
+	    << " bytes of payload, only " << p.get_remaining()
+	    << " available" << dendl;
+    return -1;
+  }
+
+  // lz4 needs the compressed blocks contiguous and the decoded output
+  // kept in place so later blocks can refer back to earlier ones.
+  bufferlist in;
+  p.copy(total_compressed, in);
+  const char *c_in = in.c_str();
+  bufferptr outptr = buffer::create_page_aligned(total_raw);
+  char *c_out = outptr.c_str();
+
+  LZ4_streamDecode_t lz4_stream_decode;
+  LZ4_setStreamDecode(&lz4_stream_decode, nullptr, 0);
+  for (unsigned i = 0; i < count; ++i) {
+    int r = LZ4_decompress_safe_continue(
+      &lz4_stream_decode, c_in, c_out, blocks[i].second, blocks[i].first);
+    if (r != (int)blocks[i].first) {
+      dout(1) << "Decompression error: block " << i << " returned " << r
+	      << " instead of " << blocks[i].first << dendl;
+      return -1;
+    }
+    c_in += blocks[i].second;
+    c_out += blocks[i].first;
+  }
+  out.append(outptr);
+  return 0;
+}
+
+int LZ4Compressor::decompress(const bufferlist &in, bufferlist &out)
+{
+  bufferlist::iterator i = const_cast<bufferlist&>(in).begin();
+  return decompress(i, in.length(), out);
+}
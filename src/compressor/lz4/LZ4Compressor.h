@@ -0,0 +1,42 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+/*
+ * Ceph - scalable distributed file system
+ *
+ * This is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License version 2.1, as published by the Free Software
+ * Foundation.  See file COPYING.
+ *
+ */
+
+#ifndef CEPH_LZ4COMPRESSOR_H
+#define CEPH_LZ4COMPRESSOR_H
+
+#include "compressor/Compressor.h"
+
+/**
+ * LZ4 block compressor.
+ *
+ * Each segment of the input bufferlist is compressed as one lz4 block
+ * with LZ4_compress_fast_continue, so later segments may reference
+ * earlier ones without first flattening the input.  The output is
+ *
+ *   u32 nr_blocks, nr_blocks * (u32 raw_len, u32 compressed_len), data
+ */
+class LZ4Compressor : public Compressor {
+  int acceleration;
+public:
+  explicit LZ4Compressor(int accel)
+    : Compressor(COMP_ALG_LZ4, "lz4"), acceleration(accel) {}
+
+  int get_acceleration() const {
+    return acceleration;
+  }
+
+  int compress(const bufferlist &in, bufferlist &out) override;
+  int decompress(const bufferlist &in, bufferlist &out) override;
+  int decompress(bufferlist::iterator &p, size_t compressed_len, bufferlist &out) override;
+};
+
+#endif
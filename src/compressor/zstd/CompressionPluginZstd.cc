@@ -0,0 +1,73 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+/*
+ * Ceph - scalable distributed file system
+ *
+ * This is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License version 2.1, as published by the Free Software
+ * Foundation.  See file COPYING.
+ *
+ */
+
+// -----------------------------------------------------------------------------
+#include "ceph_ver.h"
+#include "common/config.h"
+#include "compressor/CompressionPlugin.h"
+#include "ZstdCompressor.h"
+// -----------------------------------------------------------------------------
+
+class CompressionPluginZstd : public CompressionPlugin {
+
+public:
+
+  explicit CompressionPluginZstd(CephContext* cct) : CompressionPlugin(cct)
+  {}
+
+  virtual int factory(CompressorRef *cs,
+                      std::ostream *ss)
+  {
+    int level = cct->_conf->compressor_zstd_level;
+    if (level < 1)
+      level = 1;
+    if (level > ZSTD_maxCLevel())
+      level = ZSTD_maxCLevel();
+    const std::string& dict_path = cct->_conf->compressor_zstd_dict;
+
+    ZstdCompressor *cur = static_cast<ZstdCompressor*>(compressor.get());
+    if (cur == 0 ||
+	cur->get_level() != level ||
+	cur->get_dict_path() != dict_path) {
+      bufferlist dict;
+      if (!dict_path.empty()) {
+	std::string err;
+	int r = dict.read_file(dict_path.c_str(), &err);
+	if (r < 0) {
+	  *ss << "unable to read zstd dictionary " << dict_path << ": " << err;
+	  return r;
+	}
+      }
+      compressor = CompressorRef(new ZstdCompressor(level, dict_path, dict));
+    }
+    *cs = compressor;
+    return 0;
+  }
+};
+
+// -----------------------------------------------------------------------------
+
+const char *__ceph_plugin_version()
+{
+  return CEPH_GIT_NICE_VER;
+}
+
+// -----------------------------------------------------------------------------
+
+int __ceph_plugin_init(CephContext *cct,
+                       const std::string& type,
+                       const std::string& name)
+{
+  PluginRegistry *instance = cct->get_plugin_registry();
+
+  return instance->add(type, name, new CompressionPluginZstd(cct));
+}
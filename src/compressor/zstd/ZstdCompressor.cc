@@ -0,0 +1,171 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+/*
+ * Ceph - scalable distributed file system
+ *
+ * This is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License version 2.1, as published by the Free Software
+ * Foundation.  See file COPYING.
+ *
+ */
+
+#include "common/debug.h"
+#include "include/encoding.h"
+#include "ZstdCompressor.h"
+
+#define dout_subsys ceph_subsys_compressor
+#undef dout_prefix
+#define dout_prefix *_dout << "ZstdCompressor: "
+
+ZstdCompressor::ZstdCompressor(int l, const std::string& path,
+			       const bufferlist& dict)
+  : Compressor(COMP_ALG_ZSTD, "zstd"),
+    level(l),
+    dict_path(path)
+{
+  if (dict.length()) {
+    bufferlist flat = dict;
+    dict_id = flat.crc32c(0);
+    if (dict_id == 0)
+      dict_id = 1;  // 0 means no dictionary
+    cdict = ZSTD_createCDict(flat.c_str(), flat.length(), level);
+    ddict = ZSTD_createDDict(flat.c_str(), flat.length());
+  }
+}
+
+ZstdCompressor::~ZstdCompressor()
+{
+  if (cdict)
+    ZSTD_freeCDict(cdict);
+  if (ddict)
+    ZSTD_freeDDict(ddict);
+}
+
+int ZstdCompressor::compress(const bufferlist &in, bufferlist &out)
+{
+  ZSTD_CStream *s = ZSTD_createCStream();
+  size_t r;
+  if (cdict)
+    r = ZSTD_initCStream_usingCDict(s, cdict);
+  else
+    r = ZSTD_initCStream(s, level);
+  if (ZSTD_isError(r)) {
+    dout(1) << "Compression init error: " << ZSTD_getErrorName(r) << dendl;
+    ZSTD_freeCStream(s);
+    return -1;
+  }
+
+  bufferptr outptr = buffer::create_page_aligned(
+    ZSTD_compressBound(in.length()));
+  ZSTD_outBuffer outbuf = { outptr.c_str(), outptr.length(), 0 };
+
+  for (std::list<buffer::ptr>::const_iterator i = in.buffers().begin();
+       i != in.buffers().end(); ++i) {
+    ZSTD_inBuffer inbuf = { i->c_str(), i->length(), 0 };
+    while (inbuf.pos < inbuf.size) {
+      r = ZSTD_compressStream(s, &outbuf, &inbuf);
+      if (ZSTD_isError(r)) {
+	dout(1) << "Compression error: " << ZSTD_getErrorName(r) << dendl;
+	ZSTD_freeCStream(s);
+	return -1;
+      }
+    }
+  }
+  // the output is sized by ZSTD_compressBound so the epilogue always fits
+  r = ZSTD_endStream(s, &outbuf);
+  ZSTD_freeCStream(s);
+  if (ZSTD_isError(r) || r != 0) {
+    dout(1) << "Compression error: unable to end stream: "
+	    << (ZSTD_isError(r) ? ZSTD_getErrorName(r) : "output full")
+	    << dendl;
+    return -1;
+  }
+
+  ::encode((uint32_t)in.length(), out);
+  ::encode(dict_id, out);
+  out.append(outptr, 0, outbuf.pos);
+  return 0;
+}
+
+int ZstdCompressor::decompress(bufferlist::iterator &p,
+			       size_t compressed_len,
+			       bufferlist &out)
+{
+  uint32_t raw_len, id;
+  if (compressed_len < sizeof(raw_len) + sizeof(id)) {
+    dout(1) << "Decompression error: truncated header" << dendl;
+    return -1;
+  }
+  try {
+    ::decode(raw_len, p);
+    ::decode(id, p);
+  } catch (buffer::error& e) {
+    dout(1) << "Decompression error: truncated header" << dendl;
+    return -1;
+  }
+  compressed_len -= sizeof(raw_len) + sizeof(id);
+  if (id != dict_id) {
+    derr << "Decompression error: data was compressed with dictionary id "
+	 << id << ", but the configured compressor_zstd_dict "
+	 << (dict_path.empty() ? "is empty" : dict_path) << " has id "
+	 << dict_id << dendl;
+    return -1;
+  }
+
+  ZSTD_DStream *s = ZSTD_createDStream();
+  size_t r;
+  if (ddict)
+    r = ZSTD_initDStream_usingDDict(s, ddict);
+  else
+    r = ZSTD_initDStream(s);
+  if (ZSTD_isError(r)) {
+    dout(1) << "Decompression init error: " << ZSTD_getErrorName(r) << dendl;
+    ZSTD_freeDStream(s);
+    return -1;
+  }
+
+  bufferptr outptr = buffer::create_page_aligned(raw_len);
+  ZSTD_outBuffer outbuf = { outptr.c_str(), raw_len, 0 };
+
+  size_t remaining = MIN(p.get_remaining(), compressed_len);
+  r = 1;
+  while (remaining && r != 0) {
+    const char *c_in;
+    size_t len = p.get_ptr_and_advance(remaining, &c_in);
+    remaining -= len;
+    ZSTD_inBuffer inbuf = { c_in, len, 0 };
+    while (inbuf.pos < inbuf.size) {
+      size_t in_pos = inbuf.pos, out_pos = outbuf.pos;
+      r = ZSTD_decompressStream(s, &outbuf, &inbuf);
+      if (ZSTD_isError(r)) {
+	dout(1) << "Decompression error: " << ZSTD_getErrorName(r) << dendl;
+	ZSTD_freeDStream(s);
+	return -1;
+      }
+      if (r == 0)
+	break;  // frame complete
+      if (inbuf.pos == in_pos && outbuf.pos == out_pos) {
+	dout(1) << "Decompression error: frame larger than header length "
+		<< raw_len << dendl;
+	ZSTD_freeDStream(s);
+	return -1;
+      }
+    }
+  }
+  ZSTD_freeDStream(s);
+  if (r != 0 || outbuf.pos != raw_len) {
+    dout(1) << "Decompression error: got " << outbuf.pos << " of " << raw_len
+	    << " bytes" << dendl;
+    return -1;
+  }
+
+  out.append(outptr);
+  return 0;
+}
+
+int ZstdCompressor::decompress(const bufferlist &in, bufferlist &out)
+{
+  bufferlist::iterator i = const_cast<bufferlist&>(in).begin();
+  return decompress(i, in.length(), out);
+}
@@ -0,0 +1,55 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+/*
+ * Ceph - scalable distributed file system
+ *
+ * This is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License version 2.1, as published by the Free Software
+ * Foundation.  See file COPYING.
+ *
+ */
+
+#ifndef CEPH_ZSTDCOMPRESSOR_H
+#define CEPH_ZSTDCOMPRESSOR_H
+
+#define ZSTD_STATIC_LINKING_ONLY
+#include <zstd.h>
+
+#include "compressor/Compressor.h"
+
+/**
+ * Zstandard compressor.
+ *
+ * The output is the raw length (u32) and the id of the dictionary it
+ * was written with (u32, the crc32c of its contents; 0 for none),
+ * followed by a single zstd frame, so decompression can size its
+ * output buffer up front and refuse data written with a different
+ * dictionary than the one configured now.  If a dictionary is
+ * supplied it is digested once into a CDict/DDict pair and shared by
+ * every call.
+ */
+class ZstdCompressor : public Compressor {
+  int level;
+  std::string dict_path;
+  uint32_t dict_id = 0;
+  ZSTD_CDict *cdict = nullptr;
+  ZSTD_DDict *ddict = nullptr;
+
+public:
+  ZstdCompressor(int l, const std::string& path, const bufferlist& dict);
+  ~ZstdCompressor() override;
+
+  int get_level() const {
+    return level;
+  }
+  const std::string& get_dict_path() const {
+    return dict_path;
+  }
+
+  int compress(const bufferlist &in, bufferlist &out) override;
+  int decompress(const bufferlist &in, bufferlist &out) override;
+  int decompress(bufferlist::iterator &p, size_t compressed_len, bufferlist &out) override;
+};
+
+#endif
@@ -1082,6 +1082,32 @@ public:
     return result;
   }
 
+  /**
+   * whether mapping with a rule writes to the map
+   *
+   * bucket_perm_choose() caches its permutation in the bucket: uniform
+   * buckets always use it, and any bucket may when local fallback
+   * retries are enabled by the tunable or a rule step.
+   */
+  bool rule_writes_map(int rule) const {
+    if (crush->choose_local_fallback_tries)
+      return true;
+    crush_rule *r = get_rule(rule);
+    if (!r)
+      return false;
+    for (unsigned i = 0; i < r->len; i++) {
+      if (r->steps[i].op == CRUSH_RULE_SET_CHOOSE_LOCAL_FALLBACK_TRIES &&
+	  r->steps[i].arg1 > 0)
+	return true;
+    }
+    for (int b = 0; b < crush->max_buckets; b++) {
+      if (crush->buckets[b] &&
+	  crush->buckets[b]->alg == CRUSH_BUCKET_UNIFORM)
+	return true;
+    }
+    return false;
+  }
+
   void do_rule(int rule, int x, vector<int>& out, int maxout,
 	       const vector<__u32>& weight) const {
     Mutex::Locker l(mapper_lock);
@@ -1094,6 +1120,39 @@ public:
     for (int i=0; i<numrep; i++)
       out[i] = rawout[i];
   }
+
+  /**
+   * map many inputs with the same rule
+   *
+   * out[i] is what do_rule(rule, x[i], out[i], maxout, weight) would
+   * give, but the work buffer is set up once for the whole batch and
+   * straw2 buckets hash their items in parallel.  Unless the rule
+   * writes to the map (see rule_writes_map()), the mapper lock is
+   * skipped and several batches can run concurrently.
+   */
+  void do_rule_batch(int rule, const vector<int>& x,
+		     vector<vector<int> >& out, int maxout,
+		     const vector<__u32>& weight) const {
+    out.resize(x.size());
+    if (x.empty())
+      return;
+    vector<int> rawout(x.size() * maxout);
+    vector<int> lens(x.size());
+    vector<char> work(crush_work_size(crush, maxout));
+    crush_init_work(crush, &work[0], maxout);
+    if (rule_writes_map(rule)) {
+      Mutex::Locker l(mapper_lock);
+      crush_do_rule_batch(crush, rule, &x[0], x.size(), &rawout[0], maxout,
+			  &lens[0], &weight[0], weight.size(), &work[0]);
+    } else {
+      crush_do_rule_batch(crush, rule, &x[0], x.size(), &rawout[0], maxout,
+			  &lens[0], &weight[0], weight.size(), &work[0]);
+    }
+    for (unsigned i = 0; i < x.size(); i++) {
+      vector<int>::iterator p = rawout.begin() + i * maxout;
+      out[i].assign(p, p + lens[i]);
+    }
+  }
   
   bool check_crush_rule(int ruleset, int type, int size,  ostream& ss) {
    
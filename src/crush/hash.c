@@ -2,6 +2,9 @@
 # include <linux/crush/hash.h>
 #else
 # include "hash.h"
+# ifdef __SSE2__
+#  include <emmintrin.h>
+# endif
 #endif
 
 /*
@@ -58,6 +61,55 @@ static __u32 crush_hash32_rjenkins1_3(__u32 a, __u32 b, __u32 c)
 	return hash;
 }
 
+#if !defined(__KERNEL__) && defined(__SSE2__)
+/* crush_hashmix on four independent lanes */
+#define crush_hashmix_sse2(a, b, c) do {				\
+		a = _mm_sub_epi32(a, b); a = _mm_sub_epi32(a, c);	\
+		a = _mm_xor_si128(a, _mm_srli_epi32(c, 13));		\
+		b = _mm_sub_epi32(b, c); b = _mm_sub_epi32(b, a);	\
+		b = _mm_xor_si128(b, _mm_slli_epi32(a, 8));		\
+		c = _mm_sub_epi32(c, a); c = _mm_sub_epi32(c, b);	\
+		c = _mm_xor_si128(c, _mm_srli_epi32(b, 13));		\
+		a = _mm_sub_epi32(a, b); a = _mm_sub_epi32(a, c);	\
+		a = _mm_xor_si128(a, _mm_srli_epi32(c, 12));		\
+		b = _mm_sub_epi32(b, c); b = _mm_sub_epi32(b, a);	\
+		b = _mm_xor_si128(b, _mm_slli_epi32(a, 16));		\
+		c = _mm_sub_epi32(c, a); c = _mm_sub_epi32(c, b);	\
+		c = _mm_xor_si128(c, _mm_srli_epi32(b, 5));		\
+		a = _mm_sub_epi32(a, b); a = _mm_sub_epi32(a, c);	\
+		a = _mm_xor_si128(a, _mm_srli_epi32(c, 3));		\
+		b = _mm_sub_epi32(b, c); b = _mm_sub_epi32(b, a);	\
+		b = _mm_xor_si128(b, _mm_slli_epi32(a, 10));		\
+		c = _mm_sub_epi32(c, a); c = _mm_sub_epi32(c, b);	\
+		c = _mm_xor_si128(c, _mm_srli_epi32(b, 15));		\
+	} while (0)
+
+/* crush_hash32_rjenkins1_3(a, b[i], c) for i in [0, n & ~3) */
+static int crush_hash32_rjenkins1_3_sse2(__u32 a, const __u32 *b, __u32 c,
+					 __u32 *out, int n)
+{
+	int i;
+
+	for (i = 0; i + 4 <= n; i += 4) {
+		__m128i va = _mm_set1_epi32(a);
+		__m128i vb = _mm_loadu_si128((const __m128i *)(b + i));
+		__m128i vc = _mm_set1_epi32(c);
+		__m128i x = _mm_set1_epi32(231232);
+		__m128i y = _mm_set1_epi32(1232);
+		__m128i hash = _mm_xor_si128(
+			_mm_set1_epi32(crush_hash_seed ^ a ^ c), vb);
+
+		crush_hashmix_sse2(va, vb, hash);
+		crush_hashmix_sse2(vc, x, hash);
+		crush_hashmix_sse2(y, va, hash);
+		crush_hashmix_sse2(vb, x, hash);
+		crush_hashmix_sse2(y, vc, hash);
+		_mm_storeu_si128((__m128i *)(out + i), hash);
+	}
+	return i;
+}
+#endif
+
 static __u32 crush_hash32_rjenkins1_4(__u32 a, __u32 b, __u32 c, __u32 d)
 {
 	__u32 hash = crush_hash_seed ^ a ^ b ^ c ^ d;
@@ -120,6 +172,25 @@ __u32 crush_hash32_3(int type, __u32 a, __u32 b, __u32 c)
 	}
 }
 
+void crush_hash32_3_lanes(int type, __u32 a, const __u32 *b, __u32 c,
+			  __u32 *out, int n)
+{
+	int i = 0;
+
+	switch (type) {
+	case CRUSH_HASH_RJENKINS1:
+#if !defined(__KERNEL__) && defined(__SSE2__)
+		i = crush_hash32_rjenkins1_3_sse2(a, b, c, out, n);
+#endif
+		for (; i < n; i++)
+			out[i] = crush_hash32_rjenkins1_3(a, b[i], c);
+		break;
+	default:
+		for (; i < n; i++)
+			out[i] = 0;
+	}
+}
+
 __u32 crush_hash32_4(int type, __u32 a, __u32 b, __u32 c, __u32 d)
 {
 	switch (type) {
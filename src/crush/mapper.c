@@ -17,10 +17,12 @@
 # include <linux/kernel.h>
 # include <linux/crush/crush.h>
 # include <linux/crush/hash.h>
+# include <linux/crush/mapper.h>
 #else
 # include "crush_compat.h"
 # include "crush.h"
 # include "hash.h"
+# include "mapper.h"
 #endif
 #include "crush_ln_table.h"
 
@@ -344,7 +346,41 @@ static int bucket_straw2_choose(struct crush_bucket_straw2 *bucket,
 }
 
 
-static int crush_bucket_choose(struct crush_bucket *in, int x, int r)
+/*
+ * straw2 with the per-item hashes computed up front, several items at
+ * a time (see crush_hash32_3_lanes), into the caller's work buffer.
+ * picks exactly the same item as bucket_straw2_choose.
+ */
+static int bucket_straw2_choose_lanes(struct crush_bucket_straw2 *bucket,
+				      int x, int r, __u32 *u)
+{
+	unsigned int i, high = 0;
+	unsigned int w;
+	__s64 ln, draw, high_draw = 0;
+
+	crush_hash32_3_lanes(bucket->h.hash, x, (const __u32 *)bucket->h.items,
+			     r, u, bucket->h.size);
+
+	for (i = 0; i < bucket->h.size; i++) {
+		w = bucket->item_weights[i];
+		if (w) {
+			ln = crush_ln(u[i] & 0xffff) - 0x1000000000000ll;
+			draw = div64_s64(ln, w);
+		} else {
+			draw = S64_MIN;
+		}
+
+		if (i == 0 || draw > high_draw) {
+			high = i;
+			high_draw = draw;
+		}
+	}
+	return bucket->h.items[high];
+}
+
+
+static int crush_bucket_choose(struct crush_bucket *in, int x, int r,
+			       struct crush_work *work)
 {
 	dprintk(" crush_bucket_choose %d x=%d r=%d\n", in->id, x, r);
 	BUG_ON(in->size == 0);
@@ -362,6 +398,10 @@ static int crush_bucket_choose(struct crush_bucket *in, int x, int r)
 		return bucket_straw_choose((struct crush_bucket_straw *)in,
 					   x, r);
 	case CRUSH_BUCKET_STRAW2:
+		if (work)
+			return bucket_straw2_choose_lanes(
+				(struct crush_bucket_straw2 *)in, x, r,
+				work->hash);
 		return bucket_straw2_choose((struct crush_bucket_straw2 *)in,
 					    x, r);
 	default:
@@ -410,6 +450,7 @@ static int is_out(const struct crush_map *map,
  * @vary_r: pass r to recursive calls
  * @out2: second output vector for leaf items (if @recurse_to_leaf)
  * @parent_r: r value passed from the parent
+ * @work: batch work buffer, or NULL
  */
 static int crush_choose_firstn(const struct crush_map *map,
 			       struct crush_bucket *bucket,
@@ -425,7 +466,8 @@ static int crush_choose_firstn(const struct crush_map *map,
 			       unsigned int vary_r,
 			       unsigned int stable,
 			       int *out2,
-			       int parent_r)
+			       int parent_r,
+			       struct crush_work *work)
 {
 	int rep;
 	unsigned int ftotal, flocal;
@@ -473,7 +515,7 @@ parent_r %d stable %d\n",
 				    flocal > local_fallback_retries)
 					item = bucket_perm_choose(in, x, r);
 				else
-					item = crush_bucket_choose(in, x, r);
+					item = crush_bucket_choose(in, x, r, work);
 				if (item >= map->max_devices) {
 					dprintk("   bad item %d\n", item);
 					skip_rep = 1;
@@ -528,7 +570,8 @@ parent_r %d stable %d\n",
 							 vary_r,
 							 stable,
 							 NULL,
-							 sub_r) <= outpos)
+							 sub_r,
+							 work) <= outpos)
 							/* didn't get leaf */
 							reject = 1;
 					} else {
@@ -606,7 +649,8 @@ static void crush_choose_indep(const struct crush_map *map,
 			       unsigned int recurse_tries,
 			       int recurse_to_leaf,
 			       int *out2,
-			       int parent_r)
+			       int parent_r,
+			       struct crush_work *work)
 {
 	struct crush_bucket *in = bucket;
 	int endpos = outpos + left;
@@ -676,7 +720,7 @@ static void crush_choose_indep(const struct crush_map *map,
 					break;
 				}
 
-				item = crush_bucket_choose(in, x, r);
+				item = crush_bucket_choose(in, x, r, work);
 				if (item >= map->max_devices) {
 					dprintk("   bad item %d\n", item);
 					out[rep] = CRUSH_ITEM_NONE;
@@ -728,7 +772,7 @@ static void crush_choose_indep(const struct crush_map *map,
 						   x, 1, numrep, 0,
 						   out2, rep,
 						   recurse_tries, 0,
-						   0, NULL, r);
+						   0, NULL, r, work);
 						if (out2[rep] == CRUSH_ITEM_NONE) {
 							/* placed nothing; no leaf */
 							break;
@@ -779,21 +823,10 @@ static void crush_choose_indep(const struct crush_map *map,
 #endif
 }
 
-/**
- * crush_do_rule - calculate a mapping with the given input and rule
- * @map: the crush_map
- * @ruleno: the rule id
- * @x: hash input
- * @result: pointer to result vector
- * @result_max: maximum result size
- * @weight: weight vector (for map leaves)
- * @weight_max: size of weight vector
- * @scratch: scratch vector for private use; must be >= 3 * result_max
- */
-int crush_do_rule(const struct crush_map *map,
-		  int ruleno, int x, int *result, int result_max,
-		  const __u32 *weight, int weight_max,
-		  int *scratch)
+static int crush_do_rule_work(const struct crush_map *map,
+			      int ruleno, int x, int *result, int result_max,
+			      const __u32 *weight, int weight_max,
+			      int *scratch, struct crush_work *work)
 {
 	int result_len;
 	int *a = scratch;
@@ -948,7 +981,8 @@ int crush_do_rule(const struct crush_map *map,
 						vary_r,
 						stable,
 						c+osize,
-						0);
+						0,
+						work);
 				} else {
 					out_size = ((numrep < (result_max-osize)) ?
 						    numrep : (result_max-osize));
@@ -964,7 +998,8 @@ int crush_do_rule(const struct crush_map *map,
 						   choose_leaf_tries : 1,
 						recurse_to_leaf,
 						c+osize,
-						0);
+						0,
+						work);
 					osize += out_size;
 				}
 			}
@@ -997,3 +1032,108 @@ int crush_do_rule(const struct crush_map *map,
 	}
 	return result_len;
 }
+
+/**
+ * crush_do_rule - calculate a mapping with the given input and rule
+ * @map: the crush_map
+ * @ruleno: the rule id
+ * @x: hash input
+ * @result: pointer to result vector
+ * @result_max: maximum result size
+ * @weight: weight vector (for map leaves)
+ * @weight_max: size of weight vector
+ * @scratch: scratch vector for private use; must be >= 3 * result_max
+ */
+int crush_do_rule(const struct crush_map *map,
+		  int ruleno, int x, int *result, int result_max,
+		  const __u32 *weight, int weight_max,
+		  int *scratch)
+{
+	return crush_do_rule_work(map, ruleno, x, result, result_max,
+				  weight, weight_max, scratch, NULL);
+}
+
+/**
+ * crush_work_size - size of the work buffer for crush_do_rule_batch
+ * @map: the crush_map
+ * @result_max: maximum result size
+ */
+size_t crush_work_size(const struct crush_map *map, int result_max)
+{
+	int b;
+	size_t max_size = 0;
+
+	for (b = 0; b < map->max_buckets; b++)
+		if (map->buckets[b] && map->buckets[b]->size > max_size)
+			max_size = map->buckets[b]->size;
+	return sizeof(struct crush_work) +
+		3 * result_max * sizeof(int) +
+		max_size * sizeof(__u32);
+}
+
+/**
+ * crush_init_work - lay out a work buffer for crush_do_rule_batch
+ * @map: the crush_map
+ * @v: buffer of at least crush_work_size(map, result_max) bytes
+ * @result_max: maximum result size
+ *
+ * the buffer can be reused for any number of batches as long as the
+ * map and result_max do not change.
+ */
+void crush_init_work(const struct crush_map *map, void *v, int result_max)
+{
+	struct crush_work *w = v;
+	char *point = (char *)v + sizeof(struct crush_work);
+
+	w->result_max = result_max;
+	w->scratch = (int *)point;
+	point += 3 * result_max * sizeof(int);
+	w->hash = (__u32 *)point;
+}
+
+/**
+ * crush_do_rule_batch - calculate the mappings of many inputs at once
+ * @map: the crush_map
+ * @ruleno: the rule id
+ * @x: hash inputs
+ * @count: number of inputs
+ * @result: results, @result_max slots per input
+ * @result_max: maximum result size; must match the work buffer
+ * @result_len: number of valid slots in each input's result
+ * @weight: weight vector (for map leaves)
+ * @weight_max: size of weight vector
+ * @v: work buffer set up by crush_init_work
+ *
+ * gives exactly the results of calling crush_do_rule on each input,
+ * but straw2 buckets hash all of their items in one pass and the
+ * rule lookup and scratch setup are only done once.  returns the
+ * number of inputs mapped.
+ */
+int crush_do_rule_batch(const struct crush_map *map,
+			int ruleno, const int *x, int count,
+			int *result, int result_max, int *result_len,
+			const __u32 *weight, int weight_max,
+			void *v)
+{
+	struct crush_work *w = v;
+	int i;
+
+	if (result_max != w->result_max) {
+		dprintk(" result_max %d does not match work %d\n",
+			result_max, w->result_max);
+		return 0;
+	}
+	if ((__u32)ruleno >= map->max_rules || !map->rules[ruleno]) {
+		dprintk(" bad ruleno %d\n", ruleno);
+		for (i = 0; i < count; i++)
+			result_len[i] = 0;
+		return count;
+	}
+	for (i = 0; i < count; i++)
+		result_len[i] = crush_do_rule_work(map, ruleno, x[i],
+						   result + i * result_max,
+						   result_max,
+						   weight, weight_max,
+						   w->scratch, w);
+	return count;
+}
@@ -17,4 +17,25 @@ extern int crush_do_rule(const struct crush_map *map,
 			 const __u32 *weights, int weight_max,
 			 int *scratch);
 
+/*
+ * Work buffer for crush_do_rule_batch: the rule scratch vectors plus
+ * room to hash every item of the largest bucket in one pass.  Size it
+ * with crush_work_size() and lay it out with crush_init_work(); it can
+ * then be reused across batches.
+ */
+struct crush_work {
+	int result_max;
+	int *scratch;	/* 3 * result_max */
+	__u32 *hash;	/* one per item of the largest bucket */
+};
+
+extern size_t crush_work_size(const struct crush_map *map, int result_max);
+extern void crush_init_work(const struct crush_map *map, void *v,
+			    int result_max);
+extern int crush_do_rule_batch(const struct crush_map *map,
+			       int ruleno, const int *x, int count,
+			       int *result, int result_max, int *result_len,
+			       const __u32 *weights, int weight_max,
+			       void *work);
+
 #endif
@@ -58,6 +58,14 @@
 #define RBD_CHILDREN		"rbd_children"
 #define RBD_LOCK_NAME		"rbd_lock"
 
+/**
+ * image metadata key naming the client-side persistent cache log that
+ * holds writes not yet written back to the image.  Removed whenever the
+ * exclusive lock is broken, so that a log left behind by a crashed
+ * client is not replayed over writes made by the new lock owner.
+ */
+#define RBD_PERSISTENT_CACHE_KEY	"rbd_persistent_cache_dirty"
+
 /**
  * rbd_mirroring object in each pool contains pool-specific settings
  * for configuring mirroring.
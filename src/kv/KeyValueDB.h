@@ -281,6 +281,19 @@ public:
     return -EOPNOTSUPP;
   }
 
+  /// bytes currently held by the block/row cache, or -EOPNOTSUPP
+  virtual int64_t get_cache_usage() const {
+    return -EOPNOTSUPP;
+  }
+  /// resize the block/row cache
+  virtual int set_cache_capacity(uint64_t capacity) {
+    return -EOPNOTSUPP;
+  }
+  /// cumulative cache hits and misses, if the backend tracks them
+  virtual int get_cache_stats(uint64_t *hits, uint64_t *misses) const {
+    return -EOPNOTSUPP;
+  }
+
   virtual ~KeyValueDB() {}
 
   /// compact the underlying store
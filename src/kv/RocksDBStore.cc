@@ -15,6 +15,7 @@
 #include "rocksdb/env.h"
 #include "rocksdb/slice.h"
 #include "rocksdb/cache.h"
+#include "rocksdb/statistics.h"
 #include "rocksdb/filter_policy.h"
 #include "rocksdb/utilities/convenience.h"
 #include "rocksdb/merge_operator.h"
@@ -278,10 +279,14 @@ int RocksDBStore::do_open(ostream &out, bool create_if_missing)
     opt.env = static_cast<rocksdb::Env*>(priv);
   }
 
-  auto cache = rocksdb::NewLRUCache(g_conf->rocksdb_cache_size, g_conf->rocksdb_cache_shard_bits);
+  bbt_cache = rocksdb::NewLRUCache(g_conf->rocksdb_cache_size, g_conf->rocksdb_cache_shard_bits);
   rocksdb::BlockBasedTableOptions bbt_opts;
   bbt_opts.block_size = g_conf->rocksdb_block_size;
-  bbt_opts.block_cache = cache;
+  bbt_opts.block_cache = bbt_cache;
+  if (g_conf->rocksdb_cache_stats) {
+    dbstats = rocksdb::CreateDBStatistics();
+    opt.statistics = dbstats;
+  }
   opt.table_factory.reset(rocksdb::NewBlockBasedTableFactory(bbt_opts));
   dout(10) << __func__ << " set block size to " << g_conf->rocksdb_block_size
            << " cache size to " << g_conf->rocksdb_cache_size
@@ -358,6 +363,31 @@ void RocksDBStore::close()
     cct->get_perfcounters_collection()->remove(logger);
 }
 
+int64_t RocksDBStore::get_cache_usage() const
+{
+  if (!bbt_cache)
+    return -ENOENT;
+  return bbt_cache->GetUsage();
+}
+
+int RocksDBStore::set_cache_capacity(uint64_t capacity)
+{
+  if (!bbt_cache)
+    return -ENOENT;
+  dout(10) << __func__ << " " << capacity << dendl;
+  bbt_cache->SetCapacity(capacity);
+  return 0;
+}
+
+int RocksDBStore::get_cache_stats(uint64_t *hits, uint64_t *misses) const
+{
+  if (!dbstats)
+    return -EOPNOTSUPP;
+  *hits = dbstats->getTickerCount(rocksdb::BLOCK_CACHE_HIT);
+  *misses = dbstats->getTickerCount(rocksdb::BLOCK_CACHE_MISS);
+  return 0;
+}
+
 int RocksDBStore::submit_transaction(KeyValueDB::Transaction t)
 {
   utime_t start = ceph_clock_now(g_ceph_context);
@@ -47,6 +47,7 @@ namespace rocksdb{
   class WriteBatch;
   class Iterator;
   class Logger;
+  class Statistics;
   struct Options;
 }
 
@@ -62,6 +63,8 @@ class RocksDBStore : public KeyValueDB {
   void *priv;
   rocksdb::DB *db;
   rocksdb::Env *env;
+  std::shared_ptr<rocksdb::Cache> bbt_cache;
+  std::shared_ptr<rocksdb::Statistics> dbstats;
   string options_str;
   int do_open(ostream &out, bool create_if_missing);
 
@@ -321,6 +324,10 @@ public:
 				 std::shared_ptr<KeyValueDB::MergeOperator> mop);
   string assoc_name; ///< Name of associative operator
 
+  int64_t get_cache_usage() const override;
+  int set_cache_capacity(uint64_t capacity) override;
+  int get_cache_stats(uint64_t *hits, uint64_t *misses) const override;
+
   virtual uint64_t get_estimated_size(map<string,uint64_t> &extra) {
     DIR *store_dir = opendir(path.c_str());
     if (!store_dir) {
@@ -15,6 +15,7 @@
 #include "librbd/AioCompletion.h"
 #include "librbd/AsyncOperation.h"
 #include "librbd/AsyncRequest.h"
+#include "librbd/cache/ImageCache.h"
 #include "librbd/ExclusiveLock.h"
 #include "librbd/exclusive_lock/AutomaticPolicy.h"
 #include "librbd/exclusive_lock/StandardPolicy.h"
@@ -870,6 +871,12 @@ struct C_InvalidateCache : public Context {
       // flush cache after completing all in-flight AIO ops
       on_safe = new C_FlushCache(this, on_safe);
     }
+    if (image_cache != nullptr) {
+      // write back the persistent cache once its log has caught up
+      on_safe = new FunctionContext([this, on_safe](int r) {
+          image_cache->flush(on_safe);
+        });
+    }
     flush_async_operations(on_safe);
   }
 
@@ -961,7 +968,11 @@ struct C_InvalidateCache : public Context {
         "rbd_journal_pool", false)(
         "rbd_journal_max_payload_bytes", false)(
         "rbd_journal_max_concurrent_object_sets", false)(
-        "rbd_mirroring_resync_after_disconnect", false);
+        "rbd_mirroring_resync_after_disconnect", false)(
+        "rbd_persistent_cache_enabled", false)(
+        "rbd_persistent_cache_path", false)(
+        "rbd_persistent_cache_size", false)(
+        "rbd_persistent_cache_writeback_bytes", false);
 
     md_config_t local_config_t;
     std::map<std::string, bufferlist> res;
@@ -1019,6 +1030,10 @@ struct C_InvalidateCache : public Context {
     ASSIGN_OPTION(journal_max_payload_bytes);
     ASSIGN_OPTION(journal_max_concurrent_object_sets);
     ASSIGN_OPTION(mirroring_resync_after_disconnect);
+    ASSIGN_OPTION(persistent_cache_enabled);
+    ASSIGN_OPTION(persistent_cache_path);
+    ASSIGN_OPTION(persistent_cache_size);
+    ASSIGN_OPTION(persistent_cache_writeback_bytes);
   }
 
   ExclusiveLock<ImageCtx> *ImageCtx::create_exclusive_lock() {
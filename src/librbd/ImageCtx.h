@@ -191,6 +191,10 @@ namespace librbd {
     uint32_t journal_max_payload_bytes;
     int journal_max_concurrent_object_sets;
     bool mirroring_resync_after_disconnect;
+    bool persistent_cache_enabled;
+    std::string persistent_cache_path;
+    uint64_t persistent_cache_size;
+    uint64_t persistent_cache_writeback_bytes;
 
     LibrbdAdminSocketHook *asok_hook;
 
@@ -0,0 +1,1283 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+
+#include "FileImageCache.h"
+#include "cls/rbd/cls_rbd_client.h"
+#include "include/buffer.h"
+#include "include/encoding.h"
+#include "include/rbd_types.h"
+#include "include/stringify.h"
+#include "common/dout.h"
+#include "common/errno.h"
+#include "common/safe_io.h"
+#include "common/WorkQueue.h"
+#include "librbd/ExclusiveLock.h"
+#include "librbd/ImageCtx.h"
+#include "librbd/Utils.h"
+#include <fcntl.h>
+#include <random>
+#include <sys/file.h>
+#include <unistd.h>
+
+#define dout_subsys ceph_subsys_rbd
+#undef dout_prefix
+#define dout_prefix *_dout << "librbd::FileImageCache: " << this << " " \
+                           <<  __func__ << ": "
+
+namespace librbd {
+namespace cache {
+
+namespace {
+
+// log layout: two superblock slots, then a circular area of entries.
+// every entry is a HEADER_SIZE header followed by its data padded to
+// BLOCK_SIZE; a PAD header means "continue at DATA_START".
+const uint64_t BLOCK_SIZE = 512;
+const uint64_t HEADER_SIZE = 512;
+const uint64_t SUPERBLOCK_SLOT_SIZE = 2048;
+const uint64_t DATA_START = 2 * SUPERBLOCK_SLOT_SIZE;
+const uint64_t MIN_LOG_SIZE = 1 << 20;
+const uint64_t MAX_ENTRY_BYTES = 4 << 20;
+const uint64_t MAX_APPEND_BATCH_BYTES = 4 << 20;
+
+const uint64_t SUPERBLOCK_MAGIC = 0x726264706361636bULL; // "rbdpcack"
+const uint64_t ENTRY_MAGIC = 0x726264706c6f6721ULL;      // "rbdplog!"
+
+uint64_t round_up(uint64_t v) {
+  return (v + BLOCK_SIZE - 1) & ~(BLOCK_SIZE - 1);
+}
+
+/// append payload and its crc so torn or stale blocks are detected
+void seal(bufferlist &payload, uint64_t pad_to, bufferlist *out) {
+  uint32_t crc = payload.crc32c(-1);
+  ::encode(payload, *out);
+  ::encode(crc, *out);
+  assert(out->length() <= pad_to);
+  out->append_zero(pad_to - out->length());
+}
+
+bool unseal(bufferlist &in, bufferlist *payload) {
+  try {
+    bufferlist::iterator it = in.begin();
+    uint32_t crc;
+    ::decode(*payload, it);
+    ::decode(crc, it);
+    return payload->crc32c(-1) == crc;
+  } catch (buffer::error &err) {
+    return false;
+  }
+}
+
+struct SuperBlock {
+  uint64_t generation = 0;
+  uint64_t log_id = 0;
+  std::string image_id;
+  uint64_t log_size = 0;
+  uint64_t tail = 0;
+  uint64_t tail_seq = 0;
+
+  void encode(bufferlist &bl) const {
+    bufferlist payload;
+    ::encode(SUPERBLOCK_MAGIC, payload);
+    ::encode(generation, payload);
+    ::encode(log_id, payload);
+    ::encode(image_id, payload);
+    ::encode(log_size, payload);
+    ::encode(tail, payload);
+    ::encode(tail_seq, payload);
+    seal(payload, SUPERBLOCK_SLOT_SIZE, &bl);
+  }
+  bool decode(bufferlist &bl) {
+    bufferlist payload;
+    if (!unseal(bl, &payload)) {
+      return false;
+    }
+    try {
+      bufferlist::iterator it = payload.begin();
+      uint64_t magic;
+      ::decode(magic, it);
+      if (magic != SUPERBLOCK_MAGIC) {
+        return false;
+      }
+      ::decode(generation, it);
+      ::decode(log_id, it);
+      ::decode(image_id, it);
+      ::decode(log_size, it);
+      ::decode(tail, it);
+      ::decode(tail_seq, it);
+    } catch (buffer::error &err) {
+      return false;
+    }
+    return true;
+  }
+};
+
+struct EntryHeader {
+  uint64_t log_id = 0;
+  uint64_t seq = 0;
+  uint8_t type = 0;
+  uint64_t image_offset = 0;
+  uint64_t length = 0;
+  uint32_t data_crc = 0;
+
+  void encode(bufferlist &bl) const {
+    bufferlist payload;
+    ::encode(ENTRY_MAGIC, payload);
+    ::encode(log_id, payload);
+    ::encode(seq, payload);
+    ::encode(type, payload);
+    ::encode(image_offset, payload);
+    ::encode(length, payload);
+    ::encode(data_crc, payload);
+    seal(payload, HEADER_SIZE, &bl);
+  }
+  bool decode(bufferlist &bl) {
+    bufferlist payload;
+    if (!unseal(bl, &payload)) {
+      return false;
+    }
+    try {
+      bufferlist::iterator it = payload.begin();
+      uint64_t magic;
+      ::decode(magic, it);
+      if (magic != ENTRY_MAGIC) {
+        return false;
+      }
+      ::decode(log_id, it);
+      ::decode(seq, it);
+      ::decode(type, it);
+      ::decode(image_offset, it);
+      ::decode(length, it);
+      ::decode(data_crc, it);
+    } catch (buffer::error &err) {
+      return false;
+    }
+    return true;
+  }
+};
+
+int read_block(int fd, uint64_t offset, uint64_t length, bufferlist *bl) {
+  bufferptr bp = buffer::create_page_aligned(length);
+  int r = safe_pread_exact(fd, bp.c_str(), length, offset);
+  if (r < 0) {
+    return r;
+  }
+  bl->push_back(std::move(bp));
+  return 0;
+}
+
+/// overlay data onto a set of non-overlapping extents, newest wins
+void overlay(std::map<uint64_t, bufferlist> *extents, uint64_t off,
+             bufferlist &bl) {
+  uint64_t end = off + bl.length();
+  auto it = extents->lower_bound(off);
+  if (it != extents->begin()) {
+    auto prev = std::prev(it);
+    uint64_t prev_end = prev->first + prev->second.length();
+    if (prev_end > off) {
+      bufferlist head, tail;
+      head.substr_of(prev->second, 0, off - prev->first);
+      if (prev_end > end) {
+        tail.substr_of(prev->second, end - prev->first, prev_end - end);
+        (*extents)[end].claim(tail);
+      }
+      prev->second.claim(head);
+    }
+  }
+  while (it != extents->end() && it->first < end) {
+    uint64_t it_end = it->first + it->second.length();
+    if (it_end > end) {
+      bufferlist tail;
+      tail.substr_of(it->second, end - it->first, it_end - end);
+      extents->erase(it);
+      (*extents)[end].claim(tail);
+      break;
+    }
+    it = extents->erase(it);
+  }
+  (*extents)[off] = bl;
+}
+
+} // anonymous namespace
+
+template <typename I>
+struct FileImageCache<I>::C_ReadRequest : public Context {
+  enum Source { SOURCE_CLUSTER, SOURCE_LOG, SOURCE_ZERO };
+  struct Piece {
+    uint64_t length;
+    Source source;
+    uint64_t log_offset;
+    bufferlist bl;
+  };
+
+  bufferlist *out_bl;
+  Context *on_finish;
+  std::vector<Piece> pieces;
+  bufferlist cluster_bl;
+
+  C_ReadRequest(bufferlist *out_bl, Context *on_finish)
+    : out_bl(out_bl), on_finish(on_finish) {
+  }
+
+  virtual void finish(int r) {
+    if (r < 0) {
+      on_finish->complete(r);
+      return;
+    }
+
+    bufferlist result;
+    uint64_t cluster_off = 0;
+    for (auto &piece : pieces) {
+      switch (piece.source) {
+      case SOURCE_CLUSTER:
+        {
+          bufferlist sub;
+          sub.substr_of(cluster_bl, cluster_off, piece.length);
+          cluster_off += piece.length;
+          result.claim_append(sub);
+        }
+        break;
+      case SOURCE_LOG:
+        result.claim_append(piece.bl);
+        break;
+      case SOURCE_ZERO:
+        result.append_zero(piece.length);
+        break;
+      }
+    }
+    out_bl->claim(result);
+    on_finish->complete(0);
+  }
+};
+
+template <typename I>
+FileImageCache<I>::FileImageCache(I &image_ctx)
+  : m_image_ctx(image_ctx), m_image_writeback(image_ctx),
+    m_log_space_lock("librbd::cache::FileImageCache::m_log_space_lock"),
+    m_lock("librbd::cache::FileImageCache::m_lock"),
+    m_append_thread(this) {
+}
+
+template <typename I>
+FileImageCache<I>::~FileImageCache() {
+  assert(m_fd < 0);
+}
+
+template <typename I>
+uint64_t FileImageCache<I>::capacity() const {
+  return m_log_size - DATA_START;
+}
+
+template <typename I>
+uint64_t FileImageCache<I>::entry_footprint(uint64_t head, const AppendOp &op,
+                                            uint64_t *entry_offset) const {
+  uint64_t len = HEADER_SIZE;
+  if (op.type == ENTRY_TYPE_WRITE) {
+    len += round_up(op.length);
+  }
+  if (head + len <= m_log_size) {
+    *entry_offset = head;
+    return len;
+  }
+  // skip the rest of the log and wrap around
+  *entry_offset = DATA_START;
+  return (m_log_size - head) + len;
+}
+
+template <typename I>
+void FileImageCache<I>::aio_read(Extents &&image_extents, bufferlist *bl,
+                                 int fadvise_flags, Context *on_finish) {
+  CephContext *cct = m_image_ctx.cct;
+  ldout(cct, 20) << "image_extents=" << image_extents << ", "
+                 << "on_finish=" << on_finish << dendl;
+
+  typedef typename C_ReadRequest::Piece Piece;
+  C_ReadRequest *req = new C_ReadRequest(bl, on_finish);
+  Extents cluster_extents;
+  int r = 0;
+  {
+    // hold off retirement so the log data we are about to read stays put
+    RWLock::RLocker space_locker(m_log_space_lock);
+    {
+      Mutex::Locker locker(m_lock);
+      for (auto &extent : image_extents) {
+        uint64_t pos = extent.first;
+        uint64_t end = extent.first + extent.second;
+        auto it = m_dirty_map.upper_bound(pos);
+        if (it != m_dirty_map.begin()) {
+          auto prev = std::prev(it);
+          if (prev->first + prev->second.length > pos) {
+            it = prev;
+          }
+        }
+        while (pos < end) {
+          if (it == m_dirty_map.end() || it->first >= end) {
+            req->pieces.push_back(Piece{end - pos, C_ReadRequest::SOURCE_CLUSTER,
+                                        0, {}});
+            cluster_extents.push_back({pos, end - pos});
+            break;
+          }
+          if (it->first > pos) {
+            req->pieces.push_back(Piece{it->first - pos,
+                                        C_ReadRequest::SOURCE_CLUSTER, 0, {}});
+            cluster_extents.push_back({pos, it->first - pos});
+            pos = it->first;
+          }
+          uint64_t piece_end = MIN(end, it->first + it->second.length);
+          if (it->second.zero) {
+            req->pieces.push_back(Piece{piece_end - pos,
+                                        C_ReadRequest::SOURCE_ZERO, 0, {}});
+          } else {
+            req->pieces.push_back(Piece{piece_end - pos,
+                                        C_ReadRequest::SOURCE_LOG,
+                                        it->second.log_offset +
+                                          (pos - it->first), {}});
+          }
+          pos = piece_end;
+          ++it;
+        }
+      }
+    }
+
+    for (auto &piece : req->pieces) {
+      if (piece.source != C_ReadRequest::SOURCE_LOG) {
+        continue;
+      }
+      r = read_block(m_fd, piece.log_offset, piece.length, &piece.bl);
+      if (r < 0) {
+        lderr(cct) << "failed to read from cache log: " << cpp_strerror(r)
+                   << dendl;
+        break;
+      }
+    }
+  }
+
+  if (r < 0 || cluster_extents.empty()) {
+    req->complete(r);
+    return;
+  }
+  m_image_writeback.aio_read(std::move(cluster_extents), &req->cluster_bl,
+                             fadvise_flags, req);
+}
+
+template <typename I>
+void FileImageCache<I>::aio_write(Extents &&image_extents,
+                                  bufferlist&& bl,
+                                  int fadvise_flags,
+                                  Context *on_finish) {
+  CephContext *cct = m_image_ctx.cct;
+  ldout(cct, 20) << "image_extents=" << image_extents << ", "
+                 << "on_finish=" << on_finish << dendl;
+
+  // large writes are logged in several entries and acked together
+  C_GatherBuilder gather(cct, on_finish);
+  Mutex::Locker locker(m_lock);
+  uint64_t bl_off = 0;
+  for (auto &extent : image_extents) {
+    for (uint64_t off = 0; off < extent.second; off += m_max_entry_bytes) {
+      uint64_t len = MIN(m_max_entry_bytes, extent.second - off);
+      AppendOp op{ENTRY_TYPE_WRITE, extent.first + off, len, {},
+                  gather.new_sub()};
+      op.bl.substr_of(bl, bl_off, len);
+      bl_off += len;
+      queue_append(std::move(op));
+    }
+  }
+  gather.activate();
+}
+
+template <typename I>
+void FileImageCache<I>::aio_discard(uint64_t offset, uint64_t length,
+                                    Context *on_finish) {
+  CephContext *cct = m_image_ctx.cct;
+  ldout(cct, 20) << "offset=" << offset << ", "
+                 << "length=" << length << ", "
+                 << "on_finish=" << on_finish << dendl;
+
+  Mutex::Locker locker(m_lock);
+  queue_append(AppendOp{ENTRY_TYPE_DISCARD, offset, length, {}, on_finish});
+}
+
+template <typename I>
+void FileImageCache<I>::aio_flush(Context *on_finish) {
+  CephContext *cct = m_image_ctx.cct;
+  ldout(cct, 20) << "on_finish=" << on_finish << dendl;
+
+  // every acked write is already durable in the log; just order this
+  // behind the writes still queued
+  Mutex::Locker locker(m_lock);
+  queue_append(AppendOp{ENTRY_TYPE_FLUSH, 0, 0, {}, on_finish});
+}
+
+template <typename I>
+void FileImageCache<I>::init(Context *on_finish) {
+  CephContext *cct = m_image_ctx.cct;
+  m_path = m_image_ctx.persistent_cache_path + "/rbd-" +
+           stringify(m_image_ctx.md_ctx.get_id()) + "." +
+           m_image_ctx.header_oid + ".log";
+  ldout(cct, 5) << "path=" << m_path << dendl;
+
+  int r = open_log();
+  if (r < 0) {
+    close_log();
+    on_finish->complete(r);
+    return;
+  }
+  if (m_log_entries.empty()) {
+    start(on_finish);
+    return;
+  }
+
+  // dirty entries are only ours to write back if nobody has broken our
+  // lock (and maybe written the image) since they were logged
+  bufferlist in;
+  ::encode(std::string(RBD_PERSISTENT_CACHE_KEY), in);
+  librados::ObjectReadOperation op;
+  op.exec("rbd", "metadata_get", in);
+  librados::AioCompletion *comp = util::create_rados_ack_callback(
+    new FunctionContext([this, on_finish](int r) {
+        handle_get_state(r, on_finish);
+      }));
+  r = m_image_ctx.md_ctx.aio_operate(m_image_ctx.header_oid, comp, &op,
+                                     &m_state_bl);
+  assert(r == 0);
+  comp->release();
+}
+
+template <typename I>
+void FileImageCache<I>::handle_get_state(int r, Context *on_finish) {
+  CephContext *cct = m_image_ctx.cct;
+  ldout(cct, 20) << "r=" << r << dendl;
+
+  std::string log_id;
+  if (r == 0) {
+    try {
+      bufferlist::iterator it = m_state_bl.begin();
+      ::decode(log_id, it);
+    } catch (buffer::error &err) {
+      r = -EBADMSG;
+    }
+  }
+  if (r < 0 && r != -ENOENT) {
+    lderr(cct) << "failed to read persistent cache state: " << cpp_strerror(r)
+               << dendl;
+    close_log();
+    on_finish->complete(r);
+    return;
+  }
+
+  if (log_id != stringify(m_log_id)) {
+    lderr(cct) << "image lock was broken since " << m_path << " was written: "
+               << "discarding its " << m_log_entries.size() << " dirty entries"
+               << dendl;
+    r = format_log();
+    if (r < 0) {
+      close_log();
+      on_finish->complete(r);
+      return;
+    }
+  }
+  start(on_finish);
+}
+
+template <typename I>
+void FileImageCache<I>::start(Context *on_finish) {
+  m_append_thread.create("rbd_pcache");
+  {
+    Mutex::Locker locker(m_lock);
+    maybe_writeback();
+  }
+  on_finish->complete(0);
+}
+
+template <typename I>
+void FileImageCache<I>::shut_down(Context *on_finish) {
+  CephContext *cct = m_image_ctx.cct;
+  ldout(cct, 20) << dendl;
+
+  // write everything back; whatever fails stays in the log for replay
+  flush(new FunctionContext([this, on_finish](int r) {
+      {
+        Mutex::Locker locker(m_lock);
+        m_stopping = true;
+        m_append_cond.Signal();
+      }
+      m_append_thread.join();
+      close_log();
+      on_finish->complete(r);
+    }));
+}
+
+template <typename I>
+void FileImageCache<I>::invalidate(Context *on_finish) {
+  CephContext *cct = m_image_ctx.cct;
+  ldout(cct, 20) << dendl;
+
+  // ordered behind the writes already queued; see append_thread_entry()
+  Mutex::Locker locker(m_lock);
+  queue_append(AppendOp{ENTRY_TYPE_INVALIDATE, 0, 0, {}, on_finish});
+}
+
+template <typename I>
+void FileImageCache<I>::flush(Context *on_finish) {
+  CephContext *cct = m_image_ctx.cct;
+
+  {
+    Mutex::Locker locker(m_lock);
+    uint64_t target = m_next_seq - 1;
+    for (auto &op : m_append_queue) {
+      if (op.type == ENTRY_TYPE_WRITE || op.type == ENTRY_TYPE_DISCARD) {
+        ++target;
+      }
+    }
+    ldout(cct, 20) << "target_seq=" << target << ", "
+                   << "retired_seq=" << m_retired_seq << dendl;
+
+    if (target > m_retired_seq) {
+      m_flush_waiters.push_back({target, on_finish});
+      // retry a failed writeback
+      m_writeback_error = 0;
+      maybe_writeback();
+      return;
+    }
+  }
+  m_image_ctx.op_work_queue->queue(on_finish, 0);
+}
+
+template <typename I>
+int FileImageCache<I>::open_log() {
+  CephContext *cct = m_image_ctx.cct;
+
+  m_fd = ::open(m_path.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0600);
+  if (m_fd < 0) {
+    int r = -errno;
+    lderr(cct) << "failed to open cache log " << m_path << ": "
+               << cpp_strerror(r) << dendl;
+    return r;
+  }
+  // two writers appending to and replaying the same log would corrupt it
+  if (::flock(m_fd, LOCK_EX | LOCK_NB) < 0) {
+    int r = -errno;
+    if (r == -EWOULDBLOCK) {
+      r = -EBUSY;
+    }
+    lderr(cct) << "failed to lock cache log " << m_path << ": "
+               << cpp_strerror(r) << dendl;
+    return r;
+  }
+
+  // pick the newest valid superblock slot
+  SuperBlock sb;
+  bool found = false;
+  for (uint64_t slot = 0; slot < 2; ++slot) {
+    bufferlist bl;
+    SuperBlock candidate;
+    if (read_block(m_fd, slot * SUPERBLOCK_SLOT_SIZE, SUPERBLOCK_SLOT_SIZE,
+                   &bl) == 0 &&
+        candidate.decode(bl) &&
+        (!found || candidate.generation > sb.generation)) {
+      sb = candidate;
+      found = true;
+    }
+  }
+
+  if (!found) {
+    ldout(cct, 5) << "no valid superblock, formatting " << m_path << dendl;
+    return format_log();
+  }
+  if (sb.image_id != m_image_ctx.id) {
+    lderr(cct) << "cache log " << m_path << " belongs to image "
+               << sb.image_id << ", discarding it" << dendl;
+    return format_log();
+  }
+
+  m_log_id = sb.log_id;
+  m_log_size = sb.log_size;
+  m_generation = sb.generation;
+  m_max_entry_bytes = MIN(MAX_ENTRY_BYTES, (capacity() / 8) & ~(BLOCK_SIZE - 1));
+  return replay_log(sb.tail, sb.tail_seq);
+}
+
+template <typename I>
+int FileImageCache<I>::format_log() {
+  CephContext *cct = m_image_ctx.cct;
+
+  m_log_size = m_image_ctx.persistent_cache_size & ~(BLOCK_SIZE - 1);
+  if (m_log_size < MIN_LOG_SIZE) {
+    lderr(cct) << "rbd_persistent_cache_size must be at least "
+               << MIN_LOG_SIZE << dendl;
+    return -EINVAL;
+  }
+  if (::ftruncate(m_fd, m_log_size) < 0) {
+    int r = -errno;
+    lderr(cct) << "failed to size cache log: " << cpp_strerror(r) << dendl;
+    return r;
+  }
+
+  std::random_device rd;
+  m_log_id = (static_cast<uint64_t>(rd()) << 32) | rd();
+  m_generation = 0;
+  m_max_entry_bytes = MIN(MAX_ENTRY_BYTES, (capacity() / 8) & ~(BLOCK_SIZE - 1));
+  m_head = DATA_START;
+  m_next_seq = 1;
+  m_persisted_seq = 0;
+  m_retired_seq = 0;
+  m_used = 0;
+  m_log_entries.clear();
+  m_dirty_map.clear();
+  return write_superblock(m_head, m_next_seq);
+}
+
+template <typename I>
+int FileImageCache<I>::write_superblock(uint64_t tail, uint64_t tail_seq) {
+  SuperBlock sb;
+  sb.generation = ++m_generation;
+  sb.log_id = m_log_id;
+  sb.image_id = m_image_ctx.id;
+  sb.log_size = m_log_size;
+  sb.tail = tail;
+  sb.tail_seq = tail_seq;
+
+  // alternate slots so a torn write never loses both copies
+  bufferlist bl;
+  sb.encode(bl);
+  int r = bl.write_fd(m_fd, (sb.generation % 2) * SUPERBLOCK_SLOT_SIZE);
+  if (r == 0 && ::fdatasync(m_fd) < 0) {
+    r = -errno;
+  }
+  if (r < 0) {
+    lderr(m_image_ctx.cct) << "failed to write superblock: "
+                           << cpp_strerror(r) << dendl;
+  }
+  return r;
+}
+
+template <typename I>
+int FileImageCache<I>::replay_log(uint64_t tail, uint64_t tail_seq) {
+  CephContext *cct = m_image_ctx.cct;
+
+  uint64_t pos = tail;
+  uint64_t seq = tail_seq;
+  uint64_t skip = 0;
+  uint64_t skip_pos = 0;
+  uint64_t scanned = 0;
+  while (scanned < capacity()) {
+    if (pos + HEADER_SIZE > m_log_size) {
+      skip += m_log_size - pos;
+      pos = DATA_START;
+    }
+
+    bufferlist bl;
+    EntryHeader header;
+    if (read_block(m_fd, pos, HEADER_SIZE, &bl) < 0 ||
+        !header.decode(bl) || header.log_id != m_log_id ||
+        header.seq != seq) {
+      break;
+    }
+
+    if (header.type == ENTRY_TYPE_PAD) {
+      if (skip == 0) {
+        skip_pos = pos;
+      }
+      skip += m_log_size - pos;
+      scanned += m_log_size - pos;
+      pos = DATA_START;
+      continue;
+    }
+
+    uint64_t data_len = 0;
+    if (header.type == ENTRY_TYPE_WRITE) {
+      data_len = round_up(header.length);
+      bufferlist data;
+      if (header.length > m_max_entry_bytes ||
+          pos + HEADER_SIZE + data_len > m_log_size ||
+          read_block(m_fd, pos + HEADER_SIZE, header.length, &data) < 0 ||
+          data.crc32c(-1) != header.data_crc) {
+        break;
+      }
+    } else if (header.type != ENTRY_TYPE_DISCARD) {
+      break;
+    }
+
+    LogEntry entry;
+    entry.seq = header.seq;
+    entry.type = static_cast<EntryType>(header.type);
+    entry.image_offset = header.image_offset;
+    entry.length = header.length;
+    entry.region_offset = (skip ? (skip_pos ? skip_pos : m_log_size - skip) :
+                           pos);
+    entry.log_offset = pos;
+    entry.footprint = skip + HEADER_SIZE + data_len;
+    m_log_entries.push_back(entry);
+    add_dirty_extent(entry);
+    m_used += entry.footprint;
+
+    scanned += HEADER_SIZE + data_len;
+    pos += HEADER_SIZE + data_len;
+    skip = 0;
+    skip_pos = 0;
+    ++seq;
+  }
+
+  // an unfinished wrap (pad without a following entry) is ignored
+  m_head = (skip_pos ? skip_pos : pos);
+  if (m_head >= m_log_size) {
+    m_head = DATA_START;
+  }
+  m_next_seq = seq;
+  m_persisted_seq = seq - 1;
+  m_retired_seq = tail_seq - 1;
+
+  ldout(cct, 5) << "replayed " << m_log_entries.size() << " dirty entries ("
+                << m_used << " bytes) from " << m_path << dendl;
+  return 0;
+}
+
+template <typename I>
+void FileImageCache<I>::queue_append(AppendOp &&op) {
+  assert(m_lock.is_locked());
+  m_append_queue.push_back(std::move(op));
+  m_append_cond.Signal();
+}
+
+template <typename I>
+void FileImageCache<I>::append_thread_entry() {
+  CephContext *cct = m_image_ctx.cct;
+
+  m_lock.Lock();
+  while (true) {
+    if (m_append_queue.empty()) {
+      if (m_state_recorded && m_log_entries.empty()) {
+        // drained: nothing in the log depends on the image any more.  a
+        // stale key naming an empty log is harmless, so don't retry.
+        m_state_recorded = false;
+        m_lock.Unlock();
+        record_state(false);
+        m_lock.Lock();
+        continue;
+      }
+      if (m_stopping) {
+        break;
+      }
+      m_append_cond.Wait(m_lock);
+      continue;
+    }
+
+    if (m_append_queue.front().type == ENTRY_TYPE_INVALIDATE) {
+      m_invalidating = true;
+      if (m_writeback_in_flight) {
+        // handle_writeback wakes us up
+        m_append_cond.Wait(m_lock);
+        continue;
+      }
+      Context *on_finish = m_append_queue.front().on_finish;
+      m_append_queue.pop_front();
+      std::list<Context*> completions;
+      m_lock.Unlock();
+      int r = discard_log(&completions);
+      for (auto ctx : completions) {
+        m_image_ctx.op_work_queue->queue(ctx, 0);
+      }
+      on_finish->complete(r);
+      m_lock.Lock();
+      m_invalidating = false;
+      maybe_writeback();
+      continue;
+    }
+
+    // reserve log space for as much of the queue as fits
+    std::list<std::pair<LogEntry, AppendOp> > batch;
+    std::list<Context*> flushes;
+    uint64_t batch_bytes = 0;
+    while (!m_append_queue.empty() && batch_bytes < MAX_APPEND_BATCH_BYTES) {
+      AppendOp &op = m_append_queue.front();
+      if (op.type == ENTRY_TYPE_INVALIDATE) {
+        break;
+      }
+      if (op.type == ENTRY_TYPE_FLUSH) {
+        flushes.push_back(op.on_finish);
+        m_append_queue.pop_front();
+        continue;
+      }
+
+      LogEntry entry;
+      entry.footprint = entry_footprint(m_head, op, &entry.log_offset);
+      if (m_used + entry.footprint > capacity()) {
+        break;
+      }
+      entry.seq = m_next_seq++;
+      entry.type = op.type;
+      entry.image_offset = op.image_offset;
+      entry.length = op.length;
+      entry.region_offset = m_head;
+      m_head = entry.log_offset + HEADER_SIZE;
+      if (op.type == ENTRY_TYPE_WRITE) {
+        m_head += round_up(op.length);
+      }
+      if (m_head >= m_log_size) {
+        m_head = DATA_START;
+      }
+      m_used += entry.footprint;
+      m_log_entries.push_back(entry);
+
+      batch_bytes += entry.footprint;
+      batch.push_back(std::make_pair(entry, std::move(op)));
+      m_append_queue.pop_front();
+    }
+
+    if (batch.empty() && flushes.empty()) {
+      if (m_writeback_error < 0) {
+        // nothing will be retired until a flush retries the writeback:
+        // fail what is waiting for space rather than stall it
+        int r = m_writeback_error;
+        lderr(cct) << "log full and writeback failing: " << cpp_strerror(r)
+                   << dendl;
+        std::list<Context*> failed;
+        std::deque<AppendOp> invalidates;
+        for (auto &op : m_append_queue) {
+          if (op.type == ENTRY_TYPE_INVALIDATE) {
+            invalidates.push_back(std::move(op));
+          } else if (op.on_finish != nullptr) {
+            failed.push_back(op.on_finish);
+          }
+        }
+        m_append_queue.swap(invalidates);
+        m_lock.Unlock();
+        for (auto ctx : failed) {
+          ctx->complete(r);
+        }
+        m_lock.Lock();
+        continue;
+      }
+      // log is full of dirty data: wait for writeback to retire some
+      ldout(cct, 10) << "log full, used=" << m_used << dendl;
+      maybe_writeback();
+      m_append_cond.Wait(m_lock);
+      continue;
+    }
+
+    int r = 0;
+    if (!batch.empty()) {
+      // the key must name the log before anything in it is acked
+      bool record = !m_state_recorded;
+      m_lock.Unlock();
+      if (record) {
+        r = record_state(true);
+      }
+      bool recorded = (r == 0);
+      if (r == 0) {
+        r = write_entries(batch);
+      }
+      m_lock.Lock();
+      if (record && recorded) {
+        m_state_recorded = true;
+      }
+    }
+
+    std::list<Context*> completions;
+    if (r < 0) {
+      // we are the only appender, so the failed entries are the newest:
+      // hand their space back
+      for (auto it = batch.rbegin(); it != batch.rend(); ++it) {
+        assert(m_log_entries.back().seq == it->first.seq);
+        m_head = m_log_entries.back().region_offset;
+        m_used -= m_log_entries.back().footprint;
+        m_log_entries.pop_back();
+        --m_next_seq;
+      }
+    } else if (!batch.empty()) {
+      m_persisted_seq = batch.back().first.seq;
+      for (auto &p : batch) {
+        add_dirty_extent(p.first);
+      }
+    }
+    for (auto &p : batch) {
+      if (p.second.on_finish != nullptr) {
+        completions.push_back(p.second.on_finish);
+      }
+    }
+    completions.splice(completions.end(), flushes);
+    maybe_writeback();
+
+    m_lock.Unlock();
+    for (auto ctx : completions) {
+      ctx->complete(r);
+    }
+    m_lock.Lock();
+  }
+  m_lock.Unlock();
+}
+
+template <typename I>
+int FileImageCache<I>::write_entries(
+    std::list<std::pair<LogEntry, AppendOp> > &batch) {
+  CephContext *cct = m_image_ctx.cct;
+
+  // gather physically contiguous entries into a single write
+  std::list<std::pair<uint64_t, bufferlist> > writes;
+  auto append = [&writes](uint64_t off, bufferlist &bl) {
+    if (writes.empty() ||
+        writes.back().first + writes.back().second.length() != off) {
+      writes.push_back(std::make_pair(off, bufferlist()));
+    }
+    writes.back().second.claim_append(bl);
+  };
+
+  for (auto &p : batch) {
+    LogEntry &entry = p.first;
+    AppendOp &op = p.second;
+
+    if (entry.log_offset != entry.region_offset) {
+      EntryHeader pad;
+      pad.log_id = m_log_id;
+      pad.seq = entry.seq;
+      pad.type = ENTRY_TYPE_PAD;
+      bufferlist bl;
+      pad.encode(bl);
+      append(entry.region_offset, bl);
+    }
+
+    EntryHeader header;
+    header.log_id = m_log_id;
+    header.seq = entry.seq;
+    header.type = entry.type;
+    header.image_offset = entry.image_offset;
+    header.length = entry.length;
+    bufferlist bl;
+    if (entry.type == ENTRY_TYPE_WRITE) {
+      header.data_crc = op.bl.crc32c(-1);
+      header.encode(bl);
+      bl.append(op.bl);
+      bl.append_zero(round_up(entry.length) - entry.length);
+    } else {
+      header.encode(bl);
+    }
+    append(entry.log_offset, bl);
+  }
+
+  for (auto &w : writes) {
+    int r = w.second.write_fd(m_fd, w.first);
+    if (r < 0) {
+      lderr(cct) << "failed to append to cache log: " << cpp_strerror(r)
+                 << dendl;
+      return r;
+    }
+  }
+  if (::fdatasync(m_fd) < 0) {
+    int r = -errno;
+    lderr(cct) << "failed to sync cache log: " << cpp_strerror(r) << dendl;
+    return r;
+  }
+  return 0;
+}
+
+template <typename I>
+void FileImageCache<I>::add_dirty_extent(const LogEntry &entry) {
+  uint64_t off = entry.image_offset;
+  uint64_t end = off + entry.length;
+  if (entry.length == 0) {
+    return;
+  }
+
+  auto it = m_dirty_map.lower_bound(off);
+  if (it != m_dirty_map.begin()) {
+    auto prev = std::prev(it);
+    uint64_t prev_end = prev->first + prev->second.length;
+    if (prev_end > off) {
+      if (prev_end > end) {
+        DirtyExtent tail = prev->second;
+        tail.length = prev_end - end;
+        if (!tail.zero) {
+          tail.log_offset += end - prev->first;
+        }
+        m_dirty_map[end] = tail;
+      }
+      prev->second.length = off - prev->first;
+    }
+  }
+  while (it != m_dirty_map.end() && it->first < end) {
+    uint64_t it_end = it->first + it->second.length;
+    if (it_end > end) {
+      DirtyExtent tail = it->second;
+      tail.length = it_end - end;
+      if (!tail.zero) {
+        tail.log_offset += end - it->first;
+      }
+      m_dirty_map.erase(it);
+      m_dirty_map[end] = tail;
+      break;
+    }
+    it = m_dirty_map.erase(it);
+  }
+
+  DirtyExtent extent;
+  extent.length = entry.length;
+  extent.seq = entry.seq;
+  extent.zero = (entry.type == ENTRY_TYPE_DISCARD);
+  extent.log_offset = extent.zero ? 0 : entry.log_offset + HEADER_SIZE;
+  m_dirty_map[off] = extent;
+}
+
+template <typename I>
+void FileImageCache<I>::remove_dirty_extents(const LogEntry &entry) {
+  // everything up to entry.seq is now on the cluster
+  uint64_t end = entry.image_offset + entry.length;
+  auto it = m_dirty_map.upper_bound(entry.image_offset);
+  if (it != m_dirty_map.begin()) {
+    --it;
+  }
+  while (it != m_dirty_map.end() && it->first < end) {
+    if (it->first + it->second.length > entry.image_offset &&
+        it->second.seq <= entry.seq) {
+      it = m_dirty_map.erase(it);
+    } else {
+      ++it;
+    }
+  }
+}
+
+template <typename I>
+void FileImageCache<I>::maybe_writeback() {
+  assert(m_lock.is_locked());
+  if (m_writeback_in_flight || m_writeback_error < 0 || m_invalidating) {
+    return;
+  }
+
+  // write back in log order: a discard goes on its own, writes are
+  // batched up to rbd_persistent_cache_writeback_bytes
+  std::list<LogEntry> batch;
+  uint64_t bytes = 0;
+  for (auto &entry : m_log_entries) {
+    if (entry.seq > m_persisted_seq ||
+        bytes >= m_image_ctx.persistent_cache_writeback_bytes) {
+      break;
+    }
+    if (entry.type == ENTRY_TYPE_DISCARD) {
+      if (batch.empty()) {
+        batch.push_back(entry);
+      }
+      break;
+    }
+    batch.push_back(entry);
+    bytes += entry.length;
+  }
+  if (batch.empty()) {
+    return;
+  }
+
+  m_writeback_in_flight = true;
+  m_image_ctx.op_work_queue->queue(new FunctionContext(
+    [this, batch](int r) mutable {
+      send_writeback(std::move(batch));
+    }), 0);
+}
+
+template <typename I>
+void FileImageCache<I>::send_writeback(std::list<LogEntry> &&batch) {
+  CephContext *cct = m_image_ctx.cct;
+  ldout(cct, 20) << "seq=" << batch.front().seq << "~" << batch.back().seq
+                 << dendl;
+
+  // write back only as the lock owner: otherwise the object map is not
+  // updated and another client may be writing the image
+  RWLock::RLocker owner_locker(m_image_ctx.owner_lock);
+  if (m_image_ctx.exclusive_lock != nullptr &&
+      !m_image_ctx.exclusive_lock->is_lock_owner()) {
+    ldout(cct, 10) << "not the lock owner, deferring writeback" << dendl;
+    std::list<Context*> completions;
+    {
+      Mutex::Locker locker(m_lock);
+      m_writeback_in_flight = false;
+      // the entries are durable in the log and will be written back
+      // once we own the lock: flushes need not wait for that
+      for (auto &waiter : m_flush_waiters) {
+        completions.push_back(waiter.second);
+      }
+      m_flush_waiters.clear();
+    }
+    for (auto ctx : completions) {
+      m_image_ctx.op_work_queue->queue(ctx, 0);
+    }
+    return;
+  }
+
+  Context *ctx = new FunctionContext([this, batch](int r) mutable {
+      handle_writeback(std::move(batch), r);
+    });
+
+  if (batch.front().type == ENTRY_TYPE_DISCARD) {
+    m_image_writeback.aio_discard(batch.front().image_offset,
+                                  batch.front().length, ctx);
+    return;
+  }
+
+  // entries under writeback are never retired, so the log data is stable
+  std::map<uint64_t, bufferlist> coalesced;
+  for (auto &entry : batch) {
+    bufferlist bl;
+    int r = read_block(m_fd, entry.log_offset + HEADER_SIZE, entry.length,
+                       &bl);
+    if (r < 0) {
+      lderr(cct) << "failed to read back cache log: " << cpp_strerror(r)
+                 << dendl;
+      ctx->complete(r);
+      return;
+    }
+    overlay(&coalesced, entry.image_offset, bl);
+  }
+
+  Extents image_extents;
+  bufferlist bl;
+  for (auto &p : coalesced) {
+    if (!image_extents.empty() &&
+        image_extents.back().first + image_extents.back().second == p.first) {
+      image_extents.back().second += p.second.length();
+    } else {
+      image_extents.push_back({p.first, p.second.length()});
+    }
+    bl.claim_append(p.second);
+  }
+  ldout(cct, 20) << batch.size() << " entries coalesced into "
+                 << image_extents.size() << " extents" << dendl;
+  m_image_writeback.aio_write(std::move(image_extents), std::move(bl), 0, ctx);
+}
+
+template <typename I>
+void FileImageCache<I>::handle_writeback(std::list<LogEntry> &&batch, int r) {
+  CephContext *cct = m_image_ctx.cct;
+  ldout(cct, 20) << "r=" << r << dendl;
+
+  uint64_t tail = 0;
+  uint64_t tail_seq = batch.back().seq + 1;
+  if (r >= 0) {
+    Mutex::Locker locker(m_lock);
+    auto it = m_log_entries.begin();
+    for (size_t i = 0; i < batch.size(); ++i) {
+      ++it;
+    }
+    tail = (it == m_log_entries.end() ? m_head : it->region_offset);
+  }
+
+  // the new tail must be durable before its space can be reused
+  if (r >= 0) {
+    r = write_superblock(tail, tail_seq);
+  }
+
+  std::list<Context*> completions;
+  {
+    RWLock::WLocker space_locker(m_log_space_lock);
+    Mutex::Locker locker(m_lock);
+    m_writeback_in_flight = false;
+    if (r < 0) {
+      lderr(cct) << "failed to write back cache entries: " << cpp_strerror(r)
+                 << dendl;
+      m_writeback_error = r;
+      for (auto &waiter : m_flush_waiters) {
+        completions.push_back(waiter.second);
+      }
+      m_flush_waiters.clear();
+      // an append waiting for space must now fail instead
+      m_append_cond.Signal();
+    } else {
+      for (auto &entry : batch) {
+        assert(m_log_entries.front().seq == entry.seq);
+        m_used -= m_log_entries.front().footprint;
+        m_log_entries.pop_front();
+        remove_dirty_extents(entry);
+      }
+      m_retired_seq = batch.back().seq;
+      m_append_cond.Signal();
+
+      for (auto it = m_flush_waiters.begin(); it != m_flush_waiters.end(); ) {
+        if (it->first <= m_retired_seq) {
+          completions.push_back(it->second);
+          it = m_flush_waiters.erase(it);
+        } else {
+          ++it;
+        }
+      }
+      maybe_writeback();
+    }
+  }
+
+  for (auto ctx : completions) {
+    m_image_ctx.op_work_queue->queue(ctx, r < 0 ? r : 0);
+  }
+}
+
+template <typename I>
+int FileImageCache<I>::record_state(bool dirty) {
+  // called from the append thread only, which may block
+  CephContext *cct = m_image_ctx.cct;
+  ldout(cct, 10) << "dirty=" << dirty << dendl;
+
+  int r;
+  if (dirty) {
+    std::map<std::string, bufferlist> data;
+    data[RBD_PERSISTENT_CACHE_KEY].append(stringify(m_log_id));
+    r = cls_client::metadata_set(&m_image_ctx.md_ctx, m_image_ctx.header_oid,
+                                 data);
+  } else {
+    r = cls_client::metadata_remove(&m_image_ctx.md_ctx,
+                                    m_image_ctx.header_oid,
+                                    RBD_PERSISTENT_CACHE_KEY);
+  }
+  if (r < 0) {
+    lderr(cct) << "failed to " << (dirty ? "set" : "remove") << " "
+               << RBD_PERSISTENT_CACHE_KEY << ": " << cpp_strerror(r) << dendl;
+  }
+  return r;
+}
+
+template <typename I>
+int FileImageCache<I>::discard_log(std::list<Context*> *completions) {
+  // called from the append thread only, with no writeback in flight:
+  // nothing else can move the tail or the head meanwhile
+  CephContext *cct = m_image_ctx.cct;
+
+  RWLock::WLocker space_locker(m_log_space_lock);
+  uint64_t tail;
+  uint64_t tail_seq;
+  {
+    Mutex::Locker locker(m_lock);
+    assert(!m_writeback_in_flight);
+    ldout(cct, 5) << "discarding " << m_log_entries.size() << " entries"
+                  << dendl;
+    tail = m_head;
+    tail_seq = m_next_seq;
+  }
+
+  int r = write_superblock(tail, tail_seq);
+  if (r < 0) {
+    return r;
+  }
+
+  Mutex::Locker locker(m_lock);
+  m_log_entries.clear();
+  m_dirty_map.clear();
+  m_used = 0;
+  m_retired_seq = tail_seq - 1;
+  m_writeback_error = 0;
+  for (auto it = m_flush_waiters.begin(); it != m_flush_waiters.end(); ) {
+    if (it->first <= m_retired_seq) {
+      completions->push_back(it->second);
+      it = m_flush_waiters.erase(it);
+    } else {
+      ++it;
+    }
+  }
+  return 0;
+}
+
+template <typename I>
+void FileImageCache<I>::close_log() {
+  if (m_fd >= 0) {
+    VOID_TEMP_FAILURE_RETRY(::close(m_fd));
+    m_fd = -1;
+  }
+}
+
+} // namespace cache
+} // namespace librbd
+
+template class librbd::cache::FileImageCache<librbd::ImageCtx>;
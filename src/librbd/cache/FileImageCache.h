@@ -0,0 +1,192 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+
+#ifndef CEPH_LIBRBD_CACHE_FILE_IMAGE_CACHE
+#define CEPH_LIBRBD_CACHE_FILE_IMAGE_CACHE
+
+#include "ImageCache.h"
+#include "ImageWriteback.h"
+#include "common/Cond.h"
+#include "common/Mutex.h"
+#include "common/RWLock.h"
+#include "common/Thread.h"
+#include <deque>
+#include <list>
+#include <map>
+
+namespace librbd {
+
+struct ImageCtx;
+
+namespace cache {
+
+/**
+ * Persistent write-back cache backed by a local file or block device.
+ *
+ * Writes and discards are appended to an ordered, checksummed log and
+ * acked as soon as the log is durable (one fdatasync per batch of
+ * queued writes).  Logged entries are written back to the cluster in
+ * the background, in log order, with overlapping and adjacent writes
+ * coalesced into a single image request.  Reads of dirty extents are
+ * served from the log.  On open, the log is scanned from the last
+ * retired position and any entries still dirty are written back.
+ *
+ * Client flushes only need the log to be durable; internal flushes
+ * (ImageCtx::flush, lock release, close) drain it to the cluster.
+ *
+ * Writeback only happens while we own the exclusive lock (if the image
+ * has one), so that the object map is kept up to date and no other
+ * client writes the image meanwhile.  Without the lock, dirty entries,
+ * replayed ones included, stay in the log until client IO, which needs
+ * the lock, or a flush finds us owning it.  While writeback is failing,
+ * writes that find the log full fail with the writeback error instead
+ * of waiting; the next flush retries the writeback.
+ *
+ * The log file is flocked for as long as it is open.  Before the first
+ * write to an empty log is acked, the image metadata key
+ * RBD_PERSISTENT_CACHE_KEY is set to the log id; it is removed once the
+ * log has drained, and by whoever breaks our exclusive lock.  Dirty
+ * entries are only replayed if the key still names this log: otherwise
+ * another client may have written the image since, and the log is
+ * discarded.  invalidate() discards the log without writing it back.
+ */
+template <typename ImageCtxT = librbd::ImageCtx>
+class FileImageCache : public ImageCache {
+public:
+  FileImageCache(ImageCtxT &image_ctx);
+  ~FileImageCache();
+
+  /// client AIO methods
+  virtual void aio_read(Extents&& image_extents, ceph::bufferlist *bl,
+                        int fadvise_flags, Context *on_finish);
+  virtual void aio_write(Extents&& image_extents, ceph::bufferlist&& bl,
+                         int fadvise_flags, Context *on_finish);
+  virtual void aio_discard(uint64_t offset, uint64_t length,
+                           Context *on_finish);
+  virtual void aio_flush(Context *on_finish);
+
+  /// internal state methods
+  virtual void init(Context *on_finish);
+  virtual void shut_down(Context *on_finish);
+
+  virtual void invalidate(Context *on_finish);
+  virtual void flush(Context *on_finish);
+
+private:
+  enum EntryType {
+    ENTRY_TYPE_WRITE = 1,
+    ENTRY_TYPE_DISCARD = 2,
+    ENTRY_TYPE_PAD = 3,        ///< rest of the log is unused; wrap around
+    ENTRY_TYPE_FLUSH = 4,      ///< queued client flush; never logged
+    ENTRY_TYPE_INVALIDATE = 5, ///< queued invalidate; never logged
+  };
+
+  /// in-memory copy of a durable (or about to be) log entry
+  struct LogEntry {
+    uint64_t seq = 0;
+    EntryType type = ENTRY_TYPE_WRITE;
+    uint64_t image_offset = 0;
+    uint64_t length = 0;
+    uint64_t region_offset = 0; ///< start of the log bytes it consumes
+    uint64_t log_offset = 0;   ///< offset of the entry header in the log
+    uint64_t footprint = 0;    ///< log bytes consumed, including any skip
+  };
+
+  /// a piece of the image whose newest data lives in the log
+  struct DirtyExtent {
+    uint64_t length;
+    uint64_t seq;
+    uint64_t log_offset;       ///< data offset in the log; 0 for discards
+    bool zero;                 ///< discarded: reads return zeros
+  };
+  typedef std::map<uint64_t, DirtyExtent> DirtyMap;
+
+  /// a write or discard waiting for space in the log, or a client flush
+  struct AppendOp {
+    EntryType type;
+    uint64_t image_offset;
+    uint64_t length;
+    ceph::bufferlist bl;
+    Context *on_finish;        ///< completed once durable (may be null)
+  };
+
+  struct AppendThread : public Thread {
+    FileImageCache *cache;
+    explicit AppendThread(FileImageCache *c) : cache(c) {}
+    void *entry() {
+      cache->append_thread_entry();
+      return nullptr;
+    }
+  };
+
+  struct C_ReadRequest;
+
+  ImageCtxT &m_image_ctx;
+  ImageWriteback<ImageCtxT> m_image_writeback;
+
+  std::string m_path;
+  int m_fd = -1;
+  uint64_t m_log_id = 0;       ///< random per format; tags every header
+  uint64_t m_log_size = 0;
+  uint64_t m_max_entry_bytes = 0;
+  uint64_t m_generation = 0;   ///< superblock generation; picks the slot
+
+  /// taken for read while preading dirty data out of the log and for
+  /// write while retiring entries, so retired space is never reused
+  /// under a reader.  ordered before m_lock.
+  RWLock m_log_space_lock;
+
+  Mutex m_lock;
+  Cond m_append_cond;
+  AppendThread m_append_thread;
+  bool m_stopping = false;
+
+  std::deque<AppendOp> m_append_queue;
+  uint64_t m_next_seq = 1;     ///< next seq to hand out
+  uint64_t m_persisted_seq = 0;
+  uint64_t m_retired_seq = 0;
+  uint64_t m_head = 0;         ///< next append position
+  uint64_t m_used = 0;         ///< log bytes held by unretired entries
+  std::list<LogEntry> m_log_entries; ///< appended, not yet retired
+  DirtyMap m_dirty_map;
+
+  bool m_state_recorded = false; ///< RBD_PERSISTENT_CACHE_KEY names the log
+  bool m_invalidating = false;   ///< an invalidate is next: hold off writeback
+  bufferlist m_state_bl;
+
+  bool m_writeback_in_flight = false;
+  int m_writeback_error = 0;   ///< last writeback error; cleared by flush
+  std::list<std::pair<uint64_t, Context*> > m_flush_waiters;
+
+  uint64_t capacity() const;
+  uint64_t entry_footprint(uint64_t head, const AppendOp &op,
+                           uint64_t *entry_offset) const;
+
+  int open_log();
+  int format_log();
+  int write_superblock(uint64_t tail, uint64_t tail_seq);
+  int replay_log(uint64_t tail, uint64_t tail_seq);
+  void handle_get_state(int r, Context *on_finish);
+  void start(Context *on_finish);
+  int record_state(bool dirty);
+  int discard_log(std::list<Context*> *completions);
+
+  void queue_append(AppendOp &&op);
+  void append_thread_entry();
+  int write_entries(std::list<std::pair<LogEntry, AppendOp> > &batch);
+  void add_dirty_extent(const LogEntry &entry);
+  void remove_dirty_extents(const LogEntry &entry);
+
+  void maybe_writeback();
+  void send_writeback(std::list<LogEntry> &&batch);
+  void handle_writeback(std::list<LogEntry> &&batch, int r);
+
+  void close_log();
+};
+
+} // namespace cache
+} // namespace librbd
+
+extern template class librbd::cache::FileImageCache<librbd::ImageCtx>;
+
+#endif // CEPH_LIBRBD_CACHE_FILE_IMAGE_CACHE
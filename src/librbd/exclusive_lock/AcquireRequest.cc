@@ -4,6 +4,7 @@
 #include "librbd/exclusive_lock/AcquireRequest.h"
 #include "cls/lock/cls_lock_client.h"
 #include "cls/lock/cls_lock_types.h"
+#include "cls/rbd/cls_rbd_client.h"
 #include "common/dout.h"
 #include "common/errno.h"
 #include "common/WorkQueue.h"
@@ -562,6 +563,9 @@ void AcquireRequest<I>::send_break_lock() {
   librados::ObjectWriteOperation op;
   rados::cls::lock::break_lock(&op, RBD_LOCK_NAME, m_locker_cookie,
                                m_locker_entity);
+  // a persistent cache log the dead owner left behind must not be
+  // written back over what we are about to write
+  cls_client::metadata_remove(&op, RBD_PERSISTENT_CACHE_KEY);
 
   using klass = AcquireRequest<I>;
   librados::AioCompletion *rados_completion =
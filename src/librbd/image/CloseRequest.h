@@ -36,7 +36,10 @@ private:
    * UNREGISTER_IMAGE_WATCHER
    *    |
    *    v
-   * SHUT_DOWN_AIO_WORK_QUEUE . . .
+   * SHUT_DOWN_AIO_WORK_QUEUE
+   *    |
+   *    v
+   * SHUT_DOWN_IMAGE_CACHE  . . . .
    *    |                         .
    *    v                         .
    * SHUT_DOWN_EXCLUSIVE_LOCK     . (exclusive lock
@@ -83,6 +86,9 @@ private:
   void send_shut_down_aio_queue();
   void handle_shut_down_aio_queue(int r);
 
+  void send_shut_down_image_cache();
+  void handle_shut_down_image_cache(int r);
+
   void send_shut_down_exclusive_lock();
   void handle_shut_down_exclusive_lock(int r);
 
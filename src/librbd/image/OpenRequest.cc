@@ -7,6 +7,7 @@
 #include "cls/rbd/cls_rbd_client.h"
 #include "librbd/ImageCtx.h"
 #include "librbd/Utils.h"
+#include "librbd/cache/FileImageCache.h"
 #include "librbd/image/CloseRequest.h"
 #include "librbd/image/RefreshRequest.h"
 #include "librbd/image/SetSnapRequest.h"
@@ -440,8 +441,44 @@ Context *OpenRequest<I>::handle_refresh(int *result) {
     send_close_image(*result);
     return nullptr;
   } else {
+    return send_init_image_cache(result);
+  }
+}
+
+template <typename I>
+Context *OpenRequest<I>::send_init_image_cache(int *result) {
+  // the persistent cache only holds writes to the image head
+  if (!m_image_ctx->persistent_cache_enabled || m_image_ctx->read_only ||
+      !m_image_ctx->snap_name.empty()) {
     return send_set_snap(result);
   }
+
+  CephContext *cct = m_image_ctx->cct;
+  ldout(cct, 10) << this << " " << __func__ << dendl;
+
+  using klass = OpenRequest<I>;
+  Context *ctx = create_context_callback<
+    klass, &klass::handle_init_image_cache>(this);
+  m_image_ctx->image_cache = new cache::FileImageCache<I>(*m_image_ctx);
+  m_image_ctx->image_cache->init(ctx);
+  return nullptr;
+}
+
+template <typename I>
+Context *OpenRequest<I>::handle_init_image_cache(int *result) {
+  CephContext *cct = m_image_ctx->cct;
+  ldout(cct, 10) << __func__ << ": r=" << *result << dendl;
+
+  if (*result < 0) {
+    lderr(cct) << "failed to initialize image cache: "
+               << cpp_strerror(*result) << dendl;
+    delete m_image_ctx->image_cache;
+    m_image_ctx->image_cache = nullptr;
+    send_close_image(*result);
+    return nullptr;
+  }
+
+  return send_set_snap(result);
 }
 
 template <typename I>
@@ -57,6 +57,9 @@ private:
    *                                             REFRESH
    *                                                |
    *                                                v
+   *                                             INIT_IMAGE_CACHE (skip if
+   *                                                |              disabled)
+   *                                                v
    *                                             SET_SNAP (skip if no snap)
    *                                                |
    *                                                v
@@ -109,6 +112,9 @@ private:
   void send_refresh();
   Context *handle_refresh(int *result);
 
+  Context *send_init_image_cache(int *result);
+  Context *handle_init_image_cache(int *result);
+
   Context *send_set_snap(int *result);
   Context *handle_set_snap(int *result);
 
@@ -470,13 +470,24 @@ void Beacon::notify_health(MDSRank const *mds)
   }
 
   // Report if we have significantly exceeded our cache size limit
-  if (mds->mdcache->get_num_inodes() > g_conf->mds_cache_size * 1.5) {
+  if (g_conf->mds_cache_size > 0 &&
+      mds->mdcache->get_num_inodes() > g_conf->mds_cache_size * 1.5) {
     std::ostringstream oss;
     oss << "Too many inodes in cache (" << mds->mdcache->get_num_inodes()
         << "/" << g_conf->mds_cache_size << "), "
         << mds->mdcache->num_inodes_with_caps << " inodes in use by clients, "
         << mds->mdcache->get_num_strays() << " stray files";
 
+    MDSHealthMetric m(MDS_HEALTH_CACHE_OVERSIZED, HEALTH_WARN, oss.str());
+    health.metrics.push_back(m);
+  } else if (g_conf->mds_cache_memory_limit &&
+	     mds->mdcache->get_cache_bytes() > g_conf->mds_cache_memory_limit * 1.5) {
+    std::ostringstream oss;
+    oss << "Too much metadata in cache (" << mds->mdcache->get_cache_bytes()
+        << "/" << g_conf->mds_cache_memory_limit << " bytes), "
+        << mds->mdcache->num_inodes_with_caps << " inodes in use by clients, "
+        << mds->mdcache->get_num_strays() << " stray files";
+
     MDSHealthMetric m(MDS_HEALTH_CACHE_OVERSIZED, HEALTH_WARN, oss.str());
     health.metrics.push_back(m);
   }
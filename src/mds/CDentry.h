@@ -184,6 +184,7 @@ public:
     versionlock(this, &versionlock_type) {
     g_num_dn++;
     g_num_dna++;
+    g_mem_dn += sizeof(*this) + name.size();
   }
   CDentry(const std::string& n, __u32 h, inodeno_t ino, unsigned char dt,
 	  snapid_t f, snapid_t l) :
@@ -196,12 +197,14 @@ public:
     versionlock(this, &versionlock_type) {
     g_num_dn++;
     g_num_dna++;
+    g_mem_dn += sizeof(*this) + name.size();
     linkage.remote_ino = ino;
     linkage.remote_d_type = dt;
   }
   ~CDentry() {
     g_num_dn--;
     g_num_dns++;
+    g_mem_dn -= sizeof(*this) + name.size();
   }
 
 
@@ -198,6 +198,7 @@ CDir::CDir(CInode *in, frag_t fg, MDCache *mdcache, bool auth) :
 {
   g_num_dir++;
   g_num_dira++;
+  g_mem_dir += sizeof(*this);
 
   state = STATE_INITIAL;
 
@@ -1643,6 +1644,7 @@ CDentry *CDir::_load_dentry(
         in->dirfragtree.swap(inode_data.dirfragtree);
         in->xattrs.swap(inode_data.xattrs);
         in->old_inodes.swap(inode_data.old_inodes);
+        in->update_mem_usage();
 	if (!in->old_inodes.empty()) {
 	  snapid_t min_first = in->old_inodes.rbegin()->first + 1;
 	  if (min_first > in->first)
@@ -405,6 +405,7 @@ protected:
   ~CDir() {
     g_num_dir--;
     g_num_dirs++;
+    g_mem_dir -= sizeof(*this);
   }
 
   const scrub_info_t *scrub_info() const {
@@ -402,6 +402,7 @@ void CInode::pop_and_dirty_projected_inode(LogSegment *ls)
     --num_projected_xattrs;
     xattrs = *px;
     delete px;
+    update_mem_usage();
   }
 
   if (projected_nodes.front()->snapnode) {
@@ -1376,6 +1377,25 @@ void CInode::decode_store(bufferlist::iterator& bl)
   bufferlist snap_blob;
   InodeStoreBase::decode(bl, snap_blob);
   decode_snap_blob(snap_blob);
+  update_mem_usage();
+}
+
+void CInode::update_mem_usage()
+{
+  size_t bytes = symlink.size();
+  for (map<string,bufferptr>::iterator p = xattrs.begin(); p != xattrs.end(); ++p)
+    bytes += sizeof(*p) + p->first.size() + p->second.length();
+  for (compact_map<snapid_t, old_inode_t>::iterator p = old_inodes.begin();
+       p != old_inodes.end();
+       ++p) {
+    bytes += sizeof(p->first) + sizeof(p->second);
+    for (map<string,bufferptr>::iterator q = p->second.xattrs.begin();
+	 q != p->second.xattrs.end();
+	 ++q)
+      bytes += sizeof(*q) + q->first.size() + q->second.length();
+  }
+  g_mem_ino += (long)bytes - (long)mem_extra;
+  mem_extra = bytes;
 }
 
 // ------------------
@@ -1765,6 +1785,7 @@ void CInode::decode_lock_state(int type, bufferlist& bl)
   case CEPH_LOCK_IXATTR:
     ::decode(inode.version, p);
     ::decode(xattrs, p);
+    update_mem_usage();
     break;
 
   case CEPH_LOCK_ISNAP:
@@ -2517,6 +2538,7 @@ old_inode_t& CInode::cow_old_inode(snapid_t follows, bool cow_head)
 	   << " to [" << old.first << "," << follows << "] on "
 	   << *this << dendl;
 
+  update_mem_usage();
   return old;
 }
 
@@ -3454,6 +3476,7 @@ void CInode::_decode_base(bufferlist::iterator& p)
   ::decode(old_inodes, p);
   ::decode(damage_flags, p);
   decode_snap(p);
+  update_mem_usage();
 }
 
 void CInode::_encode_locks_full(bufferlist& bl)
@@ -410,10 +410,16 @@ public:
   std::list<projected_inode_t*> projected_nodes;   // projected values (only defined while dirty)
   int num_projected_xattrs;
   int num_projected_srnodes;
+
+  // bytes of symlink, xattrs and old_inodes counted in g_mem_ino
+  size_t mem_extra;
   
   inode_t *project_inode(std::map<std::string,bufferptr> *px=0);
   void pop_and_dirty_projected_inode(LogSegment *ls);
 
+  /// recount the variable-sized parts after xattrs or old_inodes change
+  void update_mem_usage();
+
   projected_inode_t *get_projected_node() {
     if (projected_nodes.empty())
       return NULL;
@@ -655,6 +661,7 @@ public:
     //hack_accessed(true),
     num_projected_xattrs(0),
     num_projected_srnodes(0),
+    mem_extra(0),
     stickydir_ref(0),
     scrub_infop(NULL),
     parent(0),
@@ -681,12 +688,14 @@ public:
   {
     g_num_ino++;
     g_num_inoa++;
+    g_mem_ino += sizeof(*this);
     state = 0;  
     if (auth) state_set(STATE_AUTH);
   }
   ~CInode() {
     g_num_ino--;
     g_num_inos++;
+    g_mem_ino -= sizeof(*this) + mem_extra;
     close_dirfrags();
     close_snaprealm();
     clear_file_locks();
@@ -258,10 +258,12 @@ public:
     item_revoking_caps(this), item_client_revoking_caps(this) {
     g_num_cap++;
     g_num_capa++;
+    g_mem_cap += sizeof(*this);
   }
   ~Capability() {
     g_num_cap--;
     g_num_caps++;
+    g_mem_cap -= sizeof(*this);
   }
 
   Capability(const Capability& other);  // no copying
@@ -123,6 +123,13 @@ LogEvent::EventType LogEvent::str_to_type(std::string const &str)
 }
 
 
+void LogEvent::decode_bits()
+{
+  EMetaBlob *blob = get_metablob();
+  if (blob)
+    blob->decode_bits();
+}
+
 LogEvent *LogEvent::decode_event(bufferlist& bl, bufferlist::iterator& p, LogEvent::EventType type)
 {
   int length = bl.length() - p.get_off();
@@ -116,6 +116,14 @@ public:
    * tools can examine metablobs while traversing lists of LogEvent.
    */
   virtual EMetaBlob *get_metablob() { return NULL; }
+
+  /**
+   * Decode what decode() leaves packed until it is needed (the dentries
+   * of the metablob's dirlumps), so that journal replay can do it on a
+   * decoding thread rather than in replay() under mds_lock.  Throws
+   * buffer::error like decode().
+   */
+  virtual void decode_bits();
 };
 
 inline ostream& operator<<(ostream& out, const LogEvent &le) {
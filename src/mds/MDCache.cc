@@ -125,6 +125,14 @@ long g_num_dirs = 0;
 long g_num_dns = 0;
 long g_num_caps = 0;
 
+long g_num_snaprealm = 0;
+
+long g_mem_ino = 0;
+long g_mem_dir = 0;
+long g_mem_dn = 0;
+long g_mem_cap = 0;
+long g_mem_snaprealm = 0;
+
 set<int> SimpleLock::empty_gather_set;
 
 
@@ -197,6 +205,7 @@ MDCache::MDCache(MDSRank *m) :
 
   num_inodes_with_caps = 0;
   num_caps = 0;
+  unexpirable_bytes = 0;
 
   max_dir_commit_size = g_conf->mds_dir_max_commit_size ?
                         (g_conf->mds_dir_max_commit_size << 20) :
@@ -1546,6 +1555,7 @@ CInode *MDCache::cow_inode(CInode *in, snapid_t last)
   oldin->inode = *in->get_previous_projected_inode();
   oldin->symlink = in->symlink;
   oldin->xattrs = *in->get_previous_projected_xattrs();
+  oldin->update_mem_usage();
   oldin->inode.trim_client_ranges(last);
 
   if (in->first < in->oldest_snap)
@@ -6350,16 +6360,22 @@ void MDCache::start_recovered_truncates()
 bool MDCache::trim(int max, int count)
 {
   // trim LRU
+  uint64_t max_bytes = 0;
   if (count > 0) {
     max = lru.lru_get_size() - count;
     if (max <= 0)
       max = 1;
   } else if (max < 0) {
     max = g_conf->mds_cache_size;
-    if (max <= 0)
-      return false;
+    max_bytes = g_conf->mds_cache_memory_limit;
+    if (max <= 0) {
+      if (!max_bytes)
+	return false;
+      max = INT_MAX;
+    }
   }
-  dout(7) << "trim max=" << max << "  cur=" << lru.lru_get_size() << dendl;
+  dout(7) << "trim max=" << max << "  cur=" << lru.lru_get_size()
+	  << " max_bytes=" << max_bytes << " bytes=" << get_cache_bytes() << dendl;
 
   // process delayed eval_stray()
   stray_manager.advance_delayed();
@@ -6372,15 +6388,34 @@ bool MDCache::trim(int max, int count)
   // trim dentries from the LRU: only enough to satisfy `max`,
   // unless we see null dentries at the bottom of the LRU,
   // in which case trim all those.
+  //
+  // bytes held by pinned or unexpirable objects (and by caps) can't be
+  // freed here, so once a pass has run out of dentries to expire while
+  // still over max_bytes, don't chase the same bytes again: trim down
+  // to what was left over until the cache shrinks below it.
+  uint64_t bytes_limit = 0;
+  if (max_bytes) {
+    uint64_t bytes = get_cache_bytes();
+    if (bytes <= max_bytes)
+      unexpirable_bytes = 0;
+    else if (bytes < unexpirable_bytes)
+      unexpirable_bytes = bytes;
+    bytes_limit = MAX(max_bytes, unexpirable_bytes);
+  }
   bool trimming_nulls = true;
-  while (trimming_nulls || lru.lru_get_size() + unexpirable > (unsigned)max) {
+  bool exhausted = false;
+  while (trimming_nulls ||
+	 lru.lru_get_size() + unexpirable > (unsigned)max ||
+	 (bytes_limit && get_cache_bytes() > bytes_limit)) {
     CDentry *dn = static_cast<CDentry*>(lru.lru_expire());
     if (!dn) {
+      exhausted = true;
       break;
     }
     if (!dn->get_linkage()->is_null()) {
       trimming_nulls = false;
-      if (lru.lru_get_size() + unexpirable <= (unsigned)max) {
+      if (lru.lru_get_size() + unexpirable <= (unsigned)max &&
+	  (!bytes_limit || get_cache_bytes() <= bytes_limit)) {
         break;
       }
     }
@@ -6395,6 +6430,14 @@ bool MDCache::trim(int max, int count)
       i != unexpirables.end();
       ++i)
     lru.lru_insert_mid(*i);
+  if (max_bytes && exhausted) {
+    uint64_t bytes = get_cache_bytes();
+    if (bytes > max_bytes) {
+      dout(7) << "trim ran out of dentries to expire with " << bytes
+	      << " bytes in cache" << dendl;
+      unexpirable_bytes = bytes;
+    }
+  }
 
   // trim non-auth, non-bound subtrees
   for (map<CDir*, set<CDir*> >::iterator p = subtrees.begin();
@@ -7343,13 +7386,52 @@ void MDCache::check_memory_usage()
   mds->mlogger->set(l_mdm_heap, last.get_heap());
   mds->mlogger->set(l_mdm_malloc, last.malloc);
 
-  if (num_inodes_with_caps > g_conf->mds_cache_size) {
-    float ratio = (float)g_conf->mds_cache_size * .9 / (float)num_inodes_with_caps;
-    if (ratio < 1.0) {
-      last_recall_state = ceph_clock_now(g_ceph_context);
-      mds->server->recall_client_state(ratio);
-    }
+  float ratio = 1.0;
+  if (g_conf->mds_cache_size > 0 &&
+      num_inodes_with_caps > g_conf->mds_cache_size)
+    ratio = (float)g_conf->mds_cache_size * .9 / (float)num_inodes_with_caps;
+  // caps pin inodes, so shrink them by the share of bytes we are over
+  uint64_t max_bytes = g_conf->mds_cache_memory_limit;
+  uint64_t bytes = get_cache_bytes();
+  if (max_bytes && bytes > max_bytes)
+    ratio = MIN(ratio, (float)max_bytes * .9 / (float)bytes);
+  if (ratio < 1.0) {
+    last_recall_state = ceph_clock_now(g_ceph_context);
+    mds->server->recall_client_state(ratio);
+  }
+}
+
+uint64_t MDCache::get_cache_bytes() const
+{
+  return g_mem_ino + g_mem_dn + g_mem_dir + g_mem_cap + g_mem_snaprealm;
+}
+
+void MDCache::cache_status(Formatter *f)
+{
+  f->open_object_section("cache");
+  f->dump_unsigned("bytes", get_cache_bytes());
+  f->dump_unsigned("mds_cache_memory_limit", g_conf->mds_cache_memory_limit);
+  f->dump_unsigned("unexpirable_bytes", unexpirable_bytes);
+  f->dump_int("mds_cache_size", g_conf->mds_cache_size);
+  f->open_object_section("by_type");
+  struct {
+    const char *name;
+    long items, bytes;
+  } types[] = {
+    { "inode", g_num_ino, g_mem_ino },
+    { "dentry", g_num_dn, g_mem_dn },
+    { "dirfrag", g_num_dir, g_mem_dir },
+    { "cap", g_num_cap, g_mem_cap },
+    { "snaprealm", g_num_snaprealm, g_mem_snaprealm },
+  };
+  for (unsigned i = 0; i < sizeof(types) / sizeof(types[0]); ++i) {
+    f->open_object_section(types[i].name);
+    f->dump_int("items", types[i].items);
+    f->dump_int("bytes", types[i].bytes);
+    f->close_section();
   }
+  f->close_section();
+  f->close_section();
 }
 
 
@@ -9080,6 +9162,9 @@ void MDCache::request_cleanup(MDRequestRef& mdr)
       mds->queue_waiters(mdr->more()->waiting_for_finish);
   }
 
+  if (mdr->batch_ref)
+    mds->server->finish_batched_getattr(mdr);
+
   request_drop_locks(mdr);
 
   // drop (local) auth pins
@@ -126,6 +126,9 @@ class MDCache {
   bool readonly;
   void set_readonly() { readonly = true; }
 
+  // bytes left in cache the last time trim() ran out of dentries to expire
+  uint64_t unexpirable_bytes;
+
   CInode *strays[NUM_STRAY];         // my stray dir
   int stray_index;
 
@@ -653,6 +656,9 @@ public:
   // cache
   void set_cache_size(size_t max) { lru.lru_set_max(max); }
   size_t get_cache_size() { return lru.lru_get_size(); }
+  /// bytes held by inodes, dentries, dirfrags, caps and snaprealms
+  uint64_t get_cache_bytes() const;
+  void cache_status(Formatter *f);
 
   // trimming
   bool trim(int max=-1, int count=-1);   // trim cache
@@ -40,6 +40,7 @@
 // cons/des
 MDLog::~MDLog()
 {
+  replay_tp.stop();
   if (journaler) { delete journaler; journaler = 0; }
   if (logger) {
     g_ceph_context->get_perfcounters_collection()->remove(logger);
@@ -76,6 +77,12 @@ void MDLog::create_logger()
   plb.add_u64(l_mdl_jlat, "jlat", "Journaler flush latency");
 
   plb.add_u64_counter(l_mdl_replayed, "replayed", "Events replayed");
+  plb.add_time_avg(l_mdl_submit_lat, "submit_lat",
+      "Latency from an event being submitted to it being appended to the journal");
+  plb.add_time_avg(l_mdl_commit_lat, "commit_lat",
+      "Latency from an event being submitted to its group commit being safe");
+  plb.add_u64_avg(l_mdl_commit_events, "commit_events",
+      "Events per journal flush");
 
   // logger
   logger = plb.create_perf_counters();
@@ -353,6 +360,19 @@ public:
   }
 };
 
+/**
+ * Invoked when a journal flush the submit thread issued on its own is safe
+ */
+class C_MDL_GroupCommitted : public Context {
+  MDLog *mdlog;
+  utime_t stamp;
+public:
+  C_MDL_GroupCommitted(MDLog *m, utime_t s) : mdlog(m), stamp(s) {}
+  void finish(int r) {
+    mdlog->group_committed(stamp);
+  }
+};
+
 void MDLog::_submit_thread()
 {
   dout(10) << "_submit_thread start" << dendl;
@@ -367,6 +387,11 @@ void MDLog::_submit_thread()
 
     map<uint64_t,list<PendingEvent> >::iterator it = pending_events.begin();
     if (it == pending_events.end()) {
+      if (uncommitted_events && !group_commit_inflight &&
+	  g_conf->mds_log_group_commit) {
+	_group_commit();
+	continue;
+      }
       submit_cond.Wait(submit_mutex);
       continue;
     }
@@ -376,72 +401,130 @@ void MDLog::_submit_thread()
       continue;
     }
 
-    PendingEvent data = it->second.front();
-    it->second.pop_front();
+    // Take everything queued for this segment at once.  The emptied list
+    // stays in pending_events until the batch is appended, so that
+    // wait_for_safe() and flush() still queue behind it.
+    list<PendingEvent> batch;
+    batch.swap(it->second);
 
     submit_mutex.Unlock();
 
-    if (data.le) {
-      LogEvent *le = data.le;
-      LogSegment *ls = le->_segment;
-      // encode it, with event type
-      bufferlist bl;
-      le->encode_with_header(bl, mds->mdsmap->get_up_features());
-
-      uint64_t write_pos = journaler->get_write_pos();
-
-      le->set_start_off(write_pos);
-      if (le->get_type() == EVENT_SUBTREEMAP)
-	ls->offset = write_pos;
-
-      dout(5) << "_submit_thread " << write_pos << "~" << bl.length()
-	      << " : " << *le << dendl;
-
-      // journal it.
-      const uint64_t new_write_pos = journaler->append_entry(bl);  // bl is destroyed.
-      ls->end = new_write_pos;
-
-      MDSLogContextBase *fin;
-      if (data.fin) {
-	fin = dynamic_cast<MDSLogContextBase*>(data.fin);
-	assert(fin);
-	fin->set_write_pos(new_write_pos);
+    bool do_flush = false;
+    int appended = 0;
+    utime_t oldest;
+    for (list<PendingEvent>::iterator p = batch.begin(); p != batch.end(); ++p) {
+      PendingEvent &data = *p;
+      if (data.le) {
+	LogEvent *le = data.le;
+	LogSegment *ls = le->_segment;
+	// encode it, with event type
+	bufferlist bl;
+	le->encode_with_header(bl, mds->mdsmap->get_up_features());
+
+	uint64_t write_pos = journaler->get_write_pos();
+
+	le->set_start_off(write_pos);
+	if (le->get_type() == EVENT_SUBTREEMAP)
+	  ls->offset = write_pos;
+
+	dout(5) << "_submit_thread " << write_pos << "~" << bl.length()
+		<< " : " << *le << dendl;
+
+	// journal it.
+	const uint64_t new_write_pos = journaler->append_entry(bl);  // bl is destroyed.
+	ls->end = new_write_pos;
+
+	MDSLogContextBase *fin;
+	if (data.fin) {
+	  fin = dynamic_cast<MDSLogContextBase*>(data.fin);
+	  assert(fin);
+	  fin->set_write_pos(new_write_pos);
+	} else {
+	  fin = new C_MDL_Flushed(this, new_write_pos);
+	}
+
+	journaler->wait_for_flush(fin);
+
+	if (logger) {
+	  logger->set(l_mdl_wrpos, ls->end);
+	  logger->tinc(l_mdl_submit_lat,
+		       ceph_clock_now(g_ceph_context) - le->get_stamp());
+	}
+	if (!appended)
+	  oldest = le->get_stamp();
+	appended++;
+
+	delete le;
       } else {
-	fin = new C_MDL_Flushed(this, new_write_pos);
-      }
-
-      journaler->wait_for_flush(fin);
-
-      if (data.flush)
-	journaler->flush();
-
-      if (logger)
-	logger->set(l_mdl_wrpos, ls->end);
-
-      delete le;
-    } else {
-      if (data.fin) {
-	MDSInternalContextBase* fin =
-		dynamic_cast<MDSInternalContextBase*>(data.fin);
-	assert(fin);
-	C_MDL_Flushed *fin2 = new C_MDL_Flushed(this, fin);
-	fin2->set_write_pos(journaler->get_write_pos());
-	journaler->wait_for_flush(fin2);
+	if (data.fin) {
+	  MDSInternalContextBase* fin =
+		  dynamic_cast<MDSInternalContextBase*>(data.fin);
+	  assert(fin);
+	  C_MDL_Flushed *fin2 = new C_MDL_Flushed(this, fin);
+	  fin2->set_write_pos(journaler->get_write_pos());
+	  journaler->wait_for_flush(fin2);
+	}
       }
+      // one flush for the whole batch covers every event and waiter in it
       if (data.flush)
-	journaler->flush();
+	do_flush = true;
     }
 
+    if (do_flush)
+      journaler->flush();
+
     submit_mutex.Lock();
-    if (data.flush)
+    if (appended) {
+      if (!uncommitted_events)
+	uncommitted_stamp = oldest;
+      uncommitted_events += appended;
+    }
+    if (do_flush) {
+      if (logger)
+	logger->inc(l_mdl_commit_events, uncommitted_events);
+      uncommitted_events = 0;
       unflushed = 0;
-    else if (data.le)
-      unflushed++;
+    } else {
+      unflushed += appended;
+    }
   }
 
   submit_mutex.Unlock();
 }
 
+/*
+ * Group commit: with nothing left to append, flush what was appended
+ * since the last flush, unless a flush of ours is still in flight, in
+ * which case the events collect until it is safe.  The batches thus
+ * grow with the load and the journal latency, with no timer involved.
+ */
+void MDLog::_group_commit()
+{
+  assert(submit_mutex.is_locked_by_me());
+  dout(20) << "_group_commit " << uncommitted_events << " events" << dendl;
+
+  utime_t stamp = uncommitted_stamp;
+  if (logger)
+    logger->inc(l_mdl_commit_events, uncommitted_events);
+  uncommitted_events = 0;
+  unflushed = 0;
+  group_commit_inflight = true;
+
+  submit_mutex.Unlock();
+  journaler->flush(new C_MDL_GroupCommitted(this, stamp));
+  submit_mutex.Lock();
+}
+
+void MDLog::group_committed(utime_t stamp)
+{
+  Mutex::Locker l(submit_mutex);
+  if (logger)
+    logger->tinc(l_mdl_commit_lat, ceph_clock_now(g_ceph_context) - stamp);
+  group_commit_inflight = false;
+  if (uncommitted_events)
+    submit_cond.Signal();
+}
+
 void MDLog::wait_for_safe(MDSInternalContextBase *c)
 {
   if (!g_conf->mds_log) {
@@ -534,6 +617,9 @@ void MDLog::shutdown()
     mds->mds_lock.Lock();
   }
 
+  // nothing is decoding any more: the replay thread is gone or is us
+  replay_tp.stop();
+
   if (recovery_thread.is_started() && !recovery_thread.am_self()) {
     mds->mds_lock.Unlock();
     recovery_thread.join();
@@ -881,6 +967,8 @@ void MDLog::replay(MDSInternalContextBase *c)
     // Ensure previous instance of ReplayThread is joined before
     // we create another one
     replay_thread.join();
+  } else if (replay_threads > 1) {
+    replay_tp.start();
   }
   already_replayed = true;
 
@@ -1254,10 +1342,70 @@ void MDLog::_reformat_journal(JournalPointer const &jp_in, Journaler *old_journa
 
 
 // i am a separate thread
+struct ReplayEntry {
+  uint64_t start, end;   // journal extent of the entry
+  bufferlist bl;
+  LogEvent *le;
+  ReplayEntry() : start(0), end(0), le(NULL) {}
+};
+
+/*
+ * Decode an entry completely, including the dirlump dentries that
+ * EMetaBlob would otherwise only decode in replay(), under mds_lock.
+ */
+static LogEvent *decode_replay_entry(bufferlist& bl)
+{
+  LogEvent *le = LogEvent::decode(bl);
+  if (!le)
+    return NULL;
+  try {
+    le->decode_bits();
+  } catch (const buffer::error &e) {
+    generic_dout(0) << "failed to decode dentries of LogEvent type "
+		    << le->get_type() << dendl;
+    delete le;
+    return NULL;
+  }
+  return le;
+}
+
+/*
+ * Decode the entries read by the replay thread, split over the replay
+ * thread pool when there are enough of them.  Entries that fail to
+ * decode are left NULL.
+ */
+static void decode_replay_batch(vector<ReplayEntry>& batch, ContextWQ *wq,
+				unsigned threads)
+{
+  // a handful of events is not worth handing off to the pool
+  unsigned n = MIN(threads, batch.size() / 8);
+  if (n <= 1) {
+    for (size_t i = 0; i < batch.size(); ++i)
+      batch[i].le = decode_replay_entry(batch[i].bl);
+    return;
+  }
+
+  size_t per = (batch.size() + n - 1) / n;
+  for (size_t first = 0; first < batch.size(); first += per) {
+    size_t last = MIN(first + per, batch.size());
+    wq->queue(new FunctionContext([&batch, first, last](int r) {
+	  for (size_t i = first; i < last; ++i)
+	    batch[i].le = decode_replay_entry(batch[i].bl);
+	}));
+  }
+  wq->drain();
+}
+
 void MDLog::_replay_thread()
 {
   dout(10) << "_replay_thread start" << dendl;
 
+  // decoding events is independent of replaying them, so it is spread
+  // over the mds_log_replay_threads threads of replay_tp, reading up to
+  // 64 events per thread ahead; the Journaler keeps
+  // journaler_prefetch_periods objects of reads in flight meanwhile
+  size_t replay_batch = 64 * replay_threads;
+
   // loop
   int r = 0;
   while (1) {
@@ -1333,75 +1481,93 @@ void MDLog::_replay_thread()
     
     assert(journaler->is_readable() || mds->is_daemon_stopping());
     
-    // read it
-    uint64_t pos = journaler->get_read_pos();
-    bufferlist bl;
-    bool r = journaler->try_read_entry(bl);
-    if (!r && journaler->get_error())
+    // read what is ready, up to a batch, and decode it all at once
+    vector<ReplayEntry> batch;
+    do {
+      ReplayEntry e;
+      e.start = journaler->get_read_pos();
+      if (!journaler->try_read_entry(e.bl))
+	break;
+      e.end = journaler->get_read_pos();
+      batch.push_back(e);
+    } while (batch.size() < replay_batch && journaler->is_readable());
+    if (batch.empty() && journaler->get_error())
       continue;
-    assert(r);
-    
-    // unpack event
-    LogEvent *le = LogEvent::decode(bl);
-    if (!le) {
-      dout(0) << "_replay " << pos << "~" << bl.length() << " / " << journaler->get_write_pos() 
-	      << " -- unable to decode event" << dendl;
-      dout(0) << "dump of unknown or corrupt event:\n";
-      bl.hexdump(*_dout);
-      *_dout << dendl;
-
-      mds->clog->error() << "corrupt journal event at " << pos << "~"
-                         << bl.length() << " / "
-                         << journaler->get_write_pos();
-      if (g_conf->mds_log_skip_corrupt_events) {
-        continue;
-      } else {
-        mds->damaged_unlocked();
-        assert(0);  // Should be unreachable because damaged() calls
-                    // respawn()
+    assert(!batch.empty());
+
+    decode_replay_batch(batch, &replay_wq, replay_threads);
+
+    // replay the events in order
+    for (size_t i = 0; i < batch.size(); ++i) {
+      uint64_t pos = batch[i].start;
+      bufferlist &bl = batch[i].bl;
+      LogEvent *le = batch[i].le;
+      batch[i].le = NULL;
+
+      // unpack event
+      if (!le) {
+	dout(0) << "_replay " << pos << "~" << bl.length() << " / " << journaler->get_write_pos()
+		<< " -- unable to decode event" << dendl;
+	dout(0) << "dump of unknown or corrupt event:\n";
+	bl.hexdump(*_dout);
+	*_dout << dendl;
+
+	mds->clog->error() << "corrupt journal event at " << pos << "~"
+			   << bl.length() << " / "
+			   << journaler->get_write_pos();
+	if (g_conf->mds_log_skip_corrupt_events) {
+	  continue;
+	} else {
+	  mds->damaged_unlocked();
+	  assert(0);  // Should be unreachable because damaged() calls
+		      // respawn()
+	}
+
       }
+      le->set_start_off(pos);
 
-    }
-    le->set_start_off(pos);
-
-    // new segment?
-    if (le->get_type() == EVENT_SUBTREEMAP ||
-	le->get_type() == EVENT_RESETJOURNAL) {
-      ESubtreeMap *sle = dynamic_cast<ESubtreeMap*>(le);
-      if (sle && sle->event_seq > 0)
-	event_seq = sle->event_seq;
-      else
-	event_seq = pos;
-      segments[event_seq] = new LogSegment(event_seq, pos);
-      logger->set(l_mdl_seg, segments.size());
-    } else {
-      event_seq++;
-    }
+      // new segment?
+      if (le->get_type() == EVENT_SUBTREEMAP ||
+	  le->get_type() == EVENT_RESETJOURNAL) {
+	ESubtreeMap *sle = dynamic_cast<ESubtreeMap*>(le);
+	if (sle && sle->event_seq > 0)
+	  event_seq = sle->event_seq;
+	else
+	  event_seq = pos;
+	segments[event_seq] = new LogSegment(event_seq, pos);
+	logger->set(l_mdl_seg, segments.size());
+      } else {
+	event_seq++;
+      }
 
-    // have we seen an import map yet?
-    if (segments.empty()) {
-      dout(10) << "_replay " << pos << "~" << bl.length() << " / " << journaler->get_write_pos() 
-	       << " " << le->get_stamp() << " -- waiting for subtree_map.  (skipping " << *le << ")" << dendl;
-    } else {
-      dout(10) << "_replay " << pos << "~" << bl.length() << " / " << journaler->get_write_pos() 
-	       << " " << le->get_stamp() << ": " << *le << dendl;
-      le->_segment = get_current_segment();    // replay may need this
-      le->_segment->num_events++;
-      le->_segment->end = journaler->get_read_pos();
-      num_events++;
-
-      {
-        Mutex::Locker l(mds->mds_lock);
-        if (mds->is_daemon_stopping()) {
-          return;
-        }
-        logger->inc(l_mdl_replayed);
-        le->replay(mds);
+      // have we seen an import map yet?
+      if (segments.empty()) {
+	dout(10) << "_replay " << pos << "~" << bl.length() << " / " << journaler->get_write_pos()
+		 << " " << le->get_stamp() << " -- waiting for subtree_map.  (skipping " << *le << ")" << dendl;
+      } else {
+	dout(10) << "_replay " << pos << "~" << bl.length() << " / " << journaler->get_write_pos()
+		 << " " << le->get_stamp() << ": " << *le << dendl;
+	le->_segment = get_current_segment();    // replay may need this
+	le->_segment->num_events++;
+	le->_segment->end = batch[i].end;
+	num_events++;
+
+	{
+	  Mutex::Locker l(mds->mds_lock);
+	  if (mds->is_daemon_stopping()) {
+	    delete le;
+	    for (++i; i < batch.size(); ++i)
+	      delete batch[i].le;
+	    return;
+	  }
+	  logger->inc(l_mdl_replayed);
+	  le->replay(mds);
+	}
       }
-    }
-    delete le;
+      delete le;
 
-    logger->set(l_mdl_rdpos, pos);
+      logger->set(l_mdl_rdpos, pos);
+    }
   }
 
   // done!
@@ -35,6 +35,9 @@ enum {
   l_mdl_rdpos,
   l_mdl_jlat,
   l_mdl_replayed,
+  l_mdl_submit_lat,
+  l_mdl_commit_lat,
+  l_mdl_commit_events,
   l_mdl_last,
 };
 
@@ -43,6 +46,7 @@ enum {
 
 #include "common/Thread.h"
 #include "common/Cond.h"
+#include "common/WorkQueue.h"
 
 #include "LogSegment.h"
 
@@ -96,6 +100,11 @@ protected:
   } replay_thread;
   bool already_replayed;
 
+  // decodes journal events for the replay thread
+  unsigned replay_threads;
+  ThreadPool replay_tp;
+  ContextWQ replay_wq;
+
   friend class ReplayThread;
   friend class C_MDL_Replay;
 
@@ -138,6 +147,15 @@ protected:
   Mutex submit_mutex;
   Cond submit_cond;
 
+  // group commit: events appended since the last journal flush, and
+  // whether a flush we issued on our own is still in flight
+  int uncommitted_events;
+  utime_t uncommitted_stamp;    // submit time of the oldest of them
+  bool group_commit_inflight;
+  void _group_commit();
+  void group_committed(utime_t stamp);
+  friend class C_MDL_GroupCommitted;
+
   void set_safe_pos(uint64_t pos)
   {
     Mutex::Locker l(submit_mutex);
@@ -200,9 +218,15 @@ public:
                       logger(0),
                       replay_thread(this),
                       already_replayed(false),
+                      replay_threads(MAX(1, g_conf->mds_log_replay_threads)),
+                      replay_tp(g_ceph_context, "MDLog::replay_tp",
+                                "mds_replay_tp", replay_threads),
+                      replay_wq("MDLog::replay_wq", 0, &replay_tp),
                       recovery_thread(this),
                       event_seq(0), expiring_events(0), expired_events(0),
                       submit_mutex("MDLog::submit_mutex"),
+                      uncommitted_events(0),
+                      group_commit_inflight(false),
                       submit_thread(this),
                       cur_event(NULL) { }		  
   ~MDLog();
@@ -1750,6 +1750,9 @@ bool MDSRankDispatcher::handle_asok_command(
     } else {
       mdcache->dump_cache(path);
     }
+  } else if (command == "cache status") {
+    Mutex::Locker l(mds_lock);
+    mdcache->cache_status(f);
   } else if (command == "dump tree") {
     string root;
     int64_t depth;
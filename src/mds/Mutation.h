@@ -191,6 +191,10 @@ struct MDRequestImpl : public MutationImpl, public TrackedOp {
 
   int snap_caps;
   int getattr_caps;       ///< caps requested by getattr
+
+  // getattr/lookup: the inode or dentry this request is the batch head
+  // for, with getattr_caps as the mask (see Server::batch_getattr)
+  MDSCacheObject *batch_ref;
   bool did_early_reply;
   bool o_trunc;           ///< request is an O_TRUNC mutation
   bool has_completed;     ///< request has already completed
@@ -294,7 +298,7 @@ struct MDRequestImpl : public MutationImpl, public TrackedOp {
     session(NULL), item_session_request(this),
     client_request(params.client_req), straydn(NULL), snapid(CEPH_NOSNAP),
     tracei(NULL), tracedn(NULL), alloc_ino(0), used_prealloc_ino(0),
-    snap_caps(0), getattr_caps(0),
+    snap_caps(0), getattr_caps(0), batch_ref(NULL),
     did_early_reply(false), o_trunc(false), has_completed(false),
     slave_request(NULL), internal_op(params.internal_op), internal_op_finish(NULL),
     internal_op_private(NULL),
@@ -0,0 +1,131 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+/*
+ * Ceph - scalable distributed file system
+ *
+ * This is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License version 2.1, as published by the Free Software
+ * Foundation.  See file COPYING.
+ *
+ */
+
+#ifndef CEPH_MDS_REQUESTBATCH_H
+#define CEPH_MDS_REQUESTBATCH_H
+
+#include <list>
+#include <map>
+
+#include "include/assert.h"
+
+/**
+ * Identical read requests, batched behind the first of them (the head).
+ *
+ * While the head acquires its locks, requests for the same key queue
+ * behind it instead of acquiring locks themselves.  Once the head can
+ * reply, reply() answers each queued request from the same state, or
+ * retries it if it can no longer take that answer.  When the head goes
+ * away without replying (it failed, was forwarded or killed, or can no
+ * longer be batched), cancel() retries everything queued behind it; the
+ * first of those to be dispatched again becomes the new head.
+ *
+ * K identifies what is read, R is a request reference.
+ */
+template <typename K, typename R>
+class RequestBatch {
+public:
+  typedef K key_type;
+
+  /// what reply() and cancel() do with a queued request
+  class Ops {
+  public:
+    virtual ~Ops() {}
+    /// r was killed while queued; it is dropped
+    virtual bool killed(R& r) = 0;
+    /// whether r can still take the head's answer
+    virtual bool batchable(R& r) = 0;
+    /// answer r, checking its own access
+    virtual void answer(R& r) = 0;
+    /// dispatch r again from scratch
+    virtual void retry(R& r) = 0;
+  };
+
+private:
+  struct batch_t {
+    R head;
+    std::list<R> queued;
+  };
+  std::map<K, batch_t> batches;
+
+public:
+  /**
+   * Make r the head for k, or queue it behind the head there is.
+   *
+   * @returns true if r was queued, false if r is the head
+   */
+  bool add(const K& k, const R& r) {
+    typename std::map<K, batch_t>::iterator p = batches.find(k);
+    if (p == batches.end()) {
+      batches[k].head = r;
+      return false;
+    }
+    assert(p->second.head != r);
+    p->second.queued.push_back(r);
+    return true;
+  }
+
+  const R *get_head(const K& k) const {
+    typename std::map<K, batch_t>::const_iterator p = batches.find(k);
+    if (p == batches.end())
+      return NULL;
+    return &p->second.head;
+  }
+
+  size_t num_queued(const K& k) const {
+    typename std::map<K, batch_t>::const_iterator p = batches.find(k);
+    if (p == batches.end())
+      return 0;
+    return p->second.queued.size();
+  }
+
+  /**
+   * The head of k holds what it needs to reply: answer the requests
+   * queued behind it.  The head stays registered until cancel().
+   */
+  void reply(const K& k, const R& head, Ops& ops) {
+    typename std::map<K, batch_t>::iterator p = batches.find(k);
+    assert(p != batches.end() && p->second.head == head);
+    std::list<R> queued;
+    queued.swap(p->second.queued);
+    for (typename std::list<R>::iterator q = queued.begin();
+	 q != queued.end();
+	 ++q) {
+      if (ops.killed(*q))
+	continue;
+      if (ops.batchable(*q))
+	ops.answer(*q);
+      else
+	ops.retry(*q);
+    }
+  }
+
+  /**
+   * The head of k is going away; retry whatever is still queued behind
+   * it, in the order it arrived.
+   */
+  void cancel(const K& k, const R& head, Ops& ops) {
+    typename std::map<K, batch_t>::iterator p = batches.find(k);
+    assert(p != batches.end() && p->second.head == head);
+    std::list<R> queued;
+    queued.swap(p->second.queued);
+    batches.erase(p);
+    for (typename std::list<R>::iterator q = queued.begin();
+	 q != queued.end();
+	 ++q) {
+      if (!ops.killed(*q))
+	ops.retry(*q);
+    }
+  }
+};
+
+#endif
@@ -118,6 +118,8 @@ void Server::create_logger()
       "Client session messages", "hcs");
   plb.add_u64_counter(l_mdss_dispatch_client_request, "dispatch_client_request", "Client requests dispatched");
   plb.add_u64_counter(l_mdss_dispatch_slave_request, "dispatch_server_request", "Server requests dispatched");
+  plb.add_u64_counter(l_mdss_batched_getattr, "batched_getattr",
+      "Getattr and lookup requests answered along with an identical one");
   logger = plb.create_perf_counters();
   g_ceph_context->get_perfcounters_collection()->add(logger);
 }
@@ -928,7 +930,8 @@ void Server::recover_filelocks(CInode *in, bufferlist locks, int64_t client)
  */
 void Server::recall_client_state(float ratio)
 {
-  int max_caps_per_client = (int)(g_conf->mds_cache_size * .8);
+  int max_caps_per_client = g_conf->mds_cache_size > 0 ?
+    (int)(g_conf->mds_cache_size * .8) : INT_MAX;
   int min_caps_per_client = 100;
 
   dout(10) << "recall_client_state " << ratio
@@ -2371,6 +2374,7 @@ CInode* Server::prepare_new_inode(MDRequestRef& mdr, CDir *dir, inodeno_t useino
       dout(10) << "prepare_new_inode setting xattr " << p->first << dendl;
       in->xattrs[p->first] = p->second;
     }
+    in->update_mem_usage();
   }
 
   if (!mds->mdsmap->get_inline_data_enabled() ||
@@ -2708,6 +2712,66 @@ CDir* Server::try_open_auth_dirfrag(CInode *diri, frag_t fg, MDRequestRef& mdr)
 // ===============================================================================
 // STAT
 
+// a client holding one of these reads that field from its own cache
+static const int GETATTR_EXCL_CAPS = CEPH_CAP_LINK_EXCL | CEPH_CAP_AUTH_EXCL |
+  CEPH_CAP_FILE_EXCL | CEPH_CAP_XATTR_EXCL;
+
+/*
+ * What a getattr batch does with the requests queued behind its head:
+ * answer them from the head's locks, unless their own client has since
+ * been issued an EXCL cap on the inode (its cached value is then the
+ * authoritative one, and the head did not lock for it), in which case
+ * they are dispatched again.  Each one still gets its own access check.
+ */
+struct Server::BatchGetattrOps : public getattr_batch_t::Ops {
+  Server *server;
+  MDSRank *mds;
+  CInode *ref;
+  int mask;
+  bool is_lookup;
+
+  BatchGetattrOps(Server *s, CInode *in, int m, bool l)
+    : server(s), mds(s->mds), ref(in), mask(m), is_lookup(l) {}
+
+  bool killed(MDRequestRef& r) {
+    return r->killed;
+  }
+  bool batchable(MDRequestRef& r) {
+    return ref && (server->getattr_issued(r, ref) & GETATTR_EXCL_CAPS) == 0;
+  }
+  void answer(MDRequestRef& r) {
+    if (!server->check_access(r, ref, MAY_READ))
+      return;
+    dout(10) << "reply to batched stat on " << *r->client_request << dendl;
+    r->getattr_caps = mask;
+    mds->balancer->hit_inode(ceph_clock_now(g_ceph_context), ref, META_POP_IRD,
+			     r->client_request->get_source().num());
+    r->tracei = ref;
+    if (is_lookup)
+      r->tracedn = r->dn[0].back();
+    if (server->logger)
+      server->logger->inc(l_mdss_batched_getattr);
+    server->respond_to_request(r, 0);
+  }
+  void retry(MDRequestRef& r) {
+    dout(10) << "redispatching batched " << *r->client_request << dendl;
+    mds->queue_waiter(new C_MDS_RetryRequest(server->mdcache, r));
+  }
+};
+
+/*
+ * caps the client of a getattr holds on in; fields it holds EXCL on are
+ * read from its cache rather than locked
+ */
+int Server::getattr_issued(MDRequestRef& mdr, CInode *in)
+{
+  Capability *cap = in->get_client_cap(mdr->get_client());
+  if (cap && (mdr->snapid == CEPH_NOSNAP ||
+	      mdr->snapid <= cap->client_follows))
+    return cap->issued();
+  return 0;
+}
+
 void Server::handle_client_getattr(MDRequestRef& mdr, bool is_lookup)
 {
   MClientRequest *req = mdr->client_request;
@@ -2731,12 +2795,7 @@ void Server::handle_client_getattr(MDRequestRef& mdr, bool is_lookup)
    * handling this case here is easier than weakening rdlock
    * semantics... that would cause problems elsewhere.
    */
-  client_t client = mdr->get_client();
-  int issued = 0;
-  Capability *cap = ref->get_client_cap(client);
-  if (cap && (mdr->snapid == CEPH_NOSNAP ||
-	      mdr->snapid <= cap->client_follows))
-    issued = cap->issued();
+  int issued = getattr_issued(mdr, ref);
 
   int mask = req->head.args.getattr.mask;
   if ((mask & CEPH_CAP_LINK_SHARED) && (issued & CEPH_CAP_LINK_EXCL) == 0) rdlocks.insert(&ref->linklock);
@@ -2744,6 +2803,35 @@ void Server::handle_client_getattr(MDRequestRef& mdr, bool is_lookup)
   if ((mask & CEPH_CAP_FILE_SHARED) && (issued & CEPH_CAP_FILE_EXCL) == 0) rdlocks.insert(&ref->filelock);
   if ((mask & CEPH_CAP_XATTR_SHARED) && (issued & CEPH_CAP_XATTR_EXCL) == 0) rdlocks.insert(&ref->xattrlock);
 
+  /*
+   * Many clients stat'ing the same inode each go through the lock state
+   * machine and, when a lock is not readable, each wait and retry.
+   * Instead, queue a request behind an identical one already in flight,
+   * and answer it from the locks that one ends up holding.  Only when
+   * every requested field is rdlocked, so the answer is good for any
+   * client.
+   */
+  bool batchable = g_conf->mds_batch_getattr &&
+    mdr->snapid == CEPH_NOSNAP && !req->is_replay() &&
+    (issued & GETATTR_EXCL_CAPS) == 0;
+  if (mdr->batch_ref && !batchable) {
+    // our client got an EXCL cap while we waited
+    finish_batched_getattr(mdr);
+  } else if (batchable && !mdr->batch_ref) {
+    MDSCacheObject *batch_ref = ref;
+    if (is_lookup)
+      batch_ref = mdr->dn[0].back();
+    getattr_batch_t::key_type key(batch_ref, mask);
+    if (batch_getattr.add(key, mdr)) {
+      dout(10) << "batching " << *req << " behind "
+	       << *(*batch_getattr.get_head(key))->client_request << dendl;
+      mdr->mark_event("batched");
+      return;
+    }
+    mdr->batch_ref = batch_ref;
+    mdr->getattr_caps = mask;
+  }
+
   if (!mds->locker->acquire_locks(mdr, rdlocks, wrlocks, xlocks))
     return;
 
@@ -2757,7 +2845,13 @@ void Server::handle_client_getattr(MDRequestRef& mdr, bool is_lookup)
   mds->balancer->hit_inode(ceph_clock_now(g_ceph_context), ref, META_POP_IRD,
 			   req->get_source().num());
 
-  // reply
+  // reply, while we hold the locks the batched requests are answered from
+  if (mdr->batch_ref) {
+    BatchGetattrOps ops(this, ref, mask, is_lookup);
+    batch_getattr.reply(getattr_batch_t::key_type(mdr->batch_ref, mask),
+			mdr, ops);
+  }
+
   dout(10) << "reply to stat on " << *req << dendl;
   mdr->tracei = ref;
   if (is_lookup)
@@ -2765,6 +2859,20 @@ void Server::handle_client_getattr(MDRequestRef& mdr, bool is_lookup)
   respond_to_request(mdr, 0);
 }
 
+/*
+ * A batch head is going away.  Whatever is still queued behind it was
+ * not answered (the head failed, was forwarded or killed), so dispatch
+ * those requests again; the first one becomes the new head.
+ */
+void Server::finish_batched_getattr(MDRequestRef& mdr)
+{
+  BatchGetattrOps ops(this, NULL, mdr->getattr_caps, false);
+  batch_getattr.cancel(getattr_batch_t::key_type(mdr->batch_ref,
+						 mdr->getattr_caps),
+		       mdr, ops);
+  mdr->batch_ref = NULL;
+}
+
 struct C_MDS_LookupIno2 : public ServerContext {
   MDRequestRef mdr;
   C_MDS_LookupIno2(Server *s, MDRequestRef& r) : ServerContext(s), mdr(r) {}
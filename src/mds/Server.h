@@ -16,6 +16,7 @@
 #define CEPH_MDS_SERVER_H
 
 #include "MDSRank.h"
+#include "RequestBatch.h"
 
 class OSDMap;
 class PerfCounters;
@@ -40,6 +41,7 @@ enum {
   l_mdss_handle_client_session,
   l_mdss_dispatch_client_request,
   l_mdss_dispatch_slave_request,
+  l_mdss_batched_getattr,
   l_mdss_last,
 };
 
@@ -57,6 +59,12 @@ private:
   MDSInternalContext *reconnect_done;
   int failed_reconnects;
 
+  // getattr/lookup batches, by inode (getattr) or dentry (lookup) and
+  // mask
+  typedef RequestBatch<pair<MDSCacheObject*, int>, MDRequestRef> getattr_batch_t;
+  getattr_batch_t batch_getattr;
+  struct BatchGetattrOps;
+
   friend class MDSContinuation;
   friend class ServerContext;
   friend class ServerLogContext;
@@ -163,6 +171,8 @@ public:
 
   // requests on existing inodes.
   void handle_client_getattr(MDRequestRef& mdr, bool is_lookup);
+  void finish_batched_getattr(MDRequestRef& mdr);
+  int getattr_issued(MDRequestRef& mdr, CInode *in);
   void handle_client_lookup_ino(MDRequestRef& mdr,
 				bool want_parent, bool want_dentry);
   void _lookup_ino_2(MDRequestRef& mdr, int r);
@@ -57,7 +57,14 @@ struct SnapRealm {
     open(false), parent(0),
     num_open_past_parents(0),
     inodes_with_caps(0) 
-  { }
+  {
+    g_num_snaprealm++;
+    g_mem_snaprealm += sizeof(*this);
+  }
+  ~SnapRealm() {
+    g_num_snaprealm--;
+    g_mem_snaprealm -= sizeof(*this);
+  }
 
   bool exists(const string &name) const {
     for (map<snapid_t,SnapInfo>::const_iterator p = srnode.snaps.begin();
@@ -324,6 +324,12 @@ private:
   void get_inodes(std::set<inodeno_t> &inodes) const;
   void get_paths(std::vector<std::string> &paths) const;
   void get_dentries(std::map<dirfrag_t, std::set<std::string> > &dentries) const;
+  void decode_bits() const {
+    for (map<dirfrag_t, dirlump>::const_iterator p = lump_map.begin();
+	 p != lump_map.end();
+	 ++p)
+      p->second._decode_bits();
+  }
   entity_name_t get_client_name() const {return client_name;}
 
   void dump(Formatter *f) const;
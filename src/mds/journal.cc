@@ -570,6 +570,7 @@ void EMetaBlob::fullbit::update_inode(MDSRank *mds, CInode *in)
     in->symlink = symlink;
   }
   in->old_inodes = old_inodes;
+  in->update_mem_usage();
   if (!in->old_inodes.empty()) {
     snapid_t min_first = in->old_inodes.rbegin()->first + 1;
     if (min_first > in->first)
@@ -117,6 +117,10 @@ extern long g_num_ino, g_num_dir, g_num_dn, g_num_cap;
 extern long g_num_inoa, g_num_dira, g_num_dna, g_num_capa;
 extern long g_num_inos, g_num_dirs, g_num_dns, g_num_caps;
 
+// bytes held by the cache objects of each type (see MDCache::cache_status)
+extern long g_num_snaprealm;
+extern long g_mem_ino, g_mem_dir, g_mem_dn, g_mem_cap, g_mem_snaprealm;
+
 
 // CAPS
 
@@ -286,6 +286,8 @@ void OSDMonitor::update_from_paxos(bool *need_bootstrap)
     mon->store->apply_transaction(t);
   }
 
+  osdmap.update_mapping_cache(g_ceph_context);
+
   for (int o = 0; o < osdmap.get_max_osd(); o++) {
     if (osdmap.is_down(o)) {
       // populate down -> out map
@@ -3161,7 +3163,7 @@ namespace {
     CACHE_TARGET_FULL_RATIO,
     CACHE_MIN_FLUSH_AGE, CACHE_MIN_EVICT_AGE,
     ERASURE_CODE_PROFILE, MIN_READ_RECENCY_FOR_PROMOTE,
-    MIN_WRITE_RECENCY_FOR_PROMOTE, FAST_READ,
+    MIN_WRITE_RECENCY_FOR_PROMOTE, FAST_READ, ALLOW_EC_OVERWRITES,
     HIT_SET_GRADE_DECAY_RATE, HIT_SET_SEARCH_LAST_N,
     SCRUB_MIN_INTERVAL, SCRUB_MAX_INTERVAL, DEEP_SCRUB_INTERVAL,
     RECOVERY_PRIORITY, RECOVERY_OP_PRIORITY, SCRUB_PRIORITY,
@@ -3658,6 +3660,7 @@ bool OSDMonitor::preprocess_command(MonOpRequestRef op)
       {"min_read_recency_for_promote", MIN_READ_RECENCY_FOR_PROMOTE},
       {"min_write_recency_for_promote", MIN_WRITE_RECENCY_FOR_PROMOTE},
       {"fast_read", FAST_READ},
+      {"allow_ec_overwrites", ALLOW_EC_OVERWRITES},
       {"hit_set_grade_decay_rate", HIT_SET_GRADE_DECAY_RATE},
       {"hit_set_search_last_n", HIT_SET_SEARCH_LAST_N},
       {"scrub_min_interval", SCRUB_MIN_INTERVAL},
@@ -3687,7 +3690,7 @@ bool OSDMonitor::preprocess_command(MonOpRequestRef op)
       {HIT_SET_GRADE_DECAY_RATE}, {HIT_SET_SEARCH_LAST_N}
     };
     const choices_set_t ONLY_ERASURE_CHOICES = {
-      {ERASURE_CODE_PROFILE}
+      {ERASURE_CODE_PROFILE}, {ALLOW_EC_OVERWRITES}
     };
 
     choices_set_t selected_choices;
@@ -3848,6 +3851,9 @@ bool OSDMonitor::preprocess_command(MonOpRequestRef op)
           case FAST_READ:
             f->dump_int("fast_read", p->fast_read);
             break;
+	  case ALLOW_EC_OVERWRITES:
+	    f->dump_bool("allow_ec_overwrites", p->allows_ecoverwrites());
+	    break;
 	  case HIT_SET_GRADE_DECAY_RATE:
 	    f->dump_int("hit_set_grade_decay_rate",
 			p->hit_set_grade_decay_rate);
@@ -4005,6 +4011,10 @@ bool OSDMonitor::preprocess_command(MonOpRequestRef op)
           case FAST_READ:
             ss << "fast_read: " << p->fast_read << "\n";
             break;
+	  case ALLOW_EC_OVERWRITES:
+	    ss << "allow_ec_overwrites: " <<
+	      (p->allows_ecoverwrites() ? "true" : "false") << "\n";
+	    break;
 	  case SCRUB_MIN_INTERVAL:
 	  case SCRUB_MAX_INTERVAL:
 	  case DEEP_SCRUB_INTERVAL:
@@ -5488,6 +5498,27 @@ int OSDMonitor::prepare_command_pool_set(map<string,cmd_vartype> &cmdmap,
       ss << "expecting value 'true', 'false', '0', or '1'";
       return -EINVAL;
     }
+  } else if (var == "allow_ec_overwrites") {
+    if (!p.is_erasure()) {
+      ss << "ec overwrites can only be enabled for an erasure coded pool";
+      return -EINVAL;
+    }
+    if (val == "true" || (interr.empty() && n == 1)) {
+      if (!osdmap.test_flag(CEPH_OSDMAP_REQUIRE_KRAKEN)) {
+	ss << "ec overwrites require all osds to be kraken or later; "
+	   << "set the require_kraken_osds flag first";
+	return -EPERM;
+      }
+      p.set_flag(pg_pool_t::FLAG_EC_OVERWRITES);
+    } else if (val == "false" || (interr.empty() && n == 0)) {
+      if (p.has_flag(pg_pool_t::FLAG_EC_OVERWRITES)) {
+	ss << "ec overwrites cannot be disabled once enabled";
+	return -EINVAL;
+      }
+    } else {
+      ss << "expecting value 'true', 'false', '0', or '1'";
+      return -EINVAL;
+    }
   } else if (pool_opts_t::is_opt_name(var)) {
     if (var == "compression_mode") {
       auto cmode = Compressor::get_comp_mode_type(val);
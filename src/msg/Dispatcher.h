@@ -22,6 +22,7 @@
 
 class Messenger;
 class Message;
+struct ceph_msg_header;
 class Connection;
 class AuthAuthorizer;
 class CryptoKey;
@@ -90,6 +91,25 @@ public:
    * @param m A message which has been received
    */
   virtual void ms_fast_preprocess(Message *m) {}
+  /**
+   * Supply the buffers the data segment of an incoming Message is read
+   * into.  The Messenger reads the payload straight into them, so a
+   * Dispatcher that needs its data with some particular alignment (say
+   * for O_DIRECT writes) does not have to copy it again. This is called
+   * on fast-dispatch capable systems, for every Message with a data
+   * segment, once its front and middle have been read; an implementation
+   * must be essentially lock-free in the same way as ms_fast_preprocess.
+   *
+   * @param con The Connection the Message is arriving on
+   * @param header The header of the Message
+   * @param data Output param: empty on entry; the buffers to read the
+   * header.data_len bytes of data into
+   * @returns True if data holds at least header.data_len bytes of
+   * buffers; false to let the Messenger allocate them itself
+   */
+  virtual bool ms_get_recv_buffer(Connection *con,
+				  const ceph_msg_header &header,
+				  ceph::bufferlist& data) { return false; }
   /**
    * The Messenger calls this function to deliver a single message.
    *
@@ -577,6 +577,29 @@ public:
       (*p)->ms_fast_preprocess(m);
     }
   }
+  /**
+   * Ask the fast-dispatch capable Dispatchers, in order, for the
+   * buffers to receive the data segment of a Message into.
+   *
+   * @param con The Connection the Message is arriving on
+   * @param header The header of the Message
+   * @param data Output param: the buffers, if a Dispatcher supplied them
+   * @returns True if a Dispatcher supplied the buffers
+   */
+  bool ms_deliver_get_recv_buffer(Connection *con,
+				  const ceph_msg_header &header,
+				  bufferlist &data) {
+    for (list<Dispatcher*>::iterator p = fast_dispatchers.begin();
+	 p != fast_dispatchers.end();
+	 ++p) {
+      if ((*p)->ms_get_recv_buffer(con, header, data)) {
+	assert(data.length() >= le32_to_cpu(header.data_len));
+	return true;
+      }
+      data.clear();
+    }
+    return false;
+  }
   /**
    *  Deliver a single Message. Send it to each Dispatcher
    *  in sequence until one of them handles it.
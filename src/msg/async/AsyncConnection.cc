@@ -125,6 +125,7 @@ AsyncConnection::AsyncConnection(CephContext *cct, AsyncMessenger *m, DispatchQu
     recv_start(0), recv_end(0),
     last_active(ceph::coarse_mono_clock::now()),
     inactive_timeout_us(cct->_conf->ms_tcp_read_timeout*1000*1000),
+    data_buf_supplied(false),
     got_bad_auth(false), authorizer(NULL), replacing(false),
     is_reset_from_peer(false), once_ready(false), state_buffer(NULL), state_offset(0),
     worker(w), center(&w->center)
@@ -234,11 +235,12 @@ ssize_t AsyncConnection::_try_send(bool more)
 // Normally, only "read_message" will pass existing bufferptr in
 //
 // And it will uses readahead method to reduce small read overhead,
-// "recv_buf" is used to store read buffer
+// "recv_buf" is used to store read buffer; "bypass_prefetch" reads
+// whatever is not already in it straight into "p" however small it is
 //
 // return the remaining bytes, 0 means this buffer is finished
 // else return < 0 means error
-ssize_t AsyncConnection::read_until(unsigned len, char *p)
+ssize_t AsyncConnection::read_until(unsigned len, char *p, bool bypass_prefetch)
 {
   ldout(async_msgr->cct, 25) << __func__ << " len is " << len << " state_offset is "
                              << state_offset << dendl;
@@ -268,7 +270,7 @@ ssize_t AsyncConnection::read_until(unsigned len, char *p)
 
   recv_end = recv_start = 0;
   /* nothing left in the prefetch buffer */
-  if (len > recv_max_prefetch) {
+  if (len > recv_max_prefetch || bypass_prefetch) {
     /* this was a large read, we don't prefetch for these */
     do {
       r = read_bulk(p+state_offset, left);
@@ -476,6 +478,7 @@ void AsyncConnection::process()
 
           // Reset state
           data_buf.clear();
+          data_buf_supplied = false;
           front.clear();
           middle.clear();
           data.clear();
@@ -611,6 +614,11 @@ void AsyncConnection::process()
               if (data_buf.length() < data_len)
                 data_buf.push_back(buffer::create(data_len - data_buf.length()));
               data_blp = data_buf.begin();
+            } else if (async_msgr->ms_deliver_get_recv_buffer(this, current_header, data_buf)) {
+              ldout(async_msgr->cct,20) << __func__ << " reading into supplied rx buffer len "
+                                        << data_buf.length() << dendl;
+              data_blp = data_buf.begin();
+              data_buf_supplied = true;
             } else {
               ldout(async_msgr->cct,20) << __func__ << " allocating new rx buffer at offset " << data_off << dendl;
               alloc_aligned_buffer(data_buf, data_len, data_off);
@@ -627,7 +635,7 @@ void AsyncConnection::process()
           while (msg_left > 0) {
             bufferptr bp = data_blp.get_current_ptr();
             unsigned read = MIN(bp.length(), msg_left);
-            r = read_until(read, bp.c_str());
+            r = read_until(read, bp.c_str(), data_buf_supplied);
             if (r < 0) {
               ldout(async_msgr->cct, 1) << __func__ << " read data error " << dendl;
               goto fail;
@@ -771,7 +779,10 @@ void AsyncConnection::process()
             delay_state->queue(delay_period, release, message);
           } else if (async_msgr->ms_can_fast_dispatch(message)) {
             lock.unlock();
+            auto fast_dispatch_start = ceph::mono_clock::now();
             dispatch_queue->fast_dispatch(message);
+            logger->tinc(l_msgr_running_fast_dispatch_time,
+                         ceph::mono_clock::now() - fast_dispatch_start);
             lock.lock();
           } else {
             dispatch_queue->enqueue(message, message->get_priority(), conn_id);
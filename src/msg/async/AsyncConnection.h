@@ -62,7 +62,7 @@ class AsyncConnection : public Connection {
   ssize_t _try_send(bool more=false);
   ssize_t _send(Message *m);
   void prepare_send_message(uint64_t features, Message *m, bufferlist &bl);
-  ssize_t read_until(unsigned needed, char *p);
+  ssize_t read_until(unsigned needed, char *p, bool bypass_prefetch=false);
   ssize_t _process_connection();
   void _connect();
   void _stop();
@@ -346,6 +346,7 @@ class AsyncConnection : public Connection {
   ceph_msg_header current_header;
   bufferlist data_buf;
   bufferlist::iterator data_blp;
+  bool data_buf_supplied; ///< by a Dispatcher, see ms_get_recv_buffer
   bufferlist front, middle, data;
   ceph_msg_connect connect_msg;
   // Connecting state
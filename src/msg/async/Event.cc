@@ -65,6 +65,7 @@ int EventCenter::init(int n, unsigned i)
   assert(nevent == 0);
 
   idx = i;
+  busy_poll = cct->_conf->ms_async_busy_poll;
 
 #ifdef HAVE_EPOLL
   driver = new EpollDriver(cct);
@@ -111,6 +112,11 @@ int EventCenter::init(int n, unsigned i)
 
 EventCenter::~EventCenter()
 {
+  {
+    EventCallbackRef e;
+    while (external_ring.pop(e))
+      e->do_request(0);
+  }
   {
     std::lock_guard<std::mutex> l(external_lock);
     while (!external_events.empty()) {
@@ -261,6 +267,10 @@ void EventCenter::delete_time_event(uint64_t id)
 
 void EventCenter::wakeup()
 {
+  // a busy polling owner never sleeps
+  if (busy_poll)
+    return;
+
   ldout(cct, 2) << __func__ << dendl;
 
   char buf = 'c';
@@ -297,14 +307,17 @@ int EventCenter::process_time_events()
   return processed;
 }
 
-int EventCenter::process_events(int timeout_microseconds)
+int EventCenter::process_events(int timeout_microseconds,
+                                ceph::timespan *working_dur)
 {
   struct timeval tv;
   int numevents;
   bool trigger_time = false;
   auto now = clock_type::now();
 
-  // If exists external events, don't block
+  // If exists external events, don't block; nor ever when busy polling
+  if (busy_poll)
+    timeout_microseconds = 0;
   if (external_num_events.load()) {
     tv.tv_sec = 0;
     tv.tv_usec = 0;
@@ -329,9 +342,10 @@ int EventCenter::process_events(int timeout_microseconds)
     tv.tv_usec = timeout_microseconds % 1000000;
   }
 
-  ldout(cct, 10) << __func__ << " wait second " << tv.tv_sec << " usec " << tv.tv_usec << dendl;
+  ldout(cct, 30) << __func__ << " wait second " << tv.tv_sec << " usec " << tv.tv_usec << dendl;
   vector<FiredFileEvent> fired_events;
   numevents = driver->event_wait(fired_events, &tv);
+  auto working_start = ceph::mono_clock::now();
   for (int j = 0; j < numevents; j++) {
     int rfired = 0;
     FileEvent *event;
@@ -360,11 +374,35 @@ int EventCenter::process_events(int timeout_microseconds)
   if (trigger_time)
     numevents += process_time_events();
 
-  if (external_num_events.load()) {
+  if (busy_poll && external_num_events.load()) {
+    EventCallbackRef e;
+    while (external_ring.pop(e)) {
+      --external_num_events;
+      ldout(cct, 20) << __func__ << " do " << e << dendl;
+      e->do_request(0);
+      numevents++;
+    }
+  }
+
+  if (busy_poll ? external_spilled.load() : external_num_events.load()) {
     external_lock.lock();
     deque<EventCallbackRef> cur_process;
-    cur_process.swap(external_events);
-    external_num_events.store(0);
+    if (busy_poll) {
+      // a producer only spills after its earlier events made it into the
+      // ring, and those are visible now that we hold external_lock: run
+      // them first
+      EventCallbackRef e;
+      while (external_ring.pop(e))
+        cur_process.push_back(e);
+      cur_process.insert(cur_process.end(),
+                         external_events.begin(), external_events.end());
+      external_events.clear();
+      external_spilled.store(false);
+      external_num_events -= cur_process.size();
+    } else {
+      cur_process.swap(external_events);
+      external_num_events.store(0);
+    }
     external_lock.unlock();
     while (!cur_process.empty()) {
       EventCallbackRef e = cur_process.front();
@@ -374,11 +412,27 @@ int EventCenter::process_events(int timeout_microseconds)
       numevents++;
     }
   }
+
+  if (working_dur)
+    *working_dur = ceph::mono_clock::now() - working_start;
   return numevents;
 }
 
 void EventCenter::dispatch_event_external(EventCallbackRef e)
 {
+  if (busy_poll) {
+    // count first, so that the owner never sees an event it does not
+    // account for
+    uint64_t num = ++external_num_events;
+    if (external_spilled.load() || !external_ring.push(e)) {
+      std::lock_guard<std::mutex> l(external_lock);
+      external_events.push_back(e);
+      external_spilled.store(true);
+    }
+    ldout(cct, 20) << __func__ << " " << e << " pending " << num << dendl;
+    return;
+  }
+
   external_lock.lock();
   external_events.push_back(e);
   bool wake = !external_num_events.load();
@@ -40,11 +40,15 @@
 #include <atomic>
 #include <mutex>
 #include <condition_variable>
+#include <boost/lockfree/queue.hpp>
 
 #include "common/ceph_time.h"
 #include "common/dout.h"
 #include "net_handler.h"
 
+// re-include our assert to clobber boost's
+#include "include/assert.h"
+
 #define EVENT_NONE 0
 #define EVENT_READABLE 1
 #define EVENT_WRITABLE 2
@@ -119,6 +123,19 @@ class EventCenter {
   std::mutex external_lock;
   std::atomic_ulong external_num_events;
   deque<EventCallbackRef> external_events;
+  /*
+   * With ms_async_busy_poll the owner never sleeps in event_wait, so
+   * nobody has to write to the notify pipe: external events go through
+   * this ring instead, and only spill over into external_events (under
+   * external_lock) when it is full.  Once anything has spilled, new
+   * events keep going to external_events until the owner has drained
+   * it, so that they are not run ahead of the spilled ones.
+   */
+  bool busy_poll;
+  typedef boost::lockfree::queue<
+    EventCallbackRef, boost::lockfree::capacity<1024> > external_ring_t;
+  external_ring_t external_ring;
+  std::atomic_bool external_spilled;  ///< external_events is in use
   vector<FileEvent> file_events;
   EventDriver *driver;
   std::multimap<clock_type::time_point, TimeEvent> time_events;
@@ -141,6 +158,7 @@ class EventCenter {
   explicit EventCenter(CephContext *c):
     cct(c), nevent(0),
     external_num_events(0),
+    busy_poll(false), external_spilled(false),
     driver(NULL), time_event_next_id(1),
     notify_receive_fd(-1), notify_send_fd(-1), net(c),
     notify_handler(NULL) { }
@@ -151,13 +169,20 @@ class EventCenter {
   void set_owner();
   pthread_t get_owner() const { return owner; }
   unsigned get_id() const { return idx; }
+  bool is_busy_poll() const { return busy_poll; }
 
   // Used by internal thread
   int create_file_event(int fd, int mask, EventCallbackRef ctxt);
   uint64_t create_time_event(uint64_t milliseconds, EventCallbackRef ctxt);
   void delete_file_event(int fd, int mask);
   void delete_time_event(uint64_t id);
-  int process_events(int timeout_microseconds);
+  /**
+   * @param working_dur if not NULL, set to the time spent handling the
+   * events, not counting the wait for them
+   * @return the number of events handled
+   */
+  int process_events(int timeout_microseconds,
+                     ceph::timespan *working_dur = nullptr);
   void wakeup();
 
   // Used by external thread
@@ -19,6 +19,9 @@
 #include <netinet/in.h>
 #include <arpa/inet.h>
 #include <errno.h>
+#ifdef HAVE_SCHED
+#include <sched.h>
+#endif
 
 #include <algorithm>
 
@@ -370,3 +373,26 @@ PosixNetworkStack::PosixNetworkStack(CephContext *c, const string &t)
       lderr(cct) << __func__ << " failed to parse " << corestr << " in " << cct->_conf->ms_async_affinity_cores << dendl;
   }
 }
+
+void PosixNetworkStack::spawn_worker(unsigned i, std::function<void ()> &&func)
+{
+  threads.resize(i+1);
+  int cpuid = cct->_conf->ms_async_set_affinity ? get_cpuid(i) : -1;
+  threads[i] = std::thread([this, i, cpuid, func]() {
+#ifdef HAVE_SCHED
+    if (cpuid >= 0) {
+      // a busy polling worker should own its core
+      cpu_set_t cpuset;
+      CPU_ZERO(&cpuset);
+      CPU_SET(cpuid, &cpuset);
+      if (sched_setaffinity(0, sizeof(cpuset), &cpuset) < 0)
+        lderr(cct) << __func__ << " worker " << i << " failed to bind to cpu "
+                   << cpuid << ": " << cpp_strerror(errno) << dendl;
+      else
+        ldout(cct, 10) << __func__ << " worker " << i << " bound to cpu "
+                       << cpuid << dendl;
+    }
+#endif
+    func();
+  });
+}
@@ -38,12 +38,16 @@ void NetworkStack::add_thread(unsigned i, std::function<void ()> &thread)
       while (!w->done) {
         ldout(cct, 30) << __func__ << " calling event process" << dendl;
 
-        int r = w->center.process_events(EventMaxWaitUs);
+        ceph::timespan dur;
+        int r = w->center.process_events(EventMaxWaitUs, &dur);
         if (r < 0) {
           ldout(cct, 20) << __func__ << " process events failed: "
                          << cpp_strerror(errno) << dendl;
           // TODO do something?
+        } else if (r == 0 && w->center.is_busy_poll()) {
+          w->perf_logger->inc(l_msgr_idle_polls);
         }
+        w->perf_logger->tinc(l_msgr_running_total_time, dur);
       }
       w->reset();
     }
@@ -192,6 +192,9 @@ enum {
   l_msgr_send_bytes,
   l_msgr_created_connections,
   l_msgr_active_connections,
+  l_msgr_running_total_time,
+  l_msgr_running_fast_dispatch_time,
+  l_msgr_idle_polls,
   l_msgr_last,
 };
 
@@ -227,6 +230,9 @@ class Worker {
     plb.add_u64_counter(l_msgr_send_bytes, "msgr_send_bytes", "Network received bytes");
     plb.add_u64_counter(l_msgr_active_connections, "msgr_active_connections", "Active connection number");
     plb.add_u64_counter(l_msgr_created_connections, "msgr_created_connections", "Created connection number");
+    plb.add_time(l_msgr_running_total_time, "msgr_running_total_time", "Time spent handling events");
+    plb.add_time_avg(l_msgr_running_fast_dispatch_time, "msgr_running_fast_dispatch_time", "Time spent in fast dispatch");
+    plb.add_u64_counter(l_msgr_idle_polls, "msgr_idle_polls", "Busy polls that found no events");
 
     perf_logger = plb.create_perf_counters();
     cct->get_perfcounters_collection()->add(perf_logger);
@@ -2046,8 +2046,13 @@ int Pipe::read_message(Message **pm, AuthSessionHandler* auth_handler)
 	}
       } else {
 	if (!newbuf.length()) {
-	  ldout(msgr->cct,20) << "reader allocating new rx buffer at offset " << offset << dendl;
-	  alloc_aligned_buffer(newbuf, data_len, data_off);
+	  if (msgr->ms_deliver_get_recv_buffer(connection_state.get(), header,
+					       newbuf)) {
+	    ldout(msgr->cct,20) << "reader using supplied rx buffer at offset " << offset << dendl;
+	  } else {
+	    ldout(msgr->cct,20) << "reader allocating new rx buffer at offset " << offset << dendl;
+	    alloc_aligned_buffer(newbuf, data_len, data_off);
+	  }
 	  blp = newbuf.begin();
 	  blp.advance(offset);
 	}
@@ -18,6 +18,9 @@
 #include <unistd.h>
 
 #include "KernelDevice.h"
+#if defined(HAVE_LIBURING)
+#include "IOUringDevice.h"
+#endif
 #if defined(HAVE_SPDK)
 #include "NVMEDevice.h"
 #endif
@@ -45,7 +48,7 @@ void IOContext::aio_wait()
 
 BlockDevice *BlockDevice::create(const string& path, aio_callback_t cb, void *cbpriv)
 {
-  string type = "kernel";
+  string type = g_conf->bdev_type;
   char buf[PATH_MAX];
   int r = ::readlink(path.c_str(), buf, sizeof(buf));
   if (r >= 0) {
@@ -58,6 +61,11 @@ BlockDevice *BlockDevice::create(const string& path, aio_callback_t cb, void *cb
   if (type == "kernel") {
     return new KernelDevice(cb, cbpriv);
   }
+#if defined(HAVE_LIBURING)
+  if (type == "io_uring") {
+    return new IOUringDevice(cb, cbpriv);
+  }
+#endif
 #if defined(HAVE_SPDK)
   if (type == "ust-nvme") {
     return new NVMEDevice(cb, cbpriv);
@@ -2422,9 +2422,88 @@ BlueStore::OnodeRef BlueStore::Collection::get_onode(
 
 void BlueStore::Collection::trim_cache()
 {
+  uint64_t onode_max, buffer_max;
+  store->_get_cache_limits(&onode_max, &buffer_max);
   cache->trim(
-    g_conf->bluestore_onode_cache_size / store->cache_shards.size(),
-    g_conf->bluestore_buffer_cache_size / store->cache_shards.size());
+    onode_max / store->cache_shards.size(),
+    buffer_max / store->cache_shards.size());
+}
+
+// CacheBalancer
+
+#undef dout_prefix
+#define dout_prefix *_dout << "bluestore.CacheBalancer(" << this << ") "
+
+BlueStore::CacheBalancer::CacheBalancer(
+  double meta_ratio, double kv_ratio,
+  double min_ratio, double step)
+  : min_ratio(min_ratio), step(step)
+{
+  ratio[CACHE_ONODE] = meta_ratio;
+  ratio[CACHE_KV] = kv_ratio;
+  ratio[CACHE_BUFFER] = MAX(0.0, 1.0 - meta_ratio - kv_ratio);
+}
+
+int BlueStore::CacheBalancer::balance(uint64_t total, const sample_t *samples)
+{
+  // a cache using less than this much of its share does not need more
+  const double full = .9;
+
+  // grow the full cache with the worst miss ratio
+  int grow = -1;
+  double worst = 0;
+  for (int i = 0; i < CACHE_MAX; ++i) {
+    const sample_t& s = samples[i];
+    uint64_t accesses = s.hits + s.misses;
+    if (!s.tracked || accesses == 0)
+      continue;
+    if (s.used < full * get_target(total, i))
+      continue;
+    double miss_ratio = (double)s.misses / (double)accesses;
+    if (miss_ratio > worst) {
+      worst = miss_ratio;
+      grow = i;
+    }
+  }
+  if (grow < 0)
+    return -1;
+
+  // take from whichever cache leaves the most of its share idle ...
+  int shrink = -1;
+  uint64_t most_idle = 0;
+  for (int i = 0; i < CACHE_MAX; ++i) {
+    if (i == grow || !samples[i].tracked || !can_shrink(i))
+      continue;
+    uint64_t target = get_target(total, i);
+    if (samples[i].used < full * target &&
+	target - samples[i].used > most_idle) {
+      most_idle = target - samples[i].used;
+      shrink = i;
+    }
+  }
+  // ... or else from the one that misses least
+  if (shrink < 0) {
+    double best = worst;
+    for (int i = 0; i < CACHE_MAX; ++i) {
+      if (i == grow || !samples[i].tracked || !can_shrink(i))
+	continue;
+      uint64_t accesses = samples[i].hits + samples[i].misses;
+      double miss_ratio = accesses ?
+	(double)samples[i].misses / (double)accesses : 0;
+      if (miss_ratio < best) {
+	best = miss_ratio;
+	shrink = i;
+      }
+    }
+  }
+  if (shrink < 0)
+    return -1;
+
+  dout(20) << __func__ << " moving " << step << " from " << shrink
+	   << " to " << grow << dendl;
+  ratio[shrink] -= step;
+  ratio[grow] += step;
+  return grow;
 }
 
 // =======================================================
@@ -2452,6 +2531,8 @@ BlueStore::BlueStore(CephContext *cct, const string& path)
     fsid_fd(-1),
     mounted(false),
     coll_lock("BlueStore::coll_lock"),
+    cache_autotune(cct->_conf->bluestore_cache_autotune),
+    cache_tune_thread(this),
     throttle_ops(cct, "bluestore_max_ops", cct->_conf->bluestore_max_ops),
     throttle_bytes(cct, "bluestore_max_bytes", cct->_conf->bluestore_max_bytes),
     throttle_wal_ops(cct, "bluestore_wal_max_ops",
@@ -2471,7 +2552,11 @@ BlueStore::BlueStore(CephContext *cct, const string& path)
 	     &wal_tp),
     m_finisher_num(1),
     kv_sync_thread(this),
+    kv_commit_thread(this),
+    kv_finalize_thread(this),
     kv_stop(false),
+    kv_commit_stop(false),
+    kv_finalize_stop(false),
     logger(NULL),
     debug_read_error_lock("BlueStore::debug_read_error_lock"),
     csum_type(Checksummer::CSUM_CRC32C),
@@ -2480,6 +2565,7 @@ BlueStore::BlueStore(CephContext *cct, const string& path)
   _init_logger();
   g_ceph_context->_conf->add_observer(this);
   set_cache_shards(1);
+  _cache_tune_seed();
 
   if (cct->_conf->bluestore_shard_finishers) {
     m_finisher_num = cct->_conf->osd_op_num_shards;
@@ -2685,6 +2771,22 @@ void BlueStore::_init_logger()
 	    "Onode extent map reshard events");
   b.add_u64(l_bluestore_gc, "bluestore_gc", "Sum for garbage collection reads");
   b.add_u64(l_bluestore_gc_bytes, "bluestore_gc_bytes", "garbage collected bytes");
+  b.add_time_avg(l_bluestore_kv_flush_lat, "kv_flush_lat",
+    "Average kv_sync thread block device flush latency");
+  b.add_time_avg(l_bluestore_kv_commit_lat, "kv_commit_lat",
+    "Average kv_commit thread submit and sync commit latency");
+  b.add_time_avg(l_bluestore_kv_finalize_lat, "kv_finalize_lat",
+    "Average kv_finalize thread completion processing latency");
+  b.add_time_avg(l_bluestore_kv_commit_wait_lat, "kv_commit_wait_lat",
+    "Average time a flushed batch waits for the kv_commit thread");
+  b.add_time_avg(l_bluestore_kv_finalize_wait_lat, "kv_finalize_wait_lat",
+    "Average time a committed batch waits for the kv_finalize thread");
+  b.add_u64(l_bluestore_cache_onode_target, "bluestore_cache_onode_target",
+    "Bytes of the cache memory target given to onodes");
+  b.add_u64(l_bluestore_cache_buffer_target, "bluestore_cache_buffer_target",
+    "Bytes of the cache memory target given to buffers");
+  b.add_u64(l_bluestore_cache_kv_target, "bluestore_cache_kv_target",
+    "Bytes of the cache memory target given to the kv store");
   logger = b.create_perf_counters();
   g_ceph_context->get_perfcounters_collection()->add(logger);
 }
@@ -4009,7 +4111,8 @@ int BlueStore::mount()
     f->start();
   }
   wal_tp.start();
-  kv_sync_thread.create("bstore_kv_sync");
+  _kv_start();
+  _cache_tune_start();
 
   r = _wal_replay();
   if (r < 0)
@@ -4022,6 +4125,7 @@ int BlueStore::mount()
   return 0;
 
  out_stop:
+  _cache_tune_stop();
   _kv_stop();
   wal_wq.drain();
   wal_tp.stop();
@@ -4055,6 +4159,8 @@ int BlueStore::umount()
   _reap_collections();
   coll_map.clear();
 
+  dout(20) << __func__ << " stopping cache tune thread" << dendl;
+  _cache_tune_stop();
   dout(20) << __func__ << " stopping kv thread" << dendl;
   _kv_stop();
   dout(20) << __func__ << " draining wal_wq" << dendl;
@@ -4614,8 +4720,7 @@ void BlueStore::_sync()
   bdev->flush();
 
   std::unique_lock<std::mutex> l(kv_lock);
-  while (!kv_committing.empty() ||
-	 !kv_queue.empty()) {
+  while (!_kv_pipeline_empty()) {
     dout(20) << " waiting for kv to commit" << dendl;
     kv_sync_cond.wait(l);
   }
@@ -4738,6 +4843,151 @@ void BlueStore::_update_cache_logger()
   logger->set(l_bluestore_buffer_bytes, num_buffer_bytes);
 }
 
+void BlueStore::_cache_tune_seed()
+{
+  // start from the configured shares, so collections trimming before the
+  // tuner's first pass (wal replay in mount, all of fsck) don't empty
+  // their caches
+  CacheBalancer balancer(g_conf->bluestore_cache_meta_ratio,
+			 g_conf->bluestore_cache_kv_ratio,
+			 g_conf->bluestore_cache_autotune_min_ratio,
+			 g_conf->bluestore_cache_autotune_step);
+  uint64_t target = g_conf->bluestore_cache_memory_target;
+  uint64_t onode_target =
+    balancer.get_target(target, CacheBalancer::CACHE_ONODE);
+  cache_onode_max = MAX(MAX(1u, cache_shards.size()),
+			onode_target / _cache_onode_bytes_estimate());
+  cache_buffer_max =
+    balancer.get_target(target, CacheBalancer::CACHE_BUFFER);
+  dout(10) << __func__ << " onode " << cache_onode_max
+	   << " buffer " << cache_buffer_max << dendl;
+}
+
+void BlueStore::_cache_tune_start()
+{
+  if (!cache_autotune)
+    return;
+  _cache_tune_seed();
+  dout(10) << __func__ << dendl;
+  cache_tune_stop = false;
+  cache_tune_thread.create("bstore_cache_tune");
+}
+
+void BlueStore::_cache_tune_stop()
+{
+  if (!cache_tune_thread.is_started())
+    return;
+  dout(10) << __func__ << dendl;
+  {
+    std::lock_guard<std::mutex> l(cache_tune_lock);
+    cache_tune_stop = true;
+    cache_tune_cond.notify_all();
+  }
+  cache_tune_thread.join();
+  cache_tune_stop = false;
+}
+
+void BlueStore::_cache_tune_thread()
+{
+  dout(10) << __func__ << " start" << dendl;
+  CacheBalancer balancer(g_conf->bluestore_cache_meta_ratio,
+			 g_conf->bluestore_cache_kv_ratio,
+			 g_conf->bluestore_cache_autotune_min_ratio,
+			 g_conf->bluestore_cache_autotune_step);
+  uint64_t last_onode_hits = 0, last_onode_misses = 0;
+  uint64_t last_buffer_hits = 0, last_buffer_misses = 0;
+  uint64_t last_kv_hits = 0, last_kv_misses = 0;
+  bool first = true;
+
+  std::unique_lock<std::mutex> l(cache_tune_lock);
+  while (!cache_tune_stop) {
+    uint64_t target = g_conf->bluestore_cache_memory_target;
+
+    uint64_t num_onodes = 0, num_extents = 0, num_blobs = 0;
+    uint64_t num_buffers = 0, num_buffer_bytes = 0;
+    for (auto c : cache_shards) {
+      c->add_stats(&num_onodes, &num_extents, &num_blobs,
+		   &num_buffers, &num_buffer_bytes);
+    }
+    // approximate the in-memory footprint of the onode cache: the onodes
+    // themselves plus their decoded extent maps and blobs.
+    uint64_t onode_bytes = num_onodes * sizeof(Onode) +
+      num_extents * sizeof(Extent) +
+      num_blobs * (sizeof(Blob) + sizeof(SharedBlob));
+    uint64_t bytes_per_onode = num_onodes ?
+      MAX(1, onode_bytes / num_onodes) : _cache_onode_bytes_estimate();
+
+    CacheBalancer::sample_t samples[CacheBalancer::CACHE_MAX];
+    uint64_t v;
+    samples[CacheBalancer::CACHE_ONODE].used = onode_bytes;
+    v = logger->get(l_bluestore_onode_hits);
+    samples[CacheBalancer::CACHE_ONODE].hits = v - last_onode_hits;
+    last_onode_hits = v;
+    v = logger->get(l_bluestore_onode_misses);
+    samples[CacheBalancer::CACHE_ONODE].misses = v - last_onode_misses;
+    last_onode_misses = v;
+
+    samples[CacheBalancer::CACHE_BUFFER].used = num_buffer_bytes;
+    v = logger->get(l_bluestore_buffer_hit_bytes);
+    samples[CacheBalancer::CACHE_BUFFER].hits = v - last_buffer_hits;
+    last_buffer_hits = v;
+    v = logger->get(l_bluestore_buffer_miss_bytes);
+    samples[CacheBalancer::CACHE_BUFFER].misses = v - last_buffer_misses;
+    last_buffer_misses = v;
+
+    int64_t kv_used = db->get_cache_usage();
+    uint64_t kv_hits, kv_misses;
+    if (kv_used >= 0 && db->get_cache_stats(&kv_hits, &kv_misses) == 0) {
+      samples[CacheBalancer::CACHE_KV].used = kv_used;
+      samples[CacheBalancer::CACHE_KV].hits = kv_hits - last_kv_hits;
+      samples[CacheBalancer::CACHE_KV].misses = kv_misses - last_kv_misses;
+      last_kv_hits = kv_hits;
+      last_kv_misses = kv_misses;
+    } else {
+      // without hit/miss data the kv cache keeps its initial share
+      samples[CacheBalancer::CACHE_KV].tracked = false;
+    }
+
+    if (!first) {
+      balancer.balance(target, samples);
+    }
+    first = false;
+
+    uint64_t onode_target =
+      balancer.get_target(target, CacheBalancer::CACHE_ONODE);
+    uint64_t buffer_target =
+      balancer.get_target(target, CacheBalancer::CACHE_BUFFER);
+    uint64_t kv_target = balancer.get_target(target, CacheBalancer::CACHE_KV);
+    cache_onode_max = MAX(cache_shards.size(), onode_target / bytes_per_onode);
+    cache_buffer_max = buffer_target;
+    db->set_cache_capacity(kv_target);
+    logger->set(l_bluestore_cache_onode_target, onode_target);
+    logger->set(l_bluestore_cache_buffer_target, buffer_target);
+    logger->set(l_bluestore_cache_kv_target, kv_target);
+    dout(20) << __func__ << " target " << target
+	     << " onode " << onode_target << " (" << cache_onode_max
+	     << " onodes at ~" << bytes_per_onode << " bytes)"
+	     << " buffer " << buffer_target
+	     << " kv " << kv_target << " (used " << kv_used << ")" << dendl;
+
+    // trimming normally happens as collections are used; make sure a
+    // shrinking share takes effect even on idle shards.
+    l.unlock();
+    for (auto c : cache_shards) {
+      c->trim(cache_onode_max / cache_shards.size(),
+	      cache_buffer_max / cache_shards.size());
+    }
+    l.lock();
+
+    if (cache_tune_stop)
+      break;
+    cache_tune_cond.wait_for(
+      l,
+      std::chrono::duration<double>(g_conf->bluestore_cache_autotune_interval));
+  }
+  dout(10) << __func__ << " finish" << dendl;
+}
+
 // ---------------
 // read operations
 
@@ -6496,35 +6746,77 @@ void BlueStore::_kv_sync_thread()
   dout(10) << __func__ << " start" << dendl;
   std::unique_lock<std::mutex> l(kv_lock);
   while (true) {
-    assert(kv_committing.empty());
-    assert(wal_cleaning.empty());
+    assert(kv_flushing.empty());
     if (kv_queue.empty() && wal_cleanup_queue.empty()) {
       if (kv_stop)
 	break;
       dout(20) << __func__ << " sleep" << dendl;
-      kv_sync_cond.notify_all();
+      if (_kv_pipeline_empty())
+	kv_sync_cond.notify_all();
       kv_cond.wait(l);
       dout(20) << __func__ << " wake" << dendl;
     } else {
-      dout(20) << __func__ << " committing " << kv_queue.size()
+      dout(20) << __func__ << " flushing " << kv_queue.size()
 	       << " cleaning " << wal_cleanup_queue.size() << dendl;
-      kv_committing.swap(kv_queue);
-      wal_cleaning.swap(wal_cleanup_queue);
+      kv_flushing.txcs.swap(kv_queue);
+      kv_flushing.wal_cleaning.swap(wal_cleanup_queue);
+      l.unlock();
+
+      // flush/barrier on block device.  this covers both the data
+      // written by the txcs and the wal ios whose keys we are about to
+      // clean up, and runs while kv_commit_thread commits the previous
+      // batch.
       utime_t start = ceph_clock_now(NULL);
+      bdev->flush();
+      utime_t finish = ceph_clock_now(NULL);
+      logger->tinc(l_bluestore_kv_flush_lat, finish - start);
+
+      l.lock();
+      kv_flushed.push_back(kv_batch_t());
+      kv_flushed.back().claim_append(kv_flushing);
+      kv_flushed.back().stamp = finish;
+      kv_commit_cond.notify_one();
+    }
+  }
+  dout(10) << __func__ << " finish" << dendl;
+}
+
+void BlueStore::_kv_commit_thread()
+{
+  dout(10) << __func__ << " start" << dendl;
+  std::unique_lock<std::mutex> l(kv_lock);
+  while (true) {
+    assert(kv_committing.empty());
+    if (kv_flushed.empty()) {
+      if (kv_commit_stop)
+	break;
+      dout(20) << __func__ << " sleep" << dendl;
+      kv_commit_cond.wait(l);
+      dout(20) << __func__ << " wake" << dendl;
+    } else {
+      // commit everything that has been flushed so far as one group
+      utime_t start = ceph_clock_now(NULL);
+      while (!kv_flushed.empty()) {
+	logger->tinc(l_bluestore_kv_commit_wait_lat,
+		     start - kv_flushed.front().stamp);
+	kv_committing.claim_append(kv_flushed.front());
+	kv_flushed.pop_front();
+      }
+      dout(20) << __func__ << " committing " << kv_committing.txcs.size()
+	       << " cleaning " << kv_committing.wal_cleaning.size() << dendl;
       l.unlock();
 
-      dout(30) << __func__ << " committing txc " << kv_committing << dendl;
-      dout(30) << __func__ << " wal_cleaning txc " << wal_cleaning << dendl;
+      dout(30) << __func__ << " committing txc " << kv_committing.txcs
+	       << dendl;
+      dout(30) << __func__ << " wal_cleaning txc "
+	       << kv_committing.wal_cleaning << dendl;
 
       alloc->commit_start();
 
-      // flush/barrier on block device
-      bdev->flush();
-
       uint64_t high_nid = 0, high_blobid = 0;
       if (!g_conf->bluestore_sync_transaction &&
 	  !g_conf->bluestore_sync_submit_transaction) {
-	for (auto txc : kv_committing) {
+	for (auto txc : kv_committing.txcs) {
 	  _txc_finalize_kv(txc, txc->t);
 	  if (txc->last_nid > high_nid) {
 	    high_nid = txc->last_nid;
@@ -6534,8 +6826,8 @@ void BlueStore::_kv_sync_thread()
 	  }
           txc->log_state_latency(logger, l_bluestore_state_kv_queued_lat);
 	}
-	if (!kv_committing.empty()) {
-	  TransContext *first_txc = kv_committing.front();
+	if (!kv_committing.txcs.empty()) {
+	  TransContext *first_txc = kv_committing.txcs.front();
 	  std::lock_guard<std::mutex> l(id_lock);
 	  if (high_nid + g_conf->bluestore_nid_prealloc/2 > nid_max) {
 	    nid_max = high_nid + g_conf->bluestore_nid_prealloc;
@@ -6552,7 +6844,7 @@ void BlueStore::_kv_sync_thread()
 	    dout(10) << __func__ << " blobid_max now " << blobid_max << dendl;
 	  }
 	}
-	for (auto txc : kv_committing) {
+	for (auto txc : kv_committing.txcs) {
 	  int r = db->submit_transaction(txc->t);
 	  assert(r == 0);
 	}
@@ -6578,12 +6870,10 @@ void BlueStore::_kv_sync_thread()
       }
 
       // cleanup sync wal keys
-      for (std::deque<TransContext *>::iterator it = wal_cleaning.begin();
-	    it != wal_cleaning.end();
-	    ++it) {
-	bluestore_wal_transaction_t& wt =*(*it)->wal_txn;
+      for (auto txc : kv_committing.wal_cleaning) {
+	bluestore_wal_transaction_t& wt = *txc->wal_txn;
 	// kv metadata updates
-	_txc_finalize_kv(*it, t);
+	_txc_finalize_kv(txc, t);
 	// cleanup the wal
 	string key;
 	get_wal_key(wt.seq, &key);
@@ -6594,32 +6884,74 @@ void BlueStore::_kv_sync_thread()
 
       utime_t finish = ceph_clock_now(NULL);
       utime_t dur = finish - start;
-      dout(20) << __func__ << " committed " << kv_committing.size()
-	       << " cleaned " << wal_cleaning.size()
+      logger->tinc(l_bluestore_kv_commit_lat, dur);
+      dout(20) << __func__ << " committed " << kv_committing.txcs.size()
+	       << " cleaned " << kv_committing.wal_cleaning.size()
 	       << " in " << dur << dendl;
-      while (!kv_committing.empty()) {
-	TransContext *txc = kv_committing.front();
+
+      // the sync commit above made this batch's releases durable
+      alloc->commit_finish();
+
+      if (bluefs) {
+	if (!bluefs_gift_extents.empty()) {
+	  _commit_bluefs_freespace(bluefs_gift_extents);
+	}
+      }
+
+      l.lock();
+      kv_committed.push_back(kv_batch_t());
+      kv_committed.back().claim_append(kv_committing);
+      kv_committed.back().stamp = finish;
+      kv_finalize_cond.notify_one();
+    }
+  }
+  dout(10) << __func__ << " finish" << dendl;
+}
+
+void BlueStore::_kv_finalize_thread()
+{
+  dout(10) << __func__ << " start" << dendl;
+  std::unique_lock<std::mutex> l(kv_lock);
+  while (true) {
+    assert(kv_finalizing.empty());
+    if (kv_committed.empty()) {
+      if (kv_finalize_stop)
+	break;
+      dout(20) << __func__ << " sleep" << dendl;
+      if (_kv_pipeline_empty())
+	kv_sync_cond.notify_all();
+      kv_finalize_cond.wait(l);
+      dout(20) << __func__ << " wake" << dendl;
+    } else {
+      utime_t start = ceph_clock_now(NULL);
+      while (!kv_committed.empty()) {
+	logger->tinc(l_bluestore_kv_finalize_wait_lat,
+		     start - kv_committed.front().stamp);
+	kv_finalizing.claim_append(kv_committed.front());
+	kv_committed.pop_front();
+      }
+      l.unlock();
+
+      // completions fan out to the (sharded) finishers from
+      // _txc_finish_kv; wal work goes to wal_wq.
+      while (!kv_finalizing.txcs.empty()) {
+	TransContext *txc = kv_finalizing.txcs.front();
 	_txc_state_proc(txc);
-	kv_committing.pop_front();
+	kv_finalizing.txcs.pop_front();
       }
-      while (!wal_cleaning.empty()) {
-	TransContext *txc = wal_cleaning.front();
+      while (!kv_finalizing.wal_cleaning.empty()) {
+	TransContext *txc = kv_finalizing.wal_cleaning.front();
 	_txc_state_proc(txc);
-	wal_cleaning.pop_front();
+	kv_finalizing.wal_cleaning.pop_front();
       }
 
-      alloc->commit_finish();
-
       // this is as good a place as any ...
       _reap_collections();
 
       _update_cache_logger();
 
-      if (bluefs) {
-	if (!bluefs_gift_extents.empty()) {
-	  _commit_bluefs_freespace(bluefs_gift_extents);
-	}
-      }
+      logger->tinc(l_bluestore_kv_finalize_lat,
+		   ceph_clock_now(NULL) - start);
 
       l.lock();
     }
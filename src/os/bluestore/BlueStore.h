@@ -94,6 +94,14 @@ enum {
   l_bluestore_onode_reshard,
   l_bluestore_gc,
   l_bluestore_gc_bytes,
+  l_bluestore_kv_flush_lat,
+  l_bluestore_kv_commit_lat,
+  l_bluestore_kv_finalize_lat,
+  l_bluestore_kv_commit_wait_lat,
+  l_bluestore_kv_finalize_wait_lat,
+  l_bluestore_cache_onode_target,
+  l_bluestore_cache_buffer_target,
+  l_bluestore_cache_kv_target,
   l_bluestore_last
 };
 
@@ -988,6 +996,43 @@ public:
 #endif
   };
 
+  /// split a single memory budget between the onode, buffer and kv
+  /// caches, moving memory towards whichever full cache misses most.
+  struct CacheBalancer {
+    enum {
+      CACHE_ONODE = 0,
+      CACHE_BUFFER,
+      CACHE_KV,
+      CACHE_MAX
+    };
+
+    struct sample_t {
+      uint64_t used = 0;     ///< bytes currently cached
+      uint64_t hits = 0;     ///< hits since the previous sample
+      uint64_t misses = 0;   ///< misses since the previous sample
+      bool tracked = true;   ///< false if we know nothing about hits/misses
+    };
+
+    double ratio[CACHE_MAX]; ///< share of the budget per cache
+    double min_ratio;        ///< no cache shrinks below this share
+    double step;             ///< share moved per balance() call
+
+    CacheBalancer(double meta_ratio, double kv_ratio,
+		  double min_ratio, double step);
+
+    uint64_t get_target(uint64_t total, int which) const {
+      return llround(total * ratio[which]);
+    }
+
+    bool can_shrink(int which) const {
+      // allow for rounding error in the accumulated ratios
+      return ratio[which] - step >= min_ratio - .0001;
+    }
+
+    /// move one step of the budget; return the cache that grew, or -1
+    int balance(uint64_t total, const sample_t *samples);
+  };
+
   struct OnodeSpace {
     Cache *cache;
     ceph::unordered_map<ghobject_t,OnodeRef> onode_map;  ///< forward lookups
@@ -1406,6 +1451,48 @@ public:
       return NULL;
     }
   };
+  struct CacheTuneThread : public Thread {
+    BlueStore *store;
+    explicit CacheTuneThread(BlueStore *s) : store(s) {}
+    void *entry() {
+      store->_cache_tune_thread();
+      return NULL;
+    }
+  };
+  struct KVCommitThread : public Thread {
+    BlueStore *store;
+    explicit KVCommitThread(BlueStore *s) : store(s) {}
+    void *entry() {
+      store->_kv_commit_thread();
+      return NULL;
+    }
+  };
+  struct KVFinalizeThread : public Thread {
+    BlueStore *store;
+    explicit KVFinalizeThread(BlueStore *s) : store(s) {}
+    void *entry() {
+      store->_kv_finalize_thread();
+      return NULL;
+    }
+  };
+
+  /// a group of txcs moving through the kv commit pipeline together
+  struct kv_batch_t {
+    deque<TransContext*> txcs;         ///< txcs to commit
+    deque<TransContext*> wal_cleaning; ///< txcs whose wal keys we remove
+    utime_t stamp;                     ///< when the batch entered its stage
+
+    bool empty() const {
+      return txcs.empty() && wal_cleaning.empty();
+    }
+    void claim_append(kv_batch_t& o) {
+      txcs.insert(txcs.end(), o.txcs.begin(), o.txcs.end());
+      wal_cleaning.insert(wal_cleaning.end(), o.wal_cleaning.begin(),
+			  o.wal_cleaning.end());
+      o.txcs.clear();
+      o.wal_cleaning.clear();
+    }
+  };
 
   // --------------------------------------------------------
   // members
@@ -1428,6 +1515,15 @@ private:
 
   vector<Cache*> cache_shards;
 
+  bool cache_autotune;
+  /// autotuned limits; seeded from the configured ratios at startup
+  std::atomic<uint64_t> cache_onode_max = {0};   ///< onodes, all shards
+  std::atomic<uint64_t> cache_buffer_max = {0};  ///< bytes, all shards
+  CacheTuneThread cache_tune_thread;
+  std::mutex cache_tune_lock;
+  std::condition_variable cache_tune_cond;
+  bool cache_tune_stop = false;
+
   std::mutex id_lock;
   std::atomic<uint64_t> nid_last = {0};
   uint64_t nid_max = 0;
@@ -1447,12 +1543,36 @@ private:
   int m_finisher_num;
   vector<Finisher*> finishers;
 
+  // The kv commit path is a three stage pipeline so that the block
+  // device flush for one batch overlaps the kv commit of the previous
+  // one, and neither waits on completion processing:
+  //
+  //  kv_sync_thread:     kv_queue -> bdev->flush() -> kv_flushed
+  //  kv_commit_thread:   kv_flushed -> submit + sync commit -> kv_committed
+  //  kv_finalize_thread: kv_committed -> _txc_state_proc (finishers)
+  //
+  // All queues are protected by kv_lock.
   KVSyncThread kv_sync_thread;
+  KVCommitThread kv_commit_thread;
+  KVFinalizeThread kv_finalize_thread;
   std::mutex kv_lock;
   std::condition_variable kv_cond, kv_sync_cond;
-  bool kv_stop;
-  deque<TransContext*> kv_queue, kv_committing;
-  deque<TransContext*> wal_cleanup_queue, wal_cleaning;
+  std::condition_variable kv_commit_cond, kv_finalize_cond;
+  bool kv_stop, kv_commit_stop, kv_finalize_stop;
+  deque<TransContext*> kv_queue, wal_cleanup_queue; ///< waiting for flush
+  kv_batch_t kv_flushing;    ///< being flushed by kv_sync_thread
+  deque<kv_batch_t> kv_flushed;  ///< flushed; waiting for kv commit
+  kv_batch_t kv_committing;  ///< being committed by kv_commit_thread
+  deque<kv_batch_t> kv_committed;  ///< committed; waiting for finalize
+  kv_batch_t kv_finalizing;  ///< being finalized by kv_finalize_thread
+
+  bool _kv_pipeline_empty() {
+    // must hold kv_lock
+    return kv_queue.empty() && wal_cleanup_queue.empty() &&
+      kv_flushing.empty() && kv_flushed.empty() &&
+      kv_committing.empty() && kv_committed.empty() &&
+      kv_finalizing.empty();
+  }
 
   PerfCounters *logger;
 
@@ -1528,6 +1648,24 @@ private:
   void _reap_collections();
   void _update_cache_logger();
 
+  void _get_cache_limits(uint64_t *onode_max, uint64_t *buffer_max) {
+    if (cache_autotune) {
+      *onode_max = cache_onode_max;
+      *buffer_max = cache_buffer_max;
+    } else {
+      *onode_max = g_conf->bluestore_onode_cache_size;
+      *buffer_max = g_conf->bluestore_buffer_cache_size;
+    }
+  }
+  /// footprint of a cached onode with one extent, before we know better
+  static uint64_t _cache_onode_bytes_estimate() {
+    return sizeof(Onode) + sizeof(Extent) + sizeof(Blob) + sizeof(SharedBlob);
+  }
+  void _cache_tune_seed();
+  void _cache_tune_thread();
+  void _cache_tune_start();
+  void _cache_tune_stop();
+
   void _assign_nid(TransContext *txc, OnodeRef o);
   uint64_t _assign_blobid(TransContext *txc);
 
@@ -1554,14 +1692,35 @@ private:
   void _osr_reap_done(OpSequencer *osr);
 
   void _kv_sync_thread();
+  void _kv_commit_thread();
+  void _kv_finalize_thread();
+  void _kv_start() {
+    kv_sync_thread.create("bstore_kv_sync");
+    kv_commit_thread.create("bstore_kv_commit");
+    kv_finalize_thread.create("bstore_kv_final");
+  }
   void _kv_stop() {
+    // stop the stages in pipeline order so that each one drains into
+    // the next before that one is told to stop.
     {
       std::lock_guard<std::mutex> l(kv_lock);
       kv_stop = true;
       kv_cond.notify_all();
     }
     kv_sync_thread.join();
-    kv_stop = false;
+    {
+      std::lock_guard<std::mutex> l(kv_lock);
+      kv_commit_stop = true;
+      kv_commit_cond.notify_all();
+    }
+    kv_commit_thread.join();
+    {
+      std::lock_guard<std::mutex> l(kv_lock);
+      kv_finalize_stop = true;
+      kv_finalize_cond.notify_all();
+    }
+    kv_finalize_thread.join();
+    kv_stop = kv_commit_stop = kv_finalize_stop = false;
   }
 
   bluestore_wal_op_t *_get_wal_op(TransContext *txc, OnodeRef o);
@@ -0,0 +1,478 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+
+#include <algorithm>
+
+#include "HierarchicalAllocator.h"
+#include "bluestore_types.h"
+#include "common/debug.h"
+
+#define dout_subsys ceph_subsys_bluestore
+#undef dout_prefix
+#define dout_prefix *_dout << "hieralloc "
+
+static const uint64_t NONE = (uint64_t)-1;
+
+HierarchicalAllocator::HierarchicalAllocator(int64_t device_size,
+					     int64_t bsize)
+  : block_size(bsize),
+    num_blocks(device_size / bsize),
+    leaf_blocks(g_conf->bluestore_hierarchicalallocator_blocks_per_leaf),
+    num_leaves(1),
+    dirty_begin(0),
+    dirty_end(0),
+    num_free(0),
+    num_uncommitted(0),
+    num_committing(0),
+    num_reserved(0),
+    last_alloc(0)
+{
+  assert(ISP2(block_size));
+  assert(ISP2(leaf_blocks) && leaf_blocks >= 64);
+  while (num_leaves * leaf_blocks < num_blocks)
+    num_leaves <<= 1;
+  bits.resize(num_leaves * leaf_blocks / 64, 0);
+  tree.resize(num_leaves * 2, Summary{0, 0, 0});
+  dirty.resize((num_leaves + 63) / 64, 0);
+  dout(10) << __func__ << " size 0x" << std::hex << device_size
+	   << " block_size 0x" << block_size << std::dec
+	   << " leaves " << num_leaves << dendl;
+}
+
+HierarchicalAllocator::~HierarchicalAllocator()
+{
+}
+
+void HierarchicalAllocator::_mark(uint64_t start, uint64_t n, bool free)
+{
+  if (!n)
+    return;
+  assert(start + n <= num_blocks);
+  uint64_t end = start + n;
+  uint64_t pos = start;
+  while (pos < end) {
+    uint64_t word = pos / 64;
+    unsigned shift = pos % 64;
+    unsigned len = std::min<uint64_t>(64 - shift, end - pos);
+    uint64_t mask = (len == 64 ? ~0ull : ((1ull << len) - 1)) << shift;
+    if (free)
+      bits[word] |= mask;
+    else
+      bits[word] &= ~mask;
+    pos += len;
+  }
+  uint64_t first = start / leaf_blocks;
+  uint64_t last = (end - 1) / leaf_blocks + 1;
+  for (uint64_t leaf = first; leaf < last; ++leaf)
+    dirty[leaf / 64] |= 1ull << (leaf % 64);
+  if (dirty_begin >= dirty_end) {
+    dirty_begin = first;
+    dirty_end = last;
+  } else {
+    dirty_begin = std::min(dirty_begin, first);
+    dirty_end = std::max(dirty_end, last);
+  }
+}
+
+uint64_t HierarchicalAllocator::_next_free(uint64_t pos, uint64_t end) const
+{
+  while (pos < end) {
+    uint64_t w = bits[pos / 64] >> (pos % 64);
+    if (w)
+      return std::min(pos + __builtin_ctzll(w), end);
+    pos = (pos / 64 + 1) * 64;
+  }
+  return end;
+}
+
+uint64_t HierarchicalAllocator::_next_used(uint64_t pos, uint64_t end) const
+{
+  while (pos < end) {
+    uint64_t w = ~bits[pos / 64] >> (pos % 64);
+    if (w)
+      return std::min(pos + __builtin_ctzll(w), end);
+    pos = (pos / 64 + 1) * 64;
+  }
+  return end;
+}
+
+void HierarchicalAllocator::_summarize_leaf(uint64_t leaf)
+{
+  uint64_t begin = leaf * leaf_blocks;
+  uint64_t end = begin + leaf_blocks;
+  Summary s{0, 0, 0};
+  uint64_t pos = begin;
+  while (pos < end) {
+    uint64_t f = _next_free(pos, end);
+    if (f == end)
+      break;
+    uint64_t u = _next_used(f, end);
+    if (f == begin)
+      s.prefix = u - f;
+    if (u == end)
+      s.suffix = u - f;
+    s.max = std::max(s.max, u - f);
+    pos = u;
+  }
+  tree[num_leaves + leaf] = s;
+}
+
+void HierarchicalAllocator::_merge(uint64_t node, uint64_t child_len)
+{
+  const Summary& l = tree[node * 2];
+  const Summary& r = tree[node * 2 + 1];
+  Summary& s = tree[node];
+  s.prefix = l.prefix == child_len ? child_len + r.prefix : l.prefix;
+  s.suffix = r.suffix == child_len ? child_len + l.suffix : r.suffix;
+  s.max = std::max(std::max(l.max, r.max), l.suffix + r.prefix);
+}
+
+void HierarchicalAllocator::_update_tree()
+{
+  if (dirty_begin >= dirty_end)
+    return;
+  std::vector<uint64_t> nodes;
+  for (uint64_t w = dirty_begin / 64; w <= (dirty_end - 1) / 64; ++w) {
+    uint64_t d = dirty[w];
+    while (d) {
+      nodes.push_back(num_leaves + w * 64 + __builtin_ctzll(d));
+      d &= d - 1;
+    }
+    dirty[w] = 0;
+  }
+  dirty_begin = dirty_end = 0;
+  dout(20) << __func__ << " " << nodes.size() << " leaves" << dendl;
+
+  for (auto n : nodes)
+    _summarize_leaf(n - num_leaves);
+  // nodes stays sorted, so each level's parents are adjacent duplicates
+  uint64_t len = leaf_blocks;
+  while (nodes[0] > 1) {
+    for (auto& n : nodes)
+      n /= 2;
+    nodes.erase(std::unique(nodes.begin(), nodes.end()), nodes.end());
+    for (auto n : nodes)
+      _merge(n, len);
+    len *= 2;
+  }
+}
+
+/// first run of >= n free blocks starting in [begin, end) and ending by end
+uint64_t HierarchicalAllocator::_scan(uint64_t begin, uint64_t end,
+				      uint64_t n) const
+{
+  uint64_t pos = begin;
+  while (pos < end) {
+    uint64_t f = _next_free(pos, end);
+    if (f == end)
+      break;
+    uint64_t u = _next_used(f, end);
+    if (u - f >= n)
+      return f;
+    pos = u;
+  }
+  return NONE;
+}
+
+/// leftmost run of >= n free blocks inside a subtree
+uint64_t HierarchicalAllocator::_find_in(uint64_t node, uint64_t lo,
+					 uint64_t len, uint64_t n) const
+{
+  if (tree[node].max < n)
+    return NONE;
+  while (node < num_leaves) {
+    uint64_t half = len / 2;
+    const Summary& l = tree[node * 2];
+    const Summary& r = tree[node * 2 + 1];
+    if (l.max >= n) {
+      node = node * 2;
+    } else if (l.suffix + r.prefix >= n) {
+      return lo + half - l.suffix;
+    } else {
+      node = node * 2 + 1;
+      lo += half;
+    }
+    len = half;
+  }
+  return _scan(lo, lo + len, n);
+}
+
+/// leftmost run of >= n free blocks inside a subtree starting at or after from
+uint64_t HierarchicalAllocator::_find_from(uint64_t node, uint64_t lo,
+					   uint64_t len, uint64_t n,
+					   uint64_t from) const
+{
+  if (lo + len <= from || tree[node].max < n)
+    return NONE;
+  if (lo >= from)
+    return _find_in(node, lo, len, n);
+  if (node >= num_leaves)
+    return _scan(from, lo + len, n);
+  uint64_t half = len / 2;
+  uint64_t mid = lo + half;
+  uint64_t r = _find_from(node * 2, lo, half, n, from);
+  if (r != NONE)
+    return r;
+  if (from < mid) {
+    // a run crossing the middle, clipped to start at from
+    const Summary& ls = tree[node * 2];
+    const Summary& rs = tree[node * 2 + 1];
+    uint64_t start = std::max(from, mid - ls.suffix);
+    if (mid - start + rs.prefix >= n)
+      return start;
+  }
+  return _find_from(node * 2 + 1, mid, half, n, from);
+}
+
+uint64_t HierarchicalAllocator::_find(uint64_t n, uint64_t from) const
+{
+  if (from)
+    return _find_from(1, 0, num_leaves * leaf_blocks, n, from);
+  return _find_in(1, 0, num_leaves * leaf_blocks, n);
+}
+
+/// first run of n free blocks at or after from that starts on a unit boundary
+uint64_t HierarchicalAllocator::_find_aligned(uint64_t n, uint64_t unit,
+					      uint64_t from) const
+{
+  if (unit <= 1)
+    return _find(n, from);
+
+  // any run of n + unit - 1 blocks holds an aligned run of n
+  uint64_t start = _find(n + unit - 1, from);
+  if (start != NONE)
+    return ROUND_UP_TO(start, unit);
+
+  // otherwise try the runs that are just long enough
+  while ((start = _find(n, from)) != NONE) {
+    uint64_t a = ROUND_UP_TO(start, unit);
+    if (a + n <= num_blocks && _next_used(a, a + n) == a + n)
+      return a;
+    from = a;
+  }
+  return NONE;
+}
+
+void HierarchicalAllocator::_adjust(uint64_t offset, uint64_t length,
+				    uint64_t *start, uint64_t *count) const
+{
+  // same rounding as BitMapAllocator: only whole blocks are usable
+  uint64_t offset_adj = ROUND_UP_TO(offset, block_size);
+  if (offset_adj - offset >= length) {
+    *start = offset_adj / block_size;
+    *count = 0;
+    return;
+  }
+  *start = offset_adj / block_size;
+  *count = (length - (offset_adj - offset)) / block_size;
+  if (*start >= num_blocks)
+    *count = 0;
+  else if (*start + *count > num_blocks)
+    *count = num_blocks - *start;
+}
+
+int HierarchicalAllocator::reserve(uint64_t need)
+{
+  std::lock_guard<std::mutex> l(lock);
+  dout(10) << __func__ << " need 0x" << std::hex << need
+	   << " num_free 0x" << num_free
+	   << " num_reserved 0x" << num_reserved << std::dec << dendl;
+  if ((int64_t)need > num_free - num_reserved)
+    return -ENOSPC;
+  num_reserved += need;
+  return 0;
+}
+
+void HierarchicalAllocator::unreserve(uint64_t unused)
+{
+  std::lock_guard<std::mutex> l(lock);
+  dout(10) << __func__ << " unused 0x" << std::hex << unused
+	   << " num_free 0x" << num_free
+	   << " num_reserved 0x" << num_reserved << std::dec << dendl;
+  assert(num_reserved >= (int64_t)unused);
+  num_reserved -= unused;
+}
+
+int HierarchicalAllocator::allocate(
+  uint64_t want_size, uint64_t alloc_unit, int64_t hint,
+  uint64_t *offset, uint32_t *length)
+{
+  std::lock_guard<std::mutex> l(lock);
+  dout(10) << __func__ << " want_size 0x" << std::hex << want_size
+	   << " alloc_unit 0x" << alloc_unit
+	   << " hint 0x" << hint << std::dec
+	   << dendl;
+  assert(alloc_unit);
+  assert(!(alloc_unit % block_size));
+  _update_tree();
+
+  uint64_t unit = alloc_unit / block_size;
+  uint64_t want = (MAX(alloc_unit, want_size) + block_size - 1) / block_size;
+  want = MIN(want, (0xffffffffull / block_size) / unit * unit);
+  uint64_t from = hint ? hint / block_size : last_alloc;
+
+  // settle for the largest extent we could possibly get
+  uint64_t n = MIN(want, tree[1].max / unit * unit);
+  uint64_t start = NONE;
+  while (n >= unit) {
+    start = _find_aligned(n, unit, from);
+    if (start == NONE && from)
+      start = _find_aligned(n, unit, 0);
+    if (start != NONE)
+      break;
+    // free runs that long exist but none is aligned
+    n = n / 2 / unit * unit;
+  }
+  if (start == NONE) {
+    dout(10) << __func__ << " largest free extent 0x" << std::hex
+	     << tree[1].max * block_size << std::dec << dendl;
+    return -ENOSPC;
+  }
+
+  _mark(start, n, false);
+  _update_tree();
+  *offset = start * block_size;
+  *length = n * block_size;
+  dout(30) << __func__ << " got 0x" << std::hex << *offset << "~" << *length
+	   << std::dec << dendl;
+
+  num_free -= *length;
+  num_reserved -= *length;
+  assert(num_free >= 0);
+  assert(num_reserved >= 0);
+  last_alloc = start + n;
+  return 0;
+}
+
+int HierarchicalAllocator::alloc_extents(
+  uint64_t want_size, uint64_t alloc_unit, uint64_t max_alloc_size,
+  int64_t hint, std::vector<AllocExtent> *extents, int *count)
+{
+  uint64_t allocated_size = 0;
+  uint64_t offset = 0;
+  uint32_t length = 0;
+  int res = 0;
+
+  if (max_alloc_size == 0) {
+    max_alloc_size = want_size;
+  }
+
+  ExtentList block_list = ExtentList(extents, 1, max_alloc_size);
+
+  while (allocated_size < want_size) {
+    res = allocate(MIN(max_alloc_size, (want_size - allocated_size)),
+       alloc_unit, hint, &offset, &length);
+    if (res != 0) {
+      break;
+    }
+    block_list.add_extents(offset, length);
+    allocated_size += length;
+    hint = offset + length;
+  }
+
+  *count = block_list.get_extent_count();
+  if (want_size - allocated_size > 0) {
+    release_extents(extents, *count);
+    return -ENOSPC;
+  }
+
+  return 0;
+}
+
+int HierarchicalAllocator::release(
+  uint64_t offset, uint64_t length)
+{
+  std::lock_guard<std::mutex> l(lock);
+  dout(10) << __func__ << " 0x" << std::hex << offset << "~" << length
+	   << std::dec << dendl;
+  uncommitted.insert(offset, length);
+  num_uncommitted += length;
+  return 0;
+}
+
+uint64_t HierarchicalAllocator::get_free()
+{
+  std::lock_guard<std::mutex> l(lock);
+  return num_free;
+}
+
+void HierarchicalAllocator::dump(ostream& out)
+{
+  std::lock_guard<std::mutex> l(lock);
+  _update_tree();
+  dout(30) << __func__ << " free 0x" << std::hex << num_free
+	   << " largest extent 0x" << tree[1].max * block_size << std::dec
+	   << dendl;
+  dout(30) << __func__ << " committing: "
+	   << committing.num_intervals() << " extents" << dendl;
+  for (auto p = committing.begin();
+       p != committing.end();
+       ++p) {
+    dout(30) << __func__ << "  0x" << std::hex << p.get_start() << "~"
+	     << p.get_len() << std::dec << dendl;
+  }
+  dout(30) << __func__ << " uncommitted: "
+	   << uncommitted.num_intervals() << " extents" << dendl;
+  for (auto p = uncommitted.begin();
+       p != uncommitted.end();
+       ++p) {
+    dout(30) << __func__ << "  0x" << std::hex << p.get_start() << "~"
+	     << p.get_len() << std::dec << dendl;
+  }
+}
+
+void HierarchicalAllocator::init_add_free(uint64_t offset, uint64_t length)
+{
+  std::lock_guard<std::mutex> l(lock);
+  dout(10) << __func__ << " 0x" << std::hex << offset << "~" << length
+	   << std::dec << dendl;
+  uint64_t start, count;
+  _adjust(offset, length, &start, &count);
+  _mark(start, count, true);
+  num_free += count * block_size;
+}
+
+void HierarchicalAllocator::init_rm_free(uint64_t offset, uint64_t length)
+{
+  std::lock_guard<std::mutex> l(lock);
+  dout(10) << __func__ << " 0x" << std::hex << offset << "~" << length
+	   << std::dec << dendl;
+  uint64_t start, count;
+  _adjust(offset, length, &start, &count);
+  _mark(start, count, false);
+  num_free -= count * block_size;
+  assert(num_free >= 0);
+}
+
+void HierarchicalAllocator::shutdown()
+{
+  dout(1) << __func__ << dendl;
+}
+
+void HierarchicalAllocator::commit_start()
+{
+  std::lock_guard<std::mutex> l(lock);
+  dout(10) << __func__ << " releasing " << num_uncommitted
+	   << " in extents " << uncommitted.num_intervals() << dendl;
+  assert(committing.empty());
+  committing.swap(uncommitted);
+  num_committing = num_uncommitted;
+  num_uncommitted = 0;
+}
+
+void HierarchicalAllocator::commit_finish()
+{
+  std::lock_guard<std::mutex> l(lock);
+  dout(10) << __func__ << " released " << num_committing
+	   << " in extents " << committing.num_intervals() << dendl;
+  for (auto p = committing.begin();
+       p != committing.end();
+       ++p) {
+    uint64_t start, count;
+    _adjust(p.get_start(), p.get_len(), &start, &count);
+    _mark(start, count, true);
+  }
+  committing.clear();
+  num_free += num_committing;
+  num_committing = 0;
+}
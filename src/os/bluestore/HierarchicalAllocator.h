@@ -0,0 +1,109 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+
+#ifndef CEPH_OS_BLUESTORE_HIERARCHICALALLOCATOR_H
+#define CEPH_OS_BLUESTORE_HIERARCHICALALLOCATOR_H
+
+#include <mutex>
+
+#include "Allocator.h"
+#include "include/btree_interval_set.h"
+
+/**
+ * Bitmap allocator with a summary tree over free-extent lengths.
+ *
+ * The device is a flat bitmap (1 = free block) cut into leaves of
+ * bluestore_hierarchicalallocator_blocks_per_leaf blocks.  A complete
+ * binary tree over the leaves records, for every subtree, the free run
+ * touching its left edge, the one touching its right edge and the
+ * longest run anywhere inside it.  That is enough to find the first
+ * free extent of a given length (at or after a hint) and the largest
+ * free extent in O(log n), and to keep the tree current in O(log n)
+ * per allocation or release.
+ *
+ * init_add_free/init_rm_free only touch the bitmap; the summaries of
+ * the leaves they dirtied are rebuilt before the next search.  A mount
+ * that replays the whole freelist therefore pays for one pass over the
+ * tree rather than one walk up it per extent.
+ */
+class HierarchicalAllocator : public Allocator {
+  struct Summary {
+    uint64_t prefix; ///< free blocks at the start of the subtree
+    uint64_t suffix; ///< free blocks at the end of the subtree
+    uint64_t max;    ///< longest free run inside the subtree
+  };
+
+  std::mutex lock;
+
+  uint64_t block_size;
+  uint64_t num_blocks;
+  uint64_t leaf_blocks;
+  uint64_t num_leaves;          ///< padded to a power of 2
+
+  std::vector<uint64_t> bits;   ///< one bit per block, 1 = free
+  std::vector<Summary> tree;    ///< heap order, leaves at [num_leaves, 2*num_leaves)
+  std::vector<uint64_t> dirty;  ///< one bit per leaf whose summary is stale
+  uint64_t dirty_begin;         ///< bounds of the set bits in dirty
+  uint64_t dirty_end;
+
+  int64_t num_free;             ///< total bytes free
+  int64_t num_uncommitted;
+  int64_t num_committing;
+  int64_t num_reserved;         ///< reserved bytes
+
+  btree_interval_set<uint64_t> uncommitted; ///< released but not yet usable
+  btree_interval_set<uint64_t> committing;  ///< released but not yet usable
+
+  uint64_t last_alloc;          ///< block after the last allocation
+
+  void _mark(uint64_t start, uint64_t n, bool free);
+  uint64_t _next_free(uint64_t pos, uint64_t end) const;
+  uint64_t _next_used(uint64_t pos, uint64_t end) const;
+
+  void _summarize_leaf(uint64_t leaf);
+  void _merge(uint64_t node, uint64_t child_len);
+  void _update_tree();
+
+  uint64_t _scan(uint64_t begin, uint64_t end, uint64_t n) const;
+  uint64_t _find_in(uint64_t node, uint64_t lo, uint64_t len,
+		    uint64_t n) const;
+  uint64_t _find_from(uint64_t node, uint64_t lo, uint64_t len,
+		      uint64_t n, uint64_t from) const;
+  uint64_t _find(uint64_t n, uint64_t from) const;
+  uint64_t _find_aligned(uint64_t n, uint64_t unit, uint64_t from) const;
+
+  void _adjust(uint64_t offset, uint64_t length,
+	       uint64_t *start, uint64_t *count) const;
+
+public:
+  HierarchicalAllocator(int64_t device_size, int64_t block_size);
+  ~HierarchicalAllocator();
+
+  int reserve(uint64_t need);
+  void unreserve(uint64_t unused);
+
+  int allocate(
+    uint64_t want_size, uint64_t alloc_unit, int64_t hint,
+    uint64_t *offset, uint32_t *length);
+
+  int alloc_extents(
+    uint64_t want_size, uint64_t alloc_unit, uint64_t max_alloc_size,
+    int64_t hint, std::vector<AllocExtent> *extents, int *count);
+
+  int release(
+    uint64_t offset, uint64_t length);
+
+  void commit_start();
+  void commit_finish();
+
+  uint64_t get_free();
+
+  void dump(std::ostream& out);
+
+  void init_add_free(uint64_t offset, uint64_t length);
+  void init_rm_free(uint64_t offset, uint64_t length);
+
+  void shutdown();
+};
+
+#endif
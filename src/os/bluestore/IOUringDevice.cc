@@ -0,0 +1,467 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+/*
+ * Ceph - scalable distributed file system
+ *
+ * This is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License version 2.1, as published by the Free Software
+ * Foundation.  See file COPYING.
+ *
+ */
+
+#include <unistd.h>
+#include <stdlib.h>
+#include <poll.h>
+#include <sys/eventfd.h>
+
+#include "IOUringDevice.h"
+#include "include/types.h"
+#include "include/compat.h"
+#include "common/errno.h"
+#include "common/debug.h"
+
+#define dout_subsys ceph_subsys_bdev
+#undef dout_prefix
+#define dout_prefix *_dout << "bdev(" << path << ") "
+
+// fd_direct is registered as fixed file 0
+#define FIXED_FD 0
+
+IOUringDevice::IOUringDevice(aio_callback_t cb, void *cbpriv)
+  : KernelDevice(cb, cbpriv),
+    ring_initialized(false),
+    sqpoll(false),
+    event_fd(-1),
+    inflight(0),
+    cq_depth(0),
+    buf_base(NULL),
+    buf_size(0),
+    buf_count(0),
+    completion_thread(this)
+{
+  memset(&ring, 0, sizeof(ring));
+}
+
+int IOUringDevice::_aio_start()
+{
+  dout(10) << __func__ << dendl;
+  struct io_uring_params params;
+  memset(&params, 0, sizeof(params));
+  if (g_conf->bdev_ioring_sqthread_poll) {
+    params.flags |= IORING_SETUP_SQPOLL;
+    params.sq_thread_idle = g_conf->bdev_ioring_sqthread_idle_ms;
+  }
+  int r = io_uring_queue_init_params(g_conf->bdev_ioring_queue_depth,
+				     &ring, &params);
+  if (r < 0) {
+    derr << __func__ << " io_uring_queue_init got: " << cpp_strerror(r)
+	 << dendl;
+    return r;
+  }
+  ring_initialized = true;
+  sqpoll = params.flags & IORING_SETUP_SQPOLL;
+  cq_depth = params.cq_entries;
+  inflight = 0;
+
+  r = io_uring_register_files(&ring, &fd_direct, 1);
+  if (r < 0) {
+    derr << __func__ << " io_uring_register_files got: " << cpp_strerror(r)
+	 << dendl;
+    goto out_ring;
+  }
+
+  event_fd = ::eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+  if (event_fd < 0) {
+    r = -errno;
+    derr << __func__ << " eventfd got: " << cpp_strerror(r) << dendl;
+    goto out_ring;
+  }
+  r = io_uring_register_eventfd(&ring, event_fd);
+  if (r < 0) {
+    derr << __func__ << " io_uring_register_eventfd got: " << cpp_strerror(r)
+	 << dendl;
+    goto out_eventfd;
+  }
+
+  if (g_conf->bdev_ioring_register_buffers > 0) {
+    // registered buffers are an optimization only; carry on without them
+    // if the kernel refuses (e.g., RLIMIT_MEMLOCK).
+    int n = g_conf->bdev_ioring_register_buffers;
+    uint64_t bsize = ROUND_UP_TO(g_conf->bdev_ioring_buffer_size,
+				 CEPH_PAGE_SIZE);
+    void *base = NULL;
+    r = ::posix_memalign(&base, CEPH_PAGE_SIZE, bsize * n);
+    if (r) {
+      derr << __func__ << " unable to allocate registered buffers: "
+	   << cpp_strerror(r) << dendl;
+    } else {
+      vector<iovec> iov(n);
+      for (int i = 0; i < n; ++i) {
+	iov[i].iov_base = static_cast<char*>(base) + bsize * i;
+	iov[i].iov_len = bsize;
+      }
+      r = io_uring_register_buffers(&ring, &iov[0], n);
+      if (r < 0) {
+	derr << __func__ << " io_uring_register_buffers got: "
+	     << cpp_strerror(r) << ", continuing without" << dendl;
+	::free(base);
+      } else {
+	buf_base = static_cast<char*>(base);
+	buf_size = bsize;
+	buf_count = n;
+	buf_free.reserve(n);
+	for (int i = n - 1; i >= 0; --i)
+	  buf_free.push_back(i);
+      }
+    }
+  }
+
+  dout(1) << __func__ << " queue depth " << g_conf->bdev_ioring_queue_depth
+	  << " cq depth " << cq_depth << (sqpoll ? " sqpoll" : "") << " registered buffers " << buf_count
+	  << dendl;
+  completion_thread.create("bstore_uring");
+  return 0;
+
+ out_eventfd:
+  VOID_TEMP_FAILURE_RETRY(::close(event_fd));
+  event_fd = -1;
+ out_ring:
+  io_uring_queue_exit(&ring);
+  ring_initialized = false;
+  return r;
+}
+
+void IOUringDevice::_aio_stop()
+{
+  if (!ring_initialized)
+    return;
+  dout(10) << __func__ << dendl;
+  aio_stop = true;
+  completion_thread.join();
+  aio_stop = false;
+
+  if (buf_base) {
+    io_uring_unregister_buffers(&ring);
+    ::free(buf_base);
+    buf_base = NULL;
+    buf_size = 0;
+    buf_count = 0;
+    buf_free.clear();
+  }
+  io_uring_unregister_eventfd(&ring);
+  io_uring_unregister_files(&ring);
+  io_uring_queue_exit(&ring);
+  ring_initialized = false;
+  VOID_TEMP_FAILURE_RETRY(::close(event_fd));
+  event_fd = -1;
+}
+
+void IOUringDevice::_completion_thread()
+{
+  dout(10) << __func__ << " start" << dendl;
+  int inject_crash_count = 0;
+  while (!aio_stop) {
+    dout(40) << __func__ << " polling" << dendl;
+    struct pollfd pfd;
+    pfd.fd = event_fd;
+    pfd.events = POLLIN;
+    pfd.revents = 0;
+    int r = ::poll(&pfd, 1, g_conf->bdev_aio_poll_ms);
+    if (r < 0 && errno != EINTR) {
+      derr << __func__ << " poll got " << cpp_strerror(errno) << dendl;
+    }
+    if (r > 0) {
+      uint64_t v;
+      int rr = ::read(event_fd, &v, sizeof(v));
+      (void)rr;  // the eventfd is only a wakeup; we reap the ring regardless
+      r = _reap();
+      dout(30) << __func__ << " reaped " << r << " completions" << dendl;
+    }
+    if (io_uring_sq_ready(&ring)) {
+      // left behind by a submission from an aio callback
+      std::lock_guard<std::mutex> l(sq_lock);
+      r = _submit_sqes();
+      if (r < 0) {
+	derr << __func__ << " submit got " << cpp_strerror(r) << dendl;
+	assert(0 == "io_uring submit failed");
+      }
+    }
+    reap_ioc();
+    if (g_conf->bdev_inject_crash) {
+      ++inject_crash_count;
+      if (inject_crash_count * g_conf->bdev_aio_poll_ms / 1000 >
+	  g_conf->bdev_inject_crash + g_conf->bdev_inject_crash_flush_delay) {
+	derr << __func__ << " bdev_inject_crash trigger from completion thread"
+	     << dendl;
+	g_ceph_context->_log->flush();
+	_exit(1);
+      }
+    }
+  }
+  dout(10) << __func__ << " end" << dendl;
+}
+
+int IOUringDevice::_reap()
+{
+  const unsigned max = 32;
+  struct io_uring_cqe *cqes[max];
+  int total = 0;
+  while (true) {
+    unsigned n = io_uring_peek_batch_cqe(&ring, cqes, max);
+    if (n == 0)
+      break;
+    for (unsigned i = 0; i < n; ++i) {
+      uintptr_t v = (uintptr_t)io_uring_cqe_get_data(cqes[i]);
+      int res = cqes[i]->res;
+      if (v & 1) {
+	flush_waiter_t *w = reinterpret_cast<flush_waiter_t*>(v & ~(uintptr_t)1);
+	std::lock_guard<std::mutex> l(flush_waiter_lock);
+	w->rval = res;
+	w->done = true;
+	flush_waiter_cond.notify_all();
+      } else {
+	FS::aio_t *aio = reinterpret_cast<FS::aio_t*>(v);
+	aio->rval = res;
+	_put_buffer(aio);
+	_aio_finish(aio, res);
+      }
+    }
+    io_uring_cq_advance(&ring, n);
+    total += n;
+    {
+      std::lock_guard<std::mutex> l(inflight_lock);
+      assert(inflight >= n);
+      inflight -= n;
+      inflight_cond.notify_all();
+    }
+  }
+  return total;
+}
+
+void IOUringDevice::_wait_inflight(std::unique_lock<std::mutex>& l)
+{
+  // must hold inflight_lock
+  // the completion thread runs aio callbacks; it can't wait for itself
+  // to reap, so let it go over the limit
+  if (completion_thread.am_self())
+    return;
+  inflight_cond.wait_for(l,
+			 std::chrono::milliseconds(g_conf->bdev_aio_poll_ms));
+}
+
+struct io_uring_sqe *IOUringDevice::_get_sqe()
+{
+  // must hold sq_lock
+  {
+    std::unique_lock<std::mutex> l(inflight_lock);
+    while (inflight >= cq_depth && !completion_thread.am_self()) {
+      // everything we hand out must be in the kernel's hands before we
+      // wait for it to complete
+      l.unlock();
+      dout(20) << __func__ << " " << cq_depth << " in flight, waiting"
+	       << dendl;
+      int r = _submit_sqes();
+      if (r < 0) {
+	derr << __func__ << " submit got " << cpp_strerror(r) << dendl;
+	assert(0 == "io_uring submit failed");
+      }
+      l.lock();
+      if (inflight >= cq_depth)
+	_wait_inflight(l);
+    }
+    ++inflight;
+  }
+  int delay = 125;
+  while (true) {
+    struct io_uring_sqe *sqe = io_uring_get_sqe(&ring);
+    if (sqe)
+      return sqe;
+    // the submission queue is full; push what we have and retry
+    dout(20) << __func__ << " sq full, submitting" << dendl;
+    int r = _submit_sqes();
+    if (r < 0) {
+      derr << __func__ << " submit got " << cpp_strerror(r) << dendl;
+      assert(0 == "io_uring submit failed");
+    }
+    if (sqpoll) {
+      // the kernel thread consumes entries asynchronously
+      usleep(delay);
+      delay = MIN(delay * 2, 8000);
+    }
+  }
+}
+
+int IOUringDevice::_submit_sqes()
+{
+  // must hold sq_lock
+  while (true) {
+    int r = io_uring_submit(&ring);
+    if (r >= 0)
+      return r;
+    if (r == -EAGAIN || r == -EBUSY) {
+      // the kernel is short of resources or holding completions we have
+      // not reaped yet; wait for the completion thread to make room
+      if (completion_thread.am_self()) {
+	// ...unless we are it: leave the sqes queued, they are submitted
+	// once this round of completions has been reaped
+	return 0;
+      }
+      dout(10) << __func__ << " waiting to retry after " << cpp_strerror(r)
+	       << dendl;
+      std::unique_lock<std::mutex> l(inflight_lock);
+      _wait_inflight(l);
+      continue;
+    }
+    return r;
+  }
+}
+
+int IOUringDevice::_get_buffer(uint64_t len)
+{
+  if (!buf_base || len > buf_size)
+    return -1;
+  std::lock_guard<std::mutex> l(buf_lock);
+  if (buf_free.empty())
+    return -1;
+  int i = buf_free.back();
+  buf_free.pop_back();
+  return i;
+}
+
+void IOUringDevice::_put_buffer(const FS::aio_t *aio)
+{
+  if (!buf_base || aio->iov.size() != 1)
+    return;
+  char *p = static_cast<char*>(aio->iov[0].iov_base);
+  if (!_is_registered(p))
+    return;
+  std::lock_guard<std::mutex> l(buf_lock);
+  buf_free.push_back((p - buf_base) / buf_size);
+}
+
+int IOUringDevice::flush()
+{
+  bool ret = io_since_flush.compare_and_swap(1, 0);
+  if (!ret) {
+    dout(10) << __func__ << " no-op (no ios since last flush)" << dendl;
+    return 0;
+  }
+  dout(10) << __func__ << " start" << dendl;
+  if (g_conf->bdev_inject_crash) {
+    ++injecting_crash;
+    // sleep for a moment to give other threads a chance to submit or
+    // wait on io that races with a flush.
+    derr << __func__ << " injecting crash. first we sleep..." << dendl;
+    sleep(g_conf->bdev_inject_crash_flush_delay);
+    derr << __func__ << " and now we die" << dendl;
+    g_ceph_context->_log->flush();
+    _exit(1);
+  }
+  utime_t start = ceph_clock_now(NULL);
+  flush_waiter_t fw;
+  {
+    std::lock_guard<std::mutex> l(sq_lock);
+    struct io_uring_sqe *sqe = _get_sqe();
+    io_uring_prep_fsync(sqe, FIXED_FD, IORING_FSYNC_DATASYNC);
+    // drain: the fsync starts only once every write already on the ring
+    // has completed, so callers need not wait for them first.
+    io_uring_sqe_set_flags(sqe, IOSQE_FIXED_FILE | IOSQE_IO_DRAIN);
+    io_uring_sqe_set_data(sqe, (void*)((uintptr_t)&fw | 1));
+    int r = _submit_sqes();
+    if (r < 0) {
+      derr << __func__ << " submit got: " << cpp_strerror(r) << dendl;
+      assert(0);
+    }
+  }
+  {
+    std::unique_lock<std::mutex> l(flush_waiter_lock);
+    while (!fw.done)
+      flush_waiter_cond.wait(l);
+  }
+  utime_t dur = ceph_clock_now(NULL) - start;
+  int r = fw.rval;
+  if (r < 0) {
+    derr << __func__ << " fsync got: " << cpp_strerror(r) << dendl;
+    assert(0);
+  }
+  dout(5) << __func__ << " in " << dur << dendl;
+  return r;
+}
+
+void IOUringDevice::aio_submit(IOContext *ioc)
+{
+  dout(20) << __func__ << " ioc " << ioc
+	   << " pending " << ioc->num_pending.load()
+	   << " running " << ioc->num_running.load()
+	   << dendl;
+  if (ioc->num_pending.load() == 0) {
+    return;
+  }
+  // move these aside, and get our end iterator position now, as the
+  // aios might complete as soon as they are submitted and queue more
+  // wal aio's.
+  list<FS::aio_t>::iterator e = ioc->running_aios.begin();
+  ioc->running_aios.splice(e, ioc->pending_aios);
+  list<FS::aio_t>::iterator p = ioc->running_aios.begin();
+
+  int pending = ioc->num_pending.load();
+  ioc->num_running += pending;
+  ioc->num_pending -= pending;
+  assert(ioc->num_pending.load() == 0);  // we should be only thread doing this
+
+  std::lock_guard<std::mutex> l(sq_lock);
+  for (; p != e; ++p) {
+    FS::aio_t& aio = *p;
+    aio.priv = static_cast<void*>(ioc);
+    dout(20) << __func__ << "  aio " << &aio << " fd " << aio.fd
+	     << " 0x" << std::hex << aio.offset << "~" << aio.length
+	     << std::dec << dendl;
+
+    // note that _get_sqe may push part of this batch to the kernel
+    // if the sq fills up; num_running already covers the whole batch
+    // so the ioc cannot complete underneath us.
+    struct io_uring_sqe *sqe = _get_sqe();
+    char *base = static_cast<char*>(aio.iov.empty() ? NULL :
+				    aio.iov[0].iov_base);
+    if (aio.iocb.aio_lio_opcode == IO_CMD_PREAD) {
+      // bdev_inject_crash turns writes into reads
+      io_uring_prep_read(sqe, FIXED_FD, aio.bl.c_str(), aio.length,
+			 aio.offset);
+    } else if (aio.iov.size() == 1 && _is_registered(base)) {
+      io_uring_prep_write_fixed(sqe, FIXED_FD, base, aio.length, aio.offset,
+				(base - buf_base) / buf_size);
+    } else {
+      io_uring_prep_writev(sqe, FIXED_FD, &aio.iov[0], aio.iov.size(),
+			   aio.offset);
+    }
+    io_uring_sqe_set_flags(sqe, IOSQE_FIXED_FILE);
+    io_uring_sqe_set_data(sqe, &aio);
+  }
+
+  // do not dereference ioc (or its contents) after we submit
+  int r = _submit_sqes();
+  if (r < 0) {
+    derr << __func__ << " submit got " << cpp_strerror(r) << dendl;
+    assert(r >= 0);
+  }
+}
+
+void IOUringDevice::_aio_prep_write(FS::aio_t& aio, uint64_t off,
+				    bufferlist& bl)
+{
+  uint64_t len = bl.length();
+  int i = _get_buffer(len);
+  if (i < 0) {
+    KernelDevice::_aio_prep_write(aio, off, bl);
+    return;
+  }
+  // copy into a registered buffer; cheaper than having the kernel
+  // pin and map the user pages for a small write.
+  char *b = buf_base + buf_size * i;
+  bl.copy(0, len, b);
+  aio.iov.push_back(iovec{b, (size_t)len});
+  aio.pwritev(off);
+  dout(20) << __func__ << " 0x" << std::hex << off << "~" << len << std::dec
+	   << " in registered buffer " << i << dendl;
+}
@@ -0,0 +1,99 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+/*
+ * Ceph - scalable distributed file system
+ *
+ * This is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License version 2.1, as published by the Free Software
+ * Foundation.  See file COPYING.
+ *
+ */
+
+#ifndef CEPH_OS_BLUESTORE_IOURINGDEVICE_H
+#define CEPH_OS_BLUESTORE_IOURINGDEVICE_H
+
+#include <condition_variable>
+#include <mutex>
+
+#include <liburing.h>
+
+#include "KernelDevice.h"
+
+/**
+ * BlockDevice backed by a single io_uring instance.
+ *
+ * Everything but the direct io path is KernelDevice's.  Writes queued
+ * on an IOContext are turned into SQEs and submitted with one
+ * io_uring_enter per aio_submit() (none at all with
+ * bdev_ioring_sqthread_poll).  flush() queues a datasync fsync that is
+ * drained behind every write already on the ring instead of calling
+ * fdatasync(2) separately.  Completions, the fsync's included, are
+ * reaped and run by the completion thread only.
+ */
+class IOUringDevice : public KernelDevice {
+  struct io_uring ring;
+  bool ring_initialized;
+  bool sqpoll;
+  int event_fd;                ///< signalled by the kernel on each cqe
+
+  std::mutex sq_lock;          ///< protects the submission queue
+
+  /// sqes handed out and not reaped yet; kept within the completion
+  /// queue so that a burst of writes can't overflow it
+  std::mutex inflight_lock;
+  std::condition_variable inflight_cond;
+  unsigned inflight;
+  unsigned cq_depth;
+
+  /// registered bounce buffers for small writes (IORING_OP_WRITE_FIXED)
+  std::mutex buf_lock;
+  char *buf_base;
+  uint64_t buf_size;
+  unsigned buf_count;
+  vector<int> buf_free;
+
+  bool _is_registered(const char *p) const {
+    return buf_base && p >= buf_base && p < buf_base + buf_size * buf_count;
+  }
+
+  /// pending fsync; tagged in the sqe user_data by setting the low bit
+  struct flush_waiter_t {
+    bool done = false;
+    int rval = 0;
+  };
+  std::mutex flush_waiter_lock;
+  std::condition_variable flush_waiter_cond;
+
+  struct CompletionThread : public Thread {
+    IOUringDevice *bdev;
+    explicit CompletionThread(IOUringDevice *b) : bdev(b) {}
+    void *entry() {
+      bdev->_completion_thread();
+      return NULL;
+    }
+  } completion_thread;
+
+  int _aio_start() override;
+  void _aio_stop() override;
+  void _aio_prep_write(FS::aio_t& aio, uint64_t off, bufferlist& bl) override;
+  void _completion_thread();
+
+  /// reap whatever is on the completion queue; returns number reaped
+  int _reap();
+
+  struct io_uring_sqe *_get_sqe();
+  int _submit_sqes();
+  void _wait_inflight(std::unique_lock<std::mutex>& l);
+
+  int _get_buffer(uint64_t len);
+  void _put_buffer(const FS::aio_t *aio);
+
+public:
+  IOUringDevice(aio_callback_t cb, void *cbpriv);
+
+  void aio_submit(IOContext *ioc) override;
+  int flush() override;
+};
+
+#endif
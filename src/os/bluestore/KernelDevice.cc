@@ -144,7 +144,9 @@ int KernelDevice::open(string p)
   size &= ~(block_size - 1);
 
   r = _aio_start();
-  assert(r == 0);
+  if (r < 0) {
+    goto out_fs;
+  }
 
   dout(1) << __func__
 	  << " size " << size
@@ -156,6 +158,9 @@ int KernelDevice::open(string p)
 	  << dendl;
   return 0;
 
+ out_fs:
+  delete fs;
+  fs = NULL;
  out_fail:
   VOID_TEMP_FAILURE_RETRY(::close(fd_buffered));
   fd_buffered = -1;
@@ -257,22 +262,7 @@ void KernelDevice::_aio_thread()
     if (r > 0) {
       dout(30) << __func__ << " got " << r << " completed aios" << dendl;
       for (int i = 0; i < r; ++i) {
-	IOContext *ioc = static_cast<IOContext*>(aio[i]->priv);
-	_aio_log_finish(ioc, aio[i]->offset, aio[i]->length);
-	int left = --ioc->num_running;
-	int r = aio[i]->get_return_value();
-	dout(10) << __func__ << " finished aio " << aio[i] << " r " << r
-		 << " ioc " << ioc
-		 << " with " << left << " aios left" << dendl;
-	assert(r >= 0);
-	if (left == 0) {
-	  // check waiting count before doing callback (which may
-	  // destroy this ioc).
-	  ioc->aio_wake();
-	  if (ioc->priv) {
-	    aio_callback(aio_callback_priv, ioc->priv);
-	  }
-	}
+	_aio_finish(aio[i], aio[i]->get_return_value());
       }
     }
     reap_ioc();
@@ -290,6 +280,30 @@ void KernelDevice::_aio_thread()
   dout(10) << __func__ << " end" << dendl;
 }
 
+void KernelDevice::_aio_finish(FS::aio_t *aio, int r)
+{
+  IOContext *ioc = static_cast<IOContext*>(aio->priv);
+  _aio_log_finish(ioc, aio->offset, aio->length);
+  int left = --ioc->num_running;
+  dout(10) << __func__ << " finished aio " << aio << " r " << r
+	   << " ioc " << ioc
+	   << " with " << left << " aios left" << dendl;
+  if (r >= 0 && (uint64_t)r != aio->length) {
+    derr << __func__ << " short aio 0x" << std::hex << aio->offset << "~"
+	 << aio->length << std::dec << ": got " << r << dendl;
+    r = -EIO;
+  }
+  assert(r >= 0);
+  if (left == 0) {
+    // check waiting count before doing callback (which may
+    // destroy this ioc).
+    ioc->aio_wake();
+    if (ioc->priv) {
+      aio_callback(aio_callback_priv, ioc->priv);
+    }
+  }
+}
+
 void KernelDevice::_aio_log_start(
   IOContext *ioc,
   uint64_t offset,
@@ -416,13 +430,7 @@ int KernelDevice::aio_write(
       aio.pread(off, len);
       ++injecting_crash;
     } else {
-      bl.prepare_iov(&aio.iov);
-      for (unsigned i=0; i<aio.iov.size(); ++i) {
-	dout(30) << "aio " << i << " " << aio.iov[i].iov_base
-		 << " " << aio.iov[i].iov_len << dendl;
-      }
-      aio.bl.claim_append(bl);
-      aio.pwritev(off);
+      _aio_prep_write(aio, off, bl);
     }
     dout(5) << __func__ << " 0x" << std::hex << off << "~" << len
 	    << std::dec << " aio " << &aio << dendl;
@@ -464,6 +472,18 @@ int KernelDevice::aio_write(
   return 0;
 }
 
+void KernelDevice::_aio_prep_write(FS::aio_t& aio, uint64_t off,
+				   bufferlist& bl)
+{
+  bl.prepare_iov(&aio.iov);
+  for (unsigned i=0; i<aio.iov.size(); ++i) {
+    dout(30) << "aio " << i << " " << aio.iov[i].iov_base
+	     << " " << aio.iov[i].iov_len << dendl;
+  }
+  aio.bl.claim_append(bl);
+  aio.pwritev(off);
+}
+
 int KernelDevice::read(uint64_t off, uint64_t len, bufferlist *pbl,
 		      IOContext *ioc,
 		      bool buffered)
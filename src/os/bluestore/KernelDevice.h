@@ -23,6 +23,7 @@
 #include "BlockDevice.h"
 
 class KernelDevice : public BlockDevice {
+protected:
   int fd_direct, fd_buffered;
   uint64_t size;
   uint64_t block_size;
@@ -54,8 +55,13 @@ class KernelDevice : public BlockDevice {
   std::atomic_int injecting_crash;
 
   void _aio_thread();
-  int _aio_start();
-  void _aio_stop();
+  virtual int _aio_start();
+  virtual void _aio_stop();
+
+  /// set up a direct write of bl at off
+  virtual void _aio_prep_write(FS::aio_t& aio, uint64_t off, bufferlist& bl);
+  /// account for a completed aio and call back once its ioc is done
+  void _aio_finish(FS::aio_t *aio, int r);
 
   void _aio_log_start(IOContext *ioc, uint64_t offset, uint64_t length);
   void _aio_log_finish(IOContext *ioc, uint64_t offset, uint64_t length);
@@ -180,7 +180,8 @@ ECBackend::ECBackend(
   : PGBackend(pg, store, coll, ch),
     cct(cct),
     ec_impl(ec_impl),
-    sinfo(ec_impl->get_data_chunk_count(), stripe_width) {
+    sinfo(ec_impl->get_data_chunk_count(), stripe_width),
+    extent_cache(cct->_conf->osd_ec_extent_cache_size) {
   assert((ec_impl->get_data_chunk_count() *
 	  ec_impl->get_chunk_size(stripe_width)) == stripe_width);
 }
@@ -246,6 +247,8 @@ void ECBackend::handle_recovery_push(
   PushOp &op,
   RecoveryMessages *m)
 {
+  // the pushed object replaces whatever was cached for it
+  extent_cache.invalidate(op.soid);
 
   bool oneshot = op.before_progress.first && op.after_progress.data_complete;
   ghobject_t tobj;
@@ -936,7 +939,8 @@ void ECBackend::handle_sub_read(
       // are read in sections, so the digest check here won't be done here.
       // Do NOT check osd_read_eio_on_bad_digest here.  We need to report
       // the state of our chunk in case other chunks could substitute.
-      if ((bl.length() == hinfo->get_total_chunk_size()) &&
+      if (hinfo->has_chunk_hash() &&
+	  (bl.length() == hinfo->get_total_chunk_size()) &&
 	  (j->get<0>() == 0)) {
 	dout(20) << __func__ << ": Checking hash of " << i->first << dendl;
 	bufferhash h(-1);
@@ -1253,13 +1257,16 @@ void ECBackend::check_recovery_sources(const OSDMapRef& osdmap)
     assert(j != tid_to_read_map.end());
     filter_read_op(osdmap, j->second);
   }
+  retry_rmw_reads();
 }
 
 void ECBackend::on_change()
 {
   dout(10) << __func__ << dendl;
+  waiting_writes.clear();
   writing.clear();
   tid_to_op_map.clear();
+  extent_cache.clear();
   for (map<ceph_tid_t, ReadOp>::iterator i = tid_to_read_map.begin();
        i != tid_to_read_map.end();
        ++i) {
@@ -1338,9 +1345,35 @@ struct MustPrependHashInfo : public ObjectModDesc::Visitor {
       state = FOUND_CREATE_STASH;
     }
   }
+  void rollback_extents(
+    version_t,
+    const vector<pair<uint64_t, uint64_t> > &) {
+    if (state == EMPTY) {
+      state = FOUND_APPEND;
+    }
+  }
   bool must_prepend_hash_info() const { return state == FOUND_APPEND; }
 };
 
+struct RollbackExtentsGetter : public ObjectModDesc::Visitor {
+  boost::optional<version_t> gen;
+  interval_set<uint64_t> extents;
+  void rollback_extents(
+    version_t _gen,
+    const vector<pair<uint64_t, uint64_t> > &_extents) {
+    assert(!gen || *gen == _gen);
+    gen = _gen;
+    for (vector<pair<uint64_t, uint64_t> >::const_iterator i =
+	   _extents.begin();
+	 i != _extents.end();
+	 ++i) {
+      interval_set<uint64_t> extent;
+      extent.insert(i->first, i->second);
+      extents.union_of(extent);
+    }
+  }
+};
+
 void ECBackend::submit_transaction(
   const hobject_t &hoid,
   const eversion_t &at_version,
@@ -1415,9 +1448,236 @@ void ECBackend::submit_transaction(
   }
 
   dout(10) << __func__ << ": op " << *op << " starting" << dendl;
-  start_write(op);
-  writing.push_back(op);
-  dout(10) << "onreadable_sync: " << op->on_local_applied_sync << dendl;
+  waiting_writes.push_back(op);
+  check_waiting_writes();
+}
+
+bool ECBackend::writing_unapplied(const Op *op) const
+{
+  for (list<Op*>::const_iterator i = writing.begin();
+       i != writing.end();
+       ++i) {
+    if ((*i)->pending_apply.empty())
+      continue;
+    for (map<hobject_t, interval_set<uint64_t>,
+	   hobject_t::BitwiseComparator>::const_iterator j = op->rmw_reads.begin();
+	 j != op->rmw_reads.end();
+	 ++j) {
+      if ((*i)->replaced.count(j->first))
+	return true;
+      if (!(*i)->stripes_cached && (*i)->unstable_hash_infos.count(j->first))
+	return true;
+    }
+  }
+  return false;
+}
+
+struct FinishRMWRead :
+  public GenContext<pair<RecoveryMessages*, ECBackend::read_result_t& > &> {
+  ECBackend *ec;
+  ceph_tid_t tid;
+  hobject_t hoid;
+  FinishRMWRead(ECBackend *ec, ceph_tid_t tid, const hobject_t &hoid)
+    : ec(ec), tid(tid), hoid(hoid) {}
+  void finish(pair<RecoveryMessages *, ECBackend::read_result_t &> &in) {
+    map<ceph_tid_t, ECBackend::Op>::iterator i = ec->tid_to_op_map.find(tid);
+    assert(i != ec->tid_to_op_map.end());
+    ec->handle_rmw_read(&(i->second), hoid, in.second);
+  }
+};
+
+void ECBackend::start_rmw_read(Op *op)
+{
+  set<int> want_to_read;
+  get_want_to_read_shards(&want_to_read);
+
+  // on a retry, only the objects that failed are read again
+  set<hobject_t, hobject_t::BitwiseComparator> retry;
+  retry.swap(op->rmw_failed);
+
+  map<hobject_t, read_request_t, hobject_t::BitwiseComparator> for_read_op;
+  for (map<hobject_t, interval_set<uint64_t>,
+	 hobject_t::BitwiseComparator>::iterator i = op->rmw_reads.begin();
+       i != op->rmw_reads.end();
+       ++i) {
+    if (!retry.empty() && !retry.count(i->first))
+      continue;
+    list<boost::tuple<uint64_t, uint64_t, uint32_t> > offsets;
+    for (interval_set<uint64_t>::iterator j = i->second.begin();
+	 j != i->second.end();
+	 ++j) {
+      offsets.push_back(boost::make_tuple(j.get_start(), j.get_len(), 0));
+    }
+    set<pg_shard_t> shards;
+    int r = get_min_avail_to_read_shards(
+      i->first,
+      want_to_read,
+      false,
+      false,
+      &shards);
+    if (r < 0) {
+      dout(10) << __func__ << ": not enough shards to read " << i->first
+	       << " for " << *op << ", waiting for a new map" << dendl;
+      op->rmw_failed.insert(i->first);
+      continue;
+    }
+    for_read_op.insert(
+      make_pair(
+	i->first,
+	read_request_t(
+	  i->first,
+	  offsets,
+	  shards,
+	  false,
+	  new FinishRMWRead(this, op->tid, i->first))));
+    op->rmw_pending.insert(i->first);
+  }
+  dout(10) << __func__ << ": reading " << op->rmw_reads
+	   << " for " << *op << dendl;
+  op->rmw_state = Op::RMW_READING;
+  if (!for_read_op.empty()) {
+    start_read_op(
+      CEPH_MSG_PRIO_DEFAULT,
+      for_read_op,
+      op->client_op,
+      false, false);
+  }
+}
+
+void ECBackend::handle_rmw_read(
+  Op *op,
+  const hobject_t &hoid,
+  read_result_t &res)
+{
+  if (res.r != 0) {
+    // the read already fell back to every other shard: the stripes
+    // cannot be rebuilt now.  Like a write to an unfound object, the
+    // op (and every later write) waits, and the read is retried on
+    // the next map; an interval change requeues it anyway.
+    get_parent()->clog_error() << get_parent()->get_info().pgid << " "
+			       << __func__ << ": error " << res.r
+			       << " reading partial stripes of " << hoid
+			       << " for an overwrite, will retry";
+    op->rmw_pending.erase(hoid);
+    op->rmw_failed.insert(hoid);
+    return;
+  }
+  map<uint64_t, bufferlist> &stripes = op->rmw_stripes[hoid].stripes;
+  for (list<boost::tuple<uint64_t, uint64_t, map<pg_shard_t, bufferlist> > >::iterator i =
+	 res.returned.begin();
+       i != res.returned.end();
+       ++i) {
+    map<int, bufferlist> to_decode;
+    for (map<pg_shard_t, bufferlist>::iterator j = i->get<2>().begin();
+	 j != i->get<2>().end();
+	 ++j) {
+      to_decode[j->first.shard].claim(j->second);
+    }
+    bufferlist bl;
+    int r = ECUtil::decode(sinfo, ec_impl, to_decode, &bl);
+    assert(r == 0);
+    assert(bl.length() == i->get<1>());
+    for (uint64_t pos = 0; pos < bl.length(); pos += sinfo.get_stripe_width()) {
+      stripes[i->get<0>() + pos].substr_of(bl, pos, sinfo.get_stripe_width());
+    }
+  }
+  op->rmw_pending.erase(hoid);
+  if (op->rmw_pending.empty() && op->rmw_failed.empty()) {
+    op->rmw_state = Op::RMW_READY;
+    check_waiting_writes();
+  }
+}
+
+void ECBackend::retry_rmw_reads()
+{
+  if (waiting_writes.empty())
+    return;
+  // only the head of waiting_writes can be reading
+  Op *op = waiting_writes.front();
+  if (op->rmw_state != Op::RMW_READING ||
+      !op->rmw_pending.empty() ||
+      op->rmw_failed.empty())
+    return;
+  dout(10) << __func__ << ": retrying " << op->rmw_failed
+	   << " for " << *op << dendl;
+  start_rmw_read(op);
+  if (op->rmw_pending.empty() && op->rmw_failed.empty()) {
+    op->rmw_state = Op::RMW_READY;
+    check_waiting_writes();
+  }
+}
+
+void ECBackend::plan_cached_reads(Op *op)
+{
+  for (map<hobject_t, ECUtil::HashInfoRef,
+	 hobject_t::BitwiseComparator>::iterator i =
+	 op->unstable_hash_infos.begin();
+       i != op->unstable_hash_infos.end();
+       ++i) {
+    const ECUtil::object_stripes_t *cached = extent_cache.get(i->first);
+    if (cached)
+      op->rmw_stripes[i->first] = *cached;
+  }
+
+  map<hobject_t, interval_set<uint64_t>,
+      hobject_t::BitwiseComparator>::iterator i = op->rmw_reads.begin();
+  while (i != op->rmw_reads.end()) {
+    ECTransaction::stripe_map_t::iterator obj = op->rmw_stripes.find(i->first);
+    if (obj == op->rmw_stripes.end()) {
+      ++i;
+      continue;
+    }
+    interval_set<uint64_t> to_read;
+    for (interval_set<uint64_t>::iterator j = i->second.begin();
+	 j != i->second.end();
+	 ++j) {
+      for (uint64_t off = j.get_start();
+	   off < j.get_start() + j.get_len();
+	   off += sinfo.get_stripe_width()) {
+	if (off < obj->second.valid_to && !obj->second.stripes.count(off))
+	  to_read.insert(off, sinfo.get_stripe_width());
+      }
+    }
+    if (to_read.empty()) {
+      op->rmw_reads.erase(i++);
+    } else {
+      i->second.swap(to_read);
+      ++i;
+    }
+  }
+  dout(20) << __func__ << ": " << *op << " still reading " << op->rmw_reads
+	   << dendl;
+}
+
+void ECBackend::check_waiting_writes()
+{
+  while (!waiting_writes.empty()) {
+    Op *op = waiting_writes.front();
+    if (op->rmw_state == Op::RMW_UNPLANNED) {
+      // every earlier op has generated its transaction by now, so the
+      // unstable hash infos give the sizes this op will see
+      op->t->get_rmw_reads(op->unstable_hash_infos, sinfo, &op->rmw_reads);
+      if (get_parent()->get_pool().allows_ecoverwrites())
+	plan_cached_reads(op);
+      op->rmw_state = op->rmw_reads.empty() ?
+	Op::RMW_READY : Op::RMW_WAIT_APPLY;
+    }
+    if (op->rmw_state == Op::RMW_WAIT_APPLY) {
+      if (writing_unapplied(op)) {
+	dout(20) << __func__ << ": " << *op
+		 << " waiting for earlier writes to apply" << dendl;
+	return;
+      }
+      start_rmw_read(op);
+    }
+    if (op->rmw_state == Op::RMW_READING)
+      return;
+
+    waiting_writes.pop_front();
+    start_write(op);
+    writing.push_back(op);
+    dout(10) << "onreadable_sync: " << op->on_local_applied_sync << dendl;
+  }
 }
 
 int ECBackend::get_min_avail_to_read_shards(
@@ -1756,6 +2016,15 @@ void ECBackend::check_op(Op *op)
     op->on_all_commit->complete(0);
     op->on_all_commit = 0;
   }
+  if (op->pending_apply.empty() && !op->cache_pins.empty()) {
+    for (set<hobject_t, hobject_t::BitwiseComparator>::iterator i =
+	   op->cache_pins.begin();
+	 i != op->cache_pins.end();
+	 ++i) {
+      extent_cache.release(*i, op->tid);
+    }
+    op->cache_pins.clear();
+  }
   if (op->pending_apply.empty() && op->pending_commit.empty()) {
     // done!
     assert(writing.front() == op);
@@ -1768,6 +2037,8 @@ void ECBackend::check_op(Op *op)
        ++i) {
     dout(20) << __func__ << " tid " << i->first <<": " << i->second << dendl;
   }
+  if (!waiting_writes.empty())
+    check_waiting_writes();
 }
 
 void ECBackend::start_write(Op *op) {
@@ -1780,14 +2051,38 @@ void ECBackend::start_write(Op *op) {
   }
   ObjectStore::Transaction empty;
 
+  ECTransaction::rollback_extents_t rollback_extents;
+  for (vector<pg_log_entry_t>::iterator i = op->log_entries.begin();
+       i != op->log_entries.end();
+       ++i) {
+    RollbackExtentsGetter vis;
+    i->mod_desc.visit(&vis);
+    if (vis.gen)
+      rollback_extents[i->soid] = make_pair(*(vis.gen), vis.extents);
+  }
+
+  bool cache = get_parent()->get_pool().allows_ecoverwrites();
   op->t->generate_transactions(
     op->unstable_hash_infos,
     ec_impl,
     get_parent()->get_info().pgid.pgid,
     sinfo,
+    cache ? &(op->rmw_stripes) : NULL,
+    rollback_extents,
     &trans,
     &(op->temp_added),
     &(op->temp_cleared));
+  if (cache) {
+    for (ECTransaction::stripe_map_t::iterator i = op->rmw_stripes.begin();
+	 i != op->rmw_stripes.end();
+	 ++i) {
+      extent_cache.update(i->first, i->second, op->tid);
+      op->cache_pins.insert(i->first);
+    }
+    op->t->get_replaced_objects(&(op->replaced));
+    op->stripes_cached = true;
+  }
+  op->rmw_stripes.clear();
 
   dout(10) << "onreadable_sync: " << op->on_local_applied_sync << dendl;
 
@@ -1924,6 +2219,56 @@ out:
   }
 };
 
+bool ECBackend::read_cached(
+  const hobject_t &hoid,
+  const list<pair<boost::tuple<uint64_t, uint64_t, uint32_t>,
+		  pair<bufferlist*, Context*> > > &to_read)
+{
+  if (!extent_cache.get(hoid))
+    return false;
+  ECUtil::HashInfoRef hinfo = get_hash_info(hoid, false);
+  if (!hinfo)
+    return false;
+  uint64_t size = sinfo.aligned_chunk_offset_to_logical_offset(
+    hinfo->get_total_chunk_size());
+
+  list<bufferlist> bls;
+  for (list<pair<boost::tuple<uint64_t, uint64_t, uint32_t>,
+		 pair<bufferlist*, Context*> > >::const_iterator i =
+	 to_read.begin();
+       i != to_read.end();
+       ++i) {
+    uint64_t off = i->first.get<0>();
+    pair<uint64_t, uint64_t> bounds = sinfo.offset_len_to_stripe_bounds(
+      make_pair(off, i->first.get<1>()));
+    bounds.second = MIN(bounds.first + bounds.second, size);
+    bounds.second = bounds.second > bounds.first ?
+      bounds.second - bounds.first : 0;
+    bufferlist bl;
+    if (!extent_cache.read(hoid, sinfo.get_stripe_width(),
+			   bounds.first, bounds.second, &bl))
+      return false;
+    bls.push_back(bufferlist());
+    if (off - bounds.first < bl.length())
+      bls.back().substr_of(
+	bl, off - bounds.first,
+	MIN(i->first.get<1>(), bl.length() - (off - bounds.first)));
+  }
+
+  dout(10) << __func__ << ": " << hoid << " " << to_read.size()
+	   << " extents from the extent cache" << dendl;
+  for (list<pair<boost::tuple<uint64_t, uint64_t, uint32_t>,
+		 pair<bufferlist*, Context*> > >::const_iterator i =
+	 to_read.begin();
+       i != to_read.end();
+       ++i, bls.pop_front()) {
+    i->second.first->claim(bls.front());
+    if (i->second.second)
+      i->second.second->complete(i->second.first->length());
+  }
+  return true;
+}
+
 void ECBackend::objects_read_async(
   const hobject_t &hoid,
   const list<pair<boost::tuple<uint64_t, uint64_t, uint32_t>,
@@ -1932,6 +2277,18 @@ void ECBackend::objects_read_async(
   bool fast_read)
 {
   in_progress_client_reads.push_back(ClientAsyncReadStatus(on_complete));
+  if (read_cached(hoid, to_read)) {
+    in_progress_client_reads.back().complete = true;
+    while (in_progress_client_reads.size() &&
+	   in_progress_client_reads.front().complete) {
+      if (in_progress_client_reads.front().on_complete) {
+	in_progress_client_reads.front().on_complete->complete(0);
+	in_progress_client_reads.front().on_complete = NULL;
+      }
+      in_progress_client_reads.pop_front();
+    }
+    return;
+  }
   CallClientContexts *c = new CallClientContexts(
     this, &(in_progress_client_reads.back()), to_read);
 
@@ -2041,14 +2398,36 @@ void ECBackend::rollback_append(
   uint64_t old_size,
   ObjectStore::Transaction *t)
 {
-  assert(old_size % sinfo.get_stripe_width() == 0);
+  // with overwrites the old size need not be stripe aligned, but the
+  // shards always hold whole stripes
   t->truncate(
     coll,
     ghobject_t(hoid, ghobject_t::NO_GEN, get_parent()->whoami_shard().shard),
-    sinfo.aligned_logical_offset_to_chunk_offset(
+    sinfo.logical_to_next_chunk_offset(
       old_size));
 }
 
+void ECBackend::rollback_extents(
+  version_t gen,
+  const vector<pair<uint64_t, uint64_t> > &extents,
+  const hobject_t &hoid,
+  ObjectStore::Transaction *t)
+{
+  for (vector<pair<uint64_t, uint64_t> >::const_iterator i = extents.begin();
+       i != extents.end();
+       ++i) {
+    pair<uint64_t, uint64_t> chunk = sinfo.aligned_offset_len_to_chunk(*i);
+    t->clone_range(
+      coll,
+      ghobject_t(hoid, gen, get_parent()->whoami_shard().shard),
+      ghobject_t(hoid, ghobject_t::NO_GEN, get_parent()->whoami_shard().shard),
+      chunk.first, chunk.second, chunk.first);
+  }
+  t->remove(
+    coll,
+    ghobject_t(hoid, gen, get_parent()->whoami_shard().shard));
+}
+
 void ECBackend::be_deep_scrub(
   const hobject_t &poid,
   uint32_t seed,
@@ -2098,6 +2477,15 @@ void ECBackend::be_deep_scrub(
     o.read_error = true;
     o.digest_present = false;
     return;
+  } else if (!hinfo->has_chunk_hash()) {
+    // overwritten in place: the object store verified its checksums
+    // while we read the chunk, which is all we can check here
+    if (hinfo->get_total_chunk_size() != pos) {
+      dout(0) << "_scan_list  " << poid << " got incorrect size on read" << dendl;
+      o.read_error = true;
+      return;
+    }
+    o.digest_present = false;
   } else {
     if (hinfo->get_chunk_hash(get_parent()->whoami_shard().shard) != h.digest()) {
       dout(0) << "_scan_list  " << poid << " got incorrect hash on read" << dendl;
@@ -20,6 +20,7 @@
 #include "erasure-code/ErasureCodeInterface.h"
 #include "ECUtil.h"
 #include "ECTransaction.h"
+#include "ExtentCache.h"
 
 //forward declaration
 struct ECSubWrite;
@@ -344,6 +345,17 @@ public:
    * As with client reads, there is a possibility of out-of-order
    * completions. Thus, callbacks and completion are called in order
    * on the writing list.
+   *
+   * On pools with FLAG_EC_OVERWRITES a write may only partially cover
+   * some stripes.  Those stripes are taken from extent_cache or read
+   * back before the transaction is generated, so ops wait on
+   * waiting_writes, in order, until their reads are done and only then
+   * move to the writing list.  Every write on such a pool leaves the
+   * stripes it generated in extent_cache until it is applied, so a
+   * stripe that is not there is current on the shards and can be read
+   * while earlier writes to other stripes of the object are in flight;
+   * only objects an unapplied write cloned or renamed into, whose
+   * shards do not exist yet, have to wait for it.
    */
   struct Op {
     hobject_t hoid;
@@ -368,6 +380,25 @@ public:
     set<pg_shard_t> pending_apply;
 
     map<hobject_t, ECUtil::HashInfoRef, hobject_t::BitwiseComparator> unstable_hash_infos;
+
+    enum rmw_state_t {
+      RMW_UNPLANNED,  ///< partial stripes not yet known
+      RMW_WAIT_APPLY, ///< waiting for earlier writes to apply
+      RMW_READING,    ///< reading the partial stripes
+      RMW_READY       ///< ready to generate the transaction
+    } rmw_state;
+    map<hobject_t, interval_set<uint64_t>, hobject_t::BitwiseComparator> rmw_reads;
+    set<hobject_t, hobject_t::BitwiseComparator> rmw_pending;
+    /// objects too few shards could read; retried on the next map
+    set<hobject_t, hobject_t::BitwiseComparator> rmw_failed;
+    ECTransaction::stripe_map_t rmw_stripes;
+
+    bool stripes_cached; ///< extent_cache covers what this op changed
+    set<hobject_t, hobject_t::BitwiseComparator> cache_pins;
+    set<hobject_t, hobject_t::BitwiseComparator> replaced;
+
+    Op() : on_local_applied_sync(0), on_all_applied(0), on_all_commit(0),
+	   tid(0), rmw_state(RMW_UNPLANNED), stripes_cached(false) {}
     ~Op() {
       delete on_local_applied_sync;
       delete on_all_applied;
@@ -396,8 +427,26 @@ public:
     RecoveryMessages *m);
 
   map<ceph_tid_t, Op> tid_to_op_map; /// lists below point into here
+  list<Op*> waiting_writes;
   list<Op*> writing;
 
+  friend struct FinishRMWRead;
+  bool writing_unapplied(const Op *op) const;
+  void start_rmw_read(Op *op);
+  void handle_rmw_read(
+    Op *op,
+    const hobject_t &hoid,
+    read_result_t &res);
+  void retry_rmw_reads();
+  void plan_cached_reads(Op *op);
+  void check_waiting_writes();
+
+  ExtentCache extent_cache;
+  bool read_cached(
+    const hobject_t &hoid,
+    const list<pair<boost::tuple<uint64_t, uint64_t, uint32_t>,
+		    pair<bufferlist*, Context*> > > &to_read);
+
   CephContext *cct;
   ErasureCodeInterfaceRef ec_impl;
 
@@ -493,6 +542,11 @@ public:
     const hobject_t &hoid,
     uint64_t old_size,
     ObjectStore::Transaction *t);
+  void rollback_extents(
+    version_t gen,
+    const vector<pair<uint64_t, uint64_t> > &extents,
+    const hobject_t &hoid,
+    ObjectStore::Transaction *t);
 
   bool scrub_supported() { return true; }
   bool auto_repair_supported() const { return true; }
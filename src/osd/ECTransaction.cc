@@ -26,6 +26,12 @@ struct AppendObjectsGenerator: public boost::static_visitor<void> {
   void operator()(const ECTransaction::AppendOp &op) {
     out->insert(op.oid);
   }
+  void operator()(const ECTransaction::OverwriteOp &op) {
+    out->insert(op.oid);
+  }
+  void operator()(const ECTransaction::TruncateOp &op) {
+    out->insert(op.oid);
+  }
   void operator()(const ECTransaction::TouchOp &op) {
     out->insert(op.oid);
   }
@@ -55,22 +61,134 @@ void ECTransaction::get_append_objects(
   reverse_visit(gen);
 }
 
+struct RMWReadPlanner : public boost::static_visitor<void> {
+  typedef map<hobject_t, ECUtil::HashInfoRef, hobject_t::BitwiseComparator> hinfo_map_t;
+  const hinfo_map_t &hash_infos;
+  const ECUtil::stripe_info_t &sinfo;
+  map<hobject_t, interval_set<uint64_t>, hobject_t::BitwiseComparator> *out;
+
+  /// object whose pre-transaction data an object now holds, if any
+  map<hobject_t, boost::optional<hobject_t>, hobject_t::BitwiseComparator> origin;
+
+  RMWReadPlanner(
+    const hinfo_map_t &hash_infos,
+    const ECUtil::stripe_info_t &sinfo,
+    map<hobject_t, interval_set<uint64_t>, hobject_t::BitwiseComparator> *out)
+    : hash_infos(hash_infos), sinfo(sinfo), out(out) {}
+
+  boost::optional<hobject_t> get_origin(const hobject_t &oid) const {
+    map<hobject_t, boost::optional<hobject_t>,
+	hobject_t::BitwiseComparator>::const_iterator i = origin.find(oid);
+    if (i == origin.end())
+      return oid;
+    return i->second;
+  }
+  void read_stripe(const hobject_t &oid, uint64_t off) {
+    boost::optional<hobject_t> from = get_origin(oid);
+    if (!from)
+      return;
+    hinfo_map_t::const_iterator i = hash_infos.find(*from);
+    assert(i != hash_infos.end());
+    uint64_t size = sinfo.aligned_chunk_offset_to_logical_offset(
+      i->second->get_total_chunk_size());
+    if (off >= size)
+      return;
+    interval_set<uint64_t> &reads = (*out)[*from];
+    if (!reads.contains(off, sinfo.get_stripe_width()))
+      reads.insert(off, sinfo.get_stripe_width());
+  }
+
+  void operator()(const ECTransaction::OverwriteOp &op) {
+    uint64_t end = op.off + op.bl.length();
+    if (op.off % sinfo.get_stripe_width())
+      read_stripe(op.oid, sinfo.logical_to_prev_stripe_offset(op.off));
+    if (end % sinfo.get_stripe_width())
+      read_stripe(op.oid, sinfo.logical_to_prev_stripe_offset(end));
+  }
+  void operator()(const ECTransaction::TruncateOp &op) {
+    if (op.off % sinfo.get_stripe_width())
+      read_stripe(op.oid, sinfo.logical_to_prev_stripe_offset(op.off));
+  }
+  void operator()(const ECTransaction::CloneOp &op) {
+    origin[op.target] = get_origin(op.source);
+  }
+  void operator()(const ECTransaction::RenameOp &op) {
+    origin[op.destination] = get_origin(op.source);
+    origin[op.source] = boost::none;
+  }
+  void operator()(const ECTransaction::StashOp &op) {
+    origin[op.oid] = boost::none;
+  }
+  void operator()(const ECTransaction::RemoveOp &op) {
+    origin[op.oid] = boost::none;
+  }
+  void operator()(const ECTransaction::AppendOp &op) {}
+  void operator()(const ECTransaction::TouchOp &op) {}
+  void operator()(const ECTransaction::SetAttrsOp &op) {}
+  void operator()(const ECTransaction::RmAttrOp &op) {}
+  void operator()(const ECTransaction::AllocHintOp &op) {}
+  void operator()(const ECTransaction::NoOp &op) {}
+};
+void ECTransaction::get_rmw_reads(
+  const map<hobject_t, ECUtil::HashInfoRef, hobject_t::BitwiseComparator> &hash_infos,
+  const ECUtil::stripe_info_t &sinfo,
+  map<hobject_t, interval_set<uint64_t>, hobject_t::BitwiseComparator> *out) const
+{
+  if (!overwrites)
+    return;
+  RMWReadPlanner planner(hash_infos, sinfo, out);
+  visit(planner);
+}
+
+struct ReplacedObjectsGenerator : public boost::static_visitor<void> {
+  set<hobject_t, hobject_t::BitwiseComparator> *out;
+  explicit ReplacedObjectsGenerator(
+    set<hobject_t, hobject_t::BitwiseComparator> *out) : out(out) {}
+  void operator()(const ECTransaction::CloneOp &op) {
+    out->insert(op.target);
+  }
+  void operator()(const ECTransaction::RenameOp &op) {
+    out->insert(op.destination);
+  }
+  template <typename T>
+  void operator()(const T &op) {}
+};
+void ECTransaction::get_replaced_objects(
+  set<hobject_t, hobject_t::BitwiseComparator> *out) const
+{
+  ReplacedObjectsGenerator gen(out);
+  visit(gen);
+}
+
 struct TransGenerator : public boost::static_visitor<void> {
   map<hobject_t, ECUtil::HashInfoRef, hobject_t::BitwiseComparator> &hash_infos;
 
   ErasureCodeInterfaceRef &ecimpl;
   const pg_t pgid;
   const ECUtil::stripe_info_t sinfo;
+  const ECTransaction::rollback_extents_t &rollback_extents;
   map<shard_id_t, ObjectStore::Transaction> *trans;
   set<int> want;
   set<hobject_t, hobject_t::BitwiseComparator> *temp_added;
   set<hobject_t, hobject_t::BitwiseComparator> *temp_removed;
   stringstream *out;
+
+  /**
+   * Current contents of the stripes an overwrite may need, per object.
+   * Below valid_to every stripe not in stripes was neither read nor
+   * cached because no overwrite only partially covers it.
+   */
+  ECTransaction::stripe_map_t *stripes;
+  set<hobject_t, hobject_t::BitwiseComparator> loaded;
+  set<hobject_t, hobject_t::BitwiseComparator> stashed;
+
   TransGenerator(
     map<hobject_t, ECUtil::HashInfoRef, hobject_t::BitwiseComparator> &hash_infos,
     ErasureCodeInterfaceRef &ecimpl,
     pg_t pgid,
     const ECUtil::stripe_info_t &sinfo,
+    ECTransaction::stripe_map_t *stripes,
+    const ECTransaction::rollback_extents_t &rollback_extents,
     map<shard_id_t, ObjectStore::Transaction> *trans,
     set<hobject_t, hobject_t::BitwiseComparator> *temp_added,
     set<hobject_t, hobject_t::BitwiseComparator> *temp_removed,
@@ -78,14 +196,129 @@ struct TransGenerator : public boost::static_visitor<void> {
     : hash_infos(hash_infos),
       ecimpl(ecimpl), pgid(pgid),
       sinfo(sinfo),
+      rollback_extents(rollback_extents),
       trans(trans),
       temp_added(temp_added), temp_removed(temp_removed),
-      out(out) {
+      out(out),
+      stripes(stripes) {
     for (unsigned i = 0; i < ecimpl->get_chunk_count(); ++i) {
       want.insert(i);
     }
   }
 
+  uint64_t get_logical_size(const ECUtil::HashInfoRef &hinfo) const {
+    return sinfo.aligned_chunk_offset_to_logical_offset(
+      hinfo->get_total_chunk_size());
+  }
+  ECUtil::object_stripes_t &get_stripes(const hobject_t &oid) {
+    assert(stripes);
+    ECUtil::object_stripes_t &obj = (*stripes)[oid];
+    if (loaded.insert(oid).second) {
+      // first use in this transaction: nothing past the object is known
+      assert(hash_infos.count(oid));
+      obj.valid_to = MIN(obj.valid_to, get_logical_size(hash_infos[oid]));
+    }
+    return obj;
+  }
+  bufferlist get_stripe(const hobject_t &oid, uint64_t off) {
+    ECUtil::object_stripes_t &obj = get_stripes(oid);
+    map<uint64_t, bufferlist>::iterator i = obj.stripes.find(off);
+    if (i != obj.stripes.end())
+      return i->second;
+    assert(off >= obj.valid_to);
+    bufferlist bl;
+    bl.append_zero(sinfo.get_stripe_width());
+    return bl;
+  }
+  void cache_stripes(const hobject_t &oid, uint64_t off, bufferlist &bl) {
+    if (!stripes)
+      return;
+    ECUtil::object_stripes_t &obj = get_stripes(oid);
+    for (uint64_t pos = 0; pos < bl.length(); pos += sinfo.get_stripe_width()) {
+      obj.stripes[off + pos].substr_of(bl, pos, sinfo.get_stripe_width());
+    }
+  }
+  void clear_stripes(const hobject_t &oid) {
+    if (!stripes)
+      return;
+    loaded.insert(oid);
+    ECUtil::object_stripes_t &obj = (*stripes)[oid];
+    obj.stripes.clear();
+    obj.valid_to = 0;
+  }
+
+  /// clone the extents the log entry will roll back into the stash object
+  void stash_extents(const hobject_t &oid, const ECUtil::HashInfoRef &hinfo) {
+    ECTransaction::rollback_extents_t::const_iterator i =
+      rollback_extents.find(oid);
+    if (i == rollback_extents.end() || stashed.count(oid))
+      return;
+    stashed.insert(oid);
+    uint64_t size = get_logical_size(hinfo);
+    for (interval_set<uint64_t>::const_iterator j = i->second.second.begin();
+	 j != i->second.second.end();
+	 ++j) {
+      assert(j.get_start() + j.get_len() <= size);
+      pair<uint64_t, uint64_t> chunk = sinfo.aligned_offset_len_to_chunk(
+	make_pair(j.get_start(), j.get_len()));
+      for (map<shard_id_t, ObjectStore::Transaction>::iterator k = trans->begin();
+	   k != trans->end();
+	   ++k) {
+	k->second.clone_range(
+	  get_coll_ct(k->first, oid),
+	  ghobject_t(oid, ghobject_t::NO_GEN, k->first),
+	  ghobject_t(oid, i->second.first, k->first),
+	  chunk.first, chunk.second, chunk.first);
+      }
+    }
+  }
+
+  /// encode whole stripes starting at off and write them to every shard
+  void write_stripes(
+    const hobject_t &oid,
+    uint64_t off,
+    bufferlist &bl,
+    uint32_t fadvise_flags,
+    const ECUtil::HashInfoRef &hinfo) {
+    assert(off % sinfo.get_stripe_width() == 0);
+    assert(bl.length() % sinfo.get_stripe_width() == 0);
+    map<int, bufferlist> buffers;
+    int r = ECUtil::encode(sinfo, ecimpl, bl, want, &buffers);
+    assert(r == 0);
+    cache_stripes(oid, off, bl);
+
+    uint64_t chunk_end = sinfo.aligned_logical_offset_to_chunk_offset(
+      off + bl.length());
+    hinfo->set_total_chunk_size_clear_hash(
+      MAX(hinfo->get_total_chunk_size(), chunk_end));
+    for (map<shard_id_t, ObjectStore::Transaction>::iterator i = trans->begin();
+	 i != trans->end();
+	 ++i) {
+      assert(buffers.count(i->first));
+      bufferlist &enc_bl = buffers[i->first];
+      i->second.write(
+	get_coll_ct(i->first, oid),
+	ghobject_t(oid, ghobject_t::NO_GEN, i->first),
+	sinfo.aligned_logical_offset_to_chunk_offset(off),
+	enc_bl.length(),
+	enc_bl,
+	fadvise_flags);
+    }
+  }
+  void write_hinfo(const hobject_t &oid, const ECUtil::HashInfoRef &hinfo) {
+    bufferlist hbuf;
+    ::encode(*hinfo, hbuf);
+    for (map<shard_id_t, ObjectStore::Transaction>::iterator i = trans->begin();
+	 i != trans->end();
+	 ++i) {
+      i->second.setattr(
+	get_coll_ct(i->first, oid),
+	ghobject_t(oid, ghobject_t::NO_GEN, i->first),
+	ECUtil::get_hinfo_key(),
+	hbuf);
+    }
+  }
+
   coll_t get_coll_ct(shard_id_t shard, const hobject_t &hoid) {
     if (hoid.is_temp()) {
       temp_removed->erase(hoid);
@@ -146,6 +379,7 @@ struct TransGenerator : public boost::static_visitor<void> {
     int r = ECUtil::encode(
       sinfo, ecimpl, bl, want, &buffers);
 
+    cache_stripes(op.oid, offset, bl);
     hinfo->append(
       sinfo.aligned_logical_offset_to_chunk_offset(op.off),
       buffers);
@@ -181,10 +415,78 @@ struct TransGenerator : public boost::static_visitor<void> {
 	hbuf);
     }
   }
+  void operator()(const ECTransaction::OverwriteOp &op) {
+    assert(hash_infos.count(op.oid));
+    ECUtil::HashInfoRef hinfo = hash_infos[op.oid];
+    stash_extents(op.oid, hinfo);
+
+    uint64_t end = op.off + op.bl.length();
+    uint64_t start = sinfo.logical_to_prev_stripe_offset(op.off);
+    uint64_t stripe_end = sinfo.logical_to_next_stripe_offset(end);
+    uint64_t last = stripe_end - sinfo.get_stripe_width();
+
+    // merge the new data into the stripes it only partially covers
+    bufferlist bl;
+    if (op.off > start) {
+      bufferlist head = get_stripe(op.oid, start);
+      bl.substr_of(head, 0, op.off - start);
+    }
+    bl.append(op.bl);
+    if (end < stripe_end) {
+      bufferlist tail = get_stripe(op.oid, last);
+      bufferlist rest;
+      rest.substr_of(tail, end - last, stripe_end - end);
+      bl.claim_append(rest);
+    }
+    assert(bl.length() == stripe_end - start);
+
+    write_stripes(op.oid, start, bl, op.fadvise_flags, hinfo);
+    write_hinfo(op.oid, hinfo);
+  }
+  void operator()(const ECTransaction::TruncateOp &op) {
+    assert(hash_infos.count(op.oid));
+    ECUtil::HashInfoRef hinfo = hash_infos[op.oid];
+    stash_extents(op.oid, hinfo);
+
+    uint64_t old_end = get_logical_size(hinfo);
+    uint64_t new_end = sinfo.logical_to_next_stripe_offset(op.off);
+    if ((op.off % sinfo.get_stripe_width()) && op.off < old_end) {
+      // zero the tail of the new last stripe so a later extension
+      // reads back zeros
+      uint64_t start = sinfo.logical_to_prev_stripe_offset(op.off);
+      bufferlist stripe = get_stripe(op.oid, start);
+      bufferlist bl;
+      bl.substr_of(stripe, 0, op.off - start);
+      bl.append_zero(new_end - op.off);
+      write_stripes(op.oid, start, bl, 0, hinfo);
+    }
+    if (stripes) {
+      ECUtil::object_stripes_t &obj = get_stripes(op.oid);
+      obj.stripes.erase(obj.stripes.lower_bound(new_end), obj.stripes.end());
+      obj.valid_to = MIN(obj.valid_to, new_end);
+    }
+
+    uint64_t chunk_end = sinfo.aligned_logical_offset_to_chunk_offset(new_end);
+    hinfo->set_total_chunk_size_clear_hash(chunk_end);
+    for (map<shard_id_t, ObjectStore::Transaction>::iterator i = trans->begin();
+	 i != trans->end();
+	 ++i) {
+      i->second.truncate(
+	get_coll_ct(i->first, op.oid),
+	ghobject_t(op.oid, ghobject_t::NO_GEN, i->first),
+	chunk_end);
+    }
+    write_hinfo(op.oid, hinfo);
+  }
   void operator()(const ECTransaction::CloneOp &op) {
     assert(hash_infos.count(op.source));
     assert(hash_infos.count(op.target));
     *(hash_infos[op.target]) = *(hash_infos[op.source]);
+    if (stripes) {
+      ECUtil::object_stripes_t &obj = get_stripes(op.source);
+      (*stripes)[op.target] = obj;
+      loaded.insert(op.target);
+    }
     for (map<shard_id_t, ObjectStore::Transaction>::iterator i = trans->begin();
 	 i != trans->end();
 	 ++i) {
@@ -198,6 +500,12 @@ struct TransGenerator : public boost::static_visitor<void> {
     assert(hash_infos.count(op.source));
     assert(hash_infos.count(op.destination));
     *(hash_infos[op.destination]) = *(hash_infos[op.source]);
+    if (stripes) {
+      ECUtil::object_stripes_t &obj = get_stripes(op.source);
+      (*stripes)[op.destination] = obj;
+      loaded.insert(op.destination);
+    }
+    clear_stripes(op.source);
     hash_infos[op.source]->clear();
     for (map<shard_id_t, ObjectStore::Transaction>::iterator i = trans->begin();
 	 i != trans->end();
@@ -212,6 +520,7 @@ struct TransGenerator : public boost::static_visitor<void> {
   void operator()(const ECTransaction::StashOp &op) {
     assert(hash_infos.count(op.oid));
     hash_infos[op.oid]->clear();
+    clear_stripes(op.oid);
     for (map<shard_id_t, ObjectStore::Transaction>::iterator i = trans->begin();
 	 i != trans->end();
 	 ++i) {
@@ -226,6 +535,7 @@ struct TransGenerator : public boost::static_visitor<void> {
   void operator()(const ECTransaction::RemoveOp &op) {
     assert(hash_infos.count(op.oid));
     hash_infos[op.oid]->clear();
+    clear_stripes(op.oid);
     for (map<shard_id_t, ObjectStore::Transaction>::iterator i = trans->begin();
 	 i != trans->end();
 	 ++i) {
@@ -281,16 +591,21 @@ void ECTransaction::generate_transactions(
   ErasureCodeInterfaceRef &ecimpl,
   pg_t pgid,
   const ECUtil::stripe_info_t &sinfo,
+  stripe_map_t *stripes,
+  const rollback_extents_t &rollback_extents,
   map<shard_id_t, ObjectStore::Transaction> *transactions,
   set<hobject_t, hobject_t::BitwiseComparator> *temp_added,
   set<hobject_t, hobject_t::BitwiseComparator> *temp_removed,
   stringstream *out) const
 {
+  assert(stripes || !overwrites);
   TransGenerator gen(
     hash_infos,
     ecimpl,
     pgid,
     sinfo,
+    stripes,
+    rollback_extents,
     transactions,
     temp_added,
     temp_removed,
@@ -19,6 +19,7 @@
 #include "PGBackend.h"
 #include "ECUtil.h"
 #include "erasure-code/ErasureCodeInterface.h"
+#include "include/interval_set.h"
 
 class ECTransaction : public PGBackend::PGTransaction {
 public:
@@ -30,6 +31,21 @@ public:
     AppendOp(const hobject_t &oid, uint64_t off, bufferlist &bl, uint32_t flags)
       : oid(oid), off(off), bl(bl), fadvise_flags(flags) {}
   };
+  /// write into existing stripes, only on pools with FLAG_EC_OVERWRITES
+  struct OverwriteOp {
+    hobject_t oid;
+    uint64_t off;
+    bufferlist bl;
+    uint32_t fadvise_flags;
+    OverwriteOp(const hobject_t &oid, uint64_t off, bufferlist &bl,
+		uint32_t flags)
+      : oid(oid), off(off), bl(bl), fadvise_flags(flags) {}
+  };
+  struct TruncateOp {
+    hobject_t oid;
+    uint64_t off;
+    TruncateOp(const hobject_t &oid, uint64_t off) : oid(oid), off(off) {}
+  };
   struct CloneOp {
     hobject_t source;
     hobject_t target;
@@ -90,6 +106,8 @@ public:
   struct NoOp {};
   typedef boost::variant<
     AppendOp,
+    OverwriteOp,
+    TruncateOp,
     CloneOp,
     RenameOp,
     StashOp,
@@ -101,8 +119,9 @@ public:
     NoOp> Op;
   list<Op> ops;
   uint64_t written;
+  bool overwrites;  ///< true if ops contains OverwriteOp or TruncateOp
 
-  ECTransaction() : written(0) {}
+  ECTransaction() : written(0), overwrites(false) {}
   /// Write
   void touch(
     const hobject_t &hoid) {
@@ -122,6 +141,35 @@ public:
     assert(len == bl.length());
     ops.push_back(AppendOp(hoid, off, bl, fadvise_flags));
   }
+  void write(
+    const hobject_t &hoid,
+    uint64_t off,
+    uint64_t len,
+    bufferlist &bl,
+    uint32_t fadvise_flags) {
+    if (len == 0) {
+      touch(hoid);
+      return;
+    }
+    written += len;
+    assert(len == bl.length());
+    overwrites = true;
+    ops.push_back(OverwriteOp(hoid, off, bl, fadvise_flags));
+  }
+  void zero(
+    const hobject_t &hoid,
+    uint64_t off,
+    uint64_t len) {
+    bufferlist bl;
+    bl.append_zero(len);
+    write(hoid, off, len, bl, 0);
+  }
+  void truncate(
+    const hobject_t &hoid,
+    uint64_t off) {
+    overwrites = true;
+    ops.push_back(TruncateOp(hoid, off));
+  }
   void stash(
     const hobject_t &hoid,
     version_t former_version) {
@@ -170,6 +218,8 @@ public:
     ECTransaction *to_append = static_cast<ECTransaction*>(_to_append);
     written += to_append->written;
     to_append->written = 0;
+    overwrites = overwrites || to_append->overwrites;
+    to_append->overwrites = false;
     ops.splice(ops.end(), to_append->ops,
 	       to_append->ops.begin(), to_append->ops.end());
   }
@@ -198,11 +248,40 @@ public:
   }
   void get_append_objects(
      set<hobject_t, hobject_t::BitwiseComparator> *out) const;
+
+  typedef map<hobject_t, ECUtil::object_stripes_t,
+	      hobject_t::BitwiseComparator> stripe_map_t;
+  /// extents to stash before the first overwrite and their generation
+  typedef map<hobject_t, pair<version_t, interval_set<uint64_t> >,
+	      hobject_t::BitwiseComparator> rollback_extents_t;
+
+  /**
+   * Stripes an overwrite only partially covers, which must be read
+   * before the transaction can be generated.  hash_infos must describe
+   * the objects as they will be when this transaction starts.
+   */
+  void get_rmw_reads(
+    const map<hobject_t, ECUtil::HashInfoRef, hobject_t::BitwiseComparator> &hash_infos,
+    const ECUtil::stripe_info_t &sinfo,
+    map<hobject_t, interval_set<uint64_t>, hobject_t::BitwiseComparator> *out) const;
+  /// objects this transaction fills with the contents of another
+  void get_replaced_objects(
+    set<hobject_t, hobject_t::BitwiseComparator> *out) const;
+
+  /**
+   * If stripes is not NULL, it holds on entry what is known of the
+   * objects before the transaction (at least the stripes from
+   * get_rmw_reads) and on return what is known of every object the
+   * transaction touched after it.  It may only be NULL if the
+   * transaction has no overwrites.
+   */
   void generate_transactions(
     map<hobject_t, ECUtil::HashInfoRef, hobject_t::BitwiseComparator> &hash_infos,
     ErasureCodeInterfaceRef &ecimpl,
     pg_t pgid,
     const ECUtil::stripe_info_t &sinfo,
+    stripe_map_t *stripes,
+    const rollback_extents_t &rollback_extents,
     map<shard_id_t, ObjectStore::Transaction> *transactions,
     set<hobject_t, hobject_t::BitwiseComparator> *temp_added,
     set<hobject_t, hobject_t::BitwiseComparator> *temp_removed,
@@ -129,9 +129,41 @@ public:
   uint64_t get_total_chunk_size() const {
     return total_chunk_size;
   }
+  /// false once an overwrite has made the cumulative hashes meaningless
+  bool has_chunk_hash() const {
+    return !cumulative_shard_hashes.empty();
+  }
+  /**
+   * Record an overwrite.  The hashes cover the chunks from start to
+   * end and cannot be updated in place, so they are dropped for good;
+   * the object store checksums the chunks instead.
+   */
+  void set_total_chunk_size_clear_hash(uint64_t new_chunk_size) {
+    cumulative_shard_hashes.clear();
+    total_chunk_size = new_chunk_size;
+  }
 };
 typedef ceph::shared_ptr<HashInfo> HashInfoRef;
 
+/**
+ * Known contents of some stripes of an object, keyed by logical
+ * stripe offset.  Every stripe at or beyond valid_to holds zeros; any
+ * other stripe missing from stripes is unknown and has to be read.
+ */
+struct object_stripes_t {
+  map<uint64_t, bufferlist> stripes;
+  uint64_t valid_to;
+  object_stripes_t() : valid_to((uint64_t)-1) {}
+  uint64_t get_bytes() const {
+    uint64_t bytes = 0;
+    for (map<uint64_t, bufferlist>::const_iterator i = stripes.begin();
+	 i != stripes.end();
+	 ++i)
+      bytes += i->second.length();
+    return bytes;
+  }
+};
+
 bool is_hinfo_key_string(const string &key);
 const string &get_hinfo_key();
 
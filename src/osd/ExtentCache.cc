@@ -0,0 +1,124 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+/*
+ * Ceph - scalable distributed file system
+ *
+ * This is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License version 2.1, as published by the Free Software
+ * Foundation.  See file COPYING.
+ *
+ */
+
+#include "ExtentCache.h"
+
+const ECUtil::object_stripes_t *ExtentCache::get(const hobject_t &hoid)
+{
+  entries_t::iterator i = entries.find(hoid);
+  if (i == entries.end())
+    return NULL;
+  if (i->second.pins.empty())
+    lru.splice(lru.begin(), lru, i->second.lru_pos);
+  return &(i->second.obj);
+}
+
+void ExtentCache::update(
+  const hobject_t &hoid,
+  const ECUtil::object_stripes_t &obj,
+  ceph_tid_t tid)
+{
+  entries_t::iterator i = entries.find(hoid);
+  if (i == entries.end()) {
+    i = entries.insert(make_pair(hoid, entry_t())).first;
+  } else if (i->second.pins.empty()) {
+    lru.erase(i->second.lru_pos);
+    unpinned_bytes -= i->second.bytes;
+  }
+  entry_t &e = i->second;
+  bytes -= e.bytes;
+  e.obj = obj;
+  e.bytes = obj.get_bytes();
+  bytes += e.bytes;
+  e.pins.insert(tid);
+}
+
+void ExtentCache::release(const hobject_t &hoid, ceph_tid_t tid)
+{
+  entries_t::iterator i = entries.find(hoid);
+  if (i == entries.end())
+    return;
+  entry_t &e = i->second;
+  if (!e.pins.erase(tid) || !e.pins.empty())
+    return;
+  if (e.obj.stripes.empty()) {
+    // nothing left to serve once the shards are current
+    bytes -= e.bytes;
+    entries.erase(i);
+    return;
+  }
+  lru.push_front(hoid);
+  e.lru_pos = lru.begin();
+  unpinned_bytes += e.bytes;
+  trim();
+}
+
+void ExtentCache::invalidate(const hobject_t &hoid)
+{
+  entries_t::iterator i = entries.find(hoid);
+  if (i != entries.end() && i->second.pins.empty())
+    erase(i);
+}
+
+bool ExtentCache::read(
+  const hobject_t &hoid,
+  uint64_t stripe_width,
+  uint64_t off,
+  uint64_t len,
+  bufferlist *bl)
+{
+  assert(off % stripe_width == 0);
+  assert(len % stripe_width == 0);
+  const ECUtil::object_stripes_t *obj = get(hoid);
+  if (!obj)
+    return false;
+  bufferlist out;
+  for (uint64_t pos = off; pos < off + len; pos += stripe_width) {
+    map<uint64_t, bufferlist>::const_iterator i = obj->stripes.find(pos);
+    if (i != obj->stripes.end()) {
+      out.append(i->second);
+    } else if (pos >= obj->valid_to) {
+      out.append_zero(stripe_width);
+    } else {
+      return false;
+    }
+  }
+  bl->claim_append(out);
+  return true;
+}
+
+void ExtentCache::erase(entries_t::iterator i)
+{
+  assert(i->second.pins.empty());
+  lru.erase(i->second.lru_pos);
+  unpinned_bytes -= i->second.bytes;
+  bytes -= i->second.bytes;
+  entries.erase(i);
+}
+
+void ExtentCache::trim()
+{
+  while (unpinned_bytes > max_bytes) {
+    assert(!lru.empty());
+    entries_t::iterator i = entries.find(lru.back());
+    assert(i != entries.end());
+    erase(i);
+  }
+}
+
+void ExtentCache::clear()
+{
+  entries.clear();
+  lru.clear();
+  bytes = 0;
+  unpinned_bytes = 0;
+}
@@ -0,0 +1,92 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+/*
+ * Ceph - scalable distributed file system
+ *
+ * This is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License version 2.1, as published by the Free Software
+ * Foundation.  See file COPYING.
+ *
+ */
+
+#ifndef CEPH_OSD_EXTENTCACHE_H
+#define CEPH_OSD_EXTENTCACHE_H
+
+#include <list>
+#include <map>
+#include <set>
+
+#include "common/hobject.h"
+#include "ECUtil.h"
+
+/**
+ * Recently written stripes of the objects of an EC pg, on the primary.
+ *
+ * Each in-flight write leaves the stripes it generated here, pinned
+ * with its tid until every shard has applied it; later overwrites take
+ * their partial stripes from the cache instead of reading them back
+ * from the shards, and need not wait for the earlier write to apply.
+ * Once an object has no pins left its entry matches the shards and is
+ * kept, least recently used first out, while the unpinned entries fit
+ * in max_bytes, so that it can serve reads as well.
+ */
+class ExtentCache {
+  struct entry_t {
+    ECUtil::object_stripes_t obj;
+    uint64_t bytes;
+    set<ceph_tid_t> pins;
+    list<hobject_t>::iterator lru_pos; ///< valid while pins is empty
+    entry_t() : bytes(0) {}
+  };
+  typedef map<hobject_t, entry_t, hobject_t::BitwiseComparator> entries_t;
+
+  entries_t entries;
+  list<hobject_t> lru;     ///< unpinned entries, most recently used first
+  uint64_t bytes;          ///< of all entries
+  uint64_t unpinned_bytes; ///< of the entries on lru
+  uint64_t max_bytes;      ///< bound on unpinned_bytes
+
+  void trim();
+  void erase(entries_t::iterator i);
+
+public:
+  explicit ExtentCache(uint64_t max_bytes)
+    : bytes(0), unpinned_bytes(0), max_bytes(max_bytes) {}
+
+  /// @return the known stripes of hoid, or NULL
+  const ECUtil::object_stripes_t *get(const hobject_t &hoid);
+
+  /**
+   * Replace the entry of hoid with its stripes after write tid, which
+   * pins it until release(hoid, tid).
+   */
+  void update(const hobject_t &hoid, const ECUtil::object_stripes_t &obj,
+	      ceph_tid_t tid);
+  void release(const hobject_t &hoid, ceph_tid_t tid);
+
+  /// drop hoid unless an in-flight write pins it
+  void invalidate(const hobject_t &hoid);
+
+  /**
+   * Assemble the stripe aligned extent off~len of hoid.
+   *
+   * @return false, leaving bl untouched, unless every stripe is known
+   */
+  bool read(const hobject_t &hoid, uint64_t stripe_width,
+	    uint64_t off, uint64_t len, bufferlist *bl);
+
+  void clear();
+  void set_max_bytes(uint64_t b) {
+    max_bytes = b;
+    trim();
+  }
+  uint64_t get_bytes() const {
+    return bytes;
+  }
+  unsigned get_num_objects() const {
+    return entries.size();
+  }
+};
+
+#endif
@@ -15,6 +15,7 @@
 
 #include <fstream>
 #include <iostream>
+#include <atomic>
 #include <errno.h>
 #include <sys/stat.h>
 #include <signal.h>
@@ -175,6 +176,14 @@ void PGQueueable::RunVis::operator()(const PGRecovery &op) {
   return osd->do_recovery(pg.get(), op.epoch_queued, op.reserved_pushes, handle);
 }
 
+osd_op_type_t PGQueueable::OpTypeVis::operator()(const OpRequestRef &op) const {
+  // everything but a client MOSDOp is replication or EC traffic from a peer
+  if (op->get_req()->get_type() == CEPH_MSG_OSD_OP) {
+    return osd_op_type_t::client_op;
+  }
+  return osd_op_type_t::osd_subop;
+}
+
 //Initial features in new superblock.
 //Features here are also automatically upgraded
 CompatSet OSD::get_osd_initial_compat_set() {
@@ -1354,12 +1363,24 @@ OSDMapRef OSDService::try_get_map(epoch_t epoch)
   if (epoch > 0) {
     dout(20) << "get_map " << epoch << " - loading and decoding " << map << dendl;
     bufferlist bl;
-    if (!_get_map_bl(epoch, bl) || bl.length() == 0) {
-      derr << "failed to load OSD map for epoch " << epoch << ", got " << bl.length() << " bytes" << dendl;
-      delete map;
-      return OSDMapRef();
+    if (!map_bl_cache.lookup(epoch, &bl)) {
+      // read and decode without the lock so that several maps can be
+      // loaded at once; the first one to add an epoch to the cache wins
+      map_cache_lock.Unlock();
+      bool found = store->read(coll_t::meta(),
+			       OSD::get_osdmap_pobject_name(epoch), 0, 0, bl) >= 0;
+      if (found && bl.length())
+	map->decode(bl);
+      map_cache_lock.Lock();
+      if (!found || bl.length() == 0) {
+	derr << "failed to load OSD map for epoch " << epoch << ", got " << bl.length() << " bytes" << dendl;
+	delete map;
+	return OSDMapRef();
+      }
+      _add_map_bl(epoch, bl);
+    } else {
+      map->decode(bl);
     }
-    map->decode(bl);
   } else {
     dout(20) << "get_map " << epoch << " - return initial " << map << dendl;
   }
@@ -2148,6 +2169,7 @@ int OSD::init()
   osdmap = get_map(superblock.current_epoch);
   check_osdmap_features(store);
 
+  create_logger();
   create_recoverystate_perf();
 
   {
@@ -2164,8 +2186,6 @@ int OSD::init()
   dout(0) << "using " << op_queue << " op queue with priority op cut off at " <<
     op_prio_cutoff << "." << dendl;
 
-  create_logger();
-
   // i'm ready!
   client_messenger->add_dispatcher_head(this);
   cluster_messenger->add_dispatcher_head(this);
@@ -2598,6 +2618,15 @@ void OSD::create_logger()
   osd_plb.add_u64_counter(l_osd_pg_biginfo, "osd_pg_biginfo",
 			  "PG updated its biginfo attr");
 
+  osd_plb.add_time(l_osd_boot_load_pgs_lat, "boot_load_pgs_time",
+		   "Time taken to load the PGs at startup");
+  osd_plb.add_time(l_osd_boot_read_pgs_lat, "boot_read_pgs_time",
+		   "Time taken to read PG info and logs at startup");
+  osd_plb.add_time(l_osd_boot_prefetch_maps_lat, "boot_prefetch_maps_time",
+		   "Time taken to read the maps the PGs advance through at startup");
+  osd_plb.add_time(l_osd_boot_past_intervals_lat, "boot_past_intervals_time",
+		   "Time taken to build PG past intervals at startup");
+
   logger = osd_plb.create_perf_counters();
   cct->get_perfcounters_collection()->add(logger);
 }
@@ -3253,6 +3282,98 @@ PG *OSD::_lookup_lock_pg_with_map_lock_held(spg_t pgid)
   return pg;
 }
 
+PG *OSD::_load_pg(spg_t pgid, bool *upgraded)
+{
+  dout(10) << "pgid " << pgid << " coll " << coll_t(pgid) << dendl;
+  bufferlist bl;
+  epoch_t map_epoch = 0;
+  int r = PG::peek_map_epoch(store, pgid, &map_epoch, &bl);
+  if (r < 0) {
+    derr << __func__ << " unable to peek at " << pgid << " metadata, skipping"
+	 << dendl;
+    return NULL;
+  }
+
+  PG *pg = NULL;
+  if (map_epoch > 0) {
+    OSDMapRef pgosdmap = service.try_get_map(map_epoch);
+    if (!pgosdmap) {
+      if (!osdmap->have_pg_pool(pgid.pool())) {
+	derr << __func__ << ": could not find map for epoch " << map_epoch
+	     << " on pg " << pgid << ", but the pool is not present in the "
+	     << "current map, so this is probably a result of bug 10617.  "
+	     << "Skipping the pg for now, you can use ceph-objectstore-tool "
+	     << "to clean it up later." << dendl;
+	return NULL;
+      } else {
+	derr << __func__ << ": have pgid " << pgid << " at epoch "
+	     << map_epoch << ", but missing map.  Crashing."
+	     << dendl;
+	assert(0 == "Missing map in load_pgs");
+      }
+    }
+    pg = _open_lock_pg(pgosdmap, pgid);
+  } else {
+    pg = _open_lock_pg(osdmap, pgid);
+  }
+  // there can be no waiters here, so we don't call wake_pg_waiters
+
+  pg->ch = store->open_collection(pg->coll);
+
+  // read pg state, log
+  pg->read_state(store, bl);
+
+  if (pg->must_upgrade()) {
+    if (!pg->can_upgrade()) {
+      derr << "PG needs upgrade, but on-disk data is too old; upgrade to"
+	   << " an older version first." << dendl;
+      assert(0 == "PG too old to upgrade");
+    }
+    *upgraded = true;
+    dout(10) << "PG " << pg->info.pgid
+	     << " must upgrade..." << dendl;
+    pg->upgrade(store);
+  }
+
+  service.init_splits_between(pg->info.pgid, pg->get_osdmap(), osdmap);
+
+  // generate state for PG's current mapping
+  int primary, up_primary;
+  vector<int> acting, up;
+  pg->get_osdmap()->pg_to_up_acting_osds(
+    pgid.pgid, &up, &up_primary, &acting, &primary);
+  pg->init_primary_up_acting(
+    up,
+    acting,
+    up_primary,
+    primary);
+  int role = OSDMap::calc_pg_role(whoami, pg->acting);
+  if (pg->pool.info.is_replicated() || role == pg->pg_whoami.shard)
+    pg->set_role(role);
+  else
+    pg->set_role(-1);
+
+  pg->reg_next_scrub();
+
+  PG::RecoveryCtx rctx(0, 0, 0, 0, 0, 0);
+  pg->handle_loaded(&rctx);
+
+  dout(10) << "load_pgs loaded " << *pg << " " << pg->pg_log.get_log() << dendl;
+  if (pg->pg_log.is_dirty()) {
+    ObjectStore::Transaction t;
+    pg->write_if_dirty(t);
+    store->apply_transaction(pg->osr.get(), std::move(t));
+  }
+  pg->unlock();
+  return pg;
+}
+
+/*
+ * Reading the info and log of each pg is independent of the others and
+ * mostly waits on the store, so it is spread over a pool of
+ * osd_load_pgs_threads threads.  While they run, osd_lock is held here,
+ * which is what _open_lock_pg() expects.
+ */
 void OSD::load_pgs()
 {
   assert(osd_lock.is_locked());
@@ -3261,6 +3382,7 @@ void OSD::load_pgs()
     RWLock::RLocker l(pg_map_lock);
     assert(pg_map.empty());
   }
+  utime_t start = ceph_clock_now(cct);
 
   vector<coll_t> ls;
   int r = store->list_collections(ls);
@@ -3268,8 +3390,7 @@ void OSD::load_pgs()
     derr << "failed to list pgs: " << cpp_strerror(-r) << dendl;
   }
 
-  bool has_upgraded = false;
-
+  vector<spg_t> pgids;
   for (vector<coll_t>::iterator it = ls.begin();
        it != ls.end();
        ++it) {
@@ -3292,94 +3413,43 @@ void OSD::load_pgs()
       continue;
     }
 
-    dout(10) << "pgid " << pgid << " coll " << coll_t(pgid) << dendl;
-    bufferlist bl;
-    epoch_t map_epoch = 0;
-    int r = PG::peek_map_epoch(store, pgid, &map_epoch, &bl);
-    if (r < 0) {
-      derr << __func__ << " unable to peek at " << pgid << " metadata, skipping"
-	   << dendl;
-      continue;
-    }
-
-    PG *pg = NULL;
-    if (map_epoch > 0) {
-      OSDMapRef pgosdmap = service.try_get_map(map_epoch);
-      if (!pgosdmap) {
-	if (!osdmap->have_pg_pool(pgid.pool())) {
-	  derr << __func__ << ": could not find map for epoch " << map_epoch
-	       << " on pg " << pgid << ", but the pool is not present in the "
-	       << "current map, so this is probably a result of bug 10617.  "
-	       << "Skipping the pg for now, you can use ceph-objectstore-tool "
-	       << "to clean it up later." << dendl;
-	  continue;
-	} else {
-	  derr << __func__ << ": have pgid " << pgid << " at epoch "
-	       << map_epoch << ", but missing map.  Crashing."
-	       << dendl;
-	  assert(0 == "Missing map in load_pgs");
-	}
-      }
-      pg = _open_lock_pg(pgosdmap, pgid);
-    } else {
-      pg = _open_lock_pg(osdmap, pgid);
-    }
-    // there can be no waiters here, so we don't call wake_pg_waiters
+    pgids.push_back(pgid);
+  }
 
-    pg->ch = store->open_collection(pg->coll);
+  int nthreads = cct->_conf->osd_load_pgs_threads > 0 ?
+    cct->_conf->osd_load_pgs_threads : sysconf(_SC_NPROCESSORS_ONLN);
+  nthreads = MAX(MIN(nthreads, (int)pgids.size()), 1);
 
-    // read pg state, log
-    pg->read_state(store, bl);
+  ThreadPool load_tp(cct, "OSD::load_tp", "tp_osd_load", nthreads);
+  ContextWQ load_wq("OSD::load_wq", 0, &load_tp);
+  load_tp.start();
 
-    if (pg->must_upgrade()) {
-      if (!pg->can_upgrade()) {
-	derr << "PG needs upgrade, but on-disk data is too old; upgrade to"
-	     << " an older version first." << dendl;
-	assert(0 == "PG too old to upgrade");
-      }
-      if (!has_upgraded) {
+  utime_t read_start = ceph_clock_now(cct);
+  std::atomic<bool> has_upgraded(false);
+  std::atomic<epoch_t> oldest_pg_epoch(osdmap->get_epoch());
+  for (auto& pgid : pgids) {
+    load_wq.queue(new FunctionContext([&, pgid](int r) {
+      bool upgraded = false;
+      PG *pg = _load_pg(pgid, &upgraded);
+      if (upgraded && !has_upgraded.exchange(true)) {
 	derr << "PGs are upgrading" << dendl;
-	has_upgraded = true;
       }
-      dout(10) << "PG " << pg->info.pgid
-	       << " must upgrade..." << dendl;
-      pg->upgrade(store);
-    }
-
-    service.init_splits_between(pg->info.pgid, pg->get_osdmap(), osdmap);
-
-    // generate state for PG's current mapping
-    int primary, up_primary;
-    vector<int> acting, up;
-    pg->get_osdmap()->pg_to_up_acting_osds(
-      pgid.pgid, &up, &up_primary, &acting, &primary);
-    pg->init_primary_up_acting(
-      up,
-      acting,
-      up_primary,
-      primary);
-    int role = OSDMap::calc_pg_role(whoami, pg->acting);
-    if (pg->pool.info.is_replicated() || role == pg->pg_whoami.shard)
-      pg->set_role(role);
-    else
-      pg->set_role(-1);
-
-    pg->reg_next_scrub();
-
-    PG::RecoveryCtx rctx(0, 0, 0, 0, 0, 0);
-    pg->handle_loaded(&rctx);
-
-    dout(10) << "load_pgs loaded " << *pg << " " << pg->pg_log.get_log() << dendl;
-    if (pg->pg_log.is_dirty()) {
-      ObjectStore::Transaction t;
-      pg->write_if_dirty(t);
-      store->apply_transaction(pg->osr.get(), std::move(t));
-    }
-    pg->unlock();
+      if (!pg)
+	return;
+      epoch_t e = pg->get_osdmap()->get_epoch();
+      epoch_t cur = oldest_pg_epoch;
+      while (e < cur && !oldest_pg_epoch.compare_exchange_weak(cur, e))
+	;
+    }));
   }
+  load_wq.drain();
+  utime_t read_end = ceph_clock_now(cct);
+  logger->tset(l_osd_boot_read_pgs_lat, read_end - read_start);
+
   {
     RWLock::RLocker l(pg_map_lock);
-    dout(0) << "load_pgs opened " << pg_map.size() << " pgs" << dendl;
+    dout(0) << "load_pgs opened " << pg_map.size() << " pgs in "
+	    << (read_end - read_start) << " on " << nthreads << " threads" << dendl;
   }
 
   // clean up old infos object?
@@ -3395,7 +3465,41 @@ void OSD::load_pgs()
     }
   }
 
+  prefetch_maps(oldest_pg_epoch + 1, &load_wq);
+  load_tp.stop();
+
+  utime_t pi_start = ceph_clock_now(cct);
   build_past_intervals_parallel();
+  utime_t end = ceph_clock_now(cct);
+  logger->tset(l_osd_boot_past_intervals_lat, end - pi_start);
+  logger->tset(l_osd_boot_load_pgs_lat, end - start);
+}
+
+/*
+ * The pgs are advanced from the epoch they were written at to the
+ * current one as soon as the osd is up.  Read and decode the maps they
+ * will go through ahead of that, as many as the map cache holds, so the
+ * pgs find them cached.
+ */
+void OSD::prefetch_maps(epoch_t first, ContextWQ *wq)
+{
+  epoch_t last = std::min<epoch_t>(osdmap->get_epoch(),
+				   first + cct->_conf->osd_map_cache_size - 1);
+  if (first > last)
+    return;
+  utime_t start = ceph_clock_now(cct);
+
+  for (epoch_t e = first; e <= last; ++e) {
+    wq->queue(new FunctionContext([this, e](int r) {
+      service.try_get_map(e);
+    }));
+  }
+  wq->drain();
+
+  utime_t elapsed = ceph_clock_now(cct) - start;
+  dout(10) << __func__ << " read maps " << first << "-" << last << " in "
+	   << elapsed << dendl;
+  logger->tset(l_osd_boot_prefetch_maps_lat, elapsed);
 }
 
 
@@ -6052,6 +6156,22 @@ void OSD::ms_fast_preprocess(Message *m)
   }
 }
 
+bool OSD::ms_get_recv_buffer(Connection *con, const ceph_msg_header &header,
+			     bufferlist &data)
+{
+  // Client writes: receive the payload into one page aligned buffer that
+  // sits at the same offset within a page as the data does within the
+  // object, so the object store can write it with O_DIRECT as it is.
+  unsigned len = le32_to_cpu(header.data_len);
+  if (le16_to_cpu(header.type) != CEPH_MSG_OSD_OP || len < CEPH_PAGE_SIZE)
+    return false;
+  unsigned head = le16_to_cpu(header.data_off) & ~CEPH_PAGE_MASK;
+  bufferptr bp = buffer::create_page_aligned(
+    ROUND_UP_TO(head + len, CEPH_PAGE_SIZE));
+  data.push_back(bufferptr(bp, head, len));
+  return true;
+}
+
 bool OSD::ms_get_authorizer(int dest_type, AuthAuthorizer **authorizer, bool force_new)
 {
   dout(10) << "OSD::ms_get_authorizer type=" << ceph_entity_type_name(dest_type) << dendl;
@@ -51,6 +51,8 @@ using namespace std;
 #include "common/sharedptr_registry.hpp"
 #include "common/WeightedPriorityQueue.h"
 #include "common/PrioritizedQueue.h"
+#include "osd/mClockOpClassQueue.h"
+#include "osd/mClockClientQueue.h"
 #include "messages/MOSDOp.h"
 #include "include/Spinlock.h"
 
@@ -162,6 +164,11 @@ enum {
   l_osd_pg_fastinfo,
   l_osd_pg_biginfo,
 
+  l_osd_boot_load_pgs_lat,
+  l_osd_boot_read_pgs_lat,
+  l_osd_boot_prefetch_maps_lat,
+  l_osd_boot_past_intervals_lat,
+
   l_osd_last,
 };
 
@@ -382,6 +389,18 @@ class PGQueueable {
     void operator()(const PGScrub &op);
     void operator()(const PGRecovery &op);
   };
+  struct OpTypeVis : public boost::static_visitor<osd_op_type_t> {
+    osd_op_type_t operator()(const OpRequestRef &op) const;
+    osd_op_type_t operator()(const PGSnapTrim &op) const {
+      return osd_op_type_t::bg_snaptrim;
+    }
+    osd_op_type_t operator()(const PGScrub &op) const {
+      return osd_op_type_t::bg_scrub;
+    }
+    osd_op_type_t operator()(const PGRecovery &op) const {
+      return osd_op_type_t::bg_recovery;
+    }
+  };
 public:
   // cppcheck-suppress noExplicitConstructor
   PGQueueable(OpRequestRef op)
@@ -417,6 +436,10 @@ public:
     RunVis v(osd, pg, handle);
     boost::apply_visitor(v, qvariant);
   }
+  osd_op_type_t get_op_type() const {
+    OpTypeVis v;
+    return boost::apply_visitor(v, qvariant);
+  }
   unsigned get_priority() const { return priority; }
   int get_cost() const { return cost; }
   utime_t get_start_time() const { return start_time; }
@@ -1744,7 +1767,9 @@ private:
   // -- op queue --
   enum io_queue {
     prioritized,
-    weightedpriority};
+    weightedpriority,
+    mclock_opclass,
+    mclock_client};
   const io_queue op_queue;
   const unsigned int op_prio_cutoff;
 
@@ -1773,6 +1798,14 @@ private:
 		<PrioritizedQueue< pair<PGRef, PGQueueable>, entity_inst_t>>(
 		  new PrioritizedQueue< pair<PGRef, PGQueueable>, entity_inst_t>(
 		    max_tok_per_prio, min_cost));
+	    } else if (opqueue == mclock_opclass) {
+	      pqueue = std::unique_ptr
+		<mClockOpClassQueue< pair<PGRef, PGQueueable>>>(
+		  new mClockOpClassQueue< pair<PGRef, PGQueueable>>(cct));
+	    } else if (opqueue == mclock_client) {
+	      pqueue = std::unique_ptr
+		<mClockClientQueue< pair<PGRef, PGQueueable>>>(
+		  new mClockClientQueue< pair<PGRef, PGQueueable>>(cct));
 	    }
 	  }
     };
@@ -2079,7 +2112,9 @@ protected:
     epoch_t epoch,
     PG::CephPeeringEvtRef evt);
   
+  PG *_load_pg(spg_t pgid, bool *upgraded);
   void load_pgs();
+  void prefetch_maps(epoch_t first, ContextWQ *wq);
   void build_past_intervals_parallel();
 
   /// project pg history from from to now
@@ -2396,6 +2431,8 @@ protected:
   }
   void ms_fast_dispatch(Message *m);
   void ms_fast_preprocess(Message *m);
+  bool ms_get_recv_buffer(Connection *con, const ceph_msg_header &header,
+			  bufferlist &data);
   bool ms_dispatch(Message *m);
   bool ms_get_authorizer(int dest_type, AuthAuthorizer **authorizer, bool force_new);
   bool ms_verify_authorizer(Connection *con, int peer_type,
@@ -2410,10 +2447,16 @@ protected:
 
   io_queue get_io_queue() const {
     if (cct->_conf->osd_op_queue == "debug_random") {
+      static const io_queue queues[] = {
+	prioritized, weightedpriority, mclock_opclass, mclock_client };
       srand(time(NULL));
-      return (rand() % 2 < 1) ? prioritized : weightedpriority;
+      return queues[rand() % 4];
     } else if (cct->_conf->osd_op_queue == "wpq") {
       return weightedpriority;
+    } else if (cct->_conf->osd_op_queue == "mclock_opclass") {
+      return mclock_opclass;
+    } else if (cct->_conf->osd_op_queue == "mclock_client") {
+      return mclock_client;
     } else {
       return prioritized;
     }
@@ -17,6 +17,8 @@
 
 #include "OSDMap.h"
 #include <algorithm>
+#include <atomic>
+#include <thread>
 #include "common/config.h"
 #include "common/Formatter.h"
 #include "common/TextTable.h"
@@ -1467,6 +1469,19 @@ int OSDMap::apply_incremental(const Incremental &inc)
 
   calc_num_osds();
   _calc_up_osd_features();
+
+  if (mapping) {
+    if (mapping->epoch != inc.epoch - 1 ||
+	inc.crush.length() ||
+	inc.new_max_osd >= 0 ||
+	!inc.new_weight.empty() ||
+	!inc.new_state.empty() ||
+	!inc.new_up_client.empty() ||
+	!inc.new_primary_affinity.empty())
+      mapping.reset();
+    else
+      _update_mapping_temps(inc);
+  }
   return 0;
 }
 
@@ -1694,6 +1709,9 @@ void OSDMap::pg_to_raw_up(pg_t pg, vector<int> *up, int *primary) const
       up->clear();
     return;
   }
+  const OSDMapMapping *m = _get_mapping();
+  if (m && m->get_up(pg, pool->get_size(), up, primary))
+    return;
   vector<int> raw;
   ps_t pps;
   _pg_to_raw_osds(*pool, pg, &raw, primary, &pps);
@@ -1716,6 +1734,9 @@ void OSDMap::_pg_to_up_acting_osds(const pg_t& pg, vector<int> *up, int *up_prim
       *acting_primary = -1;
     return;
   }
+  const OSDMapMapping *m = _get_mapping();
+  if (m && m->get(pg, pool->get_size(), up, up_primary, acting, acting_primary))
+    return;
   vector<int> raw;
   vector<int> _up;
   vector<int> _acting;
@@ -1742,6 +1763,145 @@ void OSDMap::_pg_to_up_acting_osds(const pg_t& pg, vector<int> *up, int *up_prim
     *acting_primary = _acting_primary;
 }
 
+void OSDMap::_map_pool_range(const pg_pool_t& pool, int64_t poolid,
+			     unsigned begin, unsigned end,
+			     PoolMapping *pm) const
+{
+  unsigned n = end - begin;
+  vector<int> pps(n);
+  for (unsigned i = 0; i < n; ++i)
+    pps[i] = pool.raw_pg_to_pps(pg_t(begin + i, poolid));
+
+  vector<vector<int> > raw;
+  int ruleno = crush->find_rule(pool.get_crush_ruleset(), pool.get_type(),
+				pool.get_size());
+  if (ruleno >= 0)
+    crush->do_rule_batch(ruleno, pps, raw, pool.get_size(), osd_weight);
+  else
+    raw.resize(n);
+
+  vector<int> up, acting;
+  for (unsigned i = 0; i < n; ++i) {
+    pg_t pg(begin + i, poolid);
+    int up_primary, acting_primary;
+    _remove_nonexistent_osds(pool, raw[i]);
+    _raw_to_up_osds(pool, raw[i], &up, &up_primary);
+    _apply_primary_affinity(pps[i], pool, &up, &up_primary);
+    _get_temp_osds(pool, pg, &acting, &acting_primary);
+    if (acting.empty()) {
+      acting = up;
+      if (acting_primary == -1)
+	acting_primary = up_primary;
+    }
+    pm->set(begin + i, up, up_primary, acting, acting_primary);
+  }
+}
+
+void OSDMap::_update_mapping_temps(const Incremental& inc)
+{
+  ceph::shared_ptr<OSDMapMapping> m(new OSDMapMapping(epoch));
+  m->pools = mapping->pools;
+
+  // changed pools are rebuilt by the next update_mapping_cache()
+  for (auto& p : inc.new_pools)
+    m->pools.erase(p.first);
+  for (auto p : inc.old_pools)
+    m->pools.erase(p);
+
+  set<pg_t> pgs;
+  for (auto& p : inc.new_pg_temp)
+    pgs.insert(p.first);
+  for (auto& p : inc.new_primary_temp)
+    pgs.insert(p.first);
+
+  map<int64_t, ceph::shared_ptr<PoolMapping> > copied;
+  vector<int> up, acting;
+  for (auto& pg : pgs) {
+    auto p = m->pools.find(pg.pool());
+    if (p == m->pools.end() || pg.ps() >= p->second->pg_num)
+      continue;
+    ceph::shared_ptr<PoolMapping>& pm = copied[pg.pool()];
+    if (!pm) {
+      pm.reset(new PoolMapping(*p->second));
+      p->second = pm;
+    }
+    const pg_pool_t *pool = get_pg_pool(pg.pool());
+    int up_primary, acting_primary;
+    pm->get_up(pg.ps(), &up, &up_primary);
+    _get_temp_osds(*pool, pg, &acting, &acting_primary);
+    if (acting.empty()) {
+      acting = up;
+      if (acting_primary == -1)
+	acting_primary = up_primary;
+    }
+    pm->set_acting(pg.ps(), acting, acting_primary);
+  }
+  mapping = m;
+}
+
+void OSDMap::update_mapping_cache(CephContext *cct)
+{
+  if (!cct->_conf->osd_map_mapping_cache) {
+    mapping.reset();
+    return;
+  }
+
+  const OSDMapMapping *cur = _get_mapping();
+  if (cur && cur->pools.size() == pools.size())
+    return;
+
+  // reuse the tables of pools that are still valid, map the rest in
+  // chunks spread over a few threads
+  struct Chunk {
+    const pg_pool_t *pool;
+    int64_t poolid;
+    unsigned begin, end;
+    PoolMapping *pm;
+  };
+  const unsigned chunk_size = 4096;
+  vector<Chunk> chunks;
+  ceph::shared_ptr<OSDMapMapping> m(new OSDMapMapping(epoch));
+  for (auto& p : pools) {
+    if (cur) {
+      auto q = cur->pools.find(p.first);
+      if (q != cur->pools.end()) {
+	m->pools[p.first] = q->second;
+	continue;
+      }
+    }
+    unsigned pg_num = p.second.get_pg_num();
+    PoolMapping *pm = new PoolMapping(p.second.get_size(), pg_num);
+    m->pools[p.first].reset(pm);
+    for (unsigned b = 0; b < pg_num; b += chunk_size) {
+      Chunk c = { &p.second, p.first, b, std::min(b + chunk_size, pg_num), pm };
+      chunks.push_back(c);
+    }
+  }
+
+  unsigned nthreads = cct->_conf->osd_map_mapping_threads > 0 ?
+    cct->_conf->osd_map_mapping_threads : std::thread::hardware_concurrency();
+  nthreads = std::min<unsigned>(std::max(nthreads, 1u), chunks.size());
+
+  std::atomic<unsigned> next(0);
+  auto work = [&]() {
+    unsigned i;
+    while ((i = next++) < chunks.size())
+      _map_pool_range(*chunks[i].pool, chunks[i].poolid,
+		      chunks[i].begin, chunks[i].end, chunks[i].pm);
+  };
+  vector<std::thread> threads;
+  for (unsigned i = 1; i < nthreads; ++i)
+    threads.push_back(std::thread(work));
+  work();
+  for (auto& t : threads)
+    t.join();
+
+  ldout(cct, 10) << __func__ << " epoch " << epoch << " mapped "
+		 << chunks.size() << " chunks of " << chunk_size << " pgs on "
+		 << nthreads << " threads" << dendl;
+  mapping = m;
+}
+
 int OSDMap::calc_pg_rank(int osd, const vector<int>& acting, int nrep)
 {
   if (!nrep)
@@ -2106,6 +2266,8 @@ void OSDMap::decode_classic(bufferlist::iterator& p)
 
 void OSDMap::decode(bufferlist::iterator& bl)
 {
+  mapping.reset();
+
   /**
    * Older encodings of the OSDMap had a single struct_v which
    * covered the whole encoding, and was prior to our modern
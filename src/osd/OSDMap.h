@@ -29,6 +29,7 @@
 
 //#include "include/ceph_features.h"
 #include "crush/CrushWrapper.h"
+#include "OSDMapMapping.h"
 #include <vector>
 #include <list>
 #include <set>
@@ -246,6 +247,9 @@ private:
   mutable bool crc_defined;
   mutable uint32_t crc;
 
+  /// precomputed pg mappings; only used while mapping->epoch == epoch
+  ceph::shared_ptr<const OSDMapMapping> mapping;
+
   void _calc_up_osd_features();
 
  public:
@@ -640,7 +644,29 @@ private:
   void _pg_to_up_acting_osds(const pg_t& pg, vector<int> *up, int *up_primary,
                              vector<int> *acting, int *acting_primary) const;
 
+  const OSDMapMapping *_get_mapping() const {
+    if (mapping && mapping->epoch == epoch)
+      return mapping.get();
+    return NULL;
+  }
+  /// map pgs [begin, end) of a pool into its mapping table
+  void _map_pool_range(const pg_pool_t& pool, int64_t poolid,
+		       unsigned begin, unsigned end, PoolMapping *pm) const;
+  /// carry the mapping across an incremental that only changed temps
+  void _update_mapping_temps(const Incremental& inc);
+
 public:
+  /**
+   * (Re)build the precomputed pg mapping of this epoch if
+   * osd_map_mapping_cache is enabled, or drop it if not.  Does nothing
+   * if the current mapping is still valid.  Lookups through the
+   * pg_to_* methods use the table once it exists.
+   */
+  void update_mapping_cache(CephContext *cct);
+  bool have_mapping_cache() const {
+    return _get_mapping() != NULL;
+  }
+
   /***
    * This is suitable only for looking at raw CRUSH outputs. It skips
    * applying the temp and up checks and should not be used
@@ -0,0 +1,139 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+/*
+ * Ceph - scalable distributed file system
+ *
+ * This is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License version 2.1, as published by the Free Software
+ * Foundation.  See file COPYING.
+ *
+ */
+
+#ifndef CEPH_OSDMAPMAPPING_H
+#define CEPH_OSDMAPMAPPING_H
+
+#include <map>
+#include <vector>
+
+#include "include/memory.h"
+#include "osd/osd_types.h"
+
+/**
+ * up and acting sets of every pg of one pool, as a flat table.
+ *
+ * Each row is [up_len, up_primary, acting_len, acting_primary,
+ * up[size], acting[size]].  A pg_temp longer than the pool size does
+ * not fit and is stored with acting_len = -1, which sends lookups of
+ * that pg back to the slow path.
+ */
+struct PoolMapping {
+  unsigned size;
+  unsigned pg_num;
+  std::vector<int32_t> table;
+
+  PoolMapping(unsigned s, unsigned n)
+    : size(s), pg_num(n), table((4 + 2 * s) * n) {}
+
+  unsigned row_size() const {
+    return 4 + 2 * size;
+  }
+  int32_t *row(unsigned ps) {
+    return &table[ps * row_size()];
+  }
+  const int32_t *row(unsigned ps) const {
+    return &table[ps * row_size()];
+  }
+
+  void set(unsigned ps,
+	   const std::vector<int>& up, int up_primary,
+	   const std::vector<int>& acting, int acting_primary) {
+    int32_t *r = row(ps);
+    assert(up.size() <= size);
+    r[0] = up.size();
+    r[1] = up_primary;
+    r[3] = acting_primary;
+    std::copy(up.begin(), up.end(), r + 4);
+    if (acting.size() > size) {
+      r[2] = -1;
+    } else {
+      r[2] = acting.size();
+      std::copy(acting.begin(), acting.end(), r + 4 + size);
+    }
+  }
+
+  /// replace the acting set of a pg, keeping its up set
+  void set_acting(unsigned ps,
+		  const std::vector<int>& acting, int acting_primary) {
+    int32_t *r = row(ps);
+    r[3] = acting_primary;
+    if (acting.size() > size) {
+      r[2] = -1;
+    } else {
+      r[2] = acting.size();
+      std::copy(acting.begin(), acting.end(), r + 4 + size);
+    }
+  }
+
+  void get_up(unsigned ps, std::vector<int> *up, int *up_primary) const {
+    const int32_t *r = row(ps);
+    if (up)
+      up->assign(r + 4, r + 4 + r[0]);
+    if (up_primary)
+      *up_primary = r[1];
+  }
+
+  bool get(unsigned ps,
+	   std::vector<int> *up, int *up_primary,
+	   std::vector<int> *acting, int *acting_primary) const {
+    const int32_t *r = row(ps);
+    if (r[2] < 0)
+      return false;
+    get_up(ps, up, up_primary);
+    if (acting)
+      acting->assign(r + 4 + size, r + 4 + size + r[2]);
+    if (acting_primary)
+      *acting_primary = r[3];
+    return true;
+  }
+};
+
+/**
+ * Precomputed pg -> up/acting mapping of one OSDMap epoch.
+ *
+ * Built by OSDMap::update_mapping_cache() and only trusted by the map
+ * while its epoch matches.  Pool tables are shared between epochs that
+ * did not change them, so an incremental that only touches pg_temp or
+ * primary_temp copies just the pools it affects.
+ */
+struct OSDMapMapping {
+  epoch_t epoch;
+  std::map<int64_t, ceph::shared_ptr<const PoolMapping> > pools;
+
+  explicit OSDMapMapping(epoch_t e) : epoch(e) {}
+
+  /// @return false if pg is not covered and must be mapped the slow way
+  bool get(pg_t pg, unsigned pool_size,
+	   std::vector<int> *up, int *up_primary,
+	   std::vector<int> *acting, int *acting_primary) const {
+    auto p = pools.find(pg.pool());
+    if (p == pools.end() ||
+	p->second->size != pool_size ||
+	pg.ps() >= p->second->pg_num)
+      return false;
+    return p->second->get(pg.ps(), up, up_primary, acting, acting_primary);
+  }
+
+  bool get_up(pg_t pg, unsigned pool_size,
+	      std::vector<int> *up, int *up_primary) const {
+    auto p = pools.find(pg.pool());
+    if (p == pools.end() ||
+	p->second->size != pool_size ||
+	pg.ps() >= p->second->pg_num)
+      return false;
+    p->second->get_up(pg.ps(), up, up_primary);
+    return true;
+  }
+};
+
+#endif
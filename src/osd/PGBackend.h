@@ -521,6 +521,13 @@ typedef ceph::shared_ptr<const OSDMap> OSDMapRef;
      uint64_t old_size,
      ObjectStore::Transaction *t);
 
+   /// Copy stashed extents back to rollback an overwrite
+   virtual void rollback_extents(
+     version_t gen,
+     const vector<pair<uint64_t, uint64_t> > &extents,
+     const hobject_t &hoid,
+     ObjectStore::Transaction *t);
+
    /// Unstash object to rollback stash
    void rollback_stash(
      const hobject_t &hoid,
@@ -74,9 +74,44 @@ struct PGLog : DoutPrefixProvider {
   /**
    * IndexLog - adds in-memory index of the log, by oid.
    * plus some methods to manipulate it all.
+   *
+   * The indexes are built the first time they are needed, and kept up
+   * to date from then on: a pg that only takes writes needs caller_ops
+   * for dup detection, objects is only wanted for recovery and peering.
    */
   struct IndexedLog : public pg_log_t {
-    mutable ceph::unordered_map<hobject_t,pg_log_entry_t*> objects;  // ptrs into log.  be careful!
+  private:
+    /*
+     * The object index is keyed by the soid of the entry it points to,
+     * rather than by a copy of it, so that it does not duplicate the
+     * object names held by the log.  The key must always be
+     * &value->soid.
+     */
+    struct hobject_ptr_hash {
+      size_t operator()(const hobject_t *o) const {
+        return std::hash<hobject_t>()(*o);
+      }
+    };
+    struct hobject_ptr_equal {
+      bool operator()(const hobject_t *l, const hobject_t *r) const {
+        return *l == *r;
+      }
+    };
+    typedef ceph::unordered_map<const hobject_t*, pg_log_entry_t*,
+				hobject_ptr_hash, hobject_ptr_equal> object_index_t;
+    mutable object_index_t objects;  // ptrs into log.  be careful!
+
+    void _index_object(pg_log_entry_t *e, bool only_if_newer) const {
+      object_index_t::iterator i = objects.find(&e->soid);
+      if (i != objects.end()) {
+	if (only_if_newer && i->second->version >= e->version)
+	  return;
+	objects.erase(i);
+      }
+      objects.insert(make_pair(&e->soid, e));
+    }
+
+  public:
     mutable ceph::unordered_map<osd_reqid_t,pg_log_entry_t*> caller_ops;
     mutable ceph::unordered_multimap<osd_reqid_t,pg_log_entry_t*> extra_caller_ops;
 
@@ -105,6 +140,23 @@ struct PGLog : DoutPrefixProvider {
       indexed_data(0),
       rollback_info_trimmed_to_riter(log.rbegin())
       {}
+    // the indexes and pointers refer to the entries of the copied log,
+    // so only the log itself is copied
+    IndexedLog(const IndexedLog& o) :
+      pg_log_t(o),
+      complete_to(log.end()),
+      last_requested(0),
+      indexed_data(0),
+      rollback_info_trimmed_to_riter(log.rbegin()) {
+      reset_rollback_info_trimmed_to_riter();
+    }
+    IndexedLog& operator=(const IndexedLog& o) {
+      pg_log_t::operator=(o);
+      unindex();
+      reset_recovery_pointers();
+      reset_rollback_info_trimmed_to_riter();
+      return *this;
+    }
 
     void claim_log_and_clear_rollback_info(const pg_log_t& o) {
       // we must have already trimmed the old entries
@@ -144,10 +196,18 @@ struct PGLog : DoutPrefixProvider {
     }
 
     bool logged_object(const hobject_t& oid) const {
+      return get_object_entry(oid) != NULL;
+    }
+
+    /// the latest entry for oid, or NULL if oid is not in the log
+    const pg_log_entry_t *get_object_entry(const hobject_t& oid) const {
       if (!(indexed_data & PGLOG_INDEXED_OBJECTS)) {
          index_objects();
       }
-      return objects.count(oid);
+      object_index_t::const_iterator i = objects.find(&oid);
+      if (i == objects.end())
+	return NULL;
+      return i->second;
     }
 
     bool logged_req(const osd_reqid_t &r) const {
@@ -211,10 +271,7 @@ struct PGLog : DoutPrefixProvider {
 			   vector<pair<osd_reqid_t, version_t> > *pls) const {
        // make sure object is present at least once before we do an
        // O(n) search.
-      if (!(indexed_data & PGLOG_INDEXED_OBJECTS)) {
-        index_objects();
-      }
-      if (objects.count(oid) == 0)
+      if (!logged_object(oid))
 	return;
       for (list<pg_log_entry_t>::const_reverse_iterator i = log.rbegin();
            i != log.rend();
@@ -240,32 +297,10 @@ struct PGLog : DoutPrefixProvider {
 	++rollback_info_trimmed_to_riter;
     }
 
-    // indexes objects, caller ops and extra caller ops
+    // drops the indexes after the log was replaced; they are rebuilt
+    // from the new log when next needed
     void index() {
-      objects.clear();
-      caller_ops.clear();
-      extra_caller_ops.clear();
-      for (list<pg_log_entry_t>::iterator i = log.begin();
-             i != log.end();
-             ++i) {
-	if (i->object_is_indexed()) {
-	  objects[i->soid] = &(*i);
-	}
-
-        if (i->reqid_is_indexed()) {
-        //assert(caller_ops.count(i->reqid) == 0);  // divergent merge_log indexes new before unindexing old
-          caller_ops[i->reqid] = &(*i);
-        }
-        
-        for (vector<pair<osd_reqid_t, version_t> >::const_iterator j =
-              i->extra_reqids.begin();
-              j != i->extra_reqids.end();
-              ++j) {
-            extra_caller_ops.insert(make_pair(j->first, &(*i)));
-        }
-      }
-        
-      indexed_data = PGLOG_INDEXED_ALL;
+      unindex();
       reset_rollback_info_trimmed_to_riter();
     }
 
@@ -275,7 +310,7 @@ struct PGLog : DoutPrefixProvider {
             i != log.end();
             ++i) {
 	if (i->object_is_indexed()) {
-	  objects[i->soid] = const_cast<pg_log_entry_t*>(&(*i));
+	  _index_object(const_cast<pg_log_entry_t*>(&(*i)), false);
 	}
        }
  
@@ -316,9 +351,7 @@ struct PGLog : DoutPrefixProvider {
 
     void index(pg_log_entry_t& e) {
       if ((indexed_data & PGLOG_INDEXED_OBJECTS) && e.object_is_indexed()) {
-        if (objects.count(e.soid) == 0 ||
-            objects[e.soid]->version < e.version)
-          objects[e.soid] = &e;
+        _index_object(&e, true);
       }
       if (indexed_data & PGLOG_INDEXED_CALLER_OPS) {
         if (e.reqid_is_indexed()) {
@@ -344,8 +377,9 @@ struct PGLog : DoutPrefixProvider {
     void unindex(pg_log_entry_t& e) {
       // NOTE: this only works if we remove from the _tail_ of the log!
       if (indexed_data & PGLOG_INDEXED_OBJECTS) {
-        if (objects.count(e.soid) && objects[e.soid]->version == e.version)
-          objects.erase(e.soid);
+        object_index_t::iterator i = objects.find(&e.soid);
+        if (i != objects.end() && i->second->version == e.version)
+          objects.erase(i);
       }
       if (e.reqid_is_indexed()) {
         if (indexed_data & PGLOG_INDEXED_CALLER_OPS) {
@@ -393,7 +427,7 @@ struct PGLog : DoutPrefixProvider {
 
       // to our index
       if ((indexed_data & PGLOG_INDEXED_OBJECTS) && e.object_is_indexed()) {
-        objects[e.soid] = &(log.back());
+        _index_object(&(log.back()), false);
       }
       if (indexed_data & PGLOG_INDEXED_CALLER_OPS) {
         if (e.reqid_is_indexed()) {
@@ -736,20 +770,19 @@ protected:
 		       << " last_divergent_update: " << last_divergent_update
 		       << dendl;
 
-    ceph::unordered_map<hobject_t, pg_log_entry_t*>::const_iterator objiter =
-      log.objects.find(hoid);
-    if (objiter != log.objects.end() &&
-	objiter->second->version >= first_divergent_update) {
+    const pg_log_entry_t *objentry = log.get_object_entry(hoid);
+    if (objentry &&
+	objentry->version >= first_divergent_update) {
       /// Case 1)
-      assert(objiter->second->version > last_divergent_update);
+      assert(objentry->version > last_divergent_update);
 
       ldpp_dout(dpp, 10) << __func__ << ": more recent entry found: "
-			 << *objiter->second << ", already merged" << dendl;
+			 << *objentry << ", already merged" << dendl;
 
       // ensure missing has been updated appropriately
-      if (objiter->second->is_update()) {
+      if (objentry->is_update()) {
 	assert(missing.is_missing(hoid) &&
-	       missing.get_items().at(hoid).need == objiter->second->version);
+	       missing.get_items().at(hoid).need == objentry->version);
       } else {
 	assert(!missing.is_missing(hoid));
       }
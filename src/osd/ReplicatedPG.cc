@@ -337,7 +337,7 @@ void ReplicatedPG::on_local_recover(
   if (pg_log.get_missing().is_missing(recovery_info.soid) &&
       pg_log.get_missing().get_items().find(recovery_info.soid)->second.need > recovery_info.version) {
     assert(is_primary());
-    const pg_log_entry_t *latest = pg_log.get_log().objects.find(recovery_info.soid)->second;
+    const pg_log_entry_t *latest = pg_log.get_log().get_object_entry(recovery_info.soid);
     if (latest->op == pg_log_entry_t::LOST_REVERT &&
 	latest->reverting_to == recovery_info.version) {
       dout(10) << " got old revert version " << recovery_info.version
@@ -3049,6 +3049,7 @@ void ReplicatedPG::execute_ctx(OpContext *ctx)
   // this method must be idempotent since we may call it several times
   // before we finally apply the resulting transaction.
   ctx->op_t.reset(pgbackend->get_transaction());
+  ctx->ec_rollback_extents.clear();
 
   if (op->may_write() || op->may_cache()) {
     // snap
@@ -5186,17 +5187,21 @@ int ReplicatedPG::do_osd_ops(OpContext *ctx, vector<OSDOp>& ops)
 	  op.flags = op.flags | CEPH_OSD_OP_FLAG_FADVISE_DONTNEED;
 
 	if (pool.info.requires_aligned_append() &&
+	    !pool.info.allows_ecoverwrites() &&
 	    (op.extent.offset % pool.info.required_alignment() != 0)) {
 	  result = -EOPNOTSUPP;
 	  break;
 	}
 
 	if (!obs.exists) {
-	  if (pool.info.require_rollback() && op.extent.offset) {
+	  if (pool.info.require_rollback() && op.extent.offset &&
+	      !pool.info.allows_ecoverwrites()) {
 	    result = -EOPNOTSUPP;
 	    break;
 	  }
 	  ctx->mod_desc.create();
+	} else if (pool.info.allows_ecoverwrites()) {
+	  // recorded below, after any truncate the write implies
 	} else if (op.extent.offset == oi.size) {
 	  ctx->mod_desc.append(oi.size);
 	} else {
@@ -5222,6 +5227,18 @@ int ReplicatedPG::do_osd_ops(OpContext *ctx, vector<OSDOp>& ops)
 	  if (obs.exists && !oi.is_whiteout()) {
 	    dout(10) << " truncate_seq " << op.extent.truncate_seq << " > current " << seq
 		     << ", truncating to " << op.extent.truncate_size << dendl;
+	    if (pool.info.require_rollback()) {
+	      if (!pool.info.allows_ecoverwrites()) {
+		result = -EOPNOTSUPP;
+		break;
+	      }
+	      if (op.extent.truncate_size < oi.size)
+		ec_overwrite_rollback(ctx, op.extent.truncate_size,
+				      oi.size - op.extent.truncate_size);
+	      else
+		ec_overwrite_rollback(ctx, oi.size,
+				      op.extent.truncate_size - oi.size);
+	    }
 	    t->truncate(soid, op.extent.truncate_size);
 	    oi.truncate_seq = op.extent.truncate_seq;
 	    oi.truncate_size = op.extent.truncate_size;
@@ -5240,7 +5257,17 @@ int ReplicatedPG::do_osd_ops(OpContext *ctx, vector<OSDOp>& ops)
 	result = check_offset_and_length(op.extent.offset, op.extent.length, cct->_conf->osd_max_object_size);
 	if (result < 0)
 	  break;
-	if (pool.info.require_rollback()) {
+	if (pool.info.allows_ecoverwrites()) {
+	  if (op.extent.length)
+	    ec_overwrite_rollback(ctx, op.extent.offset, op.extent.length);
+	  else if (op.extent.offset > oi.size)
+	    ec_overwrite_rollback(ctx, oi.size, op.extent.offset - oi.size);
+	  t->write(soid, op.extent.offset, op.extent.length, osd_op.indata, op.flags);
+	  if (!op.extent.length && op.extent.offset > oi.size) {
+	    // the shards must still cover the new size
+	    t->truncate(soid, op.extent.offset);
+	  }
+	} else if (pool.info.require_rollback()) {
 	  t->append(soid, op.extent.offset, op.extent.length, osd_op.indata, op.flags);
 	} else {
 	  t->write(soid, op.extent.offset, op.extent.length, osd_op.indata, op.flags);
@@ -5330,7 +5357,7 @@ int ReplicatedPG::do_osd_ops(OpContext *ctx, vector<OSDOp>& ops)
 
     case CEPH_OSD_OP_ZERO:
       tracepoint(osd, do_osd_op_pre_zero, soid.oid.name.c_str(), soid.snap.val, op.extent.offset, op.extent.length);
-      if (pool.info.require_rollback()) {
+      if (pool.info.require_rollback() && !pool.info.allows_ecoverwrites()) {
 	result = -EOPNOTSUPP;
 	break;
       }
@@ -5340,8 +5367,17 @@ int ReplicatedPG::do_osd_ops(OpContext *ctx, vector<OSDOp>& ops)
 	if (result < 0)
 	  break;
 	assert(op.extent.length);
+	if (pool.info.require_rollback() && obs.exists) {
+	  // zeroing past the end would only grow the shards
+	  if (op.extent.offset >= oi.size)
+	    break;
+	  op.extent.length = MIN(op.extent.length, oi.size - op.extent.offset);
+	}
 	if (obs.exists && !oi.is_whiteout()) {
-	  ctx->mod_desc.mark_unrollbackable();
+	  if (pool.info.require_rollback())
+	    ec_overwrite_rollback(ctx, op.extent.offset, op.extent.length);
+	  else
+	    ctx->mod_desc.mark_unrollbackable();
 	  t->zero(soid, op.extent.offset, op.extent.length);
 	  interval_set<uint64_t> ch;
 	  ch.insert(op.extent.offset, op.extent.length);
@@ -5394,12 +5430,13 @@ int ReplicatedPG::do_osd_ops(OpContext *ctx, vector<OSDOp>& ops)
 
     case CEPH_OSD_OP_TRUNCATE:
       tracepoint(osd, do_osd_op_pre_truncate, soid.oid.name.c_str(), soid.snap.val, oi.size, oi.truncate_seq, op.extent.offset, op.extent.length, op.extent.truncate_size, op.extent.truncate_seq);
-      if (pool.info.require_rollback()) {
+      if (pool.info.require_rollback() && !pool.info.allows_ecoverwrites()) {
 	result = -EOPNOTSUPP;
 	break;
       }
       ++ctx->num_write;
-      ctx->mod_desc.mark_unrollbackable();
+      if (!pool.info.require_rollback())
+	ctx->mod_desc.mark_unrollbackable();
       {
 	// truncate
 	if (!obs.exists || oi.is_whiteout()) {
@@ -5425,6 +5462,13 @@ int ReplicatedPG::do_osd_ops(OpContext *ctx, vector<OSDOp>& ops)
 	  oi.truncate_size = op.extent.truncate_size;
 	}
 
+	if (pool.info.require_rollback()) {
+	  if (op.extent.offset < oi.size)
+	    ec_overwrite_rollback(ctx, op.extent.offset,
+				  oi.size - op.extent.offset);
+	  else
+	    ec_overwrite_rollback(ctx, oi.size, op.extent.offset - oi.size);
+	}
 	t->truncate(soid, op.extent.offset);
 	if (oi.size > op.extent.offset) {
 	  interval_set<uint64_t> trim;
@@ -6675,6 +6719,30 @@ void ReplicatedPG::add_interval_usage(interval_set<uint64_t>& s, object_stat_sum
   }
 }
 
+void ReplicatedPG::ec_overwrite_rollback(OpContext *ctx, uint64_t offset,
+					 uint64_t length)
+{
+  assert(pool.info.allows_ecoverwrites());
+  const object_info_t& oi = ctx->new_obs.oi;
+  if (offset + length > oi.size)
+    ctx->mod_desc.append(oi.size);
+
+  // only the stripes the object held before this op are stashed;
+  // anything it grew into since is dropped by the truncate above
+  uint64_t stripe_width = pool.info.get_stripe_width();
+  uint64_t old_size = ctx->obc->obs.exists ? ctx->obc->obs.oi.size : 0;
+  uint64_t start = offset - offset % stripe_width;
+  uint64_t end = MIN(ROUND_UP_TO(offset + length, stripe_width),
+		     ROUND_UP_TO(old_size, stripe_width));
+  if (start < end) {
+    // several ops may overwrite the same stripes: the stash object is
+    // per log entry, so merge them into a single rollback record
+    interval_set<uint64_t> extent;
+    extent.insert(start, end - start);
+    ctx->ec_rollback_extents.union_of(extent);
+  }
+}
+
 void ReplicatedPG::complete_disconnect_watches(
   ObjectContextRef obc,
   const list<watch_disconnect_t> &to_disconnect)
@@ -6874,6 +6942,17 @@ void ReplicatedPG::finish_ctx(OpContext *ctx, int log_op_type, bool maintain_ssc
 	   << dendl;
   utime_t now = ceph_clock_now(cct);
 
+  if (!ctx->ec_rollback_extents.empty()) {
+    vector<pair<uint64_t, uint64_t> > extents;
+    for (interval_set<uint64_t>::const_iterator i =
+	   ctx->ec_rollback_extents.begin();
+	 i != ctx->ec_rollback_extents.end();
+	 ++i) {
+      extents.push_back(make_pair(i.get_start(), i.get_len()));
+    }
+    ctx->mod_desc.rollback_extents(ctx->at_version.version, extents);
+  }
+
   // snapset
   bufferlist bss;
 
@@ -9023,10 +9102,10 @@ void ReplicatedPG::populate_obc_watchers(ObjectContextRef obc)
   assert(is_active());
   assert((recovering.count(obc->obs.oi.soid) ||
 	  !is_missing_object(obc->obs.oi.soid)) ||
-	 (pg_log.get_log().objects.count(obc->obs.oi.soid) && // or this is a revert... see recover_primary()
-	  pg_log.get_log().objects.find(obc->obs.oi.soid)->second->op ==
+	 (pg_log.get_log().logged_object(obc->obs.oi.soid) && // or this is a revert... see recover_primary()
+	  pg_log.get_log().get_object_entry(obc->obs.oi.soid)->op ==
 	    pg_log_entry_t::LOST_REVERT &&
-	  pg_log.get_log().objects.find(obc->obs.oi.soid)->second->reverting_to ==
+	  pg_log.get_log().get_object_entry(obc->obs.oi.soid)->reverting_to ==
 	    obc->obs.oi.version));
 
   dout(10) << "populate_obc_watchers " << obc->obs.oi.soid << dendl;
@@ -9151,8 +9230,8 @@ ObjectContextRef ReplicatedPG::get_object_context(const hobject_t& soid,
   assert(
     attrs || !pg_log.get_missing().is_missing(soid) ||
     // or this is a revert... see recover_primary()
-    (pg_log.get_log().objects.count(soid) &&
-      pg_log.get_log().objects.find(soid)->second->op ==
+    (pg_log.get_log().logged_object(soid) &&
+      pg_log.get_log().get_object_entry(soid)->op ==
       pg_log_entry_t::LOST_REVERT));
   ObjectContextRef obc = object_contexts.lookup(soid);
   osd->logger->inc(l_osd_object_ctx_cache_total);
@@ -10689,7 +10768,7 @@ uint64_t ReplicatedPG::recover_primary(uint64_t max, ThreadPool::TPHandle &handl
   dout(25) << "recover_primary " << missing.get_items() << dendl;
 
   // look at log!
-  pg_log_entry_t *latest = 0;
+  const pg_log_entry_t *latest = 0;
   unsigned started = 0;
   int skipped = 0;
 
@@ -10701,12 +10780,11 @@ uint64_t ReplicatedPG::recover_primary(uint64_t max, ThreadPool::TPHandle &handl
     hobject_t soid;
     version_t v = p->first;
 
-    if (pg_log.get_log().objects.count(p->second)) {
-      latest = pg_log.get_log().objects.find(p->second)->second;
+    latest = pg_log.get_log().get_object_entry(p->second);
+    if (latest) {
       assert(latest->is_update());
       soid = latest->soid;
     } else {
-      latest = 0;
       soid = p->second;
     }
     const pg_missing_item& item = missing.get_items().find(p->second)->second;
@@ -479,6 +479,8 @@ public:
     boost::optional<pg_hit_set_history_t> updated_hset_history;
 
     interval_set<uint64_t> modified_ranges;
+    /// stripes an ec overwrite must stash, recorded once in finish_ctx
+    interval_set<uint64_t> ec_rollback_extents;
     ObjectContextRef obc;
     map<hobject_t,ObjectContextRef, hobject_t::BitwiseComparator> src_obc;
     ObjectContextRef clone_obc;    // if we created a clone
@@ -1116,6 +1118,8 @@ protected:
 				   uint64_t length, bool count_bytes,
 				   bool force_changesize=false);
   void add_interval_usage(interval_set<uint64_t>& s, object_stat_sum_t& st);
+  /// record how to roll back an ec overwrite of offset~length
+  void ec_overwrite_rollback(OpContext *ctx, uint64_t offset, uint64_t length);
 
 
   enum class cache_result_t {
@@ -0,0 +1,133 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+/*
+ * Ceph - scalable distributed file system
+ *
+ * This is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License version 2.1, as published by the Free Software
+ * Foundation.  See file COPYING.
+ *
+ */
+
+#ifndef CEPH_OSD_MCLOCKCLIENTQUEUE_H
+#define CEPH_OSD_MCLOCKCLIENTQUEUE_H
+
+#include "osd/mClockOpClassQueue.h"
+
+/**
+ * mClock op queue with one mClock client per (owner, op class) pair.
+ *
+ * Client ops are tagged per client entity with the
+ * osd_op_queue_mclock_client_* values rather than the client_op class
+ * values, which would otherwise be granted again to every client and
+ * overcommit the reservation with the number of clients. The other op
+ * classes keep their class tags. Tenants are isolated from each other
+ * as well as from background work: a busy client cannot eat into the
+ * share of a quiet one.
+ */
+template <typename Request>
+class mClockClientQueue : public OpQueue<Request, entity_inst_t> {
+  struct client_key_t {
+    entity_inst_t inst;
+    osd_op_type_t type;
+
+    client_key_t(const entity_inst_t& i, osd_op_type_t t)
+      : inst(i), type(t) {}
+
+    friend bool operator<(const client_key_t& a, const client_key_t& b) {
+      if (a.inst == b.inst) {
+	return a.type < b.type;
+      }
+      return a.inst < b.inst;
+    }
+    friend bool operator==(const client_key_t& a, const client_key_t& b) {
+      return a.inst == b.inst && a.type == b.type;
+    }
+    friend std::ostream& operator<<(std::ostream& out,
+				    const client_key_t& k) {
+      return out << k.inst << ":" << k.type;
+    }
+  };
+  typedef mClockQueue<Request, client_key_t> queue_t;
+
+  mclock_op_tags_t tags;
+  mClockClientInfo client_tags;
+  queue_t queue;
+
+  mClockClientInfo get_tags(const client_key_t& k) const {
+    if (k.type == osd_op_type_t::client_op) {
+      return client_tags;
+    }
+    return tags.get(k.type);
+  }
+
+  static client_key_t get_key(entity_inst_t cl, const Request& r) {
+    return client_key_t(cl, r.second.get_op_type());
+  }
+
+public:
+  explicit mClockClientQueue(CephContext *cct)
+    : tags(cct),
+      client_tags(cct->_conf->osd_op_queue_mclock_client_res,
+		  cct->_conf->osd_op_queue_mclock_client_wgt,
+		  cct->_conf->osd_op_queue_mclock_client_lim),
+      queue([this](const client_key_t& k) { return get_tags(k); }) {}
+
+  unsigned length() const override final {
+    return queue.length();
+  }
+
+  void remove_by_filter(std::function<bool (Request)> f) override final {
+    queue.remove_by_filter(f);
+  }
+
+  void remove_by_class(entity_inst_t cl,
+		       std::list<Request> *out = 0) override final {
+    std::list<Request> removed;
+    queue.remove_by_filter([&cl, &removed](Request r) {
+	if (r.second.get_owner() == cl) {
+	  removed.push_back(r);
+	  return true;
+	}
+	return false;
+      });
+    if (out) {
+      out->splice(out->begin(), removed);
+    }
+  }
+
+  void enqueue_strict(entity_inst_t cl, unsigned priority,
+		      Request item) override final {
+    queue.enqueue_strict(get_key(cl, item), priority, item);
+  }
+
+  void enqueue_strict_front(entity_inst_t cl, unsigned priority,
+			    Request item) override final {
+    queue.enqueue_strict_front(get_key(cl, item), priority, item);
+  }
+
+  void enqueue(entity_inst_t cl, unsigned priority, unsigned cost,
+	       Request item) override final {
+    queue.enqueue(get_key(cl, item), priority, cost, item);
+  }
+
+  void enqueue_front(entity_inst_t cl, unsigned priority, unsigned cost,
+		     Request item) override final {
+    queue.enqueue_front(get_key(cl, item), priority, cost, item);
+  }
+
+  bool empty() const override final {
+    return queue.empty();
+  }
+
+  Request dequeue() override final {
+    return queue.dequeue();
+  }
+
+  void dump(ceph::Formatter *f) const override final {
+    queue.dump(f);
+  }
+};
+
+#endif
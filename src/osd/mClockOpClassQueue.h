@@ -0,0 +1,161 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+/*
+ * Ceph - scalable distributed file system
+ *
+ * This is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License version 2.1, as published by the Free Software
+ * Foundation.  See file COPYING.
+ *
+ */
+
+#ifndef CEPH_OSD_MCLOCKOPCLASSQUEUE_H
+#define CEPH_OSD_MCLOCKOPCLASSQUEUE_H
+
+#include "common/config.h"
+#include "common/mClockPriorityQueue.h"
+#include "msg/msg_types.h"
+
+#include <ostream>
+
+/// the classes of work the OSD op queue schedules against each other
+enum class osd_op_type_t {
+  client_op,
+  osd_subop,
+  bg_snaptrim,
+  bg_recovery,
+  bg_scrub
+};
+
+inline std::ostream& operator<<(std::ostream& out, const osd_op_type_t& t) {
+  switch (t) {
+  case osd_op_type_t::client_op:   return out << "client_op";
+  case osd_op_type_t::osd_subop:   return out << "osd_subop";
+  case osd_op_type_t::bg_snaptrim: return out << "bg_snaptrim";
+  case osd_op_type_t::bg_recovery: return out << "bg_recovery";
+  case osd_op_type_t::bg_scrub:    return out << "bg_scrub";
+  }
+  return out << "unknown";
+}
+
+/// osd_op_queue_mclock_* settings, read once per queue
+struct mclock_op_tags_t {
+  mClockClientInfo client_op;
+  mClockClientInfo osd_subop;
+  mClockClientInfo snaptrim;
+  mClockClientInfo recov;
+  mClockClientInfo scrub;
+
+  explicit mclock_op_tags_t(CephContext *cct)
+    : client_op(cct->_conf->osd_op_queue_mclock_client_op_res,
+		cct->_conf->osd_op_queue_mclock_client_op_wgt,
+		cct->_conf->osd_op_queue_mclock_client_op_lim),
+      osd_subop(cct->_conf->osd_op_queue_mclock_osd_subop_res,
+		cct->_conf->osd_op_queue_mclock_osd_subop_wgt,
+		cct->_conf->osd_op_queue_mclock_osd_subop_lim),
+      snaptrim(cct->_conf->osd_op_queue_mclock_snap_res,
+	       cct->_conf->osd_op_queue_mclock_snap_wgt,
+	       cct->_conf->osd_op_queue_mclock_snap_lim),
+      recov(cct->_conf->osd_op_queue_mclock_recov_res,
+	    cct->_conf->osd_op_queue_mclock_recov_wgt,
+	    cct->_conf->osd_op_queue_mclock_recov_lim),
+      scrub(cct->_conf->osd_op_queue_mclock_scrub_res,
+	    cct->_conf->osd_op_queue_mclock_scrub_wgt,
+	    cct->_conf->osd_op_queue_mclock_scrub_lim) {}
+
+  const mClockClientInfo& get(osd_op_type_t t) const {
+    switch (t) {
+    case osd_op_type_t::client_op:   return client_op;
+    case osd_op_type_t::osd_subop:   return osd_subop;
+    case osd_op_type_t::bg_snaptrim: return snaptrim;
+    case osd_op_type_t::bg_recovery: return recov;
+    case osd_op_type_t::bg_scrub:    return scrub;
+    }
+    assert(0 == "invalid op type");
+    return client_op;
+  }
+};
+
+/**
+ * mClock op queue with one mClock client per op class: client ops,
+ * replica sub ops, snap trim, recovery and scrub each get their own
+ * reservation, weight and limit.
+ *
+ * Request is a pair<PGRef, PGQueueable>; the op class is taken from
+ * the queued item, the entity_inst_t key is only used for removal.
+ */
+template <typename Request>
+class mClockOpClassQueue : public OpQueue<Request, entity_inst_t> {
+  typedef mClockQueue<Request, osd_op_type_t> queue_t;
+
+  mclock_op_tags_t tags;
+  queue_t queue;
+
+  static osd_op_type_t get_op_type(const Request& r) {
+    return r.second.get_op_type();
+  }
+
+public:
+  explicit mClockOpClassQueue(CephContext *cct)
+    : tags(cct),
+      queue([this](const osd_op_type_t& t) { return tags.get(t); }) {}
+
+  unsigned length() const override final {
+    return queue.length();
+  }
+
+  void remove_by_filter(std::function<bool (Request)> f) override final {
+    queue.remove_by_filter(f);
+  }
+
+  void remove_by_class(entity_inst_t cl,
+		       std::list<Request> *out = 0) override final {
+    // ops of one owner are spread across the op classes
+    std::list<Request> removed;
+    queue.remove_by_filter([&cl, &removed](Request r) {
+	if (r.second.get_owner() == cl) {
+	  removed.push_back(r);
+	  return true;
+	}
+	return false;
+      });
+    if (out) {
+      out->splice(out->begin(), removed);
+    }
+  }
+
+  void enqueue_strict(entity_inst_t cl, unsigned priority,
+		      Request item) override final {
+    queue.enqueue_strict(get_op_type(item), priority, item);
+  }
+
+  void enqueue_strict_front(entity_inst_t cl, unsigned priority,
+			    Request item) override final {
+    queue.enqueue_strict_front(get_op_type(item), priority, item);
+  }
+
+  void enqueue(entity_inst_t cl, unsigned priority, unsigned cost,
+	       Request item) override final {
+    queue.enqueue(get_op_type(item), priority, cost, item);
+  }
+
+  void enqueue_front(entity_inst_t cl, unsigned priority, unsigned cost,
+		     Request item) override final {
+    queue.enqueue_front(get_op_type(item), priority, cost, item);
+  }
+
+  bool empty() const override final {
+    return queue.empty();
+  }
+
+  Request dequeue() override final {
+    return queue.dequeue();
+  }
+
+  void dump(ceph::Formatter *f) const override final {
+    queue.dump(f);
+  }
+};
+
+#endif
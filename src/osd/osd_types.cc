@@ -3300,6 +3300,14 @@ void ObjectModDesc::visit(Visitor *visitor) const
 	visitor->try_rmobject(old_version);
 	break;
       }
+      case ROLLBACK_EXTENTS: {
+	version_t gen;
+	vector<pair<uint64_t, uint64_t> > extents;
+	::decode(gen, bp);
+	::decode(extents, bp);
+	visitor->rollback_extents(gen, extents);
+	break;
+      }
       default:
 	assert(0 == "Invalid rollback code");
       }
@@ -3348,6 +3356,15 @@ struct DumpVisitor : public ObjectModDesc::Visitor {
     f->dump_stream("snaps") << snaps;
     f->close_section();
   }
+  void rollback_extents(
+    version_t gen,
+    const vector<pair<uint64_t, uint64_t> > &extents) {
+    f->open_object_section("op");
+    f->dump_string("code", "ROLLBACK_EXTENTS");
+    f->dump_unsigned("gen", gen);
+    f->dump_stream("extents") << extents;
+    f->close_section();
+  }
 };
 
 void ObjectModDesc::dump(Formatter *f) const
@@ -3383,6 +3400,13 @@ void ObjectModDesc::generate_test_instances(list<ObjectModDesc*>& o)
   o.back()->setattrs(attrs);
   o.back()->mark_unrollbackable();
   o.back()->append(1000);
+  vector<pair<uint64_t, uint64_t> > extents;
+  extents.push_back(make_pair(0, 4096));
+  extents.push_back(make_pair(65536, 8192));
+  o.push_back(new ObjectModDesc());
+  o.back()->setattrs(attrs);
+  o.back()->rollback_extents(1002, extents);
+  o.back()->append(69632);
 }
 
 void ObjectModDesc::encode(bufferlist &_bl) const
@@ -1083,6 +1083,7 @@ struct pg_pool_t {
     FLAG_WRITE_FADVISE_DONTNEED = 1<<7, // write mode with LIBRADOS_OP_FLAG_FADVISE_DONTNEED
     FLAG_NOSCRUB = 1<<8, // block periodic scrub
     FLAG_NODEEP_SCRUB = 1<<9, // block periodic deep-scrub
+    FLAG_EC_OVERWRITES = 1<<10, // ec pool allows partial-stripe overwrites
   };
 
   static const char *get_flag_name(int f) {
@@ -1097,6 +1098,7 @@ struct pg_pool_t {
     case FLAG_WRITE_FADVISE_DONTNEED: return "write_fadvise_dontneed";
     case FLAG_NOSCRUB: return "noscrub";
     case FLAG_NODEEP_SCRUB: return "nodeep-scrub";
+    case FLAG_EC_OVERWRITES: return "ec_overwrites";
     default: return "???";
     }
   }
@@ -1135,6 +1137,8 @@ struct pg_pool_t {
       return FLAG_NOSCRUB;
     if (name == "nodeep-scrub")
       return FLAG_NODEEP_SCRUB;
+    if (name == "ec_overwrites")
+      return FLAG_EC_OVERWRITES;
     return 0;
   }
 
@@ -1366,6 +1370,10 @@ public:
   bool require_rollback() const {
     return ec_pool() || flags & FLAG_DEBUG_FAKE_EC_POOL;
   }
+  /// true if an ec pool may overwrite parts of existing objects
+  bool allows_ecoverwrites() const {
+    return ec_pool() && has_flag(FLAG_EC_OVERWRITES);
+  }
 
   /// true if incomplete clones may be present
   bool allow_incomplete_clones() const {
@@ -2602,6 +2610,14 @@ public:
     }
     virtual void create() {}
     virtual void update_snaps(set<snapid_t> &old_snaps) {}
+    /**
+     * Used by ec overwrites: the old contents of each (offset, length)
+     * extent were cloned into the object at generation gen before
+     * being overwritten.  Offsets are logical and stripe aligned.
+     */
+    virtual void rollback_extents(
+      version_t gen,
+      const vector<pair<uint64_t, uint64_t> > &extents) {}
     virtual ~Visitor() {}
   };
   void visit(Visitor *visitor) const;
@@ -2612,7 +2628,8 @@ public:
     DELETE = 3,
     CREATE = 4,
     UPDATE_SNAPS = 5,
-    TRY_DELETE = 6
+    TRY_DELETE = 6,
+    ROLLBACK_EXTENTS = 7
   };
   ObjectModDesc() : can_local_rollback(true), rollback_info_completed(false) {}
   void claim(ObjectModDesc &other) {
@@ -2698,6 +2715,19 @@ public:
     ::encode(old_snaps, bl);
     ENCODE_FINISH(bl);
   }
+  /// @return false if the caller need not stash the old extents
+  bool rollback_extents(
+    version_t gen,
+    const vector<pair<uint64_t, uint64_t> > &extents) {
+    if (!can_local_rollback || rollback_info_completed)
+      return false;
+    ENCODE_START(1, 1, bl);
+    append_id(ROLLBACK_EXTENTS);
+    ::encode(gen, bl);
+    ::encode(extents, bl);
+    ENCODE_FINISH(bl);
+    return true;
+  }
 
   // cannot be rolled back
   void mark_unrollbackable() {
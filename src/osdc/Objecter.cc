@@ -1202,6 +1202,7 @@ void Objecter::handle_osd_map(MOSDMap *m)
 	  skipped_map = true;
 	  continue;
 	}
+	osdmap->update_mapping_cache(cct);
 	logger->set(l_osdc_map_epoch, osdmap->get_epoch());
 
 	cluster_full = cluster_full || _osdmap_full_flag();
@@ -1240,6 +1241,7 @@ void Objecter::handle_osd_map(MOSDMap *m)
 	ldout(cct, 3) << "handle_osd_map decoding full epoch "
 		      << m->get_last() << dendl;
 	osdmap->decode(m->maps[m->get_last()]);
+	osdmap->update_mapping_cache(cct);
 
 	_scan_requests(homeless_session, false, false, NULL,
 		       need_resend, need_resend_linger,
@@ -0,0 +1,230 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+
+#include <boost/asio/write.hpp>
+#include <boost/beast/http/read.hpp>
+
+#include "rgw_asio_client.h"
+
+#define dout_subsys ceph_subsys_rgw
+#undef dout_prefix
+#define dout_prefix (*_dout << "asio: ")
+
+using namespace rgw::asio;
+
+ClientIO::ClientIO(tcp::socket& socket, parser_type& parser,
+		   boost::beast::flat_buffer& buffer,
+		   boost::asio::yield_context yield)
+  : socket(socket), parser(parser), buffer(buffer), yield(yield),
+    status_num(0), header_done(false), sent_header(false),
+    has_content_length(false), explicit_keepalive(false),
+    explicit_conn_close(false)
+{
+}
+
+ClientIO::~ClientIO() = default;
+
+void ClientIO::init_env(CephContext *cct)
+{
+  env.init(cct);
+
+  const auto& request = parser.get();
+  for (const auto& field : request) {
+    const auto name = field.name_string().to_string();
+    const auto value = field.value().to_string();
+
+    if (strcasecmp(name.c_str(), "content-length") == 0) {
+      env.set("CONTENT_LENGTH", value.c_str());
+      continue;
+    }
+    if (strcasecmp(name.c_str(), "content-type") == 0) {
+      env.set("CONTENT_TYPE", value.c_str());
+      continue;
+    }
+    if (strcasecmp(name.c_str(), "connection") == 0) {
+      explicit_keepalive = (strcasecmp(value.c_str(), "keep-alive") == 0);
+      explicit_conn_close = (strcasecmp(value.c_str(), "close") == 0);
+    }
+
+    string buf = "HTTP_";
+    buf.reserve(5 + name.size());
+    for (char c : name) {
+      buf.push_back(c == '-' ? '_' : toupper(c));
+    }
+    env.set(buf.c_str(), value.c_str());
+  }
+  if (request.version() < 11 && !explicit_keepalive) {
+    // HTTP/1.0 closes the connection unless asked not to
+    explicit_conn_close = true;
+  }
+
+  const auto method = request.method_string().to_string();
+  env.set("REQUEST_METHOD", method.c_str());
+
+  // split uri from query
+  const auto target = request.target().to_string();
+  const auto pos = target.find('?');
+  const auto uri = target.substr(0, pos);
+  env.set("REQUEST_URI", uri.c_str());
+  env.set("SCRIPT_URI", uri.c_str()); /* FIXME */
+  if (pos != string::npos) {
+    env.set("QUERY_STRING", target.substr(pos + 1).c_str());
+  }
+
+  boost::system::error_code ec;
+  const auto local = socket.local_endpoint(ec);
+  if (!ec) {
+    char port_buf[16];
+    snprintf(port_buf, sizeof(port_buf), "%d", local.port());
+    env.set("SERVER_PORT", port_buf);
+  }
+  const auto remote = socket.remote_endpoint(ec);
+  if (!ec) {
+    env.set("REMOTE_ADDR", remote.address().to_string().c_str());
+  }
+}
+
+int ClientIO::write_data(const char *buf, int len)
+{
+  if (!header_done) {
+    header_data.append(buf, len);
+    return len;
+  }
+  if (!sent_header) {
+    data.append(buf, len);
+    return len;
+  }
+  boost::system::error_code ec;
+  auto bytes = boost::asio::async_write(socket, boost::asio::buffer(buf, len),
+					yield[ec]);
+  if (ec) {
+    dout(4) << "write_data failed: " << ec.message() << dendl;
+    return -EIO;
+  }
+  return bytes;
+}
+
+int ClientIO::read_data(char *buf, int max)
+{
+  auto& body = parser.get().body();
+  body.data = buf;
+  body.size = max;
+
+  while (body.size && !parser.is_done()) {
+    boost::system::error_code ec;
+    http::async_read_some(socket, buffer, parser, yield[ec]);
+    if (ec == http::error::need_buffer) {
+      break;
+    }
+    if (ec) {
+      dout(4) << "read_data failed: " << ec.message() << dendl;
+      return -EIO;
+    }
+  }
+  return max - body.size;
+}
+
+int ClientIO::send_status(int status, const char *status_name)
+{
+  char buf[128];
+
+  if (!status_name)
+    status_name = "";
+
+  snprintf(buf, sizeof(buf), "HTTP/1.1 %d %s\r\n", status, status_name);
+
+  bufferlist bl;
+  bl.append(buf);
+  bl.append(header_data);
+  header_data = bl;
+
+  status_num = status;
+  return 0;
+}
+
+int ClientIO::send_100_continue()
+{
+  const char buf[] = "HTTP/1.1 100 CONTINUE\r\n\r\n";
+  boost::system::error_code ec;
+  boost::asio::async_write(socket, boost::asio::buffer(buf, sizeof(buf) - 1),
+			   yield[ec]);
+  if (ec) {
+    dout(4) << "send_100_continue failed: " << ec.message() << dendl;
+    return -EIO;
+  }
+  return 0;
+}
+
+static void dump_date_header(bufferlist &out)
+{
+  char timestr[128];
+  const time_t gtime = time(NULL);
+  struct tm result;
+  struct tm const * const tmp = gmtime_r(&gtime, &result);
+
+  if (tmp == NULL)
+    return;
+
+  if (strftime(timestr, sizeof(timestr),
+	       "Date: %a, %d %b %Y %H:%M:%S %Z\r\n", tmp))
+    out.append(timestr);
+}
+
+int ClientIO::complete_header()
+{
+  header_done = true;
+
+  if (!has_content_length) {
+    return 0;
+  }
+
+  dump_date_header(header_data);
+
+  if (explicit_keepalive)
+    header_data.append("Connection: Keep-Alive\r\n");
+  else if (explicit_conn_close)
+    header_data.append("Connection: close\r\n");
+
+  header_data.append("\r\n");
+
+  sent_header = true;
+
+  return write_data(header_data.c_str(), header_data.length());
+}
+
+int ClientIO::complete_request()
+{
+  if (!sent_header) {
+    if (!has_content_length) {
+      header_done = false; /* let's go back to writing the header */
+
+      // 204 and 304 responses must not carry a content-length (RFC7230)
+      if (status_num == 204 || status_num == 304) {
+	has_content_length = true;
+      } else {
+	int r = send_content_length(data.length());
+	if (r < 0)
+	  return r;
+      }
+    }
+
+    complete_header();
+  }
+
+  if (data.length()) {
+    int r = write_data(data.c_str(), data.length());
+    if (r < 0)
+      return r;
+    data.clear();
+  }
+
+  return 0;
+}
+
+int ClientIO::send_content_length(uint64_t len)
+{
+  has_content_length = true;
+  char buf[21];
+  snprintf(buf, sizeof(buf), "%" PRIu64, len);
+  return print("Content-Length: %s\r\n", buf);
+}
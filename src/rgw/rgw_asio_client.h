@@ -0,0 +1,73 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+
+#ifndef RGW_ASIO_CLIENT_H
+#define RGW_ASIO_CLIENT_H
+
+#include <boost/asio/ip/tcp.hpp>
+#include <boost/asio/spawn.hpp>
+#include <boost/beast/core/flat_buffer.hpp>
+#include <boost/beast/http/buffer_body.hpp>
+#include <boost/beast/http/parser.hpp>
+
+#include "rgw_client_io.h"
+
+namespace rgw {
+namespace asio {
+
+namespace http = boost::beast::http;
+using boost::asio::ip::tcp;
+using parser_type = http::request_parser<http::buffer_body>;
+
+/**
+ * RGWStreamIO over a socket owned by a stackful coroutine.
+ *
+ * The request header has already been parsed by the frontend.  Body
+ * reads and response writes go through the coroutine's yield_context,
+ * so a slow client suspends only its own coroutine and never blocks
+ * one of the frontend's worker threads.
+ */
+class ClientIO : public RGWStreamIO {
+  tcp::socket& socket;
+  parser_type& parser;
+  boost::beast::flat_buffer& buffer;
+  boost::asio::yield_context yield;
+
+  bufferlist header_data;
+  bufferlist data;
+
+  int status_num;
+
+  bool header_done;
+  bool sent_header;
+  bool has_content_length;
+  bool explicit_keepalive;
+  bool explicit_conn_close;
+
+  void init_env(CephContext *cct) override;
+  int write_data(const char *buf, int len) override;
+  int read_data(char *buf, int max) override;
+
+public:
+  ClientIO(tcp::socket& socket, parser_type& parser,
+	   boost::beast::flat_buffer& buffer,
+	   boost::asio::yield_context yield);
+  ~ClientIO() override;
+
+  int send_status(int status, const char *status_name) override;
+  int send_100_continue() override;
+  int complete_header() override;
+  int complete_request() override;
+  int send_content_length(uint64_t len) override;
+  void flush() override {}
+
+  /// true if the response framing lets us read another request afterwards
+  bool can_keep_alive() const {
+    return has_content_length && !explicit_conn_close;
+  }
+};
+
+} // namespace asio
+} // namespace rgw
+
+#endif // RGW_ASIO_CLIENT_H
@@ -0,0 +1,346 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+
+#include <atomic>
+#include <condition_variable>
+#include <limits>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include <boost/asio/io_service.hpp>
+#include <boost/asio/spawn.hpp>
+#include <boost/asio/steady_timer.hpp>
+#include <boost/beast/http/read.hpp>
+
+#include "common/errno.h"
+#include "global/global_init.h"
+
+#include "rgw_asio_client.h"
+#include "rgw_asio_frontend.h"
+
+#define dout_subsys ceph_subsys_rgw
+#undef dout_prefix
+#define dout_prefix (*_dout << "asio: ")
+
+namespace {
+
+using tcp = boost::asio::ip::tcp;
+namespace http = boost::beast::http;
+
+// process_request() runs on the coroutine stack and goes through the
+// xml/json formatters and crypto code, so be generous
+constexpr size_t coroutine_stack_size = 512 * 1024;
+
+/**
+ * Tracks requests in flight so the realm reloader can swap the store.
+ *
+ * pause() waits for every request already admitted to finish.  New
+ * requests that arrive meanwhile poll on a timer instead of blocking
+ * their worker thread, so the requests still inside keep running on
+ * the same threads and the pause cannot deadlock.
+ */
+class RequestGate {
+  std::mutex mutex;
+  std::condition_variable cond;
+  bool paused = false;
+  int inflight = 0;
+
+public:
+  void enter(boost::asio::io_service& service,
+	     boost::asio::yield_context yield) {
+    std::unique_lock<std::mutex> lock(mutex);
+    while (paused) {
+      lock.unlock();
+      boost::asio::steady_timer timer(service, std::chrono::milliseconds(10));
+      boost::system::error_code ec;
+      timer.async_wait(yield[ec]);
+      lock.lock();
+    }
+    ++inflight;
+  }
+  void leave() {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (--inflight == 0 && paused) {
+      cond.notify_all();
+    }
+  }
+  void pause() {
+    std::unique_lock<std::mutex> lock(mutex);
+    paused = true;
+    cond.wait(lock, [this] { return inflight == 0; });
+  }
+  void unpause() {
+    std::lock_guard<std::mutex> lock(mutex);
+    paused = false;
+  }
+
+  struct Guard {
+    RequestGate& gate;
+    Guard(RequestGate& gate, boost::asio::io_service& service,
+	  boost::asio::yield_context yield) : gate(gate) {
+      gate.enter(service, yield);
+    }
+    ~Guard() {
+      gate.leave();
+    }
+  };
+};
+
+struct Connection {
+  tcp::socket socket;
+  boost::beast::flat_buffer buffer;
+  explicit Connection(boost::asio::io_service& service) : socket(service) {}
+};
+
+int drop_privileges(CephContext *cct)
+{
+  if ((cct->get_init_flags() & CINIT_FLAG_DEFER_DROP_PRIVILEGES) == 0) {
+    return 0;
+  }
+  gid_t gid = cct->get_set_gid();
+  if (gid && ::setgid(gid) != 0) {
+    int err = errno;
+    lderr(cct) << "unable to setgid " << gid << ": " << cpp_strerror(err)
+	       << dendl;
+    return -err;
+  }
+  uid_t uid = cct->get_set_uid();
+  if (uid && ::setuid(uid) != 0) {
+    int err = errno;
+    lderr(cct) << "unable to setuid " << uid << ": " << cpp_strerror(err)
+	       << dendl;
+    return -err;
+  }
+  return 0;
+}
+
+} // anonymous namespace
+
+class RGWAsioFrontend::Impl {
+  RGWProcessEnv env;
+  RGWFrontendConfig* conf;
+  boost::asio::io_service service;
+  tcp::acceptor acceptor;
+  std::vector<std::thread> threads;
+  RequestGate gate;
+  std::atomic<bool> going_down{false};
+
+  CephContext* ctx() const { return g_ceph_context; }
+
+  void accept(boost::asio::yield_context yield);
+  void handle_connection(std::shared_ptr<Connection> conn,
+			 boost::asio::yield_context yield);
+
+public:
+  Impl(const RGWProcessEnv& env, RGWFrontendConfig* conf)
+    : env(env), conf(conf), acceptor(service) {}
+
+  int init();
+  int run();
+  void stop();
+  void join();
+  void pause();
+  void unpause(RGWRados* store);
+};
+
+int RGWAsioFrontend::Impl::init()
+{
+  int port;
+  conf->get_val("port", 80, &port);
+  tcp::endpoint endpoint(tcp::v4(), port);
+
+  boost::system::error_code ec;
+  acceptor.open(endpoint.protocol(), ec);
+  if (ec) {
+    lderr(ctx()) << "failed to open socket: " << ec.message() << dendl;
+    return -ec.value();
+  }
+  acceptor.set_option(tcp::acceptor::reuse_address(true));
+  acceptor.bind(endpoint, ec);
+  if (ec) {
+    lderr(ctx()) << "failed to bind address " << endpoint
+		 << ": " << ec.message() << dendl;
+    return -ec.value();
+  }
+  acceptor.listen(boost::asio::socket_base::max_connections, ec);
+  if (ec) {
+    lderr(ctx()) << "failed to listen on " << endpoint
+		 << ": " << ec.message() << dendl;
+    return -ec.value();
+  }
+  ldout(ctx(), 4) << "listening on " << endpoint << dendl;
+
+  // rgw_main deferred this so we could bind privileged ports
+  return drop_privileges(ctx());
+}
+
+void RGWAsioFrontend::Impl::accept(boost::asio::yield_context yield)
+{
+  for (;;) {
+    auto conn = std::make_shared<Connection>(service);
+    boost::system::error_code ec;
+    acceptor.async_accept(conn->socket, yield[ec]);
+    if (ec == boost::asio::error::operation_aborted || going_down) {
+      return;
+    }
+    if (ec) {
+      ldout(ctx(), 1) << "accept failed: " << ec.message() << dendl;
+      continue;
+    }
+    boost::asio::spawn(service,
+		       [this, conn] (boost::asio::yield_context yield) {
+			 handle_connection(conn, yield);
+		       },
+		       boost::coroutines::attributes(coroutine_stack_size));
+  }
+}
+
+void RGWAsioFrontend::Impl::handle_connection(std::shared_ptr<Connection> conn,
+					      boost::asio::yield_context yield)
+{
+  boost::system::error_code ec;
+  for (;;) {
+    rgw::asio::parser_type parser;
+    parser.body_limit(std::numeric_limits<uint64_t>::max());
+
+    // an idle keep-alive connection parks here without holding a thread
+    http::async_read_header(conn->socket, conn->buffer, parser, yield[ec]);
+    if (ec == http::error::end_of_stream ||
+	ec == boost::asio::error::eof ||
+	ec == boost::asio::error::connection_reset ||
+	ec == boost::asio::error::operation_aborted) {
+      break;
+    }
+    if (ec) {
+      ldout(ctx(), 1) << "failed to read header: " << ec.message() << dendl;
+      break;
+    }
+
+    bool keep_alive;
+    {
+      RequestGate::Guard guard(gate, service, yield);
+
+      RGWRequest req(env.store->get_new_req_id());
+      rgw::asio::ClientIO client(conn->socket, parser, conn->buffer, yield);
+      int ret = process_request(env.store, env.rest, &req, &client, env.olog);
+      if (ret < 0) {
+	/* we don't really care about return code */
+	ldout(ctx(), 20) << "process_request() returned " << ret << dendl;
+      }
+      keep_alive = parser.keep_alive() && client.can_keep_alive();
+    }
+
+    // don't bother draining a body the op didn't consume
+    if (!keep_alive || !parser.is_done()) {
+      break;
+    }
+  }
+  conn->socket.shutdown(tcp::socket::shutdown_both, ec);
+}
+
+int RGWAsioFrontend::Impl::run()
+{
+  int num_threads;
+  conf->get_val("num_threads", g_conf->rgw_thread_pool_size, &num_threads);
+  if (num_threads < 1) {
+    num_threads = 1;
+  }
+  ldout(ctx(), 4) << "starting " << num_threads << " threads" << dendl;
+
+  boost::asio::spawn(service,
+		     [this] (boost::asio::yield_context yield) {
+		       accept(yield);
+		     },
+		     boost::coroutines::attributes(coroutine_stack_size));
+
+  threads.reserve(num_threads);
+  for (int i = 0; i < num_threads; i++) {
+    threads.emplace_back([this] {
+	for (;;) {
+	  try {
+	    service.run();
+	    return;
+	  } catch (const std::exception& e) {
+	    lderr(ctx()) << "request failed: " << e.what() << dendl;
+	  }
+	}
+      });
+  }
+  return 0;
+}
+
+void RGWAsioFrontend::Impl::stop()
+{
+  ldout(ctx(), 4) << "frontend initiating shutdown..." << dendl;
+  going_down = true;
+
+  boost::system::error_code ec;
+  acceptor.close(ec);
+  service.stop();
+}
+
+void RGWAsioFrontend::Impl::join()
+{
+  if (!going_down) {
+    stop();
+  }
+  ldout(ctx(), 4) << "frontend joining threads..." << dendl;
+  for (auto& thread : threads) {
+    thread.join();
+  }
+  ldout(ctx(), 4) << "frontend done" << dendl;
+}
+
+void RGWAsioFrontend::Impl::pause()
+{
+  ldout(ctx(), 4) << "frontend pausing requests..." << dendl;
+  gate.pause();
+  ldout(ctx(), 4) << "frontend paused" << dendl;
+}
+
+void RGWAsioFrontend::Impl::unpause(RGWRados* store)
+{
+  env.store = store;
+  gate.unpause();
+  ldout(ctx(), 4) << "frontend unpaused" << dendl;
+}
+
+
+RGWAsioFrontend::RGWAsioFrontend(const RGWProcessEnv& env,
+				 RGWFrontendConfig* conf)
+  : impl(new Impl(env, conf))
+{
+}
+
+RGWAsioFrontend::~RGWAsioFrontend() = default;
+
+int RGWAsioFrontend::init()
+{
+  return impl->init();
+}
+
+int RGWAsioFrontend::run()
+{
+  return impl->run();
+}
+
+void RGWAsioFrontend::stop()
+{
+  impl->stop();
+}
+
+void RGWAsioFrontend::join()
+{
+  impl->join();
+}
+
+void RGWAsioFrontend::pause_for_new_config()
+{
+  impl->pause();
+}
+
+void RGWAsioFrontend::unpause_with_new_config(RGWRados *store)
+{
+  impl->unpause(store);
+}
@@ -0,0 +1,34 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+
+#ifndef RGW_ASIO_FRONTEND_H
+#define RGW_ASIO_FRONTEND_H
+
+#include <memory>
+#include "rgw_frontend.h"
+
+/**
+ * Frontend built on Boost.Asio and Beast.
+ *
+ * Every connection runs as a stackful coroutine on a fixed pool of
+ * worker threads ("num_threads", defaulting to rgw_thread_pool_size),
+ * so idle keep-alive connections cost a small stack instead of a
+ * thread.  Configured as e.g. "beast port=8000 num_threads=64".
+ */
+class RGWAsioFrontend : public RGWFrontend {
+  class Impl;
+  std::unique_ptr<Impl> impl;
+public:
+  RGWAsioFrontend(const RGWProcessEnv& env, RGWFrontendConfig* conf);
+  ~RGWAsioFrontend() override;
+
+  int init() override;
+  int run() override;
+  void stop() override;
+  void join() override;
+
+  void pause_for_new_config() override;
+  void unpause_with_new_config(RGWRados *store) override;
+};
+
+#endif // RGW_ASIO_FRONTEND_H
@@ -0,0 +1,150 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+
+#include "rgw_bucket_list.h"
+
+#include "common/debug.h"
+#include "common/errno.h"
+
+#define dout_subsys ceph_subsys_rgw
+
+using namespace std;
+
+RGWBucketListShardCursor::RGWBucketListShardCursor(CephContext *_cct,
+                                                   RGWBucketListShardReader *_reader,
+                                                   uint32_t _chunk, uint32_t _max_chunk)
+  : cct(_cct), reader(_reader), chunk(_chunk), max_chunk(_max_chunk),
+    iter(cur.dir.m.end()), left(0), more(false), pending(false)
+{
+}
+
+RGWBucketListShardCursor::~RGWBucketListShardCursor()
+{
+  /* the read goes into next */
+  if (pending) {
+    reader->aio_wait();
+  }
+}
+
+int RGWBucketListShardCursor::fetch()
+{
+  assert(!pending);
+  next = rgw_cls_list_ret();
+  int r = reader->aio_list(next_start, chunk, &next);
+  if (r < 0) {
+    return r;
+  }
+  pending = true;
+  ldout(cct, 20) << "cls_bucket_list: reading " << chunk << " entries of " << get_oid()
+                 << " after " << next_start.name << dendl;
+  chunk = std::min(chunk * 2, max_chunk);
+  return 0;
+}
+
+int RGWBucketListShardCursor::wait()
+{
+  assert(pending);
+  pending = false;
+  int r = reader->aio_wait();
+  if (r < 0) {
+    ldout(cct, 0) << "ERROR: failed to list " << get_oid() << ": " << cpp_strerror(-r) << dendl;
+    return r;
+  }
+  cur.dir.m.swap(next.dir.m);
+  iter = cur.dir.m.begin();
+  left = cur.dir.m.size();
+  more = next.is_truncated;
+  if (!cur.dir.m.empty()) {
+    next_start = cls_rgw_obj_key(cur.dir.m.rbegin()->first);
+  }
+  return 0;
+}
+
+int RGWBucketListShardCursor::start(const cls_rgw_obj_key& marker)
+{
+  next_start = marker;
+  return fetch();
+}
+
+int RGWBucketListShardCursor::advance(uint32_t wanted)
+{
+  ++iter;
+  --left;
+  if (more && !pending && left < wanted && left * 2 <= cur.dir.m.size()) {
+    int r = fetch();
+    if (r < 0) {
+      return r;
+    }
+  }
+  if (!valid() && more) {
+    if (!pending) {
+      if (!wanted) {
+        return 0;
+      }
+      int r = fetch();
+      if (r < 0) {
+        return r;
+      }
+    }
+    return wait();
+  }
+  return 0;
+}
+
+int RGWBucketListMerge::push(size_t pos, uint32_t wanted)
+{
+  RGWBucketListShardCursor *cursor = cursors[pos].get();
+  while (cursor->valid()) {
+    if (candidates.insert(make_pair(cursor->key(), pos)).second) {
+      return 0;
+    }
+    /* another shard has the same key up next; skip this copy */
+    int r = cursor->advance(wanted);
+    if (r < 0) {
+      return r;
+    }
+  }
+  return 0;
+}
+
+int RGWBucketListMerge::start(const cls_rgw_obj_key& marker, uint32_t wanted)
+{
+  for (auto& cursor : cursors) {
+    int r = cursor->start(marker);
+    if (r < 0) {
+      return r;
+    }
+  }
+  for (size_t i = 0; i < cursors.size(); ++i) {
+    int r = cursors[i]->init();
+    if (r < 0) {
+      return r;
+    }
+    r = push(i, wanted);
+    if (r < 0) {
+      return r;
+    }
+  }
+  return 0;
+}
+
+int RGWBucketListMerge::next(uint32_t wanted)
+{
+  size_t pos = candidates.begin()->second;
+  candidates.erase(candidates.begin());
+  int r = cursors[pos]->advance(wanted);
+  if (r < 0) {
+    return r;
+  }
+  return push(pos, wanted);
+}
+
+bool RGWBucketListMerge::truncated()
+{
+  for (auto& cursor : cursors) {
+    if (cursor->truncated()) {
+      return true;
+    }
+  }
+  return false;
+}
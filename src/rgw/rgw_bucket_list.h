@@ -0,0 +1,138 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+
+#ifndef CEPH_RGW_BUCKET_LIST_H
+#define CEPH_RGW_BUCKET_LIST_H
+
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "cls/rgw/cls_rgw_ops.h"
+
+class CephContext;
+
+/*
+ * Reads the listing of one bucket index shard.  RGWRados reads the
+ * shard object with cls_rgw_bucket_list_op(); the unit tests read from
+ * memory.
+ */
+class RGWBucketListShardReader {
+public:
+  virtual ~RGWBucketListShardReader() {}
+
+  virtual const std::string& get_oid() = 0;
+  /* start reading up to num entries after start into *result */
+  virtual int aio_list(const cls_rgw_obj_key& start, uint32_t num,
+                       rgw_cls_list_ret *result) = 0;
+  /* wait for the read started by aio_list() */
+  virtual int aio_wait() = 0;
+};
+
+/*
+ * Position in the listing of one bucket index shard, for the merge in
+ * cls_bucket_list().  Entries are read in chunks that start at about
+ * the shard's share of the listing and double whenever the shard turns
+ * out to hold more of it; the next chunk is requested once half of the
+ * current one is consumed, so that it is usually in hand by the time
+ * the merge gets to it.
+ */
+class RGWBucketListShardCursor {
+  CephContext *cct;
+  std::unique_ptr<RGWBucketListShardReader> reader;
+  uint32_t chunk;
+  uint32_t max_chunk;
+
+  rgw_cls_list_ret cur;
+  std::map<std::string, struct rgw_bucket_dir_entry>::iterator iter;
+  size_t left;               /* entries of cur not consumed yet */
+  bool more;                 /* the shard has entries after cur */
+  cls_rgw_obj_key next_start;
+
+  bool pending;              /* a read into next is in flight */
+  rgw_cls_list_ret next;
+
+  int fetch();
+  int wait();
+
+public:
+  /* takes ownership of _reader */
+  RGWBucketListShardCursor(CephContext *_cct, RGWBucketListShardReader *_reader,
+                           uint32_t _chunk, uint32_t _max_chunk);
+  ~RGWBucketListShardCursor();
+
+  /* request the first chunk */
+  int start(const cls_rgw_obj_key& marker);
+  /* wait for the first chunk */
+  int init() {
+    return wait();
+  }
+
+  bool valid() {
+    return iter != cur.dir.m.end();
+  }
+  const std::string& key() {
+    return iter->first;
+  }
+  struct rgw_bucket_dir_entry& entry() {
+    return iter->second;
+  }
+  const std::string& get_oid() {
+    return reader->get_oid();
+  }
+  /* whether the shard has entries beyond those consumed */
+  bool truncated() {
+    return valid() || more;
+  }
+
+  /*
+   * @param wanted number of entries the merge may still take, from any shard
+   */
+  int advance(uint32_t wanted);
+};
+
+/*
+ * k-way merge of the shard cursors of a bucket index, in key order.  A
+ * key that more than one shard holds, as happens with stale entries
+ * left behind by resharding, is returned once, from the shard that
+ * listed it first; the copies in the other shards are skipped.
+ */
+class RGWBucketListMerge {
+  std::vector<std::unique_ptr<RGWBucketListShardCursor> > cursors;
+  /* the next entry of each shard that still has some */
+  std::map<std::string, size_t> candidates;
+
+  int push(size_t pos, uint32_t wanted);
+
+public:
+  /* takes ownership of cursor */
+  void add(RGWBucketListShardCursor *cursor) {
+    cursors.emplace_back(cursor);
+  }
+
+  /*
+   * Request the first chunk of every shard after marker, then wait for
+   * all of them.
+   */
+  int start(const cls_rgw_obj_key& marker, uint32_t wanted);
+
+  bool valid() {
+    return !candidates.empty();
+  }
+  /* the shard holding the next entry */
+  RGWBucketListShardCursor *cursor() {
+    return cursors[candidates.begin()->second].get();
+  }
+  /*
+   * move past the next entry
+   *
+   * @param wanted number of entries the caller may still take
+   */
+  int next(uint32_t wanted);
+
+  /* whether any shard has entries beyond those consumed */
+  bool truncated();
+};
+
+#endif
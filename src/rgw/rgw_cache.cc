@@ -5,45 +5,97 @@
 
 #include <errno.h>
 
+#include "include/stringify.h"
+
 #define dout_subsys ceph_subsys_rgw
 
 using namespace std;
 
-int ObjectCache::get(string& name, ObjectCacheInfo& info, uint32_t mask, rgw_cache_entry_info *cache_info)
+static uint64_t entry_size(const string& name, const ObjectCacheInfo& info)
+{
+  uint64_t size = sizeof(ObjectCacheEntry) + 2 * name.size() + info.data.length();
+  for (auto& i : info.xattrs) {
+    size += i.first.size() + i.second.length();
+  }
+  return size;
+}
+
+static void count_lookup(RGWCacheType type, bool hit)
+{
+  if (!perfcounter)
+    return;
+  perfcounter->inc(hit ? l_rgw_cache_hit : l_rgw_cache_miss);
+  switch (type) {
+  case RGW_CACHE_TYPE_BUCKET:
+    perfcounter->inc(hit ? l_rgw_cache_bucket_hit : l_rgw_cache_bucket_miss);
+    break;
+  case RGW_CACHE_TYPE_USER:
+    perfcounter->inc(hit ? l_rgw_cache_user_hit : l_rgw_cache_user_miss);
+    break;
+  default:
+    break;
+  }
+}
+
+ObjectCache::~ObjectCache()
 {
-  RWLock::RLocker l(lock);
+  for (auto shard : shards) {
+    if (perfcounter)
+      perfcounter->dec(l_rgw_cache_bytes, shard->bytes);
+    delete shard;
+  }
+}
+
+void ObjectCache::set_ctx(CephContext *_cct)
+{
+  cct = _cct;
+  assert(shards.empty());
+  unsigned num_shards = std::max(cct->_conf->rgw_cache_shards, 1);
+  for (unsigned i = 0; i < num_shards; ++i) {
+    shards.push_back(new Shard("ObjectCache::shard." + stringify(i)));
+  }
+  max_entries = std::max(cct->_conf->rgw_cache_lru_size / (int)num_shards, 1);
+  max_bytes = cct->_conf->rgw_cache_max_bytes / num_shards;
+  lru_window = max_entries / 2;
+}
 
+int ObjectCache::get(string& name, ObjectCacheInfo& info, uint32_t mask, rgw_cache_entry_info *cache_info,
+                     RGWCacheType type)
+{
   if (!enabled) {
     return -ENOENT;
   }
 
-  map<string, ObjectCacheEntry>::iterator iter = cache_map.find(name);
-  if (iter == cache_map.end()) {
+  Shard *shard = shards[shard_of(name)];
+  RWLock::RLocker l(shard->lock);
+
+  cache_map_t::iterator iter = shard->cache_map.find(name);
+  if (iter == shard->cache_map.end()) {
     ldout(cct, 10) << "cache get: name=" << name << " : miss" << dendl;
-    if(perfcounter) perfcounter->inc(l_rgw_cache_miss);
+    count_lookup(type, false);
     return -ENOENT;
   }
 
   ObjectCacheEntry *entry = &iter->second;
 
-  if (lru_counter - entry->lru_promotion_ts > lru_window) {
-    ldout(cct, 20) << "cache get: touching lru, lru_counter=" << lru_counter
+  if (shard->lru_counter - entry->lru_promotion_ts > lru_window) {
+    ldout(cct, 20) << "cache get: touching lru, lru_counter=" << shard->lru_counter
                    << " promotion_ts=" << entry->lru_promotion_ts << dendl;
-    lock.unlock();
-    lock.get_write(); /* promote lock to writer */
+    shard->lock.unlock();
+    shard->lock.get_write(); /* promote lock to writer */
 
     /* need to redo this because entry might have dropped off the cache */
-    iter = cache_map.find(name);
-    if (iter == cache_map.end()) {
+    iter = shard->cache_map.find(name);
+    if (iter == shard->cache_map.end()) {
       ldout(cct, 10) << "lost race! cache get: name=" << name << " : miss" << dendl;
-      if(perfcounter) perfcounter->inc(l_rgw_cache_miss);
+      count_lookup(type, false);
       return -ENOENT;
     }
 
     entry = &iter->second;
     /* check again, we might have lost a race here */
-    if (lru_counter - entry->lru_promotion_ts > lru_window) {
-      touch_lru(name, *entry, iter->second.lru_iter);
+    if (shard->lru_counter - entry->lru_promotion_ts > lru_window) {
+      touch_lru(shard, name, *entry, iter->second.lru_iter);
     }
   }
 
@@ -52,7 +104,7 @@ int ObjectCache::get(string& name, ObjectCacheInfo& info, uint32_t mask, rgw_cac
     ldout(cct, 10) << "cache get: name=" << name << " : type miss (requested=0x"
                    << std::hex << mask << ", cached=0x" << src.flags
                    << std::dec << ")" << dendl;
-    if(perfcounter) perfcounter->inc(l_rgw_cache_miss);
+    count_lookup(type, false);
     return -ENOENT;
   }
   ldout(cct, 10) << "cache get: name=" << name << " : hit (requested=0x"
@@ -64,74 +116,91 @@ int ObjectCache::get(string& name, ObjectCacheInfo& info, uint32_t mask, rgw_cac
     cache_info->cache_locator = name;
     cache_info->gen = entry->gen;
   }
-  if(perfcounter) perfcounter->inc(l_rgw_cache_hit);
+  count_lookup(type, true);
 
   return 0;
 }
 
 bool ObjectCache::chain_cache_entry(list<rgw_cache_entry_info *>& cache_info_entries, RGWChainedCache::Entry *chained_entry)
 {
-  RWLock::WLocker l(lock);
-
   if (!enabled) {
     return false;
   }
 
+  /* lock every shard involved, in order */
+  set<unsigned> shard_ids;
+  for (auto cache_info : cache_info_entries) {
+    shard_ids.insert(shard_of(cache_info->cache_locator));
+  }
+  for (auto i : shard_ids) {
+    shards[i]->lock.get_write();
+  }
+
   list<rgw_cache_entry_info *>::iterator citer;
 
   list<ObjectCacheEntry *> cache_entry_list;
 
+  bool valid = true;
+
   /* first verify that all entries are still valid */
   for (citer = cache_info_entries.begin(); citer != cache_info_entries.end(); ++citer) {
     rgw_cache_entry_info *cache_info = *citer;
+    Shard *shard = shards[shard_of(cache_info->cache_locator)];
 
     ldout(cct, 10) << "chain_cache_entry: cache_locator=" << cache_info->cache_locator << dendl;
-    map<string, ObjectCacheEntry>::iterator iter = cache_map.find(cache_info->cache_locator);
-    if (iter == cache_map.end()) {
+    cache_map_t::iterator iter = shard->cache_map.find(cache_info->cache_locator);
+    if (iter == shard->cache_map.end()) {
       ldout(cct, 20) << "chain_cache_entry: couldn't find cachce locator" << dendl;
-      return false;
+      valid = false;
+      break;
     }
 
     ObjectCacheEntry *entry = &iter->second;
 
     if (entry->gen != cache_info->gen) {
       ldout(cct, 20) << "chain_cache_entry: entry.gen (" << entry->gen << ") != cache_info.gen (" << cache_info->gen << ")" << dendl;
-      return false;
+      valid = false;
+      break;
     }
 
     cache_entry_list.push_back(entry);
   }
 
+  if (valid) {
+    chained_entry->cache->chain_cb(chained_entry->key, chained_entry->data);
 
-  chained_entry->cache->chain_cb(chained_entry->key, chained_entry->data);
+    list<ObjectCacheEntry *>::iterator liter;
 
-  list<ObjectCacheEntry *>::iterator liter;
+    for (liter = cache_entry_list.begin(); liter != cache_entry_list.end(); ++liter) {
+      ObjectCacheEntry *entry = *liter;
 
-  for (liter = cache_entry_list.begin(); liter != cache_entry_list.end(); ++liter) {
-    ObjectCacheEntry *entry = *liter;
+      entry->chained_entries.push_back(make_pair(chained_entry->cache, chained_entry->key));
+    }
+  }
 
-    entry->chained_entries.push_back(make_pair(chained_entry->cache, chained_entry->key));
+  for (auto i = shard_ids.rbegin(); i != shard_ids.rend(); ++i) {
+    shards[*i]->lock.unlock();
   }
 
-  return true;
+  return valid;
 }
 
 void ObjectCache::put(string& name, ObjectCacheInfo& info, rgw_cache_entry_info *cache_info)
 {
-  RWLock::WLocker l(lock);
-
   if (!enabled) {
     return;
   }
 
+  Shard *shard = shards[shard_of(name)];
+  RWLock::WLocker l(shard->lock);
+
   ldout(cct, 10) << "cache put: name=" << name << " info.flags=0x"
                  << std::hex << info.flags << std::dec << dendl;
-  map<string, ObjectCacheEntry>::iterator iter = cache_map.find(name);
-  if (iter == cache_map.end()) {
+  cache_map_t::iterator iter = shard->cache_map.find(name);
+  if (iter == shard->cache_map.end()) {
     ObjectCacheEntry entry;
-    entry.lru_iter = lru.end();
-    cache_map.insert(pair<string, ObjectCacheEntry>(name, entry));
-    iter = cache_map.find(name);
+    entry.lru_iter = shard->lru.end();
+    iter = shard->cache_map.insert(make_pair(name, entry)).first;
   }
   ObjectCacheEntry& entry = iter->second;
   ObjectCacheInfo& target = entry.info;
@@ -145,14 +214,14 @@ void ObjectCache::put(string& name, ObjectCacheInfo& info, rgw_cache_entry_info
   entry.chained_entries.clear();
   entry.gen++;
 
-  touch_lru(name, entry, entry.lru_iter);
-
   target.status = info.status;
 
   if (info.status < 0) {
     target.flags = 0;
     target.xattrs.clear();
     target.data.clear();
+    account(shard, entry, entry_size(name, target));
+    touch_lru(shard, name, entry, entry.lru_iter);
     return;
   }
 
@@ -191,21 +260,54 @@ void ObjectCache::put(string& name, ObjectCacheInfo& info, rgw_cache_entry_info
 
   if (info.flags & CACHE_FLAG_OBJV)
     target.version = info.version;
+
+  account(shard, entry, entry_size(name, target));
+  touch_lru(shard, name, entry, entry.lru_iter);
 }
 
 void ObjectCache::remove(string& name)
 {
-  RWLock::WLocker l(lock);
-
   if (!enabled) {
     return;
   }
 
-  map<string, ObjectCacheEntry>::iterator iter = cache_map.find(name);
-  if (iter == cache_map.end())
+  Shard *shard = shards[shard_of(name)];
+  RWLock::WLocker l(shard->lock);
+
+  cache_map_t::iterator iter = shard->cache_map.find(name);
+  if (iter == shard->cache_map.end())
     return;
 
   ldout(cct, 10) << "removing " << name << " from cache" << dendl;
+  do_remove(shard, iter);
+}
+
+void ObjectCache::remove(const list<string>& names)
+{
+  if (!enabled) {
+    return;
+  }
+
+  map<unsigned, list<const string *> > by_shard;
+  for (auto& name : names) {
+    by_shard[shard_of(name)].push_back(&name);
+  }
+
+  for (auto& i : by_shard) {
+    Shard *shard = shards[i.first];
+    RWLock::WLocker l(shard->lock);
+    for (auto name : i.second) {
+      cache_map_t::iterator iter = shard->cache_map.find(*name);
+      if (iter == shard->cache_map.end())
+        continue;
+      ldout(cct, 10) << "removing " << *name << " from cache" << dendl;
+      do_remove(shard, iter);
+    }
+  }
+}
+
+void ObjectCache::do_remove(Shard *shard, cache_map_t::iterator iter)
+{
   ObjectCacheEntry& entry = iter->second;
 
   for (list<pair<RGWChainedCache *, string> >::iterator iiter = entry.chained_entries.begin();
@@ -214,60 +316,117 @@ void ObjectCache::remove(string& name)
     chained_cache->invalidate(iiter->second);
   }
 
-  remove_lru(name, iter->second.lru_iter);
-  cache_map.erase(iter);
+  account(shard, entry, 0);
+  remove_lru(shard, entry.lru_iter);
+  shard->cache_map.erase(iter);
+}
+
+void ObjectCache::account(Shard *shard, ObjectCacheEntry& entry, uint64_t size)
+{
+  shard->bytes -= entry.size;
+  shard->bytes += size;
+  if (perfcounter) {
+    if (size > entry.size)
+      perfcounter->inc(l_rgw_cache_bytes, size - entry.size);
+    else
+      perfcounter->dec(l_rgw_cache_bytes, entry.size - size);
+  }
+  entry.size = size;
 }
 
-void ObjectCache::touch_lru(string& name, ObjectCacheEntry& entry, std::list<string>::iterator& lru_iter)
+void ObjectCache::trim(Shard *shard, const string& name)
 {
-  while (lru_size > (size_t)cct->_conf->rgw_cache_lru_size) {
-    list<string>::iterator iter = lru.begin();
-    if ((*iter).compare(name) == 0) {
+  while (shard->lru_size > max_entries ||
+         (max_bytes && shard->bytes > max_bytes)) {
+    list<string>::iterator iter = shard->lru.begin();
+    if (iter == shard->lru.end() || (*iter).compare(name) == 0) {
       /*
        * if the entry we're touching happens to be at the lru end, don't remove it,
        * lru shrinking can wait for next time
        */
       break;
     }
-    map<string, ObjectCacheEntry>::iterator map_iter = cache_map.find(*iter);
+    cache_map_t::iterator map_iter = shard->cache_map.find(*iter);
     ldout(cct, 10) << "removing entry: name=" << *iter << " from cache LRU" << dendl;
-    if (map_iter != cache_map.end())
-      cache_map.erase(map_iter);
-    lru.pop_front();
-    lru_size--;
+    if (map_iter != shard->cache_map.end()) {
+      account(shard, map_iter->second, 0);
+      shard->cache_map.erase(map_iter);
+    }
+    shard->lru.pop_front();
+    shard->lru_size--;
+    if (perfcounter)
+      perfcounter->inc(l_rgw_cache_evict);
   }
+}
 
-  if (lru_iter == lru.end()) {
-    lru.push_back(name);
-    lru_size++;
+void ObjectCache::touch_lru(Shard *shard, const string& name, ObjectCacheEntry& entry, std::list<string>::iterator& lru_iter)
+{
+  trim(shard, name);
+
+  if (lru_iter == shard->lru.end()) {
+    shard->lru.push_back(name);
+    shard->lru_size++;
     lru_iter--;
     ldout(cct, 10) << "adding " << name << " to cache LRU end" << dendl;
   } else {
     ldout(cct, 10) << "moving " << name << " to cache LRU end" << dendl;
-    lru.erase(lru_iter);
-    lru.push_back(name);
-    lru_iter = lru.end();
-    --lru_iter;
+    shard->lru.splice(shard->lru.end(), shard->lru, lru_iter);
   }
 
-  lru_counter++;
-  entry.lru_promotion_ts = lru_counter;
+  shard->lru_counter++;
+  entry.lru_promotion_ts = shard->lru_counter;
 }
 
-void ObjectCache::remove_lru(string& name, std::list<string>::iterator& lru_iter)
+void ObjectCache::remove_lru(Shard *shard, std::list<string>::iterator& lru_iter)
 {
-  if (lru_iter == lru.end())
+  if (lru_iter == shard->lru.end())
     return;
 
-  lru.erase(lru_iter);
-  lru_size--;
-  lru_iter = lru.end();
+  shard->lru.erase(lru_iter);
+  shard->lru_size--;
+  lru_iter = shard->lru.end();
 }
 
-void ObjectCache::set_enabled(bool status)
+uint64_t ObjectCache::get_bytes()
 {
-  RWLock::WLocker l(lock);
+  uint64_t bytes = 0;
+  for (auto shard : shards) {
+    RWLock::RLocker l(shard->lock);
+    bytes += shard->bytes;
+  }
+  return bytes;
+}
 
+bool rgw_cache_notify_applied(bufferlist& reply)
+{
+  map<pair<uint64_t, uint64_t>, bufferlist> acks;
+  set<pair<uint64_t, uint64_t> > missed;
+  try {
+    bufferlist::iterator iter = reply.begin();
+    ::decode(acks, iter);
+    ::decode(missed, iter);
+  } catch (buffer::error& err) {
+    return false;
+  }
+  if (!missed.empty())
+    return false;
+  for (auto& ack : acks) {
+    /* older gateways ack with an empty payload */
+    int32_t r;
+    try {
+      bufferlist::iterator iter = ack.second.begin();
+      ::decode(r, iter);
+    } catch (buffer::error& err) {
+      return false;
+    }
+    if (r < 0)
+      return false;
+  }
+  return true;
+}
+
+void ObjectCache::set_enabled(bool status)
+{
   enabled = status;
 
   if (!enabled) {
@@ -277,27 +436,30 @@ void ObjectCache::set_enabled(bool status)
 
 void ObjectCache::invalidate_all()
 {
-  RWLock::WLocker l(lock);
-
   do_invalidate_all();
 }
 
 void ObjectCache::do_invalidate_all()
 {
-  cache_map.clear();
-  lru.clear();
-
-  lru_size = 0;
-  lru_counter = 0;
-  lru_window = 0;
+  for (auto shard : shards) {
+    RWLock::WLocker l(shard->lock);
+    shard->cache_map.clear();
+    shard->lru.clear();
+
+    if (perfcounter)
+      perfcounter->dec(l_rgw_cache_bytes, shard->bytes);
+    shard->bytes = 0;
+    shard->lru_size = 0;
+    shard->lru_counter = 0;
+  }
 
+  RWLock::RLocker l(chained_lock);
   for (list<RGWChainedCache *>::iterator iter = chained_cache.begin(); iter != chained_cache.end(); ++iter) {
     (*iter)->invalidate_all();
   }
 }
 
 void ObjectCache::chain_cache(RGWChainedCache *cache) {
-  RWLock::WLocker l(lock);
+  RWLock::WLocker l(chained_lock);
   chained_cache.push_back(cache);
 }
-
@@ -5,8 +5,11 @@
 #define CEPH_RGWCACHE_H
 
 #include "rgw_rados.h"
+#include "rgw_data_cache.h"
 #include <string>
 #include <map>
+#include <unordered_map>
+#include <atomic>
 #include "include/types.h"
 #include "include/utime.h"
 #include "include/assert.h"
@@ -15,6 +18,8 @@
 enum {
   UPDATE_OBJ,
   REMOVE_OBJ,
+  REMOVE_OBJS,
+  INVALIDATE_DATA,
 };
 
 #define CACHE_FLAG_DATA           0x01
@@ -98,25 +103,29 @@ struct RGWCacheNotifyInfo {
   ObjectCacheInfo obj_info;
   off_t ofs;
   string ns;
+  list<rgw_obj> objs; /* REMOVE_OBJS */
 
   RGWCacheNotifyInfo() : op(0), ofs(0) {}
 
   void encode(bufferlist& obl) const {
-    ENCODE_START(2, 2, obl);
+    ENCODE_START(3, 2, obl);
     ::encode(op, obl);
     ::encode(obj, obl);
     ::encode(obj_info, obl);
     ::encode(ofs, obl);
     ::encode(ns, obl);
+    ::encode(objs, obl);
     ENCODE_FINISH(obl);
   }
   void decode(bufferlist::iterator& ibl) {
-    DECODE_START_LEGACY_COMPAT_LEN(2, 2, 2, ibl);
+    DECODE_START_LEGACY_COMPAT_LEN(3, 2, 2, ibl);
     ::decode(op, ibl);
     ::decode(obj, ibl);
     ::decode(obj_info, ibl);
     ::decode(ofs, ibl);
     ::decode(ns, ibl);
+    if (struct_v >= 3)
+      ::decode(objs, ibl);
     DECODE_FINISH(ibl);
   }
   void dump(Formatter *f) const;
@@ -129,45 +138,87 @@ struct ObjectCacheEntry {
   std::list<string>::iterator lru_iter;
   uint64_t lru_promotion_ts;
   uint64_t gen;
+  uint64_t size; ///< bytes charged to the shard
   std::list<pair<RGWChainedCache *, string> > chained_entries;
 
-  ObjectCacheEntry() : lru_promotion_ts(0), gen(0) {}
+  ObjectCacheEntry() : lru_promotion_ts(0), gen(0), size(0) {}
 };
 
+/* what a cached system object is, for the per-type perf counters */
+enum RGWCacheType {
+  RGW_CACHE_TYPE_OTHER,
+  RGW_CACHE_TYPE_BUCKET,  /* bucket entrypoints and instances */
+  RGW_CACHE_TYPE_USER,    /* user info and its indexes */
+};
+
+/*
+ * The entries are spread by name hash over rgw_cache_shards shards,
+ * each with its own lock and LRU, and each bounded by its share of
+ * rgw_cache_lru_size entries and rgw_cache_max_bytes bytes.  Only
+ * chain_cache_entry() ever holds more than one shard lock, and it
+ * takes them in shard order.
+ */
 class ObjectCache {
-  std::map<string, ObjectCacheEntry> cache_map;
-  std::list<string> lru;
-  unsigned long lru_size;
-  unsigned long lru_counter;
-  unsigned long lru_window;
-  RWLock lock;
+  typedef std::unordered_map<string, ObjectCacheEntry> cache_map_t;
+
+  struct Shard {
+    cache_map_t cache_map;
+    std::list<string> lru;
+    unsigned long lru_size;
+    unsigned long lru_counter;
+    uint64_t bytes;
+    RWLock lock;
+
+    explicit Shard(const string& name)
+      : lru_size(0), lru_counter(0), bytes(0), lock(name) {}
+  };
+
+  vector<Shard *> shards;
+  unsigned long lru_window;  /* per shard */
+  unsigned long max_entries; /* per shard */
+  uint64_t max_bytes;        /* per shard, 0 for no limit */
   CephContext *cct;
 
+  RWLock chained_lock; /* protects chained_cache */
   list<RGWChainedCache *> chained_cache;
 
-  bool enabled;
+  std::atomic<bool> enabled;
 
-  void touch_lru(string& name, ObjectCacheEntry& entry, std::list<string>::iterator& lru_iter);
-  void remove_lru(string& name, std::list<string>::iterator& lru_iter);
+  unsigned shard_of(const string& name) const {
+    return std::hash<string>()(name) % shards.size();
+  }
+  void account(Shard *shard, ObjectCacheEntry& entry, uint64_t size);
+  void touch_lru(Shard *shard, const string& name, ObjectCacheEntry& entry, std::list<string>::iterator& lru_iter);
+  void remove_lru(Shard *shard, std::list<string>::iterator& lru_iter);
+  void trim(Shard *shard, const string& name);
+  void do_remove(Shard *shard, cache_map_t::iterator iter);
 
   void do_invalidate_all();
 public:
-  ObjectCache() : lru_size(0), lru_counter(0), lru_window(0), lock("ObjectCache"), cct(NULL), enabled(false) { }
-  int get(std::string& name, ObjectCacheInfo& bl, uint32_t mask, rgw_cache_entry_info *cache_info);
+  ObjectCache() : lru_window(0), max_entries(0), max_bytes(0), cct(NULL),
+                  chained_lock("ObjectCache::chained_lock"), enabled(false) { }
+  ~ObjectCache();
+  int get(std::string& name, ObjectCacheInfo& bl, uint32_t mask, rgw_cache_entry_info *cache_info,
+          RGWCacheType type = RGW_CACHE_TYPE_OTHER);
   void put(std::string& name, ObjectCacheInfo& bl, rgw_cache_entry_info *cache_info);
   void remove(std::string& name);
-  void set_ctx(CephContext *_cct) {
-    cct = _cct;
-    lru_window = cct->_conf->rgw_cache_lru_size / 2;
-  }
+  /* drop a batch of entries, taking each shard lock once */
+  void remove(const list<string>& names);
+  void set_ctx(CephContext *_cct);
   bool chain_cache_entry(list<rgw_cache_entry_info *>& cache_info_entries, RGWChainedCache::Entry *chained_entry);
 
   void set_enabled(bool status);
 
   void chain_cache(RGWChainedCache *cache);
   void invalidate_all();
+
+  /* bytes charged to all shards */
+  uint64_t get_bytes();
 };
 
+/* true if every gateway acked a cache notify reply as applied */
+bool rgw_cache_notify_applied(bufferlist& reply);
+
 template <class T>
 class RGWCache  : public T
 {
@@ -194,6 +245,18 @@ class RGWCache  : public T
     return normal_name(obj.bucket, obj.get_object());
   }
 
+  RGWCacheType cache_type(const rgw_bucket& bucket) {
+    RGWZoneParams& zone = T::get_zone_params();
+    if (bucket.name == zone.domain_root.name)
+      return RGW_CACHE_TYPE_BUCKET;
+    if (bucket.name == zone.user_uid_pool.name ||
+        bucket.name == zone.user_keys_pool.name ||
+        bucket.name == zone.user_email_pool.name ||
+        bucket.name == zone.user_swift_pool.name)
+      return RGW_CACHE_TYPE_USER;
+    return RGW_CACHE_TYPE_OTHER;
+  }
+
   int init_rados() {
     int ret;
     cache.set_ctx(T::cct);
@@ -245,6 +308,7 @@ public:
                    bufferlist *first_chunk, RGWObjVersionTracker *objv_tracker);
 
   int delete_system_obj(rgw_obj& obj, RGWObjVersionTracker *objv_tracker);
+  int delete_system_objs(list<rgw_obj>& objs);
 
   bool chain_cache_entry(list<rgw_cache_entry_info *>& cache_info_entries, RGWChainedCache::Entry *chained_entry) {
     return cache.chain_cache_entry(cache_info_entries, chained_entry);
@@ -279,6 +343,51 @@ int RGWCache<T>::delete_system_obj(rgw_obj& obj, RGWObjVersionTracker *objv_trac
   return T::delete_system_obj(obj, objv_tracker);
 }
 
+template <class T>
+int RGWCache<T>::delete_system_objs(list<rgw_obj>& objs)
+{
+  if (objs.empty())
+    return 0;
+
+  list<string> names;
+  for (auto& obj : objs) {
+    names.push_back(normal_name(obj));
+  }
+  cache.remove(names);
+
+  /* one notification invalidates the whole batch on the other gateways */
+  RGWCacheNotifyInfo info;
+  info.op = REMOVE_OBJS;
+  info.objs = objs;
+  bufferlist bl, reply;
+  ::encode(info, bl);
+  int r = T::distribute(names.front(), bl, &reply);
+  if (r < 0 || (reply.length() && !rgw_cache_notify_applied(reply))) {
+    /* a gateway that does not know REMOVE_OBJS (or did not answer) still
+     * needs one REMOVE_OBJ per object */
+    mydout(10) << "batched cache invalidation not applied everywhere (r=" << r
+               << "), notifying " << objs.size() << " objects one by one" << dendl;
+    info.objs.clear();
+    info.op = REMOVE_OBJ;
+    for (auto& obj : objs) {
+      info.obj = obj;
+      bl.clear();
+      ::encode(info, bl);
+      r = T::distribute(normal_name(obj), bl);
+      if (r < 0)
+        mydout(0) << "ERROR: failed to distribute cache for " << obj << dendl;
+    }
+  }
+
+  int ret = 0;
+  for (auto& obj : objs) {
+    r = T::delete_system_obj(obj, NULL);
+    if (r < 0 && r != -ENOENT && ret == 0)
+      ret = r;
+  }
+  return ret;
+}
+
 template <class T>
 int RGWCache<T>::get_system_obj(RGWObjectCtx& obj_ctx, RGWRados::SystemObject::Read::GetObjState& read_state,
                      RGWObjVersionTracker *objv_tracker, rgw_obj& obj,
@@ -302,7 +411,7 @@ int RGWCache<T>::get_system_obj(RGWObjectCtx& obj_ctx, RGWRados::SystemObject::R
   if (attrs)
     flags |= CACHE_FLAG_XATTRS;
   
-  if (cache.get(name, info, flags, cache_info) == 0) {
+  if (cache.get(name, info, flags, cache_info, cache_type(bucket)) == 0) {
     if (info.status < 0)
       return info.status;
 
@@ -473,7 +582,7 @@ int RGWCache<T>::raw_obj_stat(rgw_obj& obj, uint64_t *psize, real_time *pmtime,
   uint32_t flags = CACHE_FLAG_META | CACHE_FLAG_XATTRS;
   if (objv_tracker)
     flags |= CACHE_FLAG_OBJV;
-  int r = cache.get(name, info, flags, NULL);
+  int r = cache.get(name, info, flags, NULL, cache_type(bucket));
   if (r == 0) {
     if (info.status < 0)
       return info.status;
@@ -560,6 +669,19 @@ int RGWCache<T>::watch_cb(uint64_t notify_id,
   case REMOVE_OBJ:
     cache.remove(name);
     break;
+  case REMOVE_OBJS:
+    {
+      list<string> names;
+      for (auto& obj : info.objs) {
+        names.push_back(normal_name(obj));
+      }
+      cache.remove(names);
+    }
+    break;
+  case INVALIDATE_DATA:
+    if (T::data_cache)
+      T::data_cache->invalidate(T::data_cache_key(info.obj));
+    break;
   default:
     mydout(0) << "WARNING: got unknown notification op: " << info.op << dendl;
     return -EINVAL;
@@ -48,6 +48,18 @@ int rgw_perf_start(CephContext *cct)
 
   plb.add_u64_counter(l_rgw_cache_hit, "cache_hit", "Cache hits");
   plb.add_u64_counter(l_rgw_cache_miss, "cache_miss", "Cache miss");
+  plb.add_u64_counter(l_rgw_cache_bucket_hit, "cache_bucket_hit", "Cache hits on bucket info");
+  plb.add_u64_counter(l_rgw_cache_bucket_miss, "cache_bucket_miss", "Cache miss on bucket info");
+  plb.add_u64_counter(l_rgw_cache_user_hit, "cache_user_hit", "Cache hits on user info");
+  plb.add_u64_counter(l_rgw_cache_user_miss, "cache_user_miss", "Cache miss on user info");
+  plb.add_u64_counter(l_rgw_cache_evict, "cache_evict", "Cache evictions");
+  plb.add_u64(l_rgw_cache_bytes, "cache_bytes", "Size of cached entries");
+
+  plb.add_u64_counter(l_rgw_datacache_hit, "datacache_hit", "Data cache hits");
+  plb.add_u64_counter(l_rgw_datacache_hit_b, "datacache_hit_b", "Bytes served from the data cache");
+  plb.add_u64_counter(l_rgw_datacache_miss, "datacache_miss", "Data cache miss");
+  plb.add_u64_counter(l_rgw_datacache_evict, "datacache_evict", "Data cache evictions");
+  plb.add_u64(l_rgw_datacache_size, "datacache_size", "Size of the data cache");
 
   plb.add_u64_counter(l_rgw_keystone_token_cache_hit, "keystone_token_cache_hit", "Keystone token cache hits");
   plb.add_u64_counter(l_rgw_keystone_token_cache_miss, "keystone_token_cache_miss", "Keystone token cache miss");
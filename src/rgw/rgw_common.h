@@ -230,6 +230,18 @@ enum {
 
   l_rgw_cache_hit,
   l_rgw_cache_miss,
+  l_rgw_cache_bucket_hit,
+  l_rgw_cache_bucket_miss,
+  l_rgw_cache_user_hit,
+  l_rgw_cache_user_miss,
+  l_rgw_cache_evict,
+  l_rgw_cache_bytes,
+
+  l_rgw_datacache_hit,
+  l_rgw_datacache_hit_b,
+  l_rgw_datacache_miss,
+  l_rgw_datacache_evict,
+  l_rgw_datacache_size,
 
   l_rgw_keystone_token_cache_hit,
   l_rgw_keystone_token_cache_miss,
@@ -908,6 +920,12 @@ enum RGWBucketIndexType {
   RGWBIType_Indexless = 1,
 };
 
+enum RGWBucketReshardStatus {
+  RGW_RESHARD_NONE = 0,
+  RGW_RESHARD_IN_PROGRESS = 1, /* new index being filled */
+  RGW_RESHARD_DONE = 2,        /* entrypoint points at the new instance */
+};
+
 struct RGWBucketInfo
 {
   enum BIShardsHashType {
@@ -947,9 +965,13 @@ struct RGWBucketInfo
   bool swift_versioning;
   string swift_ver_location;
 
+  // Online resharding: while not RGW_RESHARD_NONE, index updates also go
+  // to the index of bucket instance new_bucket_instance_id.
+  RGWBucketReshardStatus reshard_status;
+  string new_bucket_instance_id;
 
   void encode(bufferlist& bl) const {
-     ENCODE_START(17, 4, bl);
+     ENCODE_START(18, 4, bl);
      ::encode(bucket, bl);
      ::encode(owner.id, bl);
      ::encode(flags, bl);
@@ -973,10 +995,12 @@ struct RGWBucketInfo
        ::encode(swift_ver_location, bl);
      }
      ::encode(creation_time, bl);
+     ::encode((uint8_t)reshard_status, bl);
+     ::encode(new_bucket_instance_id, bl);
      ENCODE_FINISH(bl);
   }
   void decode(bufferlist::iterator& bl) {
-    DECODE_START_LEGACY_COMPAT_LEN_32(17, 4, 4, bl);
+    DECODE_START_LEGACY_COMPAT_LEN_32(18, 4, 4, bl);
      ::decode(bucket, bl);
      if (struct_v >= 2) {
        string s;
@@ -1033,6 +1057,15 @@ struct RGWBucketInfo
      if (struct_v >= 17) {
        ::decode(creation_time, bl);
      }
+     if (struct_v >= 18) {
+       uint8_t rs;
+       ::decode(rs, bl);
+       reshard_status = (RGWBucketReshardStatus)rs;
+       ::decode(new_bucket_instance_id, bl);
+     } else {
+       reshard_status = RGW_RESHARD_NONE;
+       new_bucket_instance_id.clear();
+     }
      DECODE_FINISH(bl);
   }
   void dump(Formatter *f) const;
@@ -1049,8 +1082,10 @@ struct RGWBucketInfo
     return swift_versioning && !versioned();
   }
 
+  bool resharding() const { return reshard_status != RGW_RESHARD_NONE; }
+
   RGWBucketInfo() : flags(0), has_instance_obj(false), num_shards(0), bucket_index_shard_hash_type(MOD), requester_pays(false),
-                    has_website(false), swift_versioning(false) {}
+                    has_website(false), swift_versioning(false), reshard_status(RGW_RESHARD_NONE) {}
 };
 WRITE_CLASS_ENCODER(RGWBucketInfo)
 
@@ -0,0 +1,308 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+
+#include <errno.h>
+#include <dirent.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <unistd.h>
+
+#include "rgw_data_cache.h"
+#include "rgw_common.h"
+
+#include "common/errno.h"
+#include "include/stringify.h"
+
+#define dout_subsys ceph_subsys_rgw
+
+using namespace std;
+
+const char *RGWDataCache::CHUNK_PREFIX = "rgw_datacache.";
+
+RGWDataCache::~RGWDataCache()
+{
+  shutdown();
+
+  list<string> paths;
+  while (!objs.empty()) {
+    remove_obj(objs.begin(), &paths);
+  }
+  unlink_all(paths);
+}
+
+int RGWDataCache::init()
+{
+  int r = ::mkdir(dir.c_str(), 0755);
+  if (r < 0 && errno != EEXIST) {
+    r = -errno;
+    lderr(cct) << "ERROR: failed to create data cache dir " << dir << ": " << cpp_strerror(r) << dendl;
+    return r;
+  }
+
+  DIR *d = ::opendir(dir.c_str());
+  if (!d) {
+    r = -errno;
+    lderr(cct) << "ERROR: failed to open data cache dir " << dir << ": " << cpp_strerror(r) << dendl;
+    return r;
+  }
+  list<string> stale;
+  size_t prefix_len = strlen(CHUNK_PREFIX);
+  struct dirent *de;
+  while ((de = ::readdir(d)) != NULL) {
+    if (strncmp(de->d_name, CHUNK_PREFIX, prefix_len) != 0)
+      continue;
+    stale.push_back(dir + "/" + de->d_name);
+  }
+  ::closedir(d);
+  ldout(cct, 5) << "data cache " << dir << ": removing " << stale.size() << " stale chunks" << dendl;
+  unlink_all(stale);
+
+  writer.create("rgw_datacache");
+  return 0;
+}
+
+void RGWDataCache::shutdown()
+{
+  {
+    Mutex::Locker l(lock);
+    stopping = true;
+    pending.clear();
+    pending_bytes = 0;
+    cond.Signal();
+  }
+  if (writer.is_started())
+    writer.join();
+}
+
+void *RGWDataCache::Writer::entry()
+{
+  return cache->writer_entry();
+}
+
+void *RGWDataCache::writer_entry()
+{
+  lock.Lock();
+  while (!stopping) {
+    if (pending.empty()) {
+      cond.Wait(lock);
+      continue;
+    }
+    PendingPut p;
+    std::swap(p, pending.front());
+    pending.pop_front();
+    pending_bytes -= p.bl.length();
+    writing = true;
+    lock.Unlock();
+
+    put(p.obj, p.tag, p.ofs, p.bl);
+
+    lock.Lock();
+    writing = false;
+    cond.Signal();
+  }
+  lock.Unlock();
+  return NULL;
+}
+
+void RGWDataCache::queue_put(const string& obj, const string& tag, off_t ofs, bufferlist& bl)
+{
+  uint64_t len = bl.length();
+  if (!len || len > max_bytes)
+    return;
+
+  Mutex::Locker l(lock);
+  if (stopping)
+    return;
+  if (pending_bytes + len > max_pending_bytes) {
+    ldout(cct, 20) << "data cache: writer is behind, not caching " << obj << " ofs=" << ofs << dendl;
+    return;
+  }
+  pending.push_back(PendingPut());
+  PendingPut& p = pending.back();
+  p.obj = obj;
+  p.tag = tag;
+  p.ofs = ofs;
+  p.bl = bl;
+  pending_bytes += len;
+  cond.Signal();
+}
+
+void RGWDataCache::flush()
+{
+  Mutex::Locker l(lock);
+  while ((!pending.empty() || writing) && !stopping) {
+    cond.Wait(lock);
+  }
+}
+
+bool RGWDataCache::get(const string& obj, const string& tag, off_t ofs, uint64_t len,
+                       bufferlist *bl)
+{
+  string path;
+  list<string> paths;
+  {
+    Mutex::Locker l(lock);
+    map<string, ObjEntry>::iterator iter = objs.find(obj);
+    if (iter != objs.end() && iter->second.tag != tag) {
+      ldout(cct, 10) << "data cache: " << obj << " changed, dropping it" << dendl;
+      remove_obj(iter, &paths);
+      iter = objs.end();
+    }
+    if (iter != objs.end()) {
+      map<off_t, Chunk *>::iterator citer = iter->second.chunks.find(ofs);
+      if (citer != iter->second.chunks.end() && citer->second->len == len) {
+        Chunk *chunk = citer->second;
+        lru.splice(lru.begin(), lru, chunk->lru_iter);
+        path = chunk->path;
+      }
+    }
+  }
+  unlink_all(paths);
+
+  if (!path.empty()) {
+    /* the chunk may be evicted under us; an open file survives that */
+    bufferlist data;
+    string err;
+    int r = data.read_file(path.c_str(), &err);
+    if (r >= 0 && data.length() == len) {
+      ldout(cct, 20) << "data cache: hit " << obj << " ofs=" << ofs << " len=" << len << dendl;
+      bl->claim_append(data);
+      if (perfcounter) {
+        perfcounter->inc(l_rgw_datacache_hit);
+        perfcounter->inc(l_rgw_datacache_hit_b, len);
+      }
+      return true;
+    }
+    ldout(cct, 10) << "data cache: failed to read " << path << ": " << err << dendl;
+  }
+
+  ldout(cct, 20) << "data cache: miss " << obj << " ofs=" << ofs << " len=" << len << dendl;
+  if (perfcounter)
+    perfcounter->inc(l_rgw_datacache_miss);
+  return false;
+}
+
+void RGWDataCache::put(const string& obj, const string& tag, off_t ofs, bufferlist& bl)
+{
+  uint64_t len = bl.length();
+  if (!len || len > max_bytes)
+    return;
+
+  string path;
+  list<string> paths;
+  {
+    Mutex::Locker l(lock);
+    map<string, ObjEntry>::iterator iter = objs.find(obj);
+    if (iter != objs.end()) {
+      if (iter->second.tag != tag) {
+        remove_obj(iter, &paths);
+      } else if (iter->second.chunks.count(ofs)) {
+        return;
+      }
+    }
+    path = dir + "/" + CHUNK_PREFIX + stringify(seq++);
+  }
+  unlink_all(paths);
+
+  /* write outside the lock; the chunk is indexed only once it is complete */
+  int r = bl.write_file(path.c_str(), 0600);
+  if (r < 0) {
+    ldout(cct, 0) << "ERROR: data cache: failed to write " << path << ": " << cpp_strerror(r) << dendl;
+    ::unlink(path.c_str());
+    return;
+  }
+
+  {
+    Mutex::Locker l(lock);
+    ObjEntry& entry = objs[obj];
+    if (entry.chunks.empty()) {
+      entry.tag = tag;
+    }
+    if (entry.tag != tag || entry.chunks.count(ofs)) {
+      /* raced with another put of this chunk or of a newer version */
+      paths.push_back(path);
+    } else {
+      Chunk *chunk = new Chunk;
+      chunk->obj = obj;
+      chunk->ofs = ofs;
+      chunk->len = len;
+      chunk->path = path;
+      lru.push_front(chunk);
+      chunk->lru_iter = lru.begin();
+      entry.chunks[ofs] = chunk;
+      bytes += len;
+      if (perfcounter)
+        perfcounter->inc(l_rgw_datacache_size, len);
+      ldout(cct, 20) << "data cache: added " << obj << " ofs=" << ofs << " len=" << len << dendl;
+      trim(&paths);
+    }
+  }
+  unlink_all(paths);
+}
+
+void RGWDataCache::invalidate(const string& obj)
+{
+  list<string> paths;
+  {
+    Mutex::Locker l(lock);
+    for (list<PendingPut>::iterator p = pending.begin(); p != pending.end(); ) {
+      if (p->obj == obj) {
+        pending_bytes -= p->bl.length();
+        pending.erase(p++);
+      } else {
+        ++p;
+      }
+    }
+    map<string, ObjEntry>::iterator iter = objs.find(obj);
+    if (iter == objs.end())
+      return;
+    ldout(cct, 10) << "data cache: invalidating " << obj << dendl;
+    remove_obj(iter, &paths);
+  }
+  unlink_all(paths);
+}
+
+void RGWDataCache::remove_chunk(Chunk *chunk, list<string> *paths)
+{
+  lru.erase(chunk->lru_iter);
+  bytes -= chunk->len;
+  if (perfcounter)
+    perfcounter->dec(l_rgw_datacache_size, chunk->len);
+  paths->push_back(chunk->path);
+  delete chunk;
+}
+
+void RGWDataCache::remove_obj(map<string, ObjEntry>::iterator iter, list<string> *paths)
+{
+  for (auto& i : iter->second.chunks) {
+    remove_chunk(i.second, paths);
+  }
+  objs.erase(iter);
+}
+
+void RGWDataCache::trim(list<string> *paths)
+{
+  while (bytes > max_bytes) {
+    assert(!lru.empty());
+    Chunk *chunk = lru.back();
+    map<string, ObjEntry>::iterator iter = objs.find(chunk->obj);
+    assert(iter != objs.end());
+    ldout(cct, 20) << "data cache: evicting " << chunk->obj << " ofs=" << chunk->ofs << dendl;
+    iter->second.chunks.erase(chunk->ofs);
+    if (iter->second.chunks.empty())
+      objs.erase(iter);
+    remove_chunk(chunk, paths);
+    if (perfcounter)
+      perfcounter->inc(l_rgw_datacache_evict);
+  }
+}
+
+void RGWDataCache::unlink_all(const list<string>& paths)
+{
+  for (auto& path : paths) {
+    if (::unlink(path.c_str()) < 0 && errno != ENOENT) {
+      ldout(cct, 0) << "ERROR: data cache: failed to remove " << path << ": " << cpp_strerror(-errno) << dendl;
+    }
+  }
+}
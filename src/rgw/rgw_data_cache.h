@@ -0,0 +1,118 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+
+#ifndef CEPH_RGW_DATA_CACHE_H
+#define CEPH_RGW_DATA_CACHE_H
+
+#include <string>
+#include <map>
+#include <list>
+
+#include "include/types.h"
+#include "common/Cond.h"
+#include "common/Mutex.h"
+#include "common/Thread.h"
+
+/*
+ * Local cache of object data, in files under rgw_datacache_path.
+ *
+ * The chunks that get_obj reads from rados are kept per head object
+ * under the object's ETag and mtime; a lookup with a different tag
+ * drops everything cached for that object.  Chunks are evicted least
+ * recently used first once they take more than rgw_datacache_size
+ * bytes.  The index lives in memory only, so the chunk files a
+ * previous run left behind (and only those, see CHUNK_PREFIX) are
+ * removed when the gateway starts.
+ *
+ * Chunks are written to disk by a writer thread; queue_put() only
+ * queues them, and drops them once rgw_datacache_max_pending_bytes are
+ * already waiting.
+ */
+class RGWDataCache {
+  struct Chunk {
+    std::string obj;
+    off_t ofs;
+    uint64_t len;
+    std::string path;
+    std::list<Chunk *>::iterator lru_iter;
+  };
+
+  struct ObjEntry {
+    std::string tag;
+    std::map<off_t, Chunk *> chunks;
+  };
+
+  struct PendingPut {
+    std::string obj;
+    std::string tag;
+    off_t ofs;
+    bufferlist bl;
+  };
+
+  class Writer : public Thread {
+    RGWDataCache *cache;
+  public:
+    explicit Writer(RGWDataCache *_cache) : cache(_cache) {}
+    void *entry();
+  };
+
+  CephContext *cct;
+  std::string dir;
+  uint64_t max_bytes;
+  uint64_t max_pending_bytes;
+
+  Mutex lock;
+  Cond cond;
+  std::map<std::string, ObjEntry> objs;
+  std::list<Chunk *> lru; /* most recently used first */
+  uint64_t bytes;
+  uint64_t seq;
+  std::list<PendingPut> pending; /* waiting for the writer */
+  uint64_t pending_bytes;
+  bool writing;
+  bool stopping;
+  Writer writer;
+
+  void remove_chunk(Chunk *chunk, std::list<std::string> *paths);
+  void remove_obj(std::map<std::string, ObjEntry>::iterator iter, std::list<std::string> *paths);
+  void trim(std::list<std::string> *paths);
+  void unlink_all(const std::list<std::string>& paths);
+  void *writer_entry();
+
+public:
+  /* chunk files are named CHUNK_PREFIX<seq>; nothing else in dir is touched */
+  static const char *CHUNK_PREFIX;
+
+  RGWDataCache(CephContext *_cct, const std::string& _dir, uint64_t _max_bytes,
+               uint64_t _max_pending_bytes)
+    : cct(_cct), dir(_dir), max_bytes(_max_bytes),
+      max_pending_bytes(_max_pending_bytes), lock("RGWDataCache"),
+      bytes(0), seq(0), pending_bytes(0), writing(false), stopping(false),
+      writer(this) {}
+  ~RGWDataCache();
+
+  /*
+   * create the cache directory, remove the chunks a previous run left
+   * in it and start the writer
+   */
+  int init();
+  /* drop the queued chunks and stop the writer */
+  void shutdown();
+
+  /*
+   * read chunk ofs~len of obj, as long as it was cached under tag
+   *
+   * @return true on a hit
+   */
+  bool get(const std::string& obj, const std::string& tag, off_t ofs, uint64_t len,
+           bufferlist *bl);
+  /* write chunk ofs of obj now */
+  void put(const std::string& obj, const std::string& tag, off_t ofs, bufferlist& bl);
+  /* have the writer put the chunk, unless too much is queued already */
+  void queue_put(const std::string& obj, const std::string& tag, off_t ofs, bufferlist& bl);
+  /* wait for the writer to put everything queued so far */
+  void flush();
+  void invalidate(const std::string& obj);
+};
+
+#endif
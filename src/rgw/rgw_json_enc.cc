@@ -213,6 +213,7 @@ void RGWCacheNotifyInfo::dump(Formatter *f) const
   encode_json("obj_info", obj_info, f);
   encode_json("ofs", ofs, f);
   encode_json("ns", ns, f);
+  encode_json("objs", objs, f);
 }
 
 void RGWAccessKey::dump(Formatter *f) const
@@ -694,6 +695,8 @@ void RGWBucketInfo::dump(Formatter *f) const
   }
   encode_json("swift_versioning", swift_versioning, f);
   encode_json("swift_ver_location", swift_ver_location, f);
+  encode_json("reshard_status", (int)reshard_status, f);
+  encode_json("new_bucket_instance_id", new_bucket_instance_id, f);
 }
 
 void RGWBucketInfo::decode_json(JSONObj *obj) {
@@ -722,6 +725,10 @@ void RGWBucketInfo::decode_json(JSONObj *obj) {
   }
   JSONDecoder::decode_json("swift_versioning", swift_versioning, obj);
   JSONDecoder::decode_json("swift_ver_location", swift_ver_location, obj);
+  int rs = RGW_RESHARD_NONE;
+  JSONDecoder::decode_json("reshard_status", rs, obj);
+  reshard_status = (RGWBucketReshardStatus)rs;
+  JSONDecoder::decode_json("new_bucket_instance_id", new_bucket_instance_id, obj);
 }
 
 void rgw_obj_key::dump(Formatter *f) const
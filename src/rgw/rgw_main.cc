@@ -53,6 +53,9 @@
 #include "rgw_request.h"
 #include "rgw_process.h"
 #include "rgw_frontend.h"
+#ifdef WITH_RADOSGW_BEAST_FRONTEND
+#include "rgw_asio_frontend.h"
+#endif /* WITH_RADOSGW_BEAST_FRONTEND */
 
 #include <map>
 #include <string>
@@ -227,9 +230,10 @@ int main(int argc, const char **argv)
   for (list<string>::iterator iter = frontends.begin(); iter != frontends.end(); ++iter) {
     string& f = *iter;
 
-    if (f.find("civetweb") != string::npos) {
-      // If civetweb is configured as a frontend, prevent global_init() from
-      // dropping permissions by setting the appropriate flag.
+    if (f.find("civetweb") != string::npos || f.find("beast") != string::npos) {
+      // If civetweb or beast is configured as a frontend, prevent
+      // global_init() from dropping permissions by setting the appropriate
+      // flag; they drop them once their port is bound.
       flags |= CINIT_FLAG_DEFER_DROP_PRIVILEGES;
       if (f.find("port") != string::npos) {
         // check for the most common ws problems
@@ -441,6 +445,15 @@ int main(int argc, const char **argv)
       RGWProcessEnv env = { store, &rest, olog, port };
 
       fe = new RGWMongooseFrontend(env, config);
+#ifdef WITH_RADOSGW_BEAST_FRONTEND
+    } else if (framework == "beast") {
+      int port;
+      config->get_val("port", 80, &port);
+
+      RGWProcessEnv env = { store, &rest, olog, port };
+
+      fe = new RGWAsioFrontend(env, config);
+#endif /* WITH_RADOSGW_BEAST_FRONTEND */
     } else if (framework == "loadgen") {
       int port;
       config->get_val("port", 80, &port);
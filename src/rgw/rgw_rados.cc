@@ -19,7 +19,9 @@
 #include "common/Finisher.h"
 
 #include "rgw_rados.h"
+#include "rgw_bucket_list.h"
 #include "rgw_cache.h"
+#include "rgw_data_cache.h"
 #include "rgw_acl.h"
 #include "rgw_acl_s3.h" /* for dumping s3policy in debug log */
 #include "rgw_lc.h"
@@ -64,6 +66,7 @@ using namespace librados;
 
 #include "rgw_gc.h"
 #include "rgw_lc.h"
+#include "rgw_reshard.h"
 
 #include "rgw_object_expirer_core.h"
 #include "rgw_sync.h"
@@ -2645,9 +2648,12 @@ public:
 			    << " cookie " << cookie
 			    << " notifier " << notifier_id
 			    << " bl.length()=" << bl.length() << dendl;
-    rados->watch_cb(notify_id, cookie, notifier_id, bl);
+    int32_t r = rados->watch_cb(notify_id, cookie, notifier_id, bl);
 
-    bufferlist reply_bl; // empty reply payload
+    // tell the notifier whether we applied it; older gateways ack with
+    // an empty payload
+    bufferlist reply_bl;
+    ::encode(r, reply_bl);
     rados->control_pool_ctx.notify_ack(oid, notify_id, cookie, reply_bl);
   }
   void handle_error(uint64_t cookie, int err) {
@@ -3269,6 +3275,9 @@ void RGWRados::finalize()
   delete obj_expirer;
   obj_expirer = NULL;
 
+  delete reshard;
+  reshard = nullptr;
+
   delete rest_master_conn;
 
   map<string, RGWRESTConn *>::iterator iter;
@@ -3288,6 +3297,8 @@ void RGWRados::finalize()
   delete meta_mgr;
   delete binfo_cache;
   delete obj_tombstone_cache;
+  delete data_cache;
+  data_cache = nullptr;
   delete sync_modules_manager;
 }
 
@@ -3946,6 +3957,11 @@ int RGWRados::init_complete()
     obj_expirer->start_processor();
   }
 
+  if (use_gc_thread && cct->_conf->rgw_dynamic_resharding) {
+    reshard = new RGWReshard(this);
+    reshard->start_processor();
+  }
+
   if (run_sync_thread) {
     // initialize the log period history. we want to do this any time we're not
     // running under radosgw-admin, so we check run_sync_thread here before
@@ -4037,6 +4053,19 @@ int RGWRados::init_complete()
     obj_tombstone_cache = new tombstone_cache_t(cct->_conf->rgw_obj_tombstone_cache_size);
   }
 
+  if (cct->_conf->rgw_datacache_enabled) {
+    data_cache = new RGWDataCache(cct, cct->_conf->rgw_datacache_path,
+                                  cct->_conf->rgw_datacache_size,
+                                  cct->_conf->rgw_datacache_max_pending_bytes);
+    ret = data_cache->init();
+    if (ret < 0) {
+      lderr(cct) << "ERROR: failed to initialize data cache, running without it" << dendl;
+      delete data_cache;
+      data_cache = nullptr;
+      ret = 0;
+    }
+  }
+
   return ret;
 }
 
@@ -5078,6 +5107,11 @@ int RGWRados::Bucket::List::list_objects(int max, vector<RGWObjEnt> *result,
   rgw_bucket& bucket = target->get_bucket();
   int shard_id = target->get_shard_id();
 
+  if (params.allow_unordered && !params.delim.empty()) {
+    ldout(cct, 5) << "ERROR: unordered bucket listing does not support a delimiter" << dendl;
+    return -EINVAL;
+  }
+
   int count = 0;
   bool truncated = true;
   int read_ahead = std::max(cct->_conf->rgw_list_bucket_min_readahead,max);
@@ -5133,16 +5167,28 @@ int RGWRados::Bucket::List::list_objects(int max, vector<RGWObjEnt> *result,
       cur_marker.set(skip_after_delim);
       ldout(cct, 20) << "setting cur_marker=" << cur_marker.name << "[" << cur_marker.instance << "]" << dendl;
     }
-    std::map<string, RGWObjEnt> ent_map;
-    int r = store->cls_bucket_list(bucket, shard_id, cur_marker, cur_prefix, read_ahead + 1 - count, params.list_versions, ent_map,
-                            &truncated, &cur_marker);
+    vector<RGWObjEnt> ent_list;
+    int r;
+    if (params.allow_unordered) {
+      r = store->cls_bucket_list_unordered(target->get_bucket_info(), shard_id, cur_marker, cur_prefix,
+                                           read_ahead + 1 - count, params.list_versions, ent_list,
+                                           &truncated, &cur_marker);
+    } else {
+      std::map<string, RGWObjEnt> ent_map;
+      r = store->cls_bucket_list(bucket, shard_id, cur_marker, cur_prefix, read_ahead + 1 - count, params.list_versions, ent_map,
+                                 &truncated, &cur_marker);
+      ent_list.reserve(ent_map.size());
+      for (auto& iter : ent_map) {
+        ent_list.push_back(iter.second);
+      }
+    }
     if (r < 0)
       return r;
 
-    std::map<string, RGWObjEnt>::iterator eiter;
-    for (eiter = ent_map.begin(); eiter != ent_map.end(); ++eiter) {
-      rgw_obj_key obj = eiter->second.key;
-      RGWObjEnt& entry = eiter->second;
+    vector<RGWObjEnt>::iterator eiter;
+    for (eiter = ent_list.begin(); eiter != ent_list.end(); ++eiter) {
+      rgw_obj_key obj = eiter->key;
+      RGWObjEnt& entry = *eiter;
       rgw_obj_key key = obj;
       string instance;
       string ns;
@@ -5158,7 +5204,7 @@ int RGWRados::Bucket::List::list_objects(int max, vector<RGWObjEnt> *result,
       }
 
       if (params.enforce_ns && !check_ns) {
-        if (!params.ns.empty()) {
+        if (!params.ns.empty() && !params.allow_unordered) {
           /* we've iterated past the namespace we're searching -- done now */
           truncated = false;
           goto done;
@@ -5169,6 +5215,10 @@ int RGWRados::Bucket::List::list_objects(int max, vector<RGWObjEnt> *result,
       }
 
       if (cur_end_marker_valid && cur_end_marker <= obj) {
+        if (params.allow_unordered) {
+          /* other shards may still hold entries before the end marker */
+          continue;
+        }
         truncated = false;
         goto done;
       }
@@ -5216,7 +5266,7 @@ int RGWRados::Bucket::List::list_objects(int max, vector<RGWObjEnt> *result,
         goto done;
       }
 
-      RGWObjEnt ent = eiter->second;
+      RGWObjEnt ent = *eiter;
       ent.key = obj;
       ent.ns = ns;
       result->push_back(ent);
@@ -5225,7 +5275,7 @@ int RGWRados::Bucket::List::list_objects(int max, vector<RGWObjEnt> *result,
 
     // Either the back-end telling us truncated, or we don't consume all
     // items returned per the amount caller request
-    truncated = (truncated || eiter != ent_map.end());
+    truncated = (truncated || eiter != ent_list.end());
   }
 
 done:
@@ -8193,6 +8243,7 @@ int RGWRados::Object::Delete::delete_obj()
 
   int64_t poolid = ref.ioctx.get_id();
   if (r >= 0) {
+    store->invalidate_data_cache(obj);
     tombstone_cache_t *obj_tombstone_cache = store->get_tombstone_cache();
     if (obj_tombstone_cache) {
       tombstone_entry entry{*state};
@@ -8267,6 +8318,17 @@ int RGWRados::delete_system_obj(rgw_obj& obj, RGWObjVersionTracker *objv_tracker
   return 0;
 }
 
+int RGWRados::delete_system_objs(list<rgw_obj>& objs)
+{
+  int ret = 0;
+  for (auto& obj : objs) {
+    int r = delete_system_obj(obj);
+    if (r < 0 && r != -ENOENT && ret == 0)
+      ret = r;
+  }
+  return ret;
+}
+
 int RGWRados::delete_obj_index(rgw_obj& obj)
 {
   rgw_bucket bucket;
@@ -9191,7 +9253,57 @@ int RGWRados::Bucket::UpdateIndex::prepare(RGWModifyOp op)
     }
   }
 
-  return store->cls_obj_prepare_op(*bs, op, optag, obj, bilog_flags);
+  ret = store->cls_obj_prepare_op(*bs, op, optag, obj, bilog_flags);
+  if (ret < 0) {
+    return ret;
+  }
+
+  if (target->get_bucket_info().resharding()) {
+    prepare_new(op);
+  }
+
+  return 0;
+}
+
+int RGWRados::Bucket::UpdateIndex::get_new_bucket_shard(BucketShard **pbs)
+{
+  if (!new_bs_initialized) {
+    rgw_bucket new_bucket = target->get_bucket();
+    new_bucket.bucket_id = target->get_bucket_info().new_bucket_instance_id;
+    new_bucket.oid.clear();
+    int r = new_bs.init(new_bucket, obj);
+    if (r < 0) {
+      return r;
+    }
+    new_bs_initialized = true;
+  }
+  *pbs = &new_bs;
+  return 0;
+}
+
+/*
+ * The bucket index is being resharded: prepare the operation on the new
+ * index too, after the old one, so that the copy of the old entries does
+ * not overwrite it.  Failures here only leave the new index behind; the
+ * old one stays authoritative until the switchover.
+ */
+void RGWRados::Bucket::UpdateIndex::prepare_new(RGWModifyOp op)
+{
+  RGWRados *store = target->get_store();
+  BucketShard *nbs;
+  int r = get_new_bucket_shard(&nbs);
+  if (r < 0) {
+    ldout(store->ctx(), 0) << "ERROR: failed to get new index shard of resharded bucket "
+                           << target->get_bucket() << ": ret=" << r << dendl;
+    return;
+  }
+  r = store->cls_obj_prepare_op(*nbs, op, optag, obj, bilog_flags);
+  if (r < 0) {
+    ldout(store->ctx(), 0) << "ERROR: failed to prepare op on new index shard " << nbs->bucket_obj
+                           << ": ret=" << r << dendl;
+    return;
+  }
+  new_prepared = true;
 }
 
 int RGWRados::Bucket::UpdateIndex::complete(int64_t poolid, uint64_t epoch, uint64_t size,
@@ -9227,6 +9339,14 @@ int RGWRados::Bucket::UpdateIndex::complete(int64_t poolid, uint64_t epoch, uint
 
   ret = store->cls_obj_complete_add(*bs, optag, poolid, epoch, ent, category, remove_objs, bilog_flags);
 
+  if (new_prepared) {
+    int r = store->cls_obj_complete_add(new_bs, optag, poolid, epoch, ent, category, remove_objs, bilog_flags);
+    if (r < 0) {
+      ldout(store->ctx(), 0) << "ERROR: failed to complete op on new index shard " << new_bs.bucket_obj
+                             << ": ret=" << r << dendl;
+    }
+  }
+
   int r = store->data_log->add_entry(bs->bucket, bs->shard_id);
   if (r < 0) {
     lderr(store->ctx()) << "ERROR: failed writing data log" << dendl;
@@ -9252,6 +9372,14 @@ int RGWRados::Bucket::UpdateIndex::complete_del(int64_t poolid, uint64_t epoch,
 
   ret = store->cls_obj_complete_del(*bs, optag, poolid, epoch, obj, removed_mtime, remove_objs, bilog_flags);
 
+  if (new_prepared) {
+    int r = store->cls_obj_complete_del(new_bs, optag, poolid, epoch, obj, removed_mtime, remove_objs, bilog_flags);
+    if (r < 0) {
+      ldout(store->ctx(), 0) << "ERROR: failed to complete op on new index shard " << new_bs.bucket_obj
+                             << ": ret=" << r << dendl;
+    }
+  }
+
   int r = store->data_log->add_entry(bs->bucket, bs->shard_id);
   if (r < 0) {
     lderr(store->ctx()) << "ERROR: failed writing data log" << dendl;
@@ -9276,6 +9404,31 @@ int RGWRados::Bucket::UpdateIndex::cancel()
 
   ret = store->cls_obj_complete_cancel(*bs, optag, obj, bilog_flags);
 
+  if (new_prepared) {
+    int r = store->cls_obj_complete_cancel(new_bs, optag, obj, bilog_flags);
+    if (r >= 0) {
+      /*
+       * If the prepare made the reshard skip this entry, the cancel left a
+       * bare entry behind in the new index; copy the old one over it.  Both
+       * shards order this after the cancels above.
+       */
+      rgw_cls_bi_entry entry;
+      cls_rgw_obj_key key(obj.get_index_key_name(), obj.get_instance());
+      r = cls_rgw_bi_get(bs->index_ctx, bs->bucket_obj, PlainIdx, key, &entry);
+      if (r >= 0) {
+        librados::ObjectWriteOperation op;
+        store->bi_put(op, new_bs, entry, true);
+        r = new_bs.index_ctx.operate(new_bs.bucket_obj, &op);
+      } else if (r == -ENOENT) {
+        r = 0;
+      }
+    }
+    if (r < 0) {
+      ldout(store->ctx(), 0) << "ERROR: failed to cancel op on new index shard " << new_bs.bucket_obj
+                             << ": ret=" << r << dendl;
+    }
+  }
+
   /*
    * need to update data log anyhow, so that whoever follows needs to update its internal markers
    * for following the specific bucket shard log. Otherwise they end up staying behind, and users
@@ -9488,6 +9641,8 @@ struct get_obj_aio_data {
 struct get_obj_io {
   off_t len;
   bufferlist bl;
+  bool cache = false; /* goes to the data cache once read */
+  bool ready = false; /* served from the data cache, no rados io */
 };
 
 static void _get_obj_aio_completion_cb(completion_t cb, void *arg);
@@ -9508,6 +9663,9 @@ struct get_obj_data : public RefCountedObject {
   atomic_t err_code;
   Throttle throttle;
   list<bufferlist> read_list;
+  string cache_obj;                        /* data cache key of the head object */
+  string cache_tag;                        /* etag and mtime it is cached under */
+  list<pair<off_t, bufferlist> > cache_list; /* read, not yet in the data cache */
 
   explicit get_obj_data(CephContext *_cct)
     : cct(_cct),
@@ -9557,10 +9715,11 @@ struct get_obj_data : public RefCountedObject {
     return r;
   }
 
-  void add_io(off_t ofs, off_t len, bufferlist **pbl, AioCompletion **pc) {
+  void add_io(off_t ofs, off_t len, bool cache, bufferlist **pbl, AioCompletion **pc) {
     Mutex::Locker l(lock);
 
     get_obj_io& io = io_map[ofs];
+    io.cache = cache;
     *pbl = &io.bl;
 
     struct get_obj_aio_data aio;
@@ -9610,6 +9769,25 @@ struct get_obj_data : public RefCountedObject {
     }
   }
 
+  /*
+   * queue a chunk that was read from the data cache; it goes to the
+   * client in order with the rados reads around it
+   */
+  int add_cached_io(off_t ofs, bufferlist& bl, list<bufferlist>& bl_list) {
+    Mutex::Locker l(lock);
+
+    get_obj_io& io = io_map[ofs];
+    io.len = bl.length();
+    io.bl.claim(bl);
+    io.ready = true;
+
+    if (io_map.begin()->first != ofs) {
+      /* collected once the reads before it complete */
+      return 0;
+    }
+    return _get_complete_ios(bl_list);
+  }
+
   int get_complete_ios(off_t ofs, list<bufferlist>& bl_list) {
     Mutex::Locker l(lock);
 
@@ -9620,36 +9798,46 @@ struct get_obj_data : public RefCountedObject {
       return 0;
     }
 
-    map<off_t, librados::AioCompletion *>::iterator aiter;
-    aiter = completion_map.find(ofs);
-    if (aiter == completion_map.end()) {
-    /* completion map does not hold this io, it was cancelled */
-      return 0;
-    }
+    return _get_complete_ios(bl_list);
+  }
 
-    AioCompletion *completion = aiter->second;
-    int r = completion->get_return_value();
-    if (r < 0)
-      return r;
+  /* pass on the complete ios at the front of io_map, in order */
+  int _get_complete_ios(list<bufferlist>& bl_list) {
+    assert(lock.is_locked());
 
-    for (; aiter != completion_map.end(); ++aiter) {
-      completion = aiter->second;
-      if (!completion->is_safe()) {
-        /* reached a request that is not yet complete, stop */
-        break;
-      }
+    map<off_t, get_obj_io>::iterator liter = io_map.begin();
+    while (liter != io_map.end()) {
+      get_obj_io& io = liter->second;
+      if (io.ready) {
+        total_read += io.len;
+        throttle.put(io.len);
+      } else {
+        map<off_t, librados::AioCompletion *>::iterator aiter;
+        aiter = completion_map.find(liter->first);
+        if (aiter == completion_map.end()) {
+          /* completion map does not hold this io, it was cancelled */
+          break;
+        }
 
-      r = completion->get_return_value();
-      if (r < 0) {
-        set_cancelled(r); /* mark it as cancelled, so that we don't continue processing next operations */
-        return r;
-      }
+        AioCompletion *completion = aiter->second;
+        if (!completion->is_safe()) {
+          /* reached a request that is not yet complete, stop */
+          break;
+        }
+
+        int r = completion->get_return_value();
+        if (r < 0) {
+          set_cancelled(r); /* mark it as cancelled, so that we don't continue processing next operations */
+          return r;
+        }
 
-      total_read += r;
+        total_read += r;
+        if (io.cache)
+          cache_list.push_back(make_pair(liter->first, io.bl));
+      }
 
-      map<off_t, get_obj_io>::iterator old_liter = liter++;
-      bl_list.push_back(old_liter->second.bl);
-      io_map.erase(old_liter);
+      bl_list.push_back(io.bl);
+      io_map.erase(liter++);
     }
 
     return 0;
@@ -9718,6 +9906,8 @@ int RGWRados::flush_read_list(struct get_obj_data *d)
   d->data_lock.Lock();
   list<bufferlist> l;
   l.swap(d->read_list);
+  list<pair<off_t, bufferlist> > cl;
+  cl.swap(d->cache_list);
   d->get();
   d->read_list.clear();
 
@@ -9735,6 +9925,11 @@ int RGWRados::flush_read_list(struct get_obj_data *d)
     }
   }
 
+  /* the writer thread stores them, the client does not wait for it */
+  for (auto& i : cl) {
+    data_cache->queue_put(d->cache_obj, d->cache_tag, i.first, i.second);
+  }
+
   d->data_lock.Lock();
   d->put();
   if (r < 0) {
@@ -9744,6 +9939,34 @@ int RGWRados::flush_read_list(struct get_obj_data *d)
   return r;
 }
 
+string RGWRados::data_cache_key(rgw_obj& obj)
+{
+  rgw_bucket bucket;
+  string oid, key;
+  get_obj_bucket_and_oid_loc(obj, bucket, oid, key);
+  return bucket.name + "/" + oid;
+}
+
+void RGWRados::invalidate_data_cache(rgw_obj& obj)
+{
+  if (!data_cache)
+    return;
+
+  string name = data_cache_key(obj);
+  data_cache->invalidate(name);
+
+  RGWCacheNotifyInfo info;
+  info.op = INVALIDATE_DATA;
+  info.obj = obj;
+  bufferlist bl;
+  ::encode(info, bl);
+  /* the delete does not wait for the other gateways */
+  int r = distribute_async(name, bl);
+  if (r < 0) {
+    ldout(cct, 0) << "ERROR: failed to distribute data cache invalidation for " << obj << dendl;
+  }
+}
+
 int RGWRados::get_obj_iterate_cb(RGWObjectCtx *ctx, RGWObjState *astate,
 		         rgw_obj& obj,
 			 off_t obj_ofs,
@@ -9790,6 +10013,26 @@ int RGWRados::get_obj_iterate_cb(RGWObjectCtx *ctx, RGWObjState *astate,
 
   get_obj_bucket_and_oid_loc(obj, bucket, oid, key);
 
+  if (!d->cache_obj.empty()) {
+    if (d->is_cancelled()) {
+      return d->get_err_code();
+    }
+    bufferlist bl;
+    if (data_cache->get(d->cache_obj, d->cache_tag, obj_ofs, len, &bl)) {
+      /* held until the reads before it complete, so it counts against the window */
+      d->throttle.get(len);
+      list<bufferlist> bl_list;
+      d->data_lock.Lock();
+      r = d->add_cached_io(obj_ofs, bl, bl_list);
+      d->read_list.splice(d->read_list.end(), bl_list);
+      d->data_lock.Unlock();
+      if (r < 0)
+        return r;
+
+      return flush_read_list(d);
+    }
+  }
+
   d->throttle.get(len);
   if (d->is_cancelled()) {
     return d->get_err_code();
@@ -9798,7 +10041,7 @@ int RGWRados::get_obj_iterate_cb(RGWObjectCtx *ctx, RGWObjState *astate,
   /* add io after we check that we're not cancelled, otherwise we're going to have trouble
    * cleaning up
    */
-  d->add_io(obj_ofs, len, &pbl, &c);
+  d->add_io(obj_ofs, len, !d->cache_obj.empty(), &pbl, &c);
 
   ldout(cct, 20) << "rados->get_obj_iterate_cb oid=" << oid << " obj-ofs=" << obj_ofs << " read_ofs=" << read_ofs << " len=" << len << dendl;
   op.read(read_ofs, len, pbl, NULL);
@@ -9840,6 +10083,19 @@ int RGWRados::Object::Read::iterate(int64_t ofs, int64_t end, RGWGetDataCB *cb)
   data->io_ctx.dup(state.io_ctx);
   data->client_cb = cb;
 
+  if (store->data_cache) {
+    RGWObjState *astate;
+    int r = source->get_state(&astate, true);
+    if (r >= 0) {
+      auto iter = astate->attrset.find(RGW_ATTR_ETAG);
+      if (iter != astate->attrset.end()) {
+        /* validate cached chunks against the current version */
+        data->cache_obj = store->data_cache_key(state.obj);
+        data->cache_tag = iter->second.to_str() + ":" + stringify(astate->mtime);
+      }
+    }
+  }
+
   int r = store->iterate_obj(obj_ctx, state.obj, ofs, end, cct->_conf->rgw_get_obj_max_req_size, _get_obj_iterate_cb, (void *)data);
   if (r < 0) {
     data->cancel_all_io();
@@ -11302,7 +11558,7 @@ int RGWRados::append_async(rgw_obj& obj, size_t size, bufferlist& bl)
   return r;
 }
 
-int RGWRados::distribute(const string& key, bufferlist& bl)
+int RGWRados::distribute(const string& key, bufferlist& bl, bufferlist *reply)
 {
   /*
    * we were called before watch was initialized. This can only happen if we're updating some system
@@ -11316,7 +11572,22 @@ int RGWRados::distribute(const string& key, bufferlist& bl)
   pick_control_oid(key, notify_oid);
 
   ldout(cct, 10) << "distributing notification oid=" << notify_oid << " bl.length()=" << bl.length() << dendl;
-  return control_pool_ctx.notify2(notify_oid, bl, 0, NULL);
+  return control_pool_ctx.notify2(notify_oid, bl, 0, reply);
+}
+
+int RGWRados::distribute_async(const string& key, bufferlist& bl)
+{
+  if (!watch_initialized)
+    return 0;
+
+  string notify_oid;
+  pick_control_oid(key, notify_oid);
+
+  ldout(cct, 10) << "distributing notification oid=" << notify_oid << " bl.length()=" << bl.length() << " (async)" << dendl;
+  librados::AioCompletion *completion = librados::Rados::aio_create_completion(NULL, NULL, NULL);
+  int r = control_pool_ctx.aio_notify(notify_oid, completion, bl, 0, NULL);
+  completion->release();
+  return r;
 }
 
 int RGWRados::pool_iterate_begin(rgw_bucket& bucket, RGWPoolIterCtx& ctx)
@@ -11569,9 +11840,10 @@ int RGWRados::bi_get(rgw_bucket& bucket, rgw_obj& obj, BIIndexType index_type, r
   return 0;
 }
 
-void RGWRados::bi_put(ObjectWriteOperation& op, BucketShard& bs, rgw_cls_bi_entry& entry)
+void RGWRados::bi_put(ObjectWriteOperation& op, BucketShard& bs, rgw_cls_bi_entry& entry,
+                      bool exclusive)
 {
-  cls_rgw_bi_put(op, bs.bucket_obj, entry);
+  cls_rgw_bi_put(op, bs.bucket_obj, entry, exclusive);
 }
 
 int RGWRados::bi_put(BucketShard& bs, rgw_cls_bi_entry& entry)
@@ -11787,6 +12059,77 @@ int RGWRados::cls_obj_set_bucket_tag_timeout(rgw_bucket& bucket, uint64_t timeou
   return CLSRGWIssueSetTagTimeout(index_ctx, bucket_objs, cct->_conf->rgw_bucket_index_max_aio, timeout)();
 }
 
+/*
+ * Reads a bucket index shard object for RGWBucketListShardCursor.
+ */
+class RGWBucketListShardRadosReader : public RGWBucketListShardReader {
+  librados::IoCtx& index_ctx;
+  string oid;
+  const string& prefix;
+  bool list_versions;
+
+  librados::AioCompletion *completion;
+  int rval;
+
+public:
+  RGWBucketListShardRadosReader(librados::IoCtx& _index_ctx, const string& _oid,
+                                const string& _prefix, bool _list_versions)
+    : index_ctx(_index_ctx), oid(_oid), prefix(_prefix), list_versions(_list_versions),
+      completion(NULL), rval(0) {}
+  ~RGWBucketListShardRadosReader() override {
+    if (completion) {
+      completion->wait_for_complete();
+      completion->release();
+    }
+  }
+
+  const string& get_oid() override {
+    return oid;
+  }
+
+  int aio_list(const cls_rgw_obj_key& start, uint32_t num, rgw_cls_list_ret *result) override {
+    assert(!completion);
+    rval = 0;
+    librados::ObjectReadOperation op;
+    cls_rgw_bucket_list_op(op, start, prefix, num, list_versions, result, &rval);
+    completion = librados::Rados::aio_create_completion(NULL, NULL, NULL);
+    int r = index_ctx.aio_operate(oid, completion, &op, NULL);
+    if (r < 0) {
+      completion->release();
+      completion = NULL;
+    }
+    return r;
+  }
+
+  int aio_wait() override {
+    assert(completion);
+    completion->wait_for_complete();
+    int r = completion->get_return_value();
+    completion->release();
+    completion = NULL;
+    if (r >= 0) {
+      r = rval;
+    }
+    return r;
+  }
+};
+
+static void init_obj_ent(const struct rgw_bucket_dir_entry& dirent, RGWObjEnt *e)
+{
+  e->key.set(dirent.key.name, dirent.key.instance);
+  e->size = dirent.meta.size;
+  e->mtime = dirent.meta.mtime;
+  e->etag = dirent.meta.etag;
+  e->owner = dirent.meta.owner;
+  e->owner_display_name = dirent.meta.owner_display_name;
+  e->content_type = dirent.meta.content_type;
+  e->tag = dirent.tag;
+  e->flags = dirent.flags;
+  e->versioned_epoch = dirent.versioned_epoch;
+}
+
+#define RGW_BUCKET_LIST_MIN_CHUNK 8
+
 int RGWRados::cls_bucket_list(rgw_bucket& bucket, int shard_id, rgw_obj_key& start, const string& prefix,
 		              uint32_t num_entries, bool list_versions, map<string, RGWObjEnt>& m,
 			      bool *is_truncated, rgw_obj_key *last_entry,
@@ -11795,64 +12138,40 @@ int RGWRados::cls_bucket_list(rgw_bucket& bucket, int shard_id, rgw_obj_key& sta
   ldout(cct, 10) << "cls_bucket_list " << bucket << " start " << start.name << "[" << start.instance << "] num_entries " << num_entries << dendl;
 
   librados::IoCtx index_ctx;
-  // key   - oid (for different shards if there is any)
-  // value - list result for the corresponding oid (shard), it is filled by the AIO callback
+  // key   - shard id
+  // value - oid of the shard
   map<int, string> oids;
-  map<int, struct rgw_cls_list_ret> list_results;
   int r = open_bucket_index(bucket, index_ctx, oids, shard_id);
   if (r < 0)
     return r;
 
+  /* a shard holds its share of the listing and a bit, unless the keys are skewed */
+  uint32_t chunk = num_entries / oids.size() + num_entries / (4 * oids.size());
+  chunk = std::min(std::max(chunk, (uint32_t)RGW_BUCKET_LIST_MIN_CHUNK), num_entries);
+
   cls_rgw_obj_key start_key(start.name, start.instance);
-  r = CLSRGWIssueBucketList(index_ctx, start_key, prefix, num_entries, list_versions,
-                            oids, list_results, cct->_conf->rgw_bucket_index_max_aio)();
+  RGWBucketListMerge merge;
+  for (auto& oid : oids) {
+    merge.add(new RGWBucketListShardCursor(
+                cct, new RGWBucketListShardRadosReader(index_ctx, oid.second, prefix, list_versions),
+                chunk, num_entries));
+  }
+  r = merge.start(start_key, num_entries);
   if (r < 0)
     return r;
 
-  // Create a list of iterators that are used to iterate each shard
-  vector<map<string, struct rgw_bucket_dir_entry>::iterator> vcurrents(list_results.size());
-  vector<map<string, struct rgw_bucket_dir_entry>::iterator> vends(list_results.size());
-  vector<string> vnames(list_results.size());
-  map<int, struct rgw_cls_list_ret>::iterator iter = list_results.begin();
-  *is_truncated = false;
-  for (; iter != list_results.end(); ++iter) {
-    vcurrents.push_back(iter->second.dir.m.begin());
-    vends.push_back(iter->second.dir.m.end());
-    vnames.push_back(oids[iter->first]);
-    *is_truncated = (*is_truncated || iter->second.is_truncated);
-  }
-
-  // Create a map to track the next candidate entry from each shard, if the entry
-  // from a specified shard is selected/erased, the next entry from that shard will
-  // be inserted for next round selection
-  map<string, size_t> candidates;
-  for (size_t i = 0; i < vcurrents.size(); ++i) {
-    if (vcurrents[i] != vends[i]) {
-      candidates[vcurrents[i]->first] = i;
-    }
-  }
-
   map<string, bufferlist> updates;
   uint32_t count = 0;
-  while (count < num_entries && !candidates.empty()) {
+  while (count < num_entries && merge.valid()) {
     r = 0;
     // Select the next one
-    int pos = candidates.begin()->second;
-    const string& name = vcurrents[pos]->first;
-    struct rgw_bucket_dir_entry& dirent = vcurrents[pos]->second;
+    RGWBucketListShardCursor *cursor = merge.cursor();
+    const string& name = cursor->key();
+    struct rgw_bucket_dir_entry& dirent = cursor->entry();
 
     // fill it in with initial values; we may correct later
     RGWObjEnt e;
-    e.key.set(dirent.key.name, dirent.key.instance);
-    e.size = dirent.meta.size;
-    e.mtime = dirent.meta.mtime;
-    e.etag = dirent.meta.etag;
-    e.owner = dirent.meta.owner;
-    e.owner_display_name = dirent.meta.owner_display_name;
-    e.content_type = dirent.meta.content_type;
-    e.tag = dirent.tag;
-    e.flags = dirent.flags;
-    e.versioned_epoch = dirent.versioned_epoch;
+    init_obj_ent(dirent, &e);
 
     bool force_check = force_check_filter && force_check_filter(dirent.key.name);
     if ((!dirent.exists && !dirent.is_delete_marker()) || !dirent.pending_map.empty() || force_check) {
@@ -11860,7 +12179,7 @@ int RGWRados::cls_bucket_list(rgw_bucket& bucket, int shard_id, rgw_obj_key& sta
        * and if the tags are old we need to do cleanup as well. */
       librados::IoCtx sub_ctx;
       sub_ctx.dup(index_ctx);
-      r = check_disk_state(sub_ctx, bucket, dirent, e, updates[vnames[pos]]);
+      r = check_disk_state(sub_ctx, bucket, dirent, e, updates[cursor->get_oid()]);
       if (r < 0 && r != -ENOENT) {
           return r;
       }
@@ -11871,12 +12190,10 @@ int RGWRados::cls_bucket_list(rgw_bucket& bucket, int shard_id, rgw_obj_key& sta
       ++count;
     }
 
-    // Refresh the candidates map
-    candidates.erase(candidates.begin());
-    ++vcurrents[pos];
-    if (vcurrents[pos] != vends[pos]) {
-      candidates[vcurrents[pos]->first] = pos;
-    }
+    // Move on to the next candidate
+    r = merge.next(num_entries - count);
+    if (r < 0)
+      return r;
   }
 
   // Suggest updates if there is any
@@ -11892,17 +12209,137 @@ int RGWRados::cls_bucket_list(rgw_bucket& bucket, int shard_id, rgw_obj_key& sta
     }
   }
 
-  // Check if all the returned entries are consumed or not
-  for (size_t i = 0; i < vcurrents.size(); ++i) {
-    if (vcurrents[i] != vends[i])
-      *is_truncated = true;
-  }
+  // Check if all the shards are consumed or not
+  *is_truncated = merge.truncated();
   if (!m.empty())
     *last_entry = m.rbegin()->first;
 
   return 0;
 }
 
+/*
+ * Shard of the bucket index that holds key, as listed.  Multipart upload
+ * entries go to the shard of the object being uploaded.
+ */
+static int get_list_key_shard(RGWRados *store, RGWBucketInfo& bucket_info,
+                              const rgw_obj_key& key, int *shard_id)
+{
+  string raw = key.name;
+  if (!raw.empty() && (unsigned char)raw[0] == 0x80) {
+    /* versioned listing marker: 0x80 "1000_" <name> '\0' <instance> */
+    size_t pos = raw.find('_');
+    if (pos == string::npos) {
+      return -EINVAL;
+    }
+    raw = string(raw.c_str() + pos + 1);
+  }
+  string name, instance, ns;
+  if (!rgw_obj::parse_raw_oid(raw, &name, &instance, &ns)) {
+    return -EINVAL;
+  }
+  if (ns == RGW_OBJ_NS_MULTIPART) {
+    /* <object>.<upload id>.meta */
+    size_t pos = name.rfind('.');
+    if (pos != string::npos && pos > 0) {
+      pos = name.rfind('.', pos - 1);
+      if (pos != string::npos) {
+        name = name.substr(0, pos);
+      }
+    }
+  }
+  return store->get_target_shard_id(bucket_info, name, shard_id);
+}
+
+int RGWRados::cls_bucket_list_unordered(RGWBucketInfo& bucket_info, int shard_id, rgw_obj_key& start,
+                                        const string& prefix, uint32_t num_entries, bool list_versions,
+                                        vector<RGWObjEnt>& ent_list, bool *is_truncated,
+                                        rgw_obj_key *last_entry,
+                                        bool (*force_check_filter)(const string& name))
+{
+  rgw_bucket& bucket = bucket_info.bucket;
+  ldout(cct, 10) << "cls_bucket_list_unordered " << bucket << " start " << start.name << "[" << start.instance << "] num_entries " << num_entries << dendl;
+
+  librados::IoCtx index_ctx;
+  map<int, string> oids;
+  int r = open_bucket_index(bucket, index_ctx, oids, shard_id);
+  if (r < 0)
+    return r;
+
+  /* shards are listed one after the other; resume in the shard of the marker */
+  map<int, string>::iterator oiter = oids.begin();
+  if (shard_id < 0 && bucket_info.num_shards > 0 && !start.empty()) {
+    int marker_shard;
+    r = get_list_key_shard(this, bucket_info, start, &marker_shard);
+    if (r < 0) {
+      ldout(cct, 0) << "ERROR: could not find bucket index shard of marker " << start.name << dendl;
+      return r;
+    }
+    oiter = oids.find(marker_shard);
+    if (oiter == oids.end()) {
+      return -EINVAL;
+    }
+  }
+
+  cls_rgw_obj_key marker(start.name, start.instance);
+  map<string, bufferlist> updates;
+  uint32_t count = 0;
+  while (count < num_entries && oiter != oids.end()) {
+    rgw_cls_list_ret result;
+    int rval = 0;
+    librados::ObjectReadOperation op;
+    cls_rgw_bucket_list_op(op, marker, prefix, num_entries - count, list_versions, &result, &rval);
+    r = index_ctx.operate(oiter->second, &op, NULL);
+    if (r >= 0)
+      r = rval;
+    if (r < 0)
+      return r;
+
+    for (auto& iter : result.dir.m) {
+      struct rgw_bucket_dir_entry& dirent = iter.second;
+
+      RGWObjEnt e;
+      init_obj_ent(dirent, &e);
+
+      r = 0;
+      bool force_check = force_check_filter && force_check_filter(dirent.key.name);
+      if ((!dirent.exists && !dirent.is_delete_marker()) || !dirent.pending_map.empty() || force_check) {
+        librados::IoCtx sub_ctx;
+        sub_ctx.dup(index_ctx);
+        r = check_disk_state(sub_ctx, bucket, dirent, e, updates[oiter->second]);
+        if (r < 0 && r != -ENOENT) {
+          return r;
+        }
+      }
+      if (r >= 0) {
+        ent_list.push_back(e);
+        ++count;
+      }
+      marker = cls_rgw_obj_key(iter.first);
+      *last_entry = iter.first;
+    }
+
+    if (!result.is_truncated) {
+      ++oiter;
+      marker = cls_rgw_obj_key();
+    }
+  }
+
+  map<string, bufferlist>::iterator miter = updates.begin();
+  for (; miter != updates.end(); ++miter) {
+    if (miter->second.length()) {
+      ObjectWriteOperation o;
+      cls_rgw_suggest_changes(o, miter->second);
+      AioCompletion *c = librados::Rados::aio_create_completion(NULL, NULL, NULL);
+      index_ctx.aio_operate(miter->first, c, &o);
+      c->release();
+    }
+  }
+
+  *is_truncated = (oiter != oids.end());
+
+  return 0;
+}
+
 int RGWRados::cls_obj_usage_log_add(const string& oid, rgw_usage_log_info& info)
 {
   librados::IoCtx io_ctx;
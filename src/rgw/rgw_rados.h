@@ -32,10 +32,12 @@ class RGWMetaNotifier;
 class RGWDataNotifier;
 class RGWLC;
 class RGWObjectExpirer;
+class RGWReshard;
 class RGWMetaSyncProcessorThread;
 class RGWDataSyncProcessorThread;
 class RGWSyncLogTrimThread;
 class RGWRESTConn;
+class RGWDataCache;
 
 /* flags for put_obj_meta() */
 #define PUT_OBJ_CREATE      0x01
@@ -1801,6 +1803,8 @@ class RGWRados
   friend class RGWDataNotifier;
   friend class RGWLC;
   friend class RGWObjectExpirer;
+  friend class RGWReshard;
+  friend class RGWBucketReshard;
   friend class RGWMetaSyncProcessorThread;
   friend class RGWDataSyncProcessorThread;
   friend class RGWStateLog;
@@ -1842,6 +1846,7 @@ class RGWRados
   RGWGC *gc;
   RGWLC *lc;
   RGWObjectExpirer *obj_expirer;
+  RGWReshard *reshard{nullptr};
   bool use_gc_thread;
   bool use_lc_thread;
   bool quota_threads;
@@ -1905,6 +1910,8 @@ protected:
   using tombstone_cache_t = lru_map<rgw_obj, tombstone_entry>;
   tombstone_cache_t *obj_tombstone_cache;
 
+  RGWDataCache *data_cache{nullptr};
+
   librados::IoCtx gc_pool_ctx;        // .rgw.gc
   librados::IoCtx lc_pool_ctx;        // .rgw.lc
   librados::IoCtx objexp_pool_ctx;
@@ -2469,10 +2476,19 @@ public:
       BucketShard bs;
       bool bs_initialized;
       bool blind;
+      /* shard of the index being built by an online reshard */
+      BucketShard new_bs;
+      bool new_bs_initialized;
+      bool new_prepared;
+
+      int get_new_bucket_shard(BucketShard **pbs);
+      void prepare_new(RGWModifyOp op);
     public:
 
       UpdateIndex(RGWRados::Bucket *_target, rgw_obj& _obj, RGWObjState *_state) : target(_target), obj(_obj), obj_state(_state), bilog_flags(0),
-                                                                                   bs(target->get_store()), bs_initialized(false) {
+                                                                                   bs(target->get_store()), bs_initialized(false),
+                                                                                   new_bs(target->get_store()), new_bs_initialized(false),
+                                                                                   new_prepared(false) {
                                                                                      blind = (target->get_bucket_info().index_type == RGWBIType_Indexless);
                                                                                    }
 
@@ -2516,8 +2532,9 @@ public:
         bool enforce_ns;
         RGWAccessListFilter *filter;
         bool list_versions;
+        bool allow_unordered;
 
-        Params() : enforce_ns(true), filter(NULL), list_versions(false) {}
+        Params() : enforce_ns(true), filter(NULL), list_versions(false), allow_unordered(false) {}
       } params;
 
     public:
@@ -2736,6 +2753,12 @@ public:
 
   /* Delete a system object */
   virtual int delete_system_obj(rgw_obj& src_obj, RGWObjVersionTracker *objv_tracker = NULL);
+  /**
+   * Delete several system objects, ignoring those that don't exist.
+   * The cache invalidates them on the other gateways with a single
+   * notification.
+   */
+  virtual int delete_system_objs(list<rgw_obj>& objs);
 
   /** Remove an object from the bucket index */
   int delete_obj_index(rgw_obj& obj);
@@ -2802,6 +2825,11 @@ public:
 
   int flush_read_list(struct get_obj_data *d);
 
+  /* data cache key of the head object obj */
+  string data_cache_key(rgw_obj& obj);
+  /* drop obj from the data cache here and on the other gateways */
+  void invalidate_data_cache(rgw_obj& obj);
+
   int get_obj_iterate_cb(RGWObjectCtx *ctx, RGWObjState *astate,
                          rgw_obj& obj,
                          off_t obj_ofs, off_t read_ofs, off_t len,
@@ -2863,7 +2891,11 @@ public:
   virtual bool need_watch_notify() { return false; }
   virtual int init_watch();
   virtual void finalize_watch();
-  virtual int distribute(const string& key, bufferlist& bl);
+  /* reply, if given, gets the notify acks and timeouts (see notify2()) */
+  virtual int distribute(const string& key, bufferlist& bl,
+                         bufferlist *reply = NULL);
+  /* like distribute(), without waiting for the acks */
+  int distribute_async(const string& key, bufferlist& bl);
   virtual int watch_cb(uint64_t notify_id,
 		       uint64_t cookie,
 		       uint64_t notifier_id,
@@ -2925,6 +2957,14 @@ public:
                       uint32_t num_entries, bool list_versions, map<string, RGWObjEnt>& m,
                       bool *is_truncated, rgw_obj_key *last_entry,
                       bool (*force_check_filter)(const string&  name) = NULL);
+  /*
+   * list the index shards one after the other, in no particular order;
+   * last_entry is the marker to pass as start for the next call
+   */
+  int cls_bucket_list_unordered(RGWBucketInfo& bucket_info, int shard_id, rgw_obj_key& start,
+                                const string& prefix, uint32_t num_entries, bool list_versions,
+                                vector<RGWObjEnt>& ent_list, bool *is_truncated, rgw_obj_key *last_entry,
+                                bool (*force_check_filter)(const string& name) = NULL);
   int cls_bucket_head(rgw_bucket& bucket, int shard_id, map<string, struct rgw_bucket_dir_header>& headers, map<int, string> *bucket_instance_ids = NULL);
   int cls_bucket_head_async(rgw_bucket& bucket, int shard_id, RGWGetDirHeader_CB *ctx, int *num_aio);
   int list_bi_log_entries(rgw_bucket& bucket, int shard_id, string& marker, uint32_t max, std::list<rgw_bi_log_entry>& result, bool *truncated);
@@ -2933,7 +2973,8 @@ public:
 
   int bi_get_instance(rgw_obj& obj, rgw_bucket_dir_entry *dirent);
   int bi_get(rgw_bucket& bucket, rgw_obj& obj, BIIndexType index_type, rgw_cls_bi_entry *entry);
-  void bi_put(librados::ObjectWriteOperation& op, BucketShard& bs, rgw_cls_bi_entry& entry);
+  void bi_put(librados::ObjectWriteOperation& op, BucketShard& bs, rgw_cls_bi_entry& entry,
+              bool exclusive = false);
   int bi_put(BucketShard& bs, rgw_cls_bi_entry& entry);
   int bi_put(rgw_bucket& bucket, rgw_obj& obj, rgw_cls_bi_entry& entry);
   int bi_list(rgw_bucket& bucket, int shard_id, const string& filter_obj, const string& marker, uint32_t max, list<rgw_cls_bi_entry> *entries, bool *is_truncated);
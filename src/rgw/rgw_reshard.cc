@@ -0,0 +1,840 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+
+#include <unistd.h>
+
+#include "rgw_reshard.h"
+#include "rgw_bucket.h"
+#include "rgw_metadata.h"
+
+#include "cls/rgw/cls_rgw_client.h"
+#include "common/ceph_json.h"
+#include "common/errno.h"
+
+#define dout_subsys ceph_subsys_rgw
+
+static string bucket_reshard_lock_name = "reshard_process";
+static string reshard_lock_name = "reshard";
+static string reshard_oid = "reshard";
+
+#define RESHARD_SHARD_WINDOW 64
+#define RESHARD_MAX_AIO 128
+#define RESHARD_COOKIE_LEN 16
+
+class BucketReshardShard {
+  RGWRados *store;
+  RGWBucketInfo& bucket_info;
+  int num_shard;
+  RGWRados::BucketShard bs;
+  vector<rgw_cls_bi_entry> entries;
+  deque<librados::AioCompletion *>& aio_completions;
+
+  int wait_next_completion() {
+    librados::AioCompletion *c = aio_completions.front();
+    aio_completions.pop_front();
+
+    c->wait_for_safe();
+
+    int ret = c->get_return_value();
+    c->release();
+
+    if (ret < 0) {
+      lderr(store->ctx()) << "ERROR: reshard rados operation failed: " << cpp_strerror(-ret) << dendl;
+      return ret;
+    }
+
+    return 0;
+  }
+
+  int get_completion(librados::AioCompletion **c) {
+    if (aio_completions.size() >= RESHARD_MAX_AIO) {
+      int ret = wait_next_completion();
+      if (ret < 0) {
+        return ret;
+      }
+    }
+
+    *c = librados::Rados::aio_create_completion(nullptr, nullptr, nullptr);
+    aio_completions.push_back(*c);
+
+    return 0;
+  }
+
+public:
+  BucketReshardShard(RGWRados *_store, RGWBucketInfo& _bucket_info,
+                     int _num_shard,
+                     deque<librados::AioCompletion *>& _completions) : store(_store), bucket_info(_bucket_info), bs(store),
+                                                                       aio_completions(_completions) {
+    num_shard = (bucket_info.num_shards > 0 ? _num_shard : -1);
+    bs.init(bucket_info.bucket, num_shard);
+  }
+
+  int get_num_shard() {
+    return num_shard;
+  }
+
+  int add_entry(rgw_cls_bi_entry& entry) {
+    entries.push_back(entry);
+    if (entries.size() >= RESHARD_SHARD_WINDOW) {
+      int ret = flush();
+      if (ret < 0) {
+        return ret;
+      }
+    }
+    return 0;
+  }
+
+  /*
+   * The entries are put exclusively: whatever the gateways have already
+   * written to the new index is newer than our copy.  Stats are rebuilt
+   * once the copy is over.
+   */
+  int flush() {
+    if (entries.size() == 0) {
+      return 0;
+    }
+
+    librados::ObjectWriteOperation op;
+    for (auto& entry : entries) {
+      store->bi_put(op, bs, entry, true);
+    }
+
+    librados::AioCompletion *c;
+    int ret = get_completion(&c);
+    if (ret < 0) {
+      return ret;
+    }
+    ret = bs.index_ctx.aio_operate(bs.bucket_obj, c, &op);
+    if (ret < 0) {
+      lderr(store->ctx()) << "ERROR: failed to store entries in target bucket shard (bs=" << bs.bucket << "/" << bs.shard_id << ") error=" << cpp_strerror(-ret) << dendl;
+      return ret;
+    }
+    entries.clear();
+    return 0;
+  }
+
+  /* remove entry, unless it was changed since we copied it */
+  int remove_copied_entry(rgw_cls_bi_entry& entry) {
+    librados::ObjectWriteOperation op;
+    std::map<std::string, pair<bufferlist, int> > assertions;
+    assertions[entry.idx] = make_pair(entry.data, (int)CEPH_OSD_CMPXATTR_OP_EQ);
+    int rval;
+    op.omap_cmp(assertions, &rval);
+    std::set<std::string> keys;
+    keys.insert(entry.idx);
+    op.omap_rm_keys(keys);
+    int ret = bs.index_ctx.operate(bs.bucket_obj, &op);
+    if (ret == -ECANCELED || ret == -ENOENT) {
+      ret = 0;
+    }
+    return ret;
+  }
+
+  int wait_all_aio() {
+    int ret = 0;
+    while (!aio_completions.empty()) {
+      int r = wait_next_completion();
+      if (r < 0) {
+        ret = r;
+      }
+    }
+    return ret;
+  }
+};
+
+class BucketReshardManager {
+  RGWRados *store;
+  RGWBucketInfo& target_bucket_info;
+  deque<librados::AioCompletion *> completions;
+  int num_target_shards;
+  vector<BucketReshardShard *> target_shards;
+
+public:
+  BucketReshardManager(RGWRados *_store, RGWBucketInfo& _target_bucket_info, int _num_target_shards) : store(_store), target_bucket_info(_target_bucket_info),
+                                                                                                       num_target_shards(_num_target_shards) {
+    target_shards.resize(num_target_shards);
+    for (int i = 0; i < num_target_shards; ++i) {
+      target_shards[i] = new BucketReshardShard(store, target_bucket_info, i, completions);
+    }
+  }
+
+  ~BucketReshardManager() {
+    for (auto& shard : target_shards) {
+      int ret = shard->wait_all_aio();
+      if (ret < 0) {
+        ldout(store->ctx(), 20) << __func__ << ": shard->wait_all_aio() returned ret=" << ret << dendl;
+      }
+      delete shard;
+    }
+  }
+
+  int add_entry(int shard_index, rgw_cls_bi_entry& entry) {
+    int ret = target_shards[shard_index]->add_entry(entry);
+    if (ret < 0) {
+      lderr(store->ctx()) << "ERROR: target_shards.add_entry(" << entry.idx << ") returned error: " << cpp_strerror(-ret) << dendl;
+      return ret;
+    }
+    return 0;
+  }
+
+  int remove_copied_entry(int shard_index, rgw_cls_bi_entry& entry) {
+    int ret = target_shards[shard_index]->remove_copied_entry(entry);
+    if (ret < 0) {
+      lderr(store->ctx()) << "ERROR: failed to remove " << entry.idx << " from target shard: " << cpp_strerror(-ret) << dendl;
+      return ret;
+    }
+    return 0;
+  }
+
+  /* write out everything added so far and wait for it */
+  int flush() {
+    int ret = 0;
+    for (auto& shard : target_shards) {
+      int r = shard->flush();
+      if (r < 0) {
+        lderr(store->ctx()) << "ERROR: target_shards[" << shard->get_num_shard() << "].flush() returned error: " << cpp_strerror(-r) << dendl;
+        ret = r;
+      }
+    }
+    for (auto& shard : target_shards) {
+      int r = shard->wait_all_aio();
+      if (r < 0) {
+        lderr(store->ctx()) << "ERROR: target_shards[" << shard->get_num_shard() << "].wait_all_aio() returned error: " << cpp_strerror(-r) << dendl;
+        ret = r;
+      }
+    }
+    return ret;
+  }
+};
+
+typedef pair<int, rgw_cls_bi_entry> copied_entry_t; /* target shard, entry */
+
+/*
+ * An entry may have been removed from the old index between our listing
+ * and the copy, in which case the removal reached the new index before
+ * the copy did.  List the old index again over the copied range and take
+ * back the copies of the entries that are gone.  Removals that happen
+ * after this find the copy in the new index.
+ */
+static int remove_vanished_entries(RGWRados *store, RGWBucketInfo& bucket_info,
+                                   int shard_id, const string& batch_marker, int max_entries,
+                                   vector<copied_entry_t>& batch,
+                                   BucketReshardManager& target_shards_mgr)
+{
+  string marker = batch_marker;
+  size_t decided = 0;
+
+  while (decided < batch.size()) {
+    list<rgw_cls_bi_entry> entries;
+    bool is_truncated;
+    int ret = store->bi_list(bucket_info.bucket, shard_id, string(), marker, max_entries, &entries, &is_truncated);
+    if (ret < 0) {
+      lderr(store->ctx()) << "ERROR: bi_list(): " << cpp_strerror(-ret) << dendl;
+      return ret;
+    }
+
+    set<string> found;
+    for (auto& entry : entries) {
+      found.insert(entry.idx);
+    }
+
+    /* the listing went past every copied entry up to the last one it found */
+    size_t reach = decided;
+    if (!is_truncated) {
+      reach = batch.size();
+    } else {
+      for (size_t i = decided; i < batch.size(); ++i) {
+        if (found.count(batch[i].second.idx)) {
+          reach = i + 1;
+        }
+      }
+    }
+
+    for (size_t i = decided; i < reach; ++i) {
+      if (found.count(batch[i].second.idx)) {
+        continue;
+      }
+      ldout(store->ctx(), 20) << "reshard: " << batch[i].second.idx << " removed while being copied" << dendl;
+      ret = target_shards_mgr.remove_copied_entry(batch[i].first, batch[i].second);
+      if (ret < 0) {
+        return ret;
+      }
+    }
+    decided = reach;
+
+    if (entries.empty()) {
+      break;
+    }
+    marker = entries.back().idx;
+  }
+
+  return 0;
+}
+
+RGWBucketReshard::RGWBucketReshard(RGWRados *_store, const RGWBucketInfo& _bucket_info,
+                                   const map<string, bufferlist>& _bucket_attrs)
+  : store(_store), bucket_info(_bucket_info), bucket_attrs(_bucket_attrs),
+    reshard_lock(bucket_reshard_lock_name)
+{
+  char cookie_buf[RESHARD_COOKIE_LEN + 1];
+  gen_rand_alphanumeric(store->ctx(), cookie_buf, sizeof(cookie_buf) - 1);
+  cookie_buf[RESHARD_COOKIE_LEN] = '\0';
+  reshard_lock.set_cookie(cookie_buf);
+}
+
+int RGWBucketReshard::lock_bucket()
+{
+  CephContext *cct = store->ctx();
+  map<int, string> bucket_objs;
+  int ret = store->open_bucket_index(bucket_info.bucket, lock_ctx, bucket_objs);
+  if (ret < 0) {
+    return ret;
+  }
+  assert(!bucket_objs.empty());
+  lock_oid = bucket_objs.begin()->second;
+
+  int duration = cct->_conf->rgw_reshard_lock_duration;
+  reshard_lock.set_duration(utime_t(duration, 0));
+  ret = reshard_lock.lock_exclusive(&lock_ctx, lock_oid);
+  if (ret == -EBUSY) {
+    ldout(cct, 0) << "bucket " << bucket_info.bucket << " is already being resharded" << dendl;
+    return ret;
+  }
+  if (ret < 0) {
+    lderr(cct) << "ERROR: failed to lock " << lock_oid << ": " << cpp_strerror(-ret) << dendl;
+    return ret;
+  }
+  lock_renew = ceph_clock_now(cct) + utime_t(duration / 2, 0);
+  return 0;
+}
+
+int RGWBucketReshard::renew_lock()
+{
+  CephContext *cct = store->ctx();
+  utime_t now = ceph_clock_now(cct);
+  if (now < lock_renew) {
+    return 0;
+  }
+  reshard_lock.set_renew(true);
+  int ret = reshard_lock.lock_exclusive(&lock_ctx, lock_oid);
+  reshard_lock.set_renew(false);
+  if (ret < 0) {
+    lderr(cct) << "ERROR: failed to renew lock on " << lock_oid << ": " << cpp_strerror(-ret) << dendl;
+    return ret;
+  }
+  lock_renew = now + utime_t(cct->_conf->rgw_reshard_lock_duration / 2, 0);
+  return 0;
+}
+
+void RGWBucketReshard::unlock_bucket()
+{
+  int ret = reshard_lock.unlock(&lock_ctx, lock_oid);
+  if (ret < 0) {
+    ldout(store->ctx(), 0) << "WARNING: failed to unlock " << lock_oid << ": " << cpp_strerror(-ret) << dendl;
+  }
+}
+
+int RGWBucketReshard::set_reshard_status(RGWBucketReshardStatus status, const string& new_instance_id)
+{
+  bucket_info.reshard_status = status;
+  bucket_info.new_bucket_instance_id = new_instance_id;
+
+  /* fails with -ECANCELED if the bucket instance changed under us */
+  int ret = store->put_bucket_instance_info(bucket_info, false, real_time(), &bucket_attrs);
+  if (ret < 0) {
+    lderr(store->ctx()) << "ERROR: failed to set reshard status of bucket " << bucket_info.bucket
+                        << ": " << cpp_strerror(-ret) << dendl;
+    return ret;
+  }
+  return 0;
+}
+
+int RGWBucketReshard::create_new_bucket_instance(int new_num_shards, RGWBucketInfo& new_bucket_info)
+{
+  new_bucket_info = bucket_info;
+  store->create_bucket_id(&new_bucket_info.bucket.bucket_id);
+  new_bucket_info.bucket.oid.clear();
+
+  new_bucket_info.num_shards = new_num_shards;
+  new_bucket_info.objv_tracker.clear();
+  new_bucket_info.reshard_status = RGW_RESHARD_NONE;
+  new_bucket_info.new_bucket_instance_id.clear();
+
+  int ret = store->init_bucket_index(new_bucket_info.bucket, new_bucket_info.num_shards);
+  if (ret < 0) {
+    lderr(store->ctx()) << "ERROR: failed to init new bucket indexes: " << cpp_strerror(-ret) << dendl;
+    return ret;
+  }
+
+  ret = store->put_bucket_instance_info(new_bucket_info, true, real_time(), &bucket_attrs);
+  if (ret < 0) {
+    lderr(store->ctx()) << "ERROR: failed to store new bucket instance info: " << cpp_strerror(-ret) << dendl;
+    return ret;
+  }
+
+  return 0;
+}
+
+int RGWBucketReshard::check_exclusive_put(RGWBucketInfo& new_bucket_info)
+{
+  librados::IoCtx index_ctx;
+  map<int, string> bucket_objs;
+  int ret = store->open_bucket_index(new_bucket_info.bucket, index_ctx, bucket_objs);
+  if (ret < 0) {
+    return ret;
+  }
+
+  for (auto& i : bucket_objs) {
+    ret = cls_rgw_bi_put_exclusive_probe(index_ctx, i.second);
+    if (ret == -EOPNOTSUPP) {
+      lderr(store->ctx()) << "ERROR: the OSD holding " << i.second << " does not support the exclusive bi_put;"
+                          << " upgrade all OSDs before resharding online" << dendl;
+      return ret;
+    }
+    if (ret < 0) {
+      lderr(store->ctx()) << "ERROR: failed to probe " << i.second << ": " << cpp_strerror(-ret) << dendl;
+      return ret;
+    }
+  }
+  return 0;
+}
+
+int RGWBucketReshard::do_reshard(RGWBucketInfo& new_bucket_info, int max_entries,
+                                 bool verbose, ostream *out, Formatter *formatter)
+{
+  int num_source_shards = (bucket_info.num_shards > 0 ? bucket_info.num_shards : 1);
+  int num_target_shards = (new_bucket_info.num_shards > 0 ? new_bucket_info.num_shards : 1);
+
+  BucketReshardManager target_shards_mgr(store, new_bucket_info, num_target_shards);
+
+  verbose = verbose && formatter && out;
+
+  if (verbose) {
+    formatter->open_array_section("entries");
+  }
+
+  uint64_t total_entries = 0;
+
+  if (!verbose && out) {
+    *out << "total entries:";
+  }
+
+  for (int i = 0; i < num_source_shards; ++i) {
+    bool is_truncated = true;
+    string marker;
+    while (is_truncated) {
+      list<rgw_cls_bi_entry> entries;
+      int ret = store->bi_list(bucket_info.bucket, i, string(), marker, max_entries, &entries, &is_truncated);
+      if (ret < 0) {
+        lderr(store->ctx()) << "ERROR: bi_list(): " << cpp_strerror(-ret) << dendl;
+        return ret;
+      }
+
+      vector<copied_entry_t> batch;
+      batch.reserve(entries.size());
+
+      for (auto& entry : entries) {
+        if (verbose) {
+          formatter->open_object_section("entry");
+
+          encode_json("shard_id", i, formatter);
+          encode_json("num_entry", total_entries, formatter);
+          encode_json("entry", entry, formatter);
+        }
+        total_entries++;
+
+        int target_shard_id;
+        cls_rgw_obj_key cls_key;
+        uint8_t category;
+        rgw_bucket_category_stats stats;
+        entry.get_info(&cls_key, &category, &stats);
+        rgw_obj_key key(cls_key);
+        rgw_obj obj(new_bucket_info.bucket, key);
+        ret = store->get_target_shard_id(new_bucket_info, obj.get_hash_object(), &target_shard_id);
+        if (ret < 0) {
+          lderr(store->ctx()) << "ERROR: get_target_shard_id() returned ret=" << ret << dendl;
+          return ret;
+        }
+
+        int shard_index = (target_shard_id > 0 ? target_shard_id : 0);
+
+        ret = target_shards_mgr.add_entry(shard_index, entry);
+        if (ret < 0) {
+          return ret;
+        }
+        batch.push_back(copied_entry_t(shard_index, entry));
+
+        if (verbose) {
+          formatter->close_section();
+          formatter->flush(*out);
+        } else if (out && !(total_entries % 1000)) {
+          *out << " " << total_entries;
+        }
+      }
+
+      ret = target_shards_mgr.flush();
+      if (ret < 0) {
+        return ret;
+      }
+
+      ret = remove_vanished_entries(store, bucket_info, i, marker, max_entries, batch, target_shards_mgr);
+      if (ret < 0) {
+        return ret;
+      }
+
+      if (!entries.empty()) {
+        marker = entries.back().idx;
+      }
+
+      ret = renew_lock();
+      if (ret < 0) {
+        return ret;
+      }
+    }
+  }
+
+  if (verbose) {
+    formatter->close_section();
+    formatter->flush(*out);
+  } else if (out) {
+    *out << " " << total_entries << std::endl;
+  }
+
+  return 0;
+}
+
+int RGWBucketReshard::switch_bucket(RGWBucketInfo& new_bucket_info)
+{
+  RGWObjectCtx obj_ctx(store);
+  RGWBucketEntryPoint ep;
+  RGWObjVersionTracker ot;
+  map<string, bufferlist> attrs;
+  rgw_bucket& bucket = bucket_info.bucket;
+
+  int ret = store->get_bucket_entrypoint_info(obj_ctx, bucket.tenant, bucket.name, ep, &ot, NULL, &attrs);
+  if (ret < 0) {
+    lderr(store->ctx()) << "ERROR: failed to read entrypoint of bucket " << bucket << ": " << cpp_strerror(-ret) << dendl;
+    return ret;
+  }
+  if (ep.bucket.bucket_id != bucket.bucket_id) {
+    lderr(store->ctx()) << "ERROR: bucket " << bucket.name << " now points at instance " << ep.bucket.bucket_id
+                        << ", not resharding it" << dendl;
+    return -ECANCELED;
+  }
+
+  ep.bucket = new_bucket_info.bucket;
+  ret = store->put_bucket_entrypoint_info(bucket.tenant, bucket.name, ep, false, ot, real_time(), &attrs);
+  if (ret < 0) {
+    lderr(store->ctx()) << "ERROR: failed to link bucket " << bucket.name << " to instance "
+                        << new_bucket_info.bucket.bucket_id << ": " << cpp_strerror(-ret) << dendl;
+    return ret;
+  }
+
+  return 0;
+}
+
+int RGWBucketReshard::execute(int num_shards, int max_entries, bool allow_versioned,
+                              bool verbose, ostream *out, Formatter *formatter)
+{
+  CephContext *cct = store->ctx();
+
+  if (!bucket_info.has_instance_obj) {
+    lderr(cct) << "ERROR: bucket " << bucket_info.bucket << " has no bucket instance, cannot reshard it" << dendl;
+    return -ENOTSUP;
+  }
+  if (bucket_info.reshard_status == RGW_RESHARD_DONE) {
+    lderr(cct) << "ERROR: bucket instance " << bucket_info.bucket << " was already resharded" << dendl;
+    return -EINVAL;
+  }
+  if (bucket_info.versioned()) {
+    if (!allow_versioned) {
+      lderr(cct) << "ERROR: bucket " << bucket_info.bucket << " is versioned; versioned object"
+                 << " changes made while resharding may be missing from the new index" << dendl;
+      return -EOPNOTSUPP;
+    }
+    ldout(cct, 0) << "WARNING: bucket " << bucket_info.bucket << " is versioned; versioned object"
+                  << " changes made while resharding may be missing from the new index" << dendl;
+  }
+
+  int ret = lock_bucket();
+  if (ret < 0) {
+    return ret;
+  }
+
+  if (bucket_info.reshard_status == RGW_RESHARD_IN_PROGRESS) {
+    /* we hold the lock, so whoever started this is gone; start over */
+    ldout(cct, 0) << "bucket " << bucket_info.bucket << ": abandoning unfinished reshard to instance "
+                  << bucket_info.new_bucket_instance_id << dendl;
+  }
+
+  RGWBucketInfo new_bucket_info;
+  ret = create_new_bucket_instance(num_shards, new_bucket_info);
+  if (ret < 0) {
+    unlock_bucket();
+    return ret;
+  }
+
+  /* older OSDs would overwrite what the gateways write during the copy */
+  ret = check_exclusive_put(new_bucket_info);
+  if (ret < 0) {
+    goto fail;
+  }
+
+  if (out) {
+    *out << "*** NOTICE: operation will not remove old bucket index objects ***" << std::endl;
+    *out << "***         these will need to be removed manually             ***" << std::endl;
+    *out << "old bucket instance id: " << bucket_info.bucket.bucket_id << std::endl;
+    *out << "new bucket instance id: " << new_bucket_info.bucket.bucket_id << std::endl;
+  }
+
+  ret = set_reshard_status(RGW_RESHARD_IN_PROGRESS, new_bucket_info.bucket.bucket_id);
+  if (ret < 0) {
+    unlock_bucket();
+    return ret;
+  }
+
+  /* let every gateway pick up the new bucket info before copying */
+  for (int i = 0; i < cct->_conf->rgw_reshard_dual_write_grace; ++i) {
+    sleep(1);
+    ret = renew_lock();
+    if (ret < 0) {
+      goto fail;
+    }
+  }
+
+  ret = do_reshard(new_bucket_info, max_entries, verbose, out, formatter);
+  if (ret < 0) {
+    goto fail;
+  }
+
+  ret = store->bucket_rebuild_index(new_bucket_info.bucket);
+  if (ret < 0) {
+    lderr(cct) << "ERROR: failed to rebuild stats of the new index: " << cpp_strerror(-ret) << dendl;
+    goto fail;
+  }
+
+  ret = switch_bucket(new_bucket_info);
+  if (ret < 0) {
+    goto fail;
+  }
+
+  /*
+   * Gateways still holding the old bucket info keep updating both
+   * indexes until they see this, or the new entrypoint.
+   */
+  ret = set_reshard_status(RGW_RESHARD_DONE, new_bucket_info.bucket.bucket_id);
+  if (ret < 0) {
+    ldout(cct, 0) << "WARNING: bucket " << bucket_info.bucket << " was resharded, but is not marked so" << dendl;
+  }
+
+  unlock_bucket();
+  ldout(cct, 1) << "resharded bucket " << bucket_info.bucket.name << " from instance " << bucket_info.bucket.bucket_id
+                << " to " << new_bucket_info.bucket.bucket_id << " with " << num_shards << " shards" << dendl;
+  return 0;
+
+fail:
+  /* the old index is complete, stop the double updates */
+  if (set_reshard_status(RGW_RESHARD_NONE, string()) < 0) {
+    lderr(cct) << "ERROR: bucket " << bucket_info.bucket << " is left marked as being resharded" << dendl;
+  }
+  unlock_bucket();
+  return ret;
+}
+
+int RGWBucketReshard::clear_stale()
+{
+  if (bucket_info.reshard_status != RGW_RESHARD_IN_PROGRESS) {
+    return 0;
+  }
+
+  /* the lock outlives the reshard by rgw_reshard_lock_duration at most */
+  int ret = lock_bucket();
+  if (ret < 0) {
+    return ret;
+  }
+
+  ldout(store->ctx(), 0) << "bucket " << bucket_info.bucket << ": clearing unfinished reshard to instance "
+                         << bucket_info.new_bucket_instance_id << dendl;
+  ret = set_reshard_status(RGW_RESHARD_NONE, string());
+  unlock_bucket();
+  return ret;
+}
+
+RGWReshard::RGWReshard(RGWRados *_store) : cct(_store->ctx()), store(_store), worker(NULL)
+{
+}
+
+int RGWReshard::check_bucket(const string& bucket_key)
+{
+  rgw_bucket bucket;
+  int shard_id;
+  int ret = rgw_bucket_parse_bucket_key(cct, bucket_key, &bucket, &shard_id);
+  if (ret < 0) {
+    return ret;
+  }
+
+  RGWObjectCtx obj_ctx(store);
+  RGWBucketInfo bucket_info;
+  map<string, bufferlist> attrs;
+  ret = store->get_bucket_info(obj_ctx, bucket.tenant, bucket.name, bucket_info, NULL, &attrs);
+  if (ret < 0) {
+    return ret;
+  }
+
+  if (bucket_info.reshard_status == RGW_RESHARD_IN_PROGRESS) {
+    /* a reshard that died keeps the gateways writing to both indexes */
+    RGWBucketReshard br(store, bucket_info, attrs);
+    ret = br.clear_stale();
+    if (ret == -EBUSY) {
+      return 0;
+    }
+    /* if it still needs it, the bucket is resharded on the next pass */
+    return ret;
+  }
+
+  /* the object versioning index entries are not kept up to date while resharding */
+  if (bucket_info.index_type != RGWBIType_Normal || bucket_info.versioned() ||
+      bucket_info.resharding()) {
+    return 0;
+  }
+
+  map<string, struct rgw_bucket_dir_header> headers;
+  ret = store->cls_bucket_head(bucket_info.bucket, RGW_NO_SHARD, headers);
+  if (ret < 0) {
+    return ret;
+  }
+
+  uint64_t num_objs = 0;
+  for (auto& header : headers) {
+    for (auto& stats : header.second.stats) {
+      num_objs += stats.second.num_entries;
+    }
+  }
+
+  uint64_t max_objs_per_shard = cct->_conf->rgw_max_objs_per_shard;
+  int num_shards = (bucket_info.num_shards > 0 ? bucket_info.num_shards : 1);
+  if (num_objs <= max_objs_per_shard * num_shards) {
+    return 0;
+  }
+
+  /* leave room to grow to twice the size before the next reshard */
+  uint64_t new_num_shards = (num_objs * 2 + max_objs_per_shard - 1) / max_objs_per_shard;
+  new_num_shards = MIN(new_num_shards, store->get_max_bucket_shards());
+  if (new_num_shards <= (uint64_t)num_shards) {
+    ldout(cct, 10) << "bucket " << bucket_info.bucket << " has " << num_objs << " objects, but cannot get more than "
+                   << num_shards << " index shards" << dendl;
+    return 0;
+  }
+
+  ldout(cct, 1) << "bucket " << bucket_info.bucket << " has " << num_objs << " objects in " << num_shards
+                << " index shards, resharding to " << new_num_shards << dendl;
+
+  RGWBucketReshard br(store, bucket_info, attrs);
+  return br.execute(new_num_shards, 1000);
+}
+
+int RGWReshard::process()
+{
+  rados::cls::lock::Lock l(reshard_lock_name);
+  l.set_duration(utime_t(cct->_conf->rgw_reshard_thread_interval, 0));
+
+  int ret = l.lock_exclusive(&store->gc_pool_ctx, reshard_oid);
+  if (ret == -EBUSY) { /* another gateway is going over the buckets */
+    ldout(cct, 10) << "RGWReshard::process() failed to acquire lock on " << reshard_oid << dendl;
+    return 0;
+  }
+  if (ret < 0) {
+    return ret;
+  }
+
+  string section = "bucket";
+  void *handle;
+  ret = store->meta_mgr->list_keys_init(section, &handle);
+  if (ret < 0) {
+    lderr(cct) << "ERROR: failed to list buckets: " << cpp_strerror(-ret) << dendl;
+    l.unlock(&store->gc_pool_ctx, reshard_oid);
+    return ret;
+  }
+
+  bool truncated = true;
+  while (truncated && !going_down()) {
+    list<string> keys;
+    ret = store->meta_mgr->list_keys_next(handle, 1000, keys, &truncated);
+    if (ret < 0) {
+      lderr(cct) << "ERROR: failed to list buckets: " << cpp_strerror(-ret) << dendl;
+      break;
+    }
+
+    for (auto& key : keys) {
+      if (going_down()) {
+        break;
+      }
+      int r = check_bucket(key);
+      if (r < 0 && r != -ENOENT && r != -EBUSY) {
+        ldout(cct, 0) << "WARNING: failed to reshard bucket " << key << ": " << cpp_strerror(-r) << dendl;
+      }
+    }
+  }
+  store->meta_mgr->list_keys_complete(handle);
+
+  l.unlock(&store->gc_pool_ctx, reshard_oid);
+  return (ret < 0 ? ret : 0);
+}
+
+bool RGWReshard::going_down()
+{
+  return (down_flag.read() != 0);
+}
+
+void RGWReshard::start_processor()
+{
+  worker = new ReshardWorker(cct, this);
+  worker->create("rgw_reshard");
+}
+
+void RGWReshard::stop_processor()
+{
+  down_flag.set(1);
+  if (worker) {
+    worker->stop();
+    worker->join();
+  }
+  delete worker;
+  worker = NULL;
+}
+
+void *RGWReshard::ReshardWorker::entry() {
+  do {
+    utime_t start = ceph_clock_now(cct);
+    ldout(cct, 2) << "dynamic resharding: start" << dendl;
+    int r = reshard->process();
+    if (r < 0) {
+      ldout(cct, 0) << "ERROR: dynamic resharding process() returned error r=" << r << dendl;
+    }
+    ldout(cct, 2) << "dynamic resharding: stop" << dendl;
+
+    if (reshard->going_down())
+      break;
+
+    utime_t end = ceph_clock_now(cct);
+    end -= start;
+    int secs = cct->_conf->rgw_reshard_thread_interval;
+
+    if (secs <= end.sec())
+      continue; // next round
+
+    secs -= end.sec();
+
+    lock.Lock();
+    cond.WaitInterval(cct, lock, utime_t(secs, 0));
+    lock.Unlock();
+  } while (!reshard->going_down());
+
+  return NULL;
+}
+
+void RGWReshard::ReshardWorker::stop()
+{
+  Mutex::Locker l(lock);
+  cond.Signal();
+}
@@ -0,0 +1,120 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+
+#ifndef CEPH_RGW_RESHARD_H
+#define CEPH_RGW_RESHARD_H
+
+#include <ostream>
+
+#include "include/types.h"
+#include "include/atomic.h"
+#include "include/rados/librados.hpp"
+#include "common/Mutex.h"
+#include "common/Cond.h"
+#include "common/Thread.h"
+#include "common/Formatter.h"
+#include "cls/lock/cls_lock_client.h"
+#include "rgw_common.h"
+#include "rgw_rados.h"
+
+/*
+ * Moves the index of a bucket to a new bucket instance with a different
+ * number of shards, while the bucket stays writable:
+ *
+ *  - the bucket instance is marked RGW_RESHARD_IN_PROGRESS, which makes
+ *    gateways apply every index update to the new index as well;
+ *  - after rgw_reshard_dual_write_grace seconds, long enough for every
+ *    gateway to see the mark, the old entries are copied over without
+ *    replacing those the gateways have written in the meantime;
+ *  - the bucket entrypoint is switched to the new instance.
+ *
+ * The copy relies on the exclusive bi_put; the OSDs holding the new
+ * index are probed for it first.  A reshard that dies leaves the bucket
+ * marked in progress; once its lock on the old index has expired, the
+ * next reshard of the bucket, or clear_stale(), takes the mark off.
+ *
+ * The old index objects are left in place.
+ */
+class RGWBucketReshard {
+  RGWRados *store;
+  RGWBucketInfo bucket_info;
+  map<string, bufferlist> bucket_attrs;
+
+  rados::cls::lock::Lock reshard_lock;
+  librados::IoCtx lock_ctx;
+  string lock_oid;
+  utime_t lock_renew;
+
+  int lock_bucket();
+  int renew_lock();
+  void unlock_bucket();
+  int set_reshard_status(RGWBucketReshardStatus status, const string& new_instance_id);
+  int create_new_bucket_instance(int new_num_shards, RGWBucketInfo& new_bucket_info);
+  int check_exclusive_put(RGWBucketInfo& new_bucket_info);
+  int do_reshard(RGWBucketInfo& new_bucket_info, int max_entries,
+                 bool verbose, ostream *out, Formatter *formatter);
+  int switch_bucket(RGWBucketInfo& new_bucket_info);
+
+public:
+  RGWBucketReshard(RGWRados *_store, const RGWBucketInfo& _bucket_info,
+                   const map<string, bufferlist>& _bucket_attrs);
+
+  /*
+   * @param max_entries number of entries read from the old index at once
+   * @param allow_versioned reshard a versioned bucket even though its
+   *                        olh and instance entries may not all make it
+   * @param out if set, progress is reported there, or to formatter as
+   *            the copied entries if verbose
+   */
+  int execute(int num_shards, int max_entries, bool allow_versioned = false,
+              bool verbose = false, ostream *out = nullptr, Formatter *formatter = nullptr);
+
+  /*
+   * take the in progress mark off a bucket whose reshard died
+   *
+   * @return -EBUSY if the reshard is still running
+   */
+  int clear_stale();
+};
+
+/*
+ * Background resharding: every rgw_reshard_thread_interval seconds one
+ * gateway goes over the buckets and reshards those holding more than
+ * rgw_max_objs_per_shard entries per index shard.
+ */
+class RGWReshard {
+  CephContext *cct;
+  RGWRados *store;
+  atomic_t down_flag;
+
+  class ReshardWorker : public Thread {
+    CephContext *cct;
+    RGWReshard *reshard;
+    Mutex lock;
+    Cond cond;
+
+  public:
+    ReshardWorker(CephContext *_cct, RGWReshard *_reshard) : cct(_cct), reshard(_reshard), lock("ReshardWorker") {}
+    void *entry();
+    void stop();
+  };
+
+  ReshardWorker *worker;
+
+  int check_bucket(const string& bucket_key);
+
+public:
+  explicit RGWReshard(RGWRados *_store);
+  ~RGWReshard() {
+    stop_processor();
+  }
+
+  /* one pass over all the buckets */
+  int process();
+
+  bool going_down();
+  void start_processor();
+  void stop_processor();
+};
+
+#endif
@@ -423,33 +423,28 @@ int rgw_delete_user(RGWRados *store, RGWUserInfo& info, RGWObjVersionTracker& ob
     done = (buckets.size() < max_buckets);
   } while (!done);
 
+  /* the key, swift name and email indexes go in one batch */
+  list<rgw_obj> index_objs;
+
   map<string, RGWAccessKey>::iterator kiter = info.access_keys.begin();
   for (; kiter != info.access_keys.end(); ++kiter) {
     ldout(store->ctx(), 10) << "removing key index: " << kiter->first << dendl;
-    ret = rgw_remove_key_index(store, kiter->second);
-    if (ret < 0 && ret != -ENOENT) {
-      ldout(store->ctx(), 0) << "ERROR: could not remove " << kiter->first << " (access key object), should be fixed (err=" << ret << ")" << dendl;
-      return ret;
-    }
+    index_objs.push_back(rgw_obj(store->get_zone_params().user_keys_pool, kiter->second.id));
   }
 
   map<string, RGWAccessKey>::iterator siter = info.swift_keys.begin();
   for (; siter != info.swift_keys.end(); ++siter) {
     RGWAccessKey& k = siter->second;
     ldout(store->ctx(), 10) << "removing swift subuser index: " << k.id << dendl;
-    /* check if swift mapping exists */
-    ret = rgw_remove_swift_name_index(store, k.id);
-    if (ret < 0 && ret != -ENOENT) {
-      ldout(store->ctx(), 0) << "ERROR: could not remove " << k.id << " (swift name object), should be fixed (err=" << ret << ")" << dendl;
-      return ret;
-    }
+    index_objs.push_back(rgw_obj(store->get_zone_params().user_swift_pool, k.id));
   }
 
-  rgw_obj email_obj(store->get_zone_params().user_email_pool, info.user_email);
   ldout(store->ctx(), 10) << "removing email index: " << info.user_email << dendl;
-  ret = store->delete_system_obj(email_obj);
-  if (ret < 0 && ret != -ENOENT) {
-    ldout(store->ctx(), 0) << "ERROR: could not remove " << info.user_id << ":" << email_obj << ", should be fixed (err=" << ret << ")" << dendl;
+  index_objs.push_back(rgw_obj(store->get_zone_params().user_email_pool, info.user_email));
+
+  ret = store->delete_system_objs(index_objs);
+  if (ret < 0) {
+    ldout(store->ctx(), 0) << "ERROR: could not remove the key, swift name and email indexes of " << info.user_id << ", should be fixed (err=" << ret << ")" << dendl;
     return ret;
   }
 
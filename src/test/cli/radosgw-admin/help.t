@@ -88,6 +88,7 @@
     gc process                 manually process garbage
     lc list                    list all bucket lifecycle progress
     lc process                 manually process lifecycle
+    reshard process            reshard the buckets that have outgrown their index
     metadata get               get metadata info
     metadata put               put metadata info
     metadata rm                remove metadata info
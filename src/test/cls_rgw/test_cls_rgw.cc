@@ -544,6 +544,89 @@ TEST(cls_rgw, gc_defer)
 }
 
 
+static void bi_get_entry(librados::IoCtx& ioctx, const string& oid, const string& name,
+                         rgw_cls_bi_entry *entry, rgw_bucket_dir_entry *dirent)
+{
+  cls_rgw_obj_key key(name, string());
+  ASSERT_EQ(0, cls_rgw_bi_get(ioctx, oid, PlainIdx, key, entry));
+  bufferlist::iterator iter = entry->data.begin();
+  ::decode(*dirent, iter);
+}
+
+static void bi_put_entry(librados::IoCtx& ioctx, const string& oid, const string& name,
+                         rgw_bucket_dir_entry& dirent, bool exclusive)
+{
+  rgw_cls_bi_entry entry;
+  entry.type = PlainIdx;
+  entry.idx = name;
+  ::encode(dirent, entry.data);
+  ObjectWriteOperation op;
+  cls_rgw_bi_put(op, oid, entry, exclusive);
+  ASSERT_EQ(0, ioctx.operate(oid, &op));
+}
+
+TEST(cls_rgw, bi_put_exclusive)
+{
+  string bucket_oid = str_int("bucket", 5);
+
+  OpMgr mgr;
+
+  ObjectWriteOperation *op = mgr.write_op();
+  cls_rgw_bucket_init(*op);
+  ASSERT_EQ(0, ioctx.operate(bucket_oid, op));
+
+  ASSERT_EQ(0, cls_rgw_bi_put_exclusive_probe(ioctx, bucket_oid));
+
+  string obj = "obj";
+  string tag = "tag";
+  string loc = "loc";
+  index_prepare(mgr, ioctx, bucket_oid, CLS_RGW_OP_ADD, tag, obj, loc);
+  rgw_bucket_dir_entry_meta meta;
+  meta.category = 0;
+  meta.size = 100;
+  index_complete(mgr, ioctx, bucket_oid, CLS_RGW_OP_ADD, tag, 1, obj, meta);
+
+  rgw_cls_bi_entry entry;
+  rgw_bucket_dir_entry dirent;
+  bi_get_entry(ioctx, bucket_oid, obj, &entry, &dirent);
+  ASSERT_TRUE(dirent.exists);
+  ASSERT_EQ(100u, dirent.meta.size);
+
+  /* an existing entry is left alone */
+  rgw_bucket_dir_entry older = dirent;
+  older.meta.size = 50;
+  bi_put_entry(ioctx, bucket_oid, obj, older, true);
+  bi_get_entry(ioctx, bucket_oid, obj, &entry, &dirent);
+  ASSERT_EQ(100u, dirent.meta.size);
+
+  /* unlike with the plain bi_put */
+  bi_put_entry(ioctx, bucket_oid, obj, older, false);
+  bi_get_entry(ioctx, bucket_oid, obj, &entry, &dirent);
+  ASSERT_EQ(50u, dirent.meta.size);
+
+  /* a missing entry is created */
+  string obj2 = "obj2";
+  rgw_bucket_dir_entry dirent2 = older;
+  dirent2.key.name = obj2;
+  bi_put_entry(ioctx, bucket_oid, obj2, dirent2, true);
+  bi_get_entry(ioctx, bucket_oid, obj2, &entry, &dirent);
+  ASSERT_TRUE(dirent.exists);
+  ASSERT_EQ(50u, dirent.meta.size);
+
+  /* so is one left behind by a cancelled operation */
+  string obj3 = "obj3";
+  rgw_bucket_dir_entry stale = older;
+  stale.key.name = obj3;
+  stale.exists = false;
+  bi_put_entry(ioctx, bucket_oid, obj3, stale, false);
+  rgw_bucket_dir_entry dirent3 = older;
+  dirent3.key.name = obj3;
+  bi_put_entry(ioctx, bucket_oid, obj3, dirent3, true);
+  bi_get_entry(ioctx, bucket_oid, obj3, &entry, &dirent);
+  ASSERT_TRUE(dirent.exists);
+  ASSERT_EQ(50u, dirent.meta.size);
+}
+
 /* must be last test! */
 
 TEST(cls_rgw, finalize)
@@ -0,0 +1,193 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+
+#include "gtest/gtest.h"
+#include "common/mClockPriorityQueue.h"
+
+#include <map>
+
+class mClockQueueTest : public testing::Test
+{
+protected:
+  typedef int Klass;
+  typedef unsigned Item;
+  typedef mClockQueue<Item, Klass> Q;
+
+  double now = 1000.0;
+  std::map<Klass, mClockClientInfo> infos;
+
+  Q make_queue() {
+    return Q([this](const Klass& k) {
+	auto it = infos.find(k);
+	return it == infos.end() ? mClockClientInfo(0, 1, 0) : it->second;
+      },
+      [this]() { return now; });
+  }
+
+  // klass of each item is item / 1000
+  void fill(Q &q, Klass k, unsigned n) {
+    for (unsigned i = 0; i < n; ++i) {
+      q.enqueue(k, 0, 0, Item(k * 1000 + i));
+    }
+  }
+};
+
+TEST_F(mClockQueueTest, capacity) {
+  Q q = make_queue();
+  EXPECT_TRUE(q.empty());
+  EXPECT_EQ(0u, q.length());
+
+  q.enqueue_strict(Klass(1), 0, Item(0));
+  EXPECT_FALSE(q.empty());
+  EXPECT_EQ(1u, q.length());
+
+  fill(q, Klass(1), 3);
+  for (unsigned i = 4; i > 0; i--) {
+    EXPECT_FALSE(q.empty());
+    EXPECT_EQ(i, q.length());
+    q.dequeue();
+  }
+  EXPECT_TRUE(q.empty());
+  EXPECT_EQ(0u, q.length());
+}
+
+TEST_F(mClockQueueTest, strict_first) {
+  Q q = make_queue();
+  fill(q, Klass(1), 5);
+  q.enqueue_strict(Klass(2), 10, Item(2000));
+  q.enqueue_strict(Klass(2), 20, Item(2001));
+  q.enqueue_strict_front(Klass(2), 10, Item(2002));
+
+  EXPECT_EQ(Item(2001), q.dequeue());
+  EXPECT_EQ(Item(2002), q.dequeue());
+  EXPECT_EQ(Item(2000), q.dequeue());
+  for (unsigned i = 0; i < 5; ++i) {
+    EXPECT_EQ(Item(1000 + i), q.dequeue());
+  }
+}
+
+TEST_F(mClockQueueTest, weight) {
+  infos.emplace(1, mClockClientInfo(0, 1, 0));
+  infos.emplace(2, mClockClientInfo(0, 3, 0));
+  Q q = make_queue();
+  fill(q, Klass(1), 100);
+  fill(q, Klass(2), 100);
+
+  std::map<Klass, unsigned> served;
+  for (unsigned i = 0; i < 80; ++i) {
+    ++served[q.dequeue() / 1000];
+  }
+  EXPECT_NEAR(20u, served[1], 1u);
+  EXPECT_NEAR(60u, served[2], 1u);
+}
+
+TEST_F(mClockQueueTest, reservation) {
+  // klass 1 has a tiny weight but 100 ops/s reserved
+  infos.emplace(1, mClockClientInfo(100, 0.001, 0));
+  infos.emplace(2, mClockClientInfo(0, 100, 0));
+  Q q = make_queue();
+  fill(q, Klass(1), 100);
+  fill(q, Klass(2), 1000);
+
+  std::map<Klass, unsigned> served;
+  for (unsigned step = 0; step < 10; ++step) {
+    for (unsigned i = 0; i < 50; ++i) {
+      ++served[q.dequeue() / 1000];
+    }
+    now += 0.1;
+  }
+  // one op due every 10ms from the first dequeue through the last
+  EXPECT_NEAR(91u, served[1], 1u);
+  EXPECT_EQ(500u, served[1] + served[2]);
+}
+
+TEST_F(mClockQueueTest, limit) {
+  // klass 1 would win on weight but is capped at 10 ops/s
+  infos.emplace(1, mClockClientInfo(0, 100, 10));
+  infos.emplace(2, mClockClientInfo(0, 1, 0));
+  Q q = make_queue();
+  fill(q, Klass(1), 100);
+  fill(q, Klass(2), 100);
+
+  std::map<Klass, unsigned> served;
+  for (unsigned step = 0; step < 10; ++step) {
+    for (unsigned i = 0; i < 10; ++i) {
+      ++served[q.dequeue() / 1000];
+    }
+    now += 0.1;
+  }
+  EXPECT_NEAR(10u, served[1], 1u);
+  EXPECT_NEAR(90u, served[2], 1u);
+}
+
+TEST_F(mClockQueueTest, limit_break) {
+  infos.emplace(1, mClockClientInfo(0, 1, 1));
+  Q q = make_queue();
+  fill(q, Klass(1), 10);
+
+  // nothing else to do: the limit must not stall the queue
+  for (unsigned i = 0; i < 10; ++i) {
+    EXPECT_EQ(Item(1000 + i), q.dequeue());
+  }
+  EXPECT_TRUE(q.empty());
+}
+
+TEST_F(mClockQueueTest, enqueue_front) {
+  Q q = make_queue();
+  fill(q, Klass(1), 3);
+  Item first = q.dequeue();
+  q.enqueue_front(Klass(1), 0, 0, first);
+  for (unsigned i = 0; i < 3; ++i) {
+    EXPECT_EQ(Item(1000 + i), q.dequeue());
+  }
+}
+
+TEST_F(mClockQueueTest, remove_by_class) {
+  Q q = make_queue();
+  fill(q, Klass(1), 5);
+  fill(q, Klass(2), 5);
+  q.enqueue_strict(Klass(2), 10, Item(2999));
+
+  std::list<Item> removed;
+  q.remove_by_class(Klass(2), &removed);
+  EXPECT_EQ(6u, removed.size());
+  EXPECT_EQ(5u, q.length());
+  while (!q.empty()) {
+    EXPECT_EQ(1u, q.dequeue() / 1000);
+  }
+}
+
+TEST_F(mClockQueueTest, remove_by_filter) {
+  Q q = make_queue();
+  fill(q, Klass(1), 10);
+  fill(q, Klass(2), 10);
+
+  q.remove_by_filter([](Item i) { return i % 2 == 0; });
+  EXPECT_EQ(10u, q.length());
+  while (!q.empty()) {
+    EXPECT_EQ(1u, q.dequeue() % 2);
+  }
+}
+
+TEST_F(mClockQueueTest, clean_idle_clients) {
+  // no reservation and no limit
+  Q q = make_queue();
+  fill(q, Klass(1), 1);
+  q.dequeue();
+  now += 10;
+
+  // enough dequeues to clean up, with klass 2 still busy
+  fill(q, Klass(2), 1100);
+  for (unsigned i = 0; i < 1050; ++i) {
+    EXPECT_EQ(2u, q.dequeue() / 1000);
+  }
+
+  JSONFormatter f;
+  f.open_object_section("queue");
+  q.dump(&f);
+  f.close_section();
+  std::ostringstream ss;
+  f.flush(ss);
+  EXPECT_EQ(std::string::npos, ss.str().find("\"client\":\"1\""));
+  EXPECT_NE(std::string::npos, ss.str().find("\"client\":\"2\""));
+}
@@ -0,0 +1,234 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+/*
+ * Ceph - scalable distributed file system
+ *
+ * This is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License version 2.1, as published by the Free Software
+ * Foundation.  See file COPYING.
+ *
+ */
+
+/*
+ * Compare compression plugins over a corpus of files (by default the
+ * ceph-object-corpus archive).  The corpus is concatenated and cut
+ * into --block-size chunks, roughly what bluestore hands to the
+ * compressor per blob, and each chunk is compressed and decompressed
+ * --repeats times per plugin.  Plugin knobs such as
+ * --compressor_zstd_level are taken from the usual config arguments.
+ */
+
+#include <chrono>
+#include <iomanip>
+#include <dirent.h>
+#include <sys/stat.h>
+
+#include "global/global_init.h"
+#include "global/global_context.h"
+#include "common/ceph_argparse.h"
+#include "common/config.h"
+#include "common/debug.h"
+#include "common/errno.h"
+#include "include/str_list.h"
+#include "common/strtol.h"
+#include "compressor/Compressor.h"
+
+#define dout_subsys ceph_subsys_compressor
+
+static void usage()
+{
+  derr << "usage: ceph_bench_compression [flags]\n"
+      "	 --corpus <dir>\n"
+      "	       directory to read (recursively), default ceph-object-corpus\n"
+      "	 --plugins <a,b,...>\n"
+      "	       compressors to compare, default snappy,zlib,zstd,lz4\n"
+      "	 --block-size <bytes>\n"
+      "	       size of each compressed chunk, default 64K\n"
+      "	 --repeats <n>\n"
+      "	       passes over the corpus per plugin, default 3\n" << dendl;
+  generic_client_usage();
+}
+
+static int read_corpus(const std::string& path, bufferlist& corpus,
+		       unsigned *files)
+{
+  struct stat st;
+  if (::stat(path.c_str(), &st) < 0)
+    return -errno;
+  if (S_ISREG(st.st_mode)) {
+    bufferlist bl;
+    std::string err;
+    int r = bl.read_file(path.c_str(), &err);
+    if (r < 0) {
+      derr << "unable to read " << path << ": " << err << dendl;
+      return r;
+    }
+    corpus.claim_append(bl);
+    ++*files;
+    return 0;
+  }
+  if (!S_ISDIR(st.st_mode))
+    return 0;
+
+  DIR *dir = ::opendir(path.c_str());
+  if (!dir)
+    return -errno;
+  std::list<std::string> children;
+  struct dirent *de;
+  while ((de = ::readdir(dir)) != NULL) {
+    if (strcmp(de->d_name, ".") == 0 || strcmp(de->d_name, "..") == 0)
+      continue;
+    children.push_back(path + "/" + de->d_name);
+  }
+  ::closedir(dir);
+  children.sort();  // stable chunk boundaries between runs
+  for (auto& c : children) {
+    int r = read_corpus(c, corpus, files);
+    if (r < 0)
+      return r;
+  }
+  return 0;
+}
+
+struct result_t {
+  uint64_t raw = 0;
+  uint64_t compressed = 0;
+  double compress_sec = 0;
+  double decompress_sec = 0;
+};
+
+static int bench(CompressorRef cs, const vector<bufferlist>& chunks,
+		 int repeats, result_t *res)
+{
+  typedef std::chrono::steady_clock clock;
+  for (int pass = 0; pass < repeats; ++pass) {
+    for (auto& chunk : chunks) {
+      bufferlist out, back;
+      auto start = clock::now();
+      int r = cs->compress(chunk, out);
+      auto mid = clock::now();
+      if (r < 0)
+	return r;
+      r = cs->decompress(out, back);
+      auto end = clock::now();
+      if (r < 0)
+	return r;
+      if (!back.contents_equal(chunk))
+	return -EIO;
+      res->raw += chunk.length();
+      res->compressed += out.length();
+      res->compress_sec +=
+	std::chrono::duration<double>(mid - start).count();
+      res->decompress_sec +=
+	std::chrono::duration<double>(end - mid).count();
+    }
+  }
+  return 0;
+}
+
+int main(int argc, const char **argv)
+{
+  vector<const char*> args;
+  argv_to_vec(argc, argv, args);
+  env_to_vec(args);
+
+  global_init(NULL, args, CEPH_ENTITY_TYPE_CLIENT, CODE_ENVIRONMENT_UTILITY, 0);
+
+  std::string corpus_dir = "ceph-object-corpus";
+  std::string plugins = "snappy,zlib,zstd,lz4";
+  uint64_t block_size = 65536;
+  int repeats = 3;
+
+  std::string val;
+  vector<const char*>::iterator i = args.begin();
+  while (i != args.end()) {
+    if (ceph_argparse_double_dash(args, i))
+      break;
+    if (ceph_argparse_witharg(args, i, &val, "--corpus", (char*)NULL)) {
+      corpus_dir = val;
+    } else if (ceph_argparse_witharg(args, i, &val, "--plugins", (char*)NULL)) {
+      plugins = val;
+    } else if (ceph_argparse_witharg(args, i, &val, "--block-size", (char*)NULL)) {
+      std::string err;
+      block_size = strict_sistrtoll(val.c_str(), &err);
+      if (!err.empty() || block_size == 0) {
+	derr << "error parsing block-size: " << err << dendl;
+	usage();
+	return 1;
+      }
+    } else if (ceph_argparse_witharg(args, i, &val, "--repeats", (char*)NULL)) {
+      repeats = atoi(val.c_str());
+    } else if (ceph_argparse_flag(args, i, "-h", "--help", (char*)NULL)) {
+      usage();
+      return 0;
+    } else {
+      derr << "Error: can't understand argument: " << *i << "\n" << dendl;
+      usage();
+      return 1;
+    }
+  }
+
+  common_init_finish(g_ceph_context);
+
+  const char* env = getenv("CEPH_LIB");
+  if (env)
+    g_conf->set_val("plugin_dir", env, false, false);
+
+  bufferlist corpus;
+  unsigned files = 0;
+  int r = read_corpus(corpus_dir, corpus, &files);
+  if (r < 0) {
+    derr << "unable to read corpus " << corpus_dir << ": "
+	 << cpp_strerror(r) << dendl;
+    return 1;
+  }
+  if (corpus.length() == 0) {
+    derr << "corpus " << corpus_dir << " is empty" << dendl;
+    return 1;
+  }
+
+  vector<bufferlist> chunks;
+  for (uint64_t off = 0; off < corpus.length(); off += block_size) {
+    bufferlist chunk;
+    chunk.substr_of(corpus, off,
+		    MIN(block_size, corpus.length() - off));
+    chunk.rebuild();
+    chunks.push_back(chunk);
+  }
+
+  cout << "corpus " << corpus_dir << ": " << files << " files, "
+       << corpus.length() << " bytes, " << chunks.size() << " chunks of "
+       << block_size << " bytes, " << repeats << " repeats" << std::endl;
+  cout << std::setw(10) << "plugin"
+       << std::setw(10) << "ratio"
+       << std::setw(16) << "compress MB/s"
+       << std::setw(18) << "decompress MB/s" << std::endl;
+
+  list<string> names;
+  get_str_list(plugins, names);
+  int ret = 0;
+  for (auto& name : names) {
+    CompressorRef cs = Compressor::create(g_ceph_context, name);
+    if (!cs) {
+      cout << std::setw(10) << name << "  (not available)" << std::endl;
+      continue;
+    }
+    result_t res;
+    r = bench(cs, chunks, repeats, &res);
+    if (r < 0) {
+      cout << std::setw(10) << name << "  failed: " << cpp_strerror(r)
+	   << std::endl;
+      ret = 1;
+      continue;
+    }
+    double mb = (double)res.raw / (1024 * 1024);
+    cout << std::setw(10) << name
+	 << std::setw(10) << std::fixed << std::setprecision(3)
+	 << (double)res.raw / res.compressed
+	 << std::setw(16) << std::setprecision(1) << mb / res.compress_sec
+	 << std::setw(18) << mb / res.decompress_sec
+	 << std::endl;
+  }
+  return ret;
+}
@@ -18,6 +18,7 @@
 #include <signal.h>
 #include <stdlib.h>
 #include <gtest/gtest.h>
+#include "acconfig.h"
 #include "global/global_init.h"
 #include "compressor/Compressor.h"
 #include "common/ceph_argparse.h"
@@ -135,6 +136,27 @@ TEST_P(CompressorTest, big_round_trip_randomish)
        << " with " << GetParam() << std::endl;
 }
 
+TEST_P(CompressorTest, round_trip_incompressible_segments)
+{
+  // random data in many small segments: each segment may come out
+  // bigger than it went in
+  bufferlist orig;
+  for (unsigned seg = 0; seg < 64; ++seg) {
+    bufferptr bp(4096 + seg);
+    for (unsigned i = 0; i < bp.length(); ++i)
+      bp.c_str()[i] = rand();
+    orig.append(bp);
+  }
+  ASSERT_EQ(64u, orig.buffers().size());
+  bufferlist compressed;
+  int r = compressor->compress(orig, compressed);
+  ASSERT_EQ(0, r);
+  bufferlist decompressed;
+  r = compressor->decompress(compressed, decompressed);
+  ASSERT_EQ(0, r);
+  ASSERT_TRUE(decompressed.contents_equal(orig));
+}
+
 #if 0
 TEST_P(CompressorTest, big_round_trip_file)
 {
@@ -326,8 +348,78 @@ INSTANTIATE_TEST_CASE_P(
   ::testing::Values(
     "zlib/isal",
     "zlib/noisal",
+#ifdef HAVE_ZSTD
+    "zstd",
+#endif
+#ifdef HAVE_LZ4
+    "lz4",
+#endif
     "snappy"));
 
+#ifdef HAVE_ZSTD
+TEST(ZstdCompressor, dictionary)
+{
+  bufferlist dict;
+  for (int i = 0; i < 64; ++i)
+    dict.append("ceph object corpus zstd dictionary sample text ");
+  string path = "test_compression_zstd.dict";
+  ASSERT_EQ(0, dict.write_file(path.c_str()));
+
+  CompressorRef plain = Compressor::create(g_ceph_context, "zstd");
+  ASSERT_TRUE(plain);
+  g_conf->set_val("compressor_zstd_dict", path);
+  g_ceph_context->_conf->apply_changes(NULL);
+  CompressorRef with_dict = Compressor::create(g_ceph_context, "zstd");
+  ASSERT_TRUE(with_dict);
+  EXPECT_NE(plain.get(), with_dict.get());
+
+  bufferlist in;
+  for (int i = 0; i < 8; ++i)
+    in.append("zstd dictionary sample text for ceph object corpus ");
+  bufferlist a, b;
+  EXPECT_EQ(0, plain->compress(in, a));
+  EXPECT_EQ(0, with_dict->compress(in, b));
+  EXPECT_LT(b.length(), a.length());
+
+  bufferlist after;
+  EXPECT_EQ(0, with_dict->decompress(b, after));
+  EXPECT_TRUE(in.contents_equal(after));
+
+  // data is only read back with the dictionary it was written with
+  after.clear();
+  EXPECT_NE(0, plain->decompress(b, after));
+  after.clear();
+  EXPECT_NE(0, with_dict->decompress(a, after));
+
+  g_conf->set_val("compressor_zstd_dict", "does/not/exist");
+  g_ceph_context->_conf->apply_changes(NULL);
+  EXPECT_FALSE(Compressor::create(g_ceph_context, "zstd"));
+
+  g_conf->set_val("compressor_zstd_dict", "");
+  g_ceph_context->_conf->apply_changes(NULL);
+  ::unlink(path.c_str());
+}
+#endif
+
+#ifdef HAVE_LZ4
+TEST(LZ4Compressor, corrupt_block_count)
+{
+  CompressorRef lz4 = Compressor::create(g_ceph_context, "lz4");
+  ASSERT_TRUE(lz4);
+  bufferlist in, out;
+  in.append(string(4096, 'a'));
+  ASSERT_EQ(0, lz4->compress(in, out));
+
+  // a header claiming 4G blocks is refused before anything is allocated
+  bufferlist bad, rest;
+  ::encode((uint32_t)0xffffffff, bad);
+  rest.substr_of(out, sizeof(uint32_t), out.length() - sizeof(uint32_t));
+  bad.append(rest);
+  bufferlist after;
+  EXPECT_NE(0, lz4->decompress(bad, after));
+}
+#endif
+
 TEST(ZlibCompressor, zlib_isal_compatibility)
 {
   g_conf->set_val("compressor_zlib_isal", "true");
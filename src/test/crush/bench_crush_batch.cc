@@ -0,0 +1,221 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+/*
+ * Ceph - scalable distributed file system
+ *
+ * This is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License version 2.1, as published by the Free Software
+ * Foundation.  See file COPYING.
+ *
+ */
+
+/*
+ * Compare CrushWrapper::do_rule_batch against one do_rule call per
+ * input.  Maps --count pg seeds of a pool through a rule of either a
+ * compiled crush map (--infn, as written by crushtool -o) or a
+ * synthetic straw2 root -> host -> osd hierarchy, checks that both
+ * paths give the same mappings and reports the time each took.
+ */
+
+#include <chrono>
+#include <iomanip>
+
+#include "global/global_init.h"
+#include "global/global_context.h"
+#include "common/ceph_argparse.h"
+#include "common/config.h"
+#include "common/debug.h"
+#include "common/errno.h"
+#include "include/stringify.h"
+#include "crush/CrushWrapper.h"
+#include "osd/osd_types.h"
+
+#define dout_subsys ceph_subsys_crush
+
+static void usage()
+{
+  derr << "usage: ceph_bench_crush_batch [flags]\n"
+      "	 --infn <file>\n"
+      "	       compiled crush map to use instead of a synthetic one\n"
+      "	 --hosts <n> --osds-per-host <n>\n"
+      "	       size of the synthetic map, default 1000 x 10\n"
+      "	 --rule <id>\n"
+      "	       rule to map with, default 0\n"
+      "	 --num-rep <n>\n"
+      "	       replicas per mapping, default 3\n"
+      "	 --count <n>\n"
+      "	       pg seeds to map, default 1048576\n"
+      "	 --batch <n>\n"
+      "	       seeds per do_rule_batch call, default 4096\n" << dendl;
+  generic_client_usage();
+}
+
+static CrushWrapper *build_map(int num_host, int num_osd)
+{
+  CrushWrapper *c = new CrushWrapper;
+  c->create();
+  c->set_tunables_optimal();
+  c->set_type_name(2, "root");
+  c->set_type_name(1, "host");
+  c->set_type_name(0, "osd");
+
+  vector<int> hosts(num_host), host_weights(num_host);
+  int osd = 0;
+  for (int h = 0; h < num_host; ++h) {
+    vector<int> items(num_osd), weights(num_osd);
+    for (int i = 0; i < num_osd; ++i, ++osd) {
+      items[i] = osd;
+      weights[i] = 0x10000;
+    }
+    crush_bucket *b = crush_make_bucket(c->get_crush_map(),
+					CRUSH_BUCKET_STRAW2,
+					CRUSH_HASH_RJENKINS1, 1, num_osd,
+					&items[0], &weights[0]);
+    crush_add_bucket(c->get_crush_map(), 0, b, &hosts[h]);
+    c->set_item_name(hosts[h], "host" + stringify(h));
+    host_weights[h] = b->weight;
+  }
+  c->set_max_devices(osd);
+  int root;
+  crush_bucket *b = crush_make_bucket(c->get_crush_map(),
+				      CRUSH_BUCKET_STRAW2,
+				      CRUSH_HASH_RJENKINS1, 2, num_host,
+				      &hosts[0], &host_weights[0]);
+  crush_add_bucket(c->get_crush_map(), 0, b, &root);
+  c->set_item_name(root, "default");
+  c->add_simple_ruleset("replicated", "default", "host", "firstn",
+			pg_pool_t::TYPE_REPLICATED);
+  c->finalize();
+  return c;
+}
+
+int main(int argc, const char **argv)
+{
+  vector<const char*> args;
+  argv_to_vec(argc, argv, args);
+  env_to_vec(args);
+
+  global_init(NULL, args, CEPH_ENTITY_TYPE_CLIENT, CODE_ENVIRONMENT_UTILITY, 0);
+
+  std::string infn;
+  int num_host = 1000;
+  int num_osd = 10;
+  int rule = 0;
+  int num_rep = 3;
+  int count = 1 << 20;
+  int batch = 4096;
+
+  std::string val;
+  vector<const char*>::iterator i = args.begin();
+  while (i != args.end()) {
+    if (ceph_argparse_double_dash(args, i))
+      break;
+    if (ceph_argparse_witharg(args, i, &val, "--infn", (char*)NULL)) {
+      infn = val;
+    } else if (ceph_argparse_witharg(args, i, &val, "--hosts", (char*)NULL)) {
+      num_host = atoi(val.c_str());
+    } else if (ceph_argparse_witharg(args, i, &val, "--osds-per-host", (char*)NULL)) {
+      num_osd = atoi(val.c_str());
+    } else if (ceph_argparse_witharg(args, i, &val, "--rule", (char*)NULL)) {
+      rule = atoi(val.c_str());
+    } else if (ceph_argparse_witharg(args, i, &val, "--num-rep", (char*)NULL)) {
+      num_rep = atoi(val.c_str());
+    } else if (ceph_argparse_witharg(args, i, &val, "--count", (char*)NULL)) {
+      count = atoi(val.c_str());
+    } else if (ceph_argparse_witharg(args, i, &val, "--batch", (char*)NULL)) {
+      batch = atoi(val.c_str());
+    } else if (ceph_argparse_flag(args, i, "-h", "--help", (char*)NULL)) {
+      usage();
+      return 0;
+    } else {
+      derr << "Error: can't understand argument: " << *i << "\n" << dendl;
+      usage();
+      return 1;
+    }
+  }
+  if (num_host <= 0 || num_osd <= 0 || num_rep <= 0 || count <= 0 ||
+      batch <= 0) {
+    usage();
+    return 1;
+  }
+
+  common_init_finish(g_ceph_context);
+
+  CrushWrapper *crush;
+  if (infn.empty()) {
+    crush = build_map(num_host, num_osd);
+  } else {
+    bufferlist bl;
+    std::string err;
+    int r = bl.read_file(infn.c_str(), &err);
+    if (r < 0) {
+      derr << "unable to read " << infn << ": " << err << dendl;
+      return 1;
+    }
+    crush = new CrushWrapper;
+    bufferlist::iterator p = bl.begin();
+    try {
+      crush->decode(p);
+    } catch (buffer::error &e) {
+      derr << "unable to decode " << infn << ": " << e.what() << dendl;
+      return 1;
+    }
+  }
+  if (!crush->rule_exists(rule)) {
+    derr << "rule " << rule << " does not exist" << dendl;
+    return 1;
+  }
+
+  vector<__u32> weight(crush->get_max_devices(), 0x10000);
+  vector<int> xs(count);
+  for (int x = 0; x < count; ++x)
+    xs[x] = crush_hash32_2(CRUSH_HASH_RJENKINS1, x, 1);
+
+  typedef std::chrono::steady_clock clock;
+
+  vector<vector<int> > scalar(count);
+  auto start = clock::now();
+  for (int x = 0; x < count; ++x)
+    crush->do_rule(rule, xs[x], scalar[x], num_rep, weight);
+  double scalar_sec =
+    std::chrono::duration<double>(clock::now() - start).count();
+
+  vector<vector<int> > batched;
+  batched.reserve(count);
+  start = clock::now();
+  for (int x = 0; x < count; x += batch) {
+    vector<int> in(xs.begin() + x, xs.begin() + std::min(x + batch, count));
+    vector<vector<int> > out;
+    crush->do_rule_batch(rule, in, out, num_rep, weight);
+    for (auto& o : out)
+      batched.push_back(std::move(o));
+  }
+  double batch_sec =
+    std::chrono::duration<double>(clock::now() - start).count();
+
+  int mismatches = 0;
+  for (int x = 0; x < count; ++x) {
+    if (scalar[x] != batched[x]) {
+      if (mismatches++ < 10)
+	cerr << "mismatch x " << xs[x] << ": " << scalar[x]
+	     << " vs " << batched[x] << std::endl;
+    }
+  }
+
+  cout << "rule " << rule << ", " << crush->get_max_devices()
+       << " devices, " << count << " mappings of " << num_rep << std::endl;
+  cout << std::fixed << std::setprecision(3)
+       << "scalar\t" << scalar_sec << " s\t"
+       << (count / scalar_sec / 1000000) << " M/s" << std::endl
+       << "batch\t" << batch_sec << " s\t"
+       << (count / batch_sec / 1000000) << " M/s" << std::endl
+       << "speedup\t" << (scalar_sec / batch_sec) << "x" << std::endl;
+  if (mismatches) {
+    cout << mismatches << " mappings differ" << std::endl;
+    delete crush;
+    return 1;
+  }
+  delete crush;
+  return 0;
+}
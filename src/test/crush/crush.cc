@@ -636,7 +636,88 @@ TEST(CRUSH, straw2_reweight) {
   }
 }
 
+TEST(CRUSH, hash32_3_lanes) {
+  __u32 b[37], out[37];
+  for (int i = 0; i < 37; ++i)
+    b[i] = i * 7919 - 100;
+  for (int n = 0; n <= 37; ++n) {
+    crush_hash32_3_lanes(CRUSH_HASH_RJENKINS1, 12345, b, 678, out, n);
+    for (int i = 0; i < n; ++i)
+      ASSERT_EQ(crush_hash32_3(CRUSH_HASH_RJENKINS1, 12345, b[i], 678),
+		out[i]);
+  }
+}
+
+TEST(CRUSH, do_rule_batch) {
+  CrushWrapper *c = new CrushWrapper;
+  c->create();
+  const int ROOT_TYPE = 2;
+  c->set_type_name(ROOT_TYPE, "root");
+  const int HOST_TYPE = 1;
+  c->set_type_name(HOST_TYPE, "host");
+  const int OSD_TYPE = 0;
+  c->set_type_name(OSD_TYPE, "osd");
 
+  // straw2 hosts of uneven sizes, so the hash lanes have tails
+  const int num_host = 9;
+  int hosts[num_host];
+  int host_weights[num_host];
+  int osd = 0;
+  for (int h = 0; h < num_host; ++h) {
+    int n = 3 + h * 4;
+    int items[n], weights[n];
+    for (int i = 0; i < n; ++i, ++osd) {
+      items[i] = osd;
+      weights[i] = (i % 5 == 4) ? 0 : 0x10000 + (osd % 3) * 0x8000;
+    }
+    crush_bucket *b = crush_make_bucket(c->get_crush_map(),
+					CRUSH_BUCKET_STRAW2,
+					CRUSH_HASH_RJENKINS1,
+					HOST_TYPE, n, items, weights);
+    crush_add_bucket(c->get_crush_map(), 0, b, &hosts[h]);
+    c->set_item_name(hosts[h], string("host-") + stringify(h));
+    host_weights[h] = b->weight;
+  }
+  c->set_max_devices(osd);
+  int root;
+  crush_bucket *b = crush_make_bucket(c->get_crush_map(),
+				      CRUSH_BUCKET_STRAW2,
+				      CRUSH_HASH_RJENKINS1,
+				      ROOT_TYPE, num_host, hosts,
+				      host_weights);
+  crush_add_bucket(c->get_crush_map(), 0, b, &root);
+  c->set_item_name(root, "default");
+  int firstn = c->add_simple_ruleset("firstn", "default", "host",
+				     "firstn", pg_pool_t::TYPE_REPLICATED);
+  int indep = c->add_simple_ruleset("indep", "default", "host",
+				    "indep", pg_pool_t::TYPE_ERASURE);
+
+  // mark some devices out and some partially out to force retries
+  vector<__u32> weight(osd, 0x10000);
+  for (int i = 0; i < osd; i += 7)
+    weight[i] = 0;
+  for (int i = 3; i < osd; i += 11)
+    weight[i] = 0x4000;
+
+  vector<int> xs;
+  for (int x = 0; x < 10000; ++x)
+    xs.push_back(crush_hash32_2(CRUSH_HASH_RJENKINS1, x, 3));
+
+  int rules[] = { firstn, indep };
+  for (int rule : rules) {
+    for (int numrep = 1; numrep <= 6; ++numrep) {
+      vector<vector<int> > batch;
+      c->do_rule_batch(rule, xs, batch, numrep, weight);
+      ASSERT_EQ(xs.size(), batch.size());
+      for (unsigned i = 0; i < xs.size(); ++i) {
+	vector<int> out;
+	c->do_rule(rule, xs[i], out, numrep, weight);
+	ASSERT_EQ(out, batch[i]) << "rule " << rule << " x " << xs[i];
+      }
+    }
+  }
+  delete c;
+}
 
 int main(int argc, char **argv) {
   vector<const char*> args;
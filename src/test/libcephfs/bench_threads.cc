@@ -0,0 +1,183 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+/*
+ * Ceph - scalable distributed file system
+ *
+ * This is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License version 2.1, as published by the Free Software
+ * Foundation.  See file COPYING.
+ *
+ */
+
+/*
+ * Measure how reads and writes through one libcephfs mount scale with
+ * the number of threads using it, the way nfs-ganesha or samba use it.
+ * Every thread works on a file of its own, so the threads share nothing
+ * but the Client.  For 1, 2, 4, ... up to --threads threads, each thread
+ * writes --size bytes in --bs blocks, then reads them back, and the
+ * aggregate bandwidth of both phases is reported.
+ *
+ * Run it with client_oc enabled to measure the Client itself rather than
+ * the osds.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <chrono>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "include/cephfs/libcephfs.h"
+
+static void usage()
+{
+  std::cerr << "usage: ceph_bench_cephfs_threads [flags] [ceph options]\n"
+	    << "	--threads <n>\n"
+	    << "	      largest number of threads, default 8\n"
+	    << "	--size <bytes>\n"
+	    << "	      bytes per thread, default 64M\n"
+	    << "	--bs <bytes>\n"
+	    << "	      block size of each read and write, default 64K\n"
+	    << "	--dir <path>\n"
+	    << "	      directory for the files, default /bench_threads.<pid>\n"
+	    << std::endl;
+}
+
+static std::atomic<int> errors(0);
+
+static void run_phase(struct ceph_mount_info *cmount, const std::vector<int>& fds,
+		      uint64_t size, uint64_t bs, bool write)
+{
+  std::vector<std::thread> threads;
+  for (int fd : fds) {
+    threads.push_back(std::thread([=]() {
+      std::vector<char> buf(bs, 'a' + fd % 26);
+      for (uint64_t off = 0; off < size; off += bs) {
+	int r;
+	if (write)
+	  r = ceph_write(cmount, fd, &buf[0], bs, off);
+	else
+	  r = ceph_read(cmount, fd, &buf[0], bs, off);
+	if (r != (int)bs) {
+	  std::cerr << (write ? "write" : "read") << " fd " << fd << " off "
+		    << off << " = " << r << std::endl;
+	  ++errors;
+	  return;
+	}
+      }
+    }));
+  }
+  for (auto& t : threads)
+    t.join();
+}
+
+static double mbps(uint64_t bytes, std::chrono::steady_clock::duration d)
+{
+  double secs = std::chrono::duration<double>(d).count();
+  return secs > 0 ? (double)bytes / secs / (1 << 20) : 0;
+}
+
+int main(int argc, const char **argv)
+{
+  int max_threads = 8;
+  uint64_t size = 64 << 20;
+  uint64_t bs = 64 << 10;
+  std::string dir = "/bench_threads." + std::to_string(getpid());
+
+  std::vector<const char*> args;
+  for (int i = 1; i < argc; ++i) {
+    std::string a = argv[i];
+    if ((a == "--threads" || a == "--size" || a == "--bs" || a == "--dir") &&
+	i + 1 < argc) {
+      const char *v = argv[++i];
+      if (a == "--threads")
+	max_threads = atoi(v);
+      else if (a == "--size")
+	size = strtoull(v, NULL, 10);
+      else if (a == "--bs")
+	bs = strtoull(v, NULL, 10);
+      else
+	dir = v;
+    } else if (a == "-h" || a == "--help") {
+      usage();
+      return 0;
+    } else {
+      args.push_back(argv[i]);
+    }
+  }
+  if (max_threads <= 0 || bs == 0 || size < bs) {
+    usage();
+    return 1;
+  }
+  size -= size % bs;
+
+  struct ceph_mount_info *cmount;
+  int r = ceph_create(&cmount, NULL);
+  if (r < 0) {
+    std::cerr << "ceph_create failed: " << strerror(-r) << std::endl;
+    return 1;
+  }
+  ceph_conf_read_file(cmount, NULL);
+  ceph_conf_parse_env(cmount, NULL);
+  args.insert(args.begin(), argv[0]);
+  r = ceph_conf_parse_argv(cmount, args.size(), &args[0]);
+  if (r < 0) {
+    std::cerr << "bad ceph options: " << strerror(-r) << std::endl;
+    return 1;
+  }
+  r = ceph_mount(cmount, NULL);
+  if (r < 0) {
+    std::cerr << "ceph_mount failed: " << strerror(-r) << std::endl;
+    return 1;
+  }
+  r = ceph_mkdir(cmount, dir.c_str(), 0755);
+  if (r < 0 && r != -EEXIST) {
+    std::cerr << "mkdir " << dir << " failed: " << strerror(-r) << std::endl;
+    return 1;
+  }
+
+  std::cout << "threads\twrite MB/s\tread MB/s" << std::endl;
+  for (int n = 1; n <= max_threads && !errors; n *= 2) {
+    std::vector<int> fds;
+    for (int i = 0; i < n; ++i) {
+      std::string path = dir + "/" + std::to_string(n) + "." + std::to_string(i);
+      int fd = ceph_open(cmount, path.c_str(), O_CREAT|O_TRUNC|O_RDWR, 0644);
+      if (fd < 0) {
+	std::cerr << "open " << path << " failed: " << strerror(-fd) << std::endl;
+	return 1;
+      }
+      fds.push_back(fd);
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    run_phase(cmount, fds, size, bs, true);
+    for (int fd : fds)
+      ceph_fsync(cmount, fd, 0);
+    auto written = std::chrono::steady_clock::now();
+    run_phase(cmount, fds, size, bs, false);
+    auto read = std::chrono::steady_clock::now();
+
+    std::cout << n << "\t" << mbps(size * n, written - start)
+	      << "\t\t" << mbps(size * n, read - written) << std::endl;
+
+    for (int i = 0; i < n; ++i) {
+      ceph_close(cmount, fds[i]);
+      std::string path = dir + "/" + std::to_string(n) + "." + std::to_string(i);
+      ceph_unlink(cmount, path.c_str());
+    }
+  }
+
+  ceph_rmdir(cmount, dir.c_str());
+  ceph_unmount(cmount);
+  ceph_release(cmount);
+  return errors ? 1 : 0;
+}
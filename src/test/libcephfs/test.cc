@@ -999,6 +999,31 @@ TEST(LibCephFS, BadFileDesc) {
   ceph_shutdown(cmount);
 }
 
+TEST(LibCephFS, BadWriteArgs) {
+  struct ceph_mount_info *cmount;
+  ASSERT_EQ(ceph_create(&cmount, NULL), 0);
+  ASSERT_EQ(ceph_conf_read_file(cmount, NULL), 0);
+  ASSERT_EQ(0, ceph_conf_parse_env(cmount, NULL));
+  ASSERT_EQ(ceph_mount(cmount, NULL), 0);
+
+  char c_path[1024];
+  sprintf(c_path, "test_bad_write_args_%d", getpid());
+  int fd = ceph_open(cmount, c_path, O_CREAT|O_RDWR, 0666);
+  ASSERT_LT(0, fd);
+
+  // the arguments are checked before the buffer is looked at
+  ASSERT_EQ(-EBADF, ceph_write(cmount, -1, NULL, 1 << 20, 0));
+  ASSERT_EQ(-EINVAL, ceph_write(cmount, fd, NULL, -1, 0));
+  ASSERT_EQ(-EFBIG, ceph_write(cmount, fd, NULL, 1 << 20, 1ll << 62));
+
+  struct iovec iov = { NULL, 1 << 20 };
+  ASSERT_EQ(-EFBIG, ceph_pwritev(cmount, fd, &iov, 1, 1ll << 62));
+
+  ASSERT_EQ(0, ceph_close(cmount, fd));
+  ASSERT_EQ(0, ceph_unlink(cmount, c_path));
+  ceph_shutdown(cmount);
+}
+
 TEST(LibCephFS, ReadEmptyFile) {
   struct ceph_mount_info *cmount;
   ASSERT_EQ(ceph_create(&cmount, NULL), 0);
@@ -1160,3 +1160,124 @@ TEST_F(LibRadosIoECPP, XattrListPP) {
     }
   }
 }
+
+class LibRadosIoECOverwritesPP : public RadosTestECPP {
+protected:
+  static void SetUpTestCase() {
+    RadosTestECPP::SetUpTestCase();
+    bufferlist inbl;
+    ASSERT_EQ(0, s_cluster.mon_command(
+      "{\"prefix\": \"osd set\", \"key\": \"require_kraken_osds\"}",
+      inbl, NULL, NULL));
+    ASSERT_EQ(0, s_cluster.mon_command(
+      "{\"prefix\": \"osd pool set\", \"pool\": \"" + pool_name +
+      "\", \"var\": \"allow_ec_overwrites\", \"val\": \"true\"}",
+      inbl, NULL, NULL));
+    s_cluster.wait_for_latest_osdmap();
+  }
+
+  // apply a write to the expected contents of the object
+  static void apply(std::string *expected, uint64_t off, const std::string &s) {
+    if (expected->size() < off + s.size())
+      expected->resize(off + s.size(), '\0');
+    expected->replace(off, s.size(), s);
+  }
+
+  void verify(const std::string &oid, const std::string &expected) {
+    uint64_t size;
+    time_t mtime;
+    ASSERT_EQ(0, ioctx.stat(oid, &size, &mtime));
+    ASSERT_EQ(expected.size(), size);
+    bufferlist bl;
+    ASSERT_EQ((int)expected.size(),
+	      ioctx.read(oid, bl, expected.size() + alignment, 0));
+    ASSERT_EQ(expected, std::string(bl.c_str(), bl.length()));
+  }
+};
+
+TEST_F(LibRadosIoECOverwritesPP, PartialOverwritePP) {
+  std::string expected;
+  std::string s(alignment * 2, 'a');
+  bufferlist bl;
+  bl.append(s);
+  ASSERT_EQ(0, ioctx.write("foo", bl, bl.length(), 0));
+  apply(&expected, 0, s);
+
+  // within one stripe, then across a stripe boundary
+  s = std::string(100, 'b');
+  bl.clear();
+  bl.append(s);
+  ASSERT_EQ(0, ioctx.write("foo", bl, bl.length(), 10));
+  apply(&expected, 10, s);
+  bl.clear();
+  bl.append(s);
+  ASSERT_EQ(0, ioctx.write("foo", bl, bl.length(), alignment - 50));
+  apply(&expected, alignment - 50, s);
+  verify("foo", expected);
+}
+
+TEST_F(LibRadosIoECOverwritesPP, UnalignedGrowPP) {
+  std::string expected;
+  std::string s(100, 'a');
+  bufferlist bl;
+  bl.append(s);
+  // a new object written at an offset, then past its end
+  ASSERT_EQ(0, ioctx.write("foo", bl, bl.length(), 10));
+  apply(&expected, 10, s);
+  verify("foo", expected);
+  bl.clear();
+  bl.append(s);
+  ASSERT_EQ(0, ioctx.write("foo", bl, bl.length(), alignment * 3 + 7));
+  apply(&expected, alignment * 3 + 7, s);
+  verify("foo", expected);
+}
+
+TEST_F(LibRadosIoECOverwritesPP, ZeroTruncatePP) {
+  std::string expected;
+  std::string s(alignment * 3, 'a');
+  bufferlist bl;
+  bl.append(s);
+  ASSERT_EQ(0, ioctx.write_full("foo", bl));
+  apply(&expected, 0, s);
+
+  ASSERT_EQ(0, ioctx.trunc("foo", alignment * 2 + 13));
+  expected.resize(alignment * 2 + 13);
+  verify("foo", expected);
+
+  ObjectWriteOperation op;
+  op.zero(alignment - 5, 10);
+  ASSERT_EQ(0, ioctx.operate("foo", &op));
+  apply(&expected, alignment - 5, std::string(10, '\0'));
+  verify("foo", expected);
+
+  // growing by truncate must read back zeroes
+  ASSERT_EQ(0, ioctx.trunc("foo", alignment * 4));
+  expected.resize(alignment * 4, '\0');
+  verify("foo", expected);
+}
+
+TEST_F(LibRadosIoECOverwritesPP, SameStripeTwicePP) {
+  std::string expected;
+  std::string s(alignment * 2, 'a');
+  bufferlist bl;
+  bl.append(s);
+  ASSERT_EQ(0, ioctx.write_full("foo", bl));
+  apply(&expected, 0, s);
+
+  // several ops of one request overwrite the same stripes: their old
+  // contents are stashed once for the log entry
+  ObjectWriteOperation op;
+  bufferlist b1, b2;
+  b1.append(std::string(20, 'b'));
+  b2.append(std::string(alignment, 'c'));
+  op.write(5, b1);
+  op.zero(15, 30);
+  op.write(alignment / 2, b2);
+  op.truncate(alignment * 2 - 3);
+  ASSERT_EQ(0, ioctx.operate("foo", &op));
+  apply(&expected, 5, std::string(20, 'b'));
+  apply(&expected, 15, std::string(30, '\0'));
+  apply(&expected, alignment / 2, std::string(alignment, 'c'));
+  expected.resize(alignment * 2 - 3);
+  verify("foo", expected);
+}
@@ -0,0 +1,385 @@
+// -*- mode:C; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+
+#include "test/librbd/test_mock_fixture.h"
+#include "test/librbd/test_support.h"
+#include "test/librbd/mock/MockImageCtx.h"
+#include "test/librbd/mock/MockExclusiveLock.h"
+#include "cls/rbd/cls_rbd_client.h"
+#include "include/rbd_types.h"
+#include "librbd/cache/ImageWriteback.h"
+#include <atomic>
+#include <dirent.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+namespace librbd {
+namespace {
+
+struct MockTestImageCtx : public MockImageCtx {
+  MockTestImageCtx(ImageCtx &image_ctx) : MockImageCtx(image_ctx) {
+  }
+};
+
+} // anonymous namespace
+
+namespace cache {
+
+struct MockImageWriteback {
+  typedef std::vector<std::pair<uint64_t,uint64_t> > Extents;
+
+  static MockImageWriteback *s_instance;
+
+  MockImageWriteback() {
+    s_instance = this;
+  }
+  ~MockImageWriteback() {
+    s_instance = nullptr;
+  }
+
+  MOCK_METHOD4(aio_read, void(const Extents &, ceph::bufferlist *, int,
+                              Context *));
+  MOCK_METHOD4(aio_write, void(const Extents &, const ceph::bufferlist &, int,
+                               Context *));
+  MOCK_METHOD3(aio_discard, void(uint64_t, uint64_t, Context *));
+};
+
+MockImageWriteback *MockImageWriteback::s_instance = nullptr;
+
+template <>
+struct ImageWriteback<librbd::MockTestImageCtx> {
+  typedef std::vector<std::pair<uint64_t,uint64_t> > Extents;
+
+  ImageWriteback(librbd::MockTestImageCtx &image_ctx) {
+  }
+
+  void aio_read(Extents &&image_extents, ceph::bufferlist *bl,
+                int fadvise_flags, Context *on_finish) {
+    assert(MockImageWriteback::s_instance != nullptr);
+    MockImageWriteback::s_instance->aio_read(image_extents, bl, fadvise_flags,
+                                             on_finish);
+  }
+  void aio_write(Extents &&image_extents, ceph::bufferlist&& bl,
+                 int fadvise_flags, Context *on_finish) {
+    assert(MockImageWriteback::s_instance != nullptr);
+    MockImageWriteback::s_instance->aio_write(image_extents, bl, fadvise_flags,
+                                              on_finish);
+  }
+  void aio_discard(uint64_t offset, uint64_t length, Context *on_finish) {
+    assert(MockImageWriteback::s_instance != nullptr);
+    MockImageWriteback::s_instance->aio_discard(offset, length, on_finish);
+  }
+};
+
+} // namespace cache
+} // namespace librbd
+
+#include "librbd/cache/FileImageCache.cc"
+template class librbd::cache::FileImageCache<librbd::MockTestImageCtx>;
+
+namespace librbd {
+namespace cache {
+
+using ::testing::_;
+using ::testing::Invoke;
+using ::testing::Return;
+using ::testing::WithArg;
+
+class TestMockCacheFileImageCache : public TestMockFixture {
+public:
+  typedef FileImageCache<librbd::MockTestImageCtx> MockFileImageCache;
+  typedef MockImageWriteback::Extents Extents;
+
+  std::string m_cache_dir;
+
+  virtual void SetUp() {
+    TestMockFixture::SetUp();
+
+    char dir[] = "/tmp/test_rbd_file_image_cache.XXXXXX";
+    ASSERT_TRUE(mkdtemp(dir) != nullptr);
+    m_cache_dir = dir;
+  }
+
+  virtual void TearDown() {
+    DIR *dir = opendir(m_cache_dir.c_str());
+    if (dir != nullptr) {
+      struct dirent *de;
+      while ((de = readdir(dir)) != nullptr) {
+        std::string name(de->d_name);
+        if (name != "." && name != "..") {
+          unlink((m_cache_dir + "/" + name).c_str());
+        }
+      }
+      closedir(dir);
+    }
+    rmdir(m_cache_dir.c_str());
+
+    TestMockFixture::TearDown();
+  }
+
+  void init_mock_image_ctx(MockTestImageCtx &mock_image_ctx) {
+    mock_image_ctx.persistent_cache_path = m_cache_dir;
+    mock_image_ctx.persistent_cache_size = 1 << 20;
+    mock_image_ctx.persistent_cache_writeback_bytes = 16 << 20;
+    expect_op_work_queue(mock_image_ctx);
+  }
+
+  void expect_writeback(MockTestImageCtx &mock_image_ctx,
+                        MockImageWriteback &mock_image_writeback,
+                        uint64_t off, const bufferlist &bl, int r) {
+    EXPECT_CALL(mock_image_writeback,
+                aio_write(Extents{{off, bl.length()}}, ContentsEqual(bl), _, _))
+      .WillOnce(WithArg<3>(CompleteContext(
+        r, mock_image_ctx.image_ctx->op_work_queue)));
+  }
+
+  int init(MockFileImageCache &cache) {
+    C_SaferCond ctx;
+    cache.init(&ctx);
+    return ctx.wait();
+  }
+
+  int write(MockFileImageCache &cache, uint64_t off, const bufferlist &bl) {
+    C_SaferCond ctx;
+    bufferlist data(bl);
+    cache.aio_write({{off, bl.length()}}, std::move(data), 0, &ctx);
+    return ctx.wait();
+  }
+
+  int read(MockFileImageCache &cache, uint64_t off, uint64_t len,
+           bufferlist *bl) {
+    C_SaferCond ctx;
+    cache.aio_read({{off, len}}, bl, 0, &ctx);
+    return ctx.wait();
+  }
+
+  int flush(MockFileImageCache &cache) {
+    C_SaferCond ctx;
+    cache.flush(&ctx);
+    return ctx.wait();
+  }
+
+  int shut_down(MockFileImageCache &cache) {
+    C_SaferCond ctx;
+    cache.shut_down(&ctx);
+    return ctx.wait();
+  }
+
+  int invalidate(MockFileImageCache &cache) {
+    C_SaferCond ctx;
+    cache.invalidate(&ctx);
+    return ctx.wait();
+  }
+
+  void expect_writeback_error(MockTestImageCtx &mock_image_ctx,
+                              MockImageWriteback &mock_image_writeback) {
+    EXPECT_CALL(mock_image_writeback, aio_write(_, _, _, _))
+      .WillRepeatedly(WithArg<3>(CompleteContext(
+        -EIO, mock_image_ctx.image_ctx->op_work_queue)));
+  }
+
+  void expect_no_writeback(MockImageWriteback &mock_image_writeback) {
+    EXPECT_CALL(mock_image_writeback, aio_write(_, _, _, _)).Times(0);
+  }
+};
+
+TEST_F(TestMockCacheFileImageCache, WriteBack) {
+  librbd::ImageCtx *ictx;
+  ASSERT_EQ(0, open_image(m_image_name, &ictx));
+
+  MockTestImageCtx mock_image_ctx(*ictx);
+  MockImageWriteback mock_image_writeback;
+  init_mock_image_ctx(mock_image_ctx);
+
+  bufferlist bl;
+  bl.append(std::string(4096, '1'));
+  expect_writeback(mock_image_ctx, mock_image_writeback, 8192, bl, 0);
+
+  MockFileImageCache cache(mock_image_ctx);
+  ASSERT_EQ(0, init(cache));
+  ASSERT_EQ(0, write(cache, 8192, bl));
+  ASSERT_EQ(0, flush(cache));
+  ASSERT_EQ(0, shut_down(cache));
+}
+
+TEST_F(TestMockCacheFileImageCache, ReplayAfterWritebackError) {
+  librbd::ImageCtx *ictx;
+  ASSERT_EQ(0, open_image(m_image_name, &ictx));
+
+  MockTestImageCtx mock_image_ctx(*ictx);
+  MockImageWriteback mock_image_writeback;
+  init_mock_image_ctx(mock_image_ctx);
+
+  bufferlist bl;
+  bl.append(std::string(4096, '1'));
+
+  // every writeback fails: the write stays in the log
+  EXPECT_CALL(mock_image_writeback, aio_write(_, _, _, _))
+    .WillRepeatedly(WithArg<3>(CompleteContext(
+      -EIO, mock_image_ctx.image_ctx->op_work_queue)));
+  {
+    MockFileImageCache cache(mock_image_ctx);
+    ASSERT_EQ(0, init(cache));
+    ASSERT_EQ(0, write(cache, 0, bl));
+    ASSERT_EQ(-EIO, flush(cache));
+    ASSERT_EQ(-EIO, shut_down(cache));
+  }
+
+  // and is written back once the log is opened again
+  expect_writeback(mock_image_ctx, mock_image_writeback, 0, bl, 0);
+  MockFileImageCache cache(mock_image_ctx);
+  ASSERT_EQ(0, init(cache));
+  ASSERT_EQ(0, flush(cache));
+  ASSERT_EQ(0, shut_down(cache));
+}
+
+TEST_F(TestMockCacheFileImageCache, WritebackErrorFailsWritesWhenFull) {
+  librbd::ImageCtx *ictx;
+  ASSERT_EQ(0, open_image(m_image_name, &ictx));
+
+  MockTestImageCtx mock_image_ctx(*ictx);
+  MockImageWriteback mock_image_writeback;
+  init_mock_image_ctx(mock_image_ctx);
+
+  EXPECT_CALL(mock_image_writeback, aio_write(_, _, _, _))
+    .WillRepeatedly(WithArg<3>(CompleteContext(
+      -EIO, mock_image_ctx.image_ctx->op_work_queue)));
+
+  MockFileImageCache cache(mock_image_ctx);
+  ASSERT_EQ(0, init(cache));
+
+  // twice the size of the log: the writes must fail rather than hang
+  bufferlist bl;
+  bl.append(std::string(65536, '1'));
+  int r = 0;
+  for (uint64_t i = 0; i < 32 && r == 0; ++i) {
+    r = write(cache, i * bl.length(), bl);
+  }
+  ASSERT_EQ(-EIO, r);
+  ASSERT_EQ(-EIO, shut_down(cache));
+}
+
+TEST_F(TestMockCacheFileImageCache, WritebackNeedsLockOwner) {
+  librbd::ImageCtx *ictx;
+  ASSERT_EQ(0, open_image(m_image_name, &ictx));
+
+  MockTestImageCtx mock_image_ctx(*ictx);
+  MockExclusiveLock mock_exclusive_lock;
+  MockImageWriteback mock_image_writeback;
+  init_mock_image_ctx(mock_image_ctx);
+  mock_image_ctx.exclusive_lock = &mock_exclusive_lock;
+
+  std::atomic<bool> lock_owner(false);
+  EXPECT_CALL(mock_exclusive_lock, is_lock_owner())
+    .WillRepeatedly(Invoke([&lock_owner]() { return lock_owner.load(); }));
+
+  bufferlist bl;
+  bl.append(std::string(4096, '1'));
+
+  MockFileImageCache cache(mock_image_ctx);
+  ASSERT_EQ(0, init(cache));
+  ASSERT_EQ(0, write(cache, 0, bl));
+
+  // nothing is written back without the lock, but the data is durable
+  // in the log and reads see it
+  ASSERT_EQ(0, flush(cache));
+  bufferlist read_bl;
+  ASSERT_EQ(0, read(cache, 0, bl.length(), &read_bl));
+  ASSERT_TRUE(read_bl.contents_equal(bl));
+
+  lock_owner = true;
+  expect_writeback(mock_image_ctx, mock_image_writeback, 0, bl, 0);
+  ASSERT_EQ(0, flush(cache));
+  ASSERT_EQ(0, shut_down(cache));
+}
+
+TEST_F(TestMockCacheFileImageCache, LogInUse) {
+  librbd::ImageCtx *ictx;
+  ASSERT_EQ(0, open_image(m_image_name, &ictx));
+
+  MockTestImageCtx mock_image_ctx(*ictx);
+  MockImageWriteback mock_image_writeback;
+  init_mock_image_ctx(mock_image_ctx);
+
+  MockFileImageCache cache(mock_image_ctx);
+  ASSERT_EQ(0, init(cache));
+
+  // a second writer on the same log is refused
+  MockFileImageCache other(mock_image_ctx);
+  ASSERT_EQ(-EBUSY, init(other));
+
+  ASSERT_EQ(0, shut_down(cache));
+}
+
+TEST_F(TestMockCacheFileImageCache, BrokenLockDiscardsLog) {
+  librbd::ImageCtx *ictx;
+  ASSERT_EQ(0, open_image(m_image_name, &ictx));
+
+  MockTestImageCtx mock_image_ctx(*ictx);
+  MockImageWriteback mock_image_writeback;
+  init_mock_image_ctx(mock_image_ctx);
+
+  bufferlist bl;
+  bl.append(std::string(4096, '1'));
+
+  expect_writeback_error(mock_image_ctx, mock_image_writeback);
+  {
+    MockFileImageCache cache(mock_image_ctx);
+    ASSERT_EQ(0, init(cache));
+    ASSERT_EQ(0, write(cache, 0, bl));
+    ASSERT_EQ(-EIO, shut_down(cache));
+  }
+  std::string value;
+  ASSERT_EQ(0, librbd::cls_client::metadata_get(&ictx->md_ctx,
+                                                ictx->header_oid,
+                                                RBD_PERSISTENT_CACHE_KEY,
+                                                &value));
+
+  // as if another client broke our lock: the log must not be replayed
+  ASSERT_EQ(0, librbd::cls_client::metadata_remove(&ictx->md_ctx,
+                                                   ictx->header_oid,
+                                                   RBD_PERSISTENT_CACHE_KEY));
+  expect_no_writeback(mock_image_writeback);
+  MockFileImageCache cache(mock_image_ctx);
+  ASSERT_EQ(0, init(cache));
+  ASSERT_EQ(0, flush(cache));
+  ASSERT_EQ(0, shut_down(cache));
+}
+
+TEST_F(TestMockCacheFileImageCache, InvalidateDropsLog) {
+  librbd::ImageCtx *ictx;
+  ASSERT_EQ(0, open_image(m_image_name, &ictx));
+
+  MockTestImageCtx mock_image_ctx(*ictx);
+  MockImageWriteback mock_image_writeback;
+  init_mock_image_ctx(mock_image_ctx);
+
+  bufferlist bl;
+  bl.append(std::string(4096, '1'));
+
+  expect_writeback_error(mock_image_ctx, mock_image_writeback);
+  MockFileImageCache cache(mock_image_ctx);
+  ASSERT_EQ(0, init(cache));
+  ASSERT_EQ(0, write(cache, 0, bl));
+  ASSERT_EQ(-EIO, flush(cache));
+
+  // nothing is written back, now or after the log is reopened
+  expect_no_writeback(mock_image_writeback);
+  ASSERT_EQ(0, invalidate(cache));
+  ASSERT_EQ(0, flush(cache));
+  ASSERT_EQ(0, shut_down(cache));
+
+  std::string value;
+  ASSERT_EQ(-ENOENT, librbd::cls_client::metadata_get(&ictx->md_ctx,
+                                                      ictx->header_oid,
+                                                      RBD_PERSISTENT_CACHE_KEY,
+                                                      &value));
+
+  MockFileImageCache reopened(mock_image_ctx);
+  ASSERT_EQ(0, init(reopened));
+  ASSERT_EQ(0, flush(reopened));
+  ASSERT_EQ(0, shut_down(reopened));
+}
+
+} // namespace cache
+} // namespace librbd
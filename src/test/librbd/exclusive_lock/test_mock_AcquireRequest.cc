@@ -233,6 +233,11 @@ public:
     EXPECT_CALL(get_mock_io_ctx(mock_image_ctx.md_ctx),
                 exec(mock_image_ctx.header_oid, _, StrEq("lock"), StrEq("break_lock"), _, _, _))
                   .WillOnce(Return(r));
+    if (r == 0) {
+      EXPECT_CALL(get_mock_io_ctx(mock_image_ctx.md_ctx),
+                  exec(mock_image_ctx.header_oid, _, StrEq("rbd"), StrEq("metadata_remove"), _, _, _))
+                    .WillOnce(Return(0));
+    }
   }
 
   void expect_flush_notifies(MockTestImageCtx &mock_image_ctx) {
@@ -96,7 +96,11 @@ struct MockImageCtx {
       journal_max_concurrent_object_sets(
           image_ctx.journal_max_concurrent_object_sets),
       mirroring_resync_after_disconnect(
-          image_ctx.mirroring_resync_after_disconnect)
+          image_ctx.mirroring_resync_after_disconnect),
+      persistent_cache_path(image_ctx.persistent_cache_path),
+      persistent_cache_size(image_ctx.persistent_cache_size),
+      persistent_cache_writeback_bytes(
+          image_ctx.persistent_cache_writeback_bytes)
   {
     md_ctx.dup(image_ctx.md_ctx);
     data_ctx.dup(image_ctx.data_ctx);
@@ -272,6 +276,9 @@ struct MockImageCtx {
   uint32_t journal_max_payload_bytes;
   int journal_max_concurrent_object_sets;
   bool mirroring_resync_after_disconnect;
+  std::string persistent_cache_path;
+  uint64_t persistent_cache_size;
+  uint64_t persistent_cache_writeback_bytes;
 };
 
 } // namespace librbd
@@ -0,0 +1,197 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+/*
+ * Ceph - scalable distributed file system
+ *
+ * This is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License version 2.1, as published by the Free Software
+ * Foundation.  See file COPYING.
+ *
+ */
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "mds/RequestBatch.h"
+
+#include "gtest/gtest.h"
+
+using std::string;
+using std::vector;
+
+namespace {
+
+/*
+ * Stands in for a getattr MDRequest: killed is set when the client
+ * session goes away, excl when its client is issued an EXCL cap on the
+ * inode while queued, denied when check_access() refuses it.
+ */
+struct FakeReq {
+  string name;
+  bool killed = false;
+  bool excl = false;
+  bool denied = false;
+  explicit FakeReq(const string& n) : name(n) {}
+};
+typedef std::shared_ptr<FakeReq> ReqRef;
+typedef RequestBatch<string, ReqRef> batch_t;
+
+// what Server::BatchGetattrOps does, recorded
+struct FakeOps : public batch_t::Ops {
+  vector<string> answered, errored, retried;
+
+  bool killed(ReqRef& r) override {
+    return r->killed;
+  }
+  bool batchable(ReqRef& r) override {
+    return !r->excl;
+  }
+  void answer(ReqRef& r) override {
+    if (r->denied)
+      errored.push_back(r->name);
+    else
+      answered.push_back(r->name);
+  }
+  void retry(ReqRef& r) override {
+    retried.push_back(r->name);
+  }
+};
+
+ReqRef req(const string& name)
+{
+  return std::make_shared<FakeReq>(name);
+}
+
+} // anonymous namespace
+
+TEST(RequestBatch, Reply)
+{
+  batch_t batch;
+  ReqRef head = req("head"), a = req("a"), b = req("b"), other = req("other");
+
+  EXPECT_FALSE(batch.add("ino1", head));
+  EXPECT_TRUE(batch.add("ino1", a));
+  EXPECT_TRUE(batch.add("ino1", b));
+  EXPECT_FALSE(batch.add("ino2", other));
+  EXPECT_EQ(head, *batch.get_head("ino1"));
+  EXPECT_EQ(2u, batch.num_queued("ino1"));
+  EXPECT_EQ(0u, batch.num_queued("ino2"));
+
+  FakeOps ops;
+  batch.reply("ino1", head, ops);
+  EXPECT_EQ(vector<string>({"a", "b"}), ops.answered);
+  EXPECT_TRUE(ops.retried.empty());
+
+  // the head stays registered until it goes away
+  EXPECT_EQ(head, *batch.get_head("ino1"));
+  EXPECT_EQ(0u, batch.num_queued("ino1"));
+  batch.cancel("ino1", head, ops);
+  EXPECT_EQ(NULL, batch.get_head("ino1"));
+  EXPECT_TRUE(ops.retried.empty());
+}
+
+TEST(RequestBatch, HeadGoesAway)
+{
+  // the head is forwarded, fails, or is killed before it can reply
+  batch_t batch;
+  ReqRef head = req("head"), a = req("a"), b = req("b"), c = req("c");
+  batch.add("ino1", head);
+  batch.add("ino1", a);
+  batch.add("ino1", b);
+  batch.add("ino1", c);
+
+  FakeOps ops;
+  batch.cancel("ino1", head, ops);
+  EXPECT_TRUE(ops.answered.empty());
+  EXPECT_EQ(vector<string>({"a", "b", "c"}), ops.retried);
+  EXPECT_EQ(NULL, batch.get_head("ino1"));
+
+  // redispatched in order: the first one becomes the new head
+  EXPECT_FALSE(batch.add("ino1", a));
+  EXPECT_TRUE(batch.add("ino1", b));
+  EXPECT_TRUE(batch.add("ino1", c));
+  EXPECT_EQ(a, *batch.get_head("ino1"));
+
+  FakeOps ops2;
+  batch.reply("ino1", a, ops2);
+  EXPECT_EQ(vector<string>({"b", "c"}), ops2.answered);
+}
+
+TEST(RequestBatch, KilledWhileQueued)
+{
+  batch_t batch;
+  ReqRef head = req("head"), a = req("a"), b = req("b");
+  batch.add("ino1", head);
+  batch.add("ino1", a);
+  batch.add("ino1", b);
+  a->killed = true;
+
+  FakeOps ops;
+  batch.reply("ino1", head, ops);
+  EXPECT_EQ(vector<string>({"b"}), ops.answered);
+  EXPECT_TRUE(ops.retried.empty());
+  batch.cancel("ino1", head, ops);
+
+  // nor is a killed request redispatched when the head goes away
+  batch.add("ino1", head);
+  batch.add("ino1", a);
+  batch.add("ino1", b);
+  FakeOps ops2;
+  batch.cancel("ino1", head, ops2);
+  EXPECT_EQ(vector<string>({"b"}), ops2.retried);
+}
+
+TEST(RequestBatch, ExclWhileQueued)
+{
+  // a's client is issued an EXCL cap while a waits: the head did not
+  // lock for a's cached fields, so a has to go through on its own
+  batch_t batch;
+  ReqRef head = req("head"), a = req("a"), b = req("b");
+  batch.add("ino1", head);
+  batch.add("ino1", a);
+  batch.add("ino1", b);
+  a->excl = true;
+
+  FakeOps ops;
+  batch.reply("ino1", head, ops);
+  EXPECT_EQ(vector<string>({"b"}), ops.answered);
+  EXPECT_EQ(vector<string>({"a"}), ops.retried);
+}
+
+TEST(RequestBatch, AccessDenied)
+{
+  // each batched request gets its own access check; one failing does
+  // not affect the others
+  batch_t batch;
+  ReqRef head = req("head"), a = req("a"), b = req("b"), c = req("c");
+  batch.add("ino1", head);
+  batch.add("ino1", a);
+  batch.add("ino1", b);
+  batch.add("ino1", c);
+  b->denied = true;
+
+  FakeOps ops;
+  batch.reply("ino1", head, ops);
+  EXPECT_EQ(vector<string>({"a", "c"}), ops.answered);
+  EXPECT_EQ(vector<string>({"b"}), ops.errored);
+  EXPECT_TRUE(ops.retried.empty());
+}
+
+TEST(RequestBatch, QueuedAfterReply)
+{
+  // requests arriving between reply() and cancel() of the same head
+  // are retried when it goes away
+  batch_t batch;
+  ReqRef head = req("head"), a = req("a"), late = req("late");
+  batch.add("ino1", head);
+  batch.add("ino1", a);
+
+  FakeOps ops;
+  batch.reply("ino1", head, ops);
+  EXPECT_TRUE(batch.add("ino1", late));
+  batch.cancel("ino1", head, ops);
+  EXPECT_EQ(vector<string>({"a"}), ops.answered);
+  EXPECT_EQ(vector<string>({"late"}), ops.retried);
+}
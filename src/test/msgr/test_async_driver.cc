@@ -327,6 +327,49 @@ TEST(EventCenterTest, DispatchTest) {
   worker2.join();
 }
 
+class OrderEvent: public EventCallback {
+  EventCenter *center;
+  vector<int> *order;
+  int id;
+  int next;
+
+ public:
+  OrderEvent(EventCenter *c, vector<int> *o, int i, int n = -1)
+    : center(c), order(o), id(i), next(n) {}
+  void do_request(int fd) {
+    order->push_back(id);
+    if (next >= 0)
+      center->dispatch_event_external(
+        EventCallbackRef(new OrderEvent(center, order, next)));
+  }
+};
+
+TEST(EventCenterTest, BusyPollSpillOrder) {
+  g_ceph_context->_conf->set_val("ms_async_busy_poll", "true");
+  EventCenter center(g_ceph_context);
+  center.init(100, 0);
+  g_ceph_context->_conf->set_val("ms_async_busy_poll", "false");
+  ASSERT_TRUE(center.is_busy_poll());
+
+  // more than the ring holds, so the tail spills into the deque; the
+  // event queued by the first one finds room in the ring again but must
+  // still run after everything that spilled
+  vector<int> order;
+  const int n = 3000;
+  center.dispatch_event_external(
+    EventCallbackRef(new OrderEvent(&center, &order, 0, n)));
+  for (int i = 1; i < n; ++i)
+    center.dispatch_event_external(
+      EventCallbackRef(new OrderEvent(&center, &order, i)));
+  center.set_owner();
+  while (order.size() < (size_t)n + 1)
+    center.process_events(0);
+
+  ASSERT_EQ((size_t)n + 1, order.size());
+  for (int i = 0; i <= n; ++i)
+    ASSERT_EQ(i, order[i]);
+}
+
 INSTANTIATE_TEST_CASE_P(
   AsyncMessenger,
   EventDriverTest,
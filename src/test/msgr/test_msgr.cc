@@ -98,6 +98,8 @@ class FakeDispatcher : public Dispatcher {
   bool got_remote_reset;
   bool got_connect;
   bool loopback;
+  bufferptr recv_buffer;  ///< if set, supplied for incoming data
+  bufferlist last_data;
 
   explicit FakeDispatcher(bool s): Dispatcher(g_ceph_context), lock("FakeDispatcher::lock"),
                           is_server(s), got_new(false), got_remote_reset(false),
@@ -134,6 +136,13 @@ class FakeDispatcher : public Dispatcher {
     }
     s->put();
   }
+  bool ms_get_recv_buffer(Connection *con, const ceph_msg_header &header,
+                          bufferlist &data) {
+    if (!recv_buffer.length() || recv_buffer.length() < le32_to_cpu(header.data_len))
+      return false;
+    data.push_back(recv_buffer);
+    return true;
+  }
   bool ms_dispatch(Message *m) {
     Session *s = static_cast<Session*>(m->get_connection()->get_priv());
     if (!s) {
@@ -187,6 +196,10 @@ class FakeDispatcher : public Dispatcher {
     s->put();
     s->count++;
     lderr(g_ceph_context) << __func__ << " conn: " << m->get_connection() << " session " << s << " count: " << s->count << dendl;
+    if (is_server) {
+      Mutex::Locker l(lock);
+      last_data = m->get_data();
+    }
     if (is_server) {
       if (loopback)
         assert(m->get_source().is_osd());
@@ -760,6 +773,30 @@ TEST_P(MessengerTest, MessageTest) {
     ASSERT_TRUE(cli_dispatcher.got_new);
     cli_dispatcher.got_new = false;
   }
+
+  // 3. "data" received into a buffer the dispatcher supplied
+  {
+    bufferlist bl;
+    string s("abcdefghijklmnopqrstuvwxyz");
+    for (int i = 0; i < 1024*30; i++)
+      bl.append(s);
+    srv_dispatcher.recv_buffer = buffer::create_page_aligned(bl.length());
+    MPing *m = new MPing();
+    m->set_data(bl);
+    conn->send_message(m);
+    utime_t t;
+    t += 1000*1000*500;
+    Mutex::Locker l(cli_dispatcher.lock);
+    while (!cli_dispatcher.got_new)
+      cli_dispatcher.cond.WaitInterval(g_ceph_context, cli_dispatcher.lock, t);
+    ASSERT_TRUE(cli_dispatcher.got_new);
+    cli_dispatcher.got_new = false;
+    Mutex::Locker l2(srv_dispatcher.lock);
+    ASSERT_TRUE(srv_dispatcher.last_data.contents_equal(bl));
+    ASSERT_EQ(1u, srv_dispatcher.last_data.get_num_buffers());
+    ASSERT_EQ(srv_dispatcher.recv_buffer.c_str(),
+              srv_dispatcher.last_data.buffers().front().c_str());
+  }
   server_msgr->shutdown();
   client_msgr->shutdown();
   server_msgr->wait();
@@ -16,6 +16,8 @@
 #include "include/stringify.h"
 #include <gtest/gtest.h>
 #include <os/bluestore/BitAllocator.h>
+#include <chrono>
+#include <random>
 
 #if GTEST_HAS_PARAM_TEST
 
@@ -229,11 +231,129 @@ TEST_P(AllocTest, test_alloc_hint_bmap)
   EXPECT_EQ(extents[0].offset, (uint64_t) 0);
 }
 
+TEST_P(AllocTest, test_alloc_largest_extent)
+{
+  if (GetParam() == std::string("bitmap")) {
+    return;
+  }
+  int64_t block_size = 1024;
+  int64_t blocks = BitMapZone::get_total_blocks() * 4;
+  uint64_t offset = 0;
+  uint32_t length = 0;
+
+  init_alloc(blocks * block_size, block_size);
+  // free runs of 3, 7 and 5 blocks
+  alloc->init_add_free(0, block_size * 3);
+  alloc->init_add_free(block_size * 10, block_size * 7);
+  alloc->init_add_free(block_size * 20, block_size * 5);
+  EXPECT_EQ(alloc->reserve(block_size * 15), 0);
+
+  // nothing holds 8 blocks; we get at least one alloc_unit
+  EXPECT_EQ(alloc->allocate(block_size * 8, block_size, 0, &offset, &length), 0);
+  EXPECT_LE(length, (uint64_t)block_size * 8);
+  EXPECT_GE(length, (uint64_t)block_size);
+  if (GetParam() == std::string("hierarchical")) {
+    // ... and the hierarchical allocator hands out the largest run
+    EXPECT_EQ(offset, (uint64_t)block_size * 10);
+    EXPECT_EQ(length, (uint64_t)block_size * 7);
+  }
+  EXPECT_EQ(alloc->get_free(), (uint64_t)block_size * 15 - length);
+}
+
+/*
+ * Fragment a device the way a long running OSD does, then time
+ * allocations and the mount time rebuild from the freelist.  This
+ * fills a 4 GB device, so it only runs when asked for with
+ * --gtest_also_run_disabled_tests.
+ */
+TEST_P(AllocTest, DISABLED_bench_fragmented)
+{
+  typedef std::chrono::steady_clock clock;
+  const int64_t block_size = 4096;
+  const int64_t size = 4ull << 30;
+  const unsigned num_allocs = 20000;
+
+  init_alloc(size, block_size);
+  alloc->init_add_free(0, size);
+
+  // fill to ~90% with 4K..64K objects, then delete half of them
+  std::mt19937 rng(0);
+  std::uniform_int_distribution<int> len_dist(1, 16);
+  std::vector<std::pair<uint64_t, uint32_t> > used;
+  uint64_t filled = 0;
+  while (filled < size / 10 * 9) {
+    uint64_t want = len_dist(rng) * block_size;
+    uint64_t offset = 0;
+    uint32_t length = 0;
+    ASSERT_EQ(alloc->reserve(want), 0);
+    ASSERT_EQ(alloc->allocate(want, block_size, 0, &offset, &length), 0);
+    if (length < want)
+      alloc->unreserve(want - length);
+    used.push_back(std::make_pair(offset, length));
+    filled += length;
+  }
+  std::shuffle(used.begin(), used.end(), rng);
+  for (size_t i = 0; i < used.size() / 2; ++i)
+    alloc->release(used[i].first, used[i].second);
+  alloc->commit_start();
+  alloc->commit_finish();
+  used.erase(used.begin(), used.begin() + used.size() / 2);
+
+  // allocate/release churn at 64K
+  auto start = clock::now();
+  for (unsigned i = 0; i < num_allocs; ++i) {
+    uint64_t offset = 0;
+    uint32_t length = 0;
+    ASSERT_EQ(alloc->reserve(65536), 0);
+    ASSERT_EQ(alloc->allocate(65536, block_size, 0, &offset, &length), 0);
+    if (length < 65536)
+      alloc->unreserve(65536 - length);
+    alloc->release(offset, length);
+    if (i % 64 == 63) {
+      alloc->commit_start();
+      alloc->commit_finish();
+    }
+  }
+  double alloc_usec = std::chrono::duration<double, std::micro>(
+    clock::now() - start).count() / num_allocs;
+  alloc->commit_start();
+  alloc->commit_finish();
+
+  // mount: replay the free extents into a fresh allocator
+  std::sort(used.begin(), used.end());
+  std::vector<std::pair<uint64_t, uint64_t> > free_list;
+  uint64_t pos = 0;
+  for (auto& u : used) {
+    if (u.first > pos)
+      free_list.push_back(std::make_pair(pos, u.first - pos));
+    pos = u.first + u.second;
+  }
+  if ((uint64_t)size > pos)
+    free_list.push_back(std::make_pair(pos, size - pos));
+
+  start = clock::now();
+  init_alloc(size, block_size);
+  for (auto& f : free_list)
+    alloc->init_add_free(f.first, f.second);
+  {
+    uint64_t offset = 0;
+    uint32_t length = 0;
+    ASSERT_EQ(alloc->reserve(block_size), 0);
+    ASSERT_EQ(alloc->allocate(block_size, block_size, 0, &offset, &length), 0);
+  }
+  double mount_msec = std::chrono::duration<double, std::milli>(
+    clock::now() - start).count();
+
+  std::cout << GetParam() << ": " << free_list.size() << " free extents, "
+	    << alloc_usec << " us/allocate, "
+	    << mount_msec << " ms to rebuild" << std::endl;
+  alloc->shutdown();
+}
 
 INSTANTIATE_TEST_CASE_P(
   Allocator,
   AllocTest,
-  ::testing::Values("stupid", "bitmap"));
+  ::testing::Values("stupid", "bitmap", "hierarchical"));
 
 #else
 
@@ -1102,6 +1102,56 @@ TEST(ExtentMap, GarbageCollectorTest)
   ASSERT_EQ(gc_end_offset, 0x2f000ul);
 }
 
+TEST(CacheBalancer, balance)
+{
+  typedef BlueStore::CacheBalancer CB;
+  uint64_t total = 1000;
+  CB cb(.4, .3, .1, .1);
+  ASSERT_EQ(400u, cb.get_target(total, CB::CACHE_ONODE));
+  ASSERT_EQ(300u, cb.get_target(total, CB::CACHE_BUFFER));
+  ASSERT_EQ(300u, cb.get_target(total, CB::CACHE_KV));
+
+  CB::sample_t s[CB::CACHE_MAX];
+
+  // nothing is full: no change
+  s[CB::CACHE_ONODE].used = 100;
+  s[CB::CACHE_ONODE].hits = 10;
+  s[CB::CACHE_ONODE].misses = 90;
+  ASSERT_EQ(-1, cb.balance(total, s));
+
+  // full onode cache that misses grows from the idle buffer cache
+  s[CB::CACHE_ONODE].used = 400;
+  s[CB::CACHE_BUFFER].used = 50;
+  s[CB::CACHE_KV].used = 290;
+  s[CB::CACHE_KV].hits = 10;
+  s[CB::CACHE_KV].misses = 10;
+  ASSERT_EQ(CB::CACHE_ONODE, cb.balance(total, s));
+  ASSERT_EQ(500u, cb.get_target(total, CB::CACHE_ONODE));
+  ASSERT_EQ(200u, cb.get_target(total, CB::CACHE_BUFFER));
+
+  // everything full: take from the one that misses least
+  s[CB::CACHE_ONODE].used = 500;
+  s[CB::CACHE_BUFFER].used = 200;
+  s[CB::CACHE_BUFFER].hits = 99;
+  s[CB::CACHE_BUFFER].misses = 1;
+  ASSERT_EQ(CB::CACHE_ONODE, cb.balance(total, s));
+  ASSERT_EQ(600u, cb.get_target(total, CB::CACHE_ONODE));
+  ASSERT_EQ(100u, cb.get_target(total, CB::CACHE_BUFFER));
+
+  // the buffer cache is at its floor; kv gives instead
+  s[CB::CACHE_ONODE].used = 600;
+  s[CB::CACHE_BUFFER].used = 100;
+  ASSERT_EQ(CB::CACHE_ONODE, cb.balance(total, s));
+  ASSERT_EQ(100u, cb.get_target(total, CB::CACHE_BUFFER));
+  ASSERT_EQ(200u, cb.get_target(total, CB::CACHE_KV));
+
+  // untracked caches neither grow nor shrink
+  s[CB::CACHE_KV].tracked = false;
+  s[CB::CACHE_ONODE].used = 700;
+  ASSERT_EQ(-1, cb.balance(total, s));
+  ASSERT_EQ(700u, cb.get_target(total, CB::CACHE_ONODE));
+}
+
 
 int main(int argc, char **argv) {
   vector<const char*> args;
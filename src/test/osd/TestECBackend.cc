@@ -58,3 +58,65 @@ TEST(ECUtil, stripe_info_t)
             make_pair((uint64_t)0, 2*swidth));
 }
 
+
+TEST(ExtentCache, pin_and_read)
+{
+  const uint64_t swidth = 4096;
+  hobject_t oid(sobject_t("foo", CEPH_NOSNAP));
+
+  ExtentCache cache(swidth);
+  bufferlist bl;
+  ASSERT_FALSE(cache.read(oid, swidth, 0, swidth, &bl));
+
+  ECUtil::object_stripes_t obj;
+  obj.stripes[swidth].append(string(swidth, 'a'));
+  obj.valid_to = 3 * swidth;
+  cache.update(oid, obj, 1);
+  cache.update(oid, obj, 2);
+
+  // stripe 0 is unknown, stripe 1 cached and stripe 3 past valid_to
+  ASSERT_FALSE(cache.read(oid, swidth, 0, 2 * swidth, &bl));
+  ASSERT_EQ(0u, bl.length());
+  ASSERT_TRUE(cache.read(oid, swidth, swidth, swidth, &bl));
+  ASSERT_EQ(string(swidth, 'a'), bl.to_str());
+  bl.clear();
+  ASSERT_TRUE(cache.read(oid, swidth, 3 * swidth, swidth, &bl));
+  ASSERT_TRUE(bl.is_zero());
+
+  // pinned entries stay however small the cache is
+  cache.set_max_bytes(0);
+  ASSERT_EQ(1u, cache.get_num_objects());
+  cache.release(oid, 1);
+  ASSERT_EQ(1u, cache.get_num_objects());
+  cache.release(oid, 2);
+  ASSERT_EQ(0u, cache.get_num_objects());
+  ASSERT_EQ(0u, cache.get_bytes());
+}
+
+TEST(ExtentCache, lru)
+{
+  const uint64_t swidth = 4096;
+  hobject_t a(sobject_t("a", CEPH_NOSNAP));
+  hobject_t b(sobject_t("b", CEPH_NOSNAP));
+
+  ExtentCache cache(swidth);
+  ECUtil::object_stripes_t obj;
+  obj.stripes[0].append_zero(swidth);
+  cache.update(a, obj, 1);
+  cache.update(b, obj, 2);
+  cache.release(a, 1);
+  ASSERT_EQ(2u, cache.get_num_objects());
+  cache.release(b, 2);
+  // a was released first and goes first
+  ASSERT_EQ(1u, cache.get_num_objects());
+  ASSERT_TRUE(cache.get(b));
+  ASSERT_FALSE(cache.get(a));
+
+  // invalidating a pinned entry does nothing
+  cache.update(b, obj, 3);
+  cache.invalidate(b);
+  ASSERT_TRUE(cache.get(b));
+  cache.release(b, 3);
+  cache.invalidate(b);
+  ASSERT_FALSE(cache.get(b));
+}
@@ -411,3 +411,72 @@ TEST_F(OSDMapTest, PrimaryAffinity) {
     osdmap.set_primary_affinity(1, 0x10000);
   }
 }
+
+TEST_F(OSDMapTest, MappingCache) {
+  set_up_map();
+
+  // pool 0 (replicated) and the ec pool
+  set<int64_t> pools;
+  for (int64_t p = 0; p <= osdmap.get_pool_max(); ++p)
+    if (osdmap.have_pg_pool(p))
+      pools.insert(p);
+  ASSERT_EQ(2u, pools.size());
+
+  auto check = [&]() {
+    OSDMap plain;
+    plain.deepish_copy_from(osdmap);
+    g_ceph_context->_conf->set_val("osd_map_mapping_cache", "false");
+    plain.update_mapping_cache(g_ceph_context);
+    ASSERT_FALSE(plain.have_mapping_cache());
+    ASSERT_TRUE(osdmap.have_mapping_cache());
+    for (auto p : pools) {
+      for (int ps = 0; ps < osdmap.get_pg_num(p); ++ps) {
+	pg_t pgid(ps, p);
+	vector<int> up, acting, eup, eacting;
+	int up_primary, acting_primary, eup_primary, eacting_primary;
+	osdmap.pg_to_up_acting_osds(pgid, &up, &up_primary,
+				    &acting, &acting_primary);
+	plain.pg_to_up_acting_osds(pgid, &eup, &eup_primary,
+				   &eacting, &eacting_primary);
+	EXPECT_EQ(eup, up);
+	EXPECT_EQ(eup_primary, up_primary);
+	EXPECT_EQ(eacting, acting);
+	EXPECT_EQ(eacting_primary, acting_primary);
+	osdmap.pg_to_raw_up(pgid, &up, &up_primary);
+	plain.pg_to_raw_up(pgid, &eup, &eup_primary);
+	EXPECT_EQ(eup, up);
+	EXPECT_EQ(eup_primary, up_primary);
+      }
+    }
+  };
+
+  g_ceph_context->_conf->set_val("osd_map_mapping_cache", "true");
+  g_ceph_context->_conf->set_val("osd_map_mapping_threads", "4");
+  osdmap.update_mapping_cache(g_ceph_context);
+  check();
+
+  // temp-only changes are carried into the next epoch without a rebuild
+  pg_t pgid = osdmap.raw_pg_to_pg(pg_t(0, 0));
+  vector<int> acting;
+  osdmap.pg_to_acting_osds(pgid, acting);
+  OSDMap::Incremental temp_inc(osdmap.get_epoch() + 1);
+  vector<int> new_acting(acting.rbegin(), acting.rend());
+  temp_inc.new_pg_temp[pgid] = new_acting;
+  temp_inc.new_primary_temp[osdmap.raw_pg_to_pg(pg_t(1, 0))] = acting[1];
+  osdmap.apply_incremental(temp_inc);
+  g_ceph_context->_conf->set_val("osd_map_mapping_cache", "true");
+  check();
+  osdmap.pg_to_acting_osds(pgid, acting);
+  EXPECT_EQ(new_acting, acting);
+
+  // anything else drops the cache until it is rebuilt
+  OSDMap::Incremental down_inc(osdmap.get_epoch() + 1);
+  down_inc.new_state[0] = CEPH_OSD_UP;
+  osdmap.apply_incremental(down_inc);
+  EXPECT_FALSE(osdmap.have_mapping_cache());
+  g_ceph_context->_conf->set_val("osd_map_mapping_cache", "true");
+  osdmap.update_mapping_cache(g_ceph_context);
+  check();
+
+  g_ceph_context->_conf->set_val("osd_map_mapping_cache", "false");
+}
@@ -86,6 +86,15 @@ public:
     return e;
   }
 
+  static pg_log_entry_t mk_ple_ow_rb(
+    const hobject_t &hoid, eversion_t v, eversion_t pv) {
+    pg_log_entry_t e = mk_ple_mod_rb(hoid, v, pv);
+    vector<pair<uint64_t, uint64_t> > extents;
+    extents.push_back(make_pair(0, 4096));
+    e.mod_desc.rollback_extents(v.version, extents);
+    return e;
+  }
+
   struct TestCase {
     list<pg_log_entry_t> base;
     list<pg_log_entry_t> auth;
@@ -378,9 +387,9 @@ TEST_F(PGLogTest, rewind_divergent_log) {
     rewind_divergent_log(t, newhead, info, &h,
 			 dirty_info, dirty_big_info);
 
-    EXPECT_TRUE(log.objects.count(divergent));
+    EXPECT_TRUE(log.logged_object(divergent));
     EXPECT_TRUE(missing.is_missing(divergent_object));
-    EXPECT_EQ(1U, log.objects.count(divergent_object));
+    EXPECT_TRUE(log.logged_object(divergent_object));
     EXPECT_EQ(2U, log.log.size());
     EXPECT_TRUE(remove_snap.empty());
     EXPECT_TRUE(t.empty());
@@ -447,7 +456,7 @@ TEST_F(PGLogTest, rewind_divergent_log) {
 			 dirty_info, dirty_big_info);
 
     EXPECT_TRUE(missing.is_missing(divergent_object));
-    EXPECT_EQ(0U, log.objects.count(divergent_object));
+    EXPECT_FALSE(log.logged_object(divergent_object));
     EXPECT_TRUE(log.empty());
     EXPECT_TRUE(remove_snap.empty());
     EXPECT_TRUE(t.empty());
@@ -1104,7 +1113,7 @@ TEST_F(PGLogTest, merge_log) {
     }
 
     EXPECT_FALSE(missing.have_missing());
-    EXPECT_EQ(1U, log.objects.count(divergent_object));
+    EXPECT_TRUE(log.logged_object(divergent_object));
     EXPECT_EQ(3U, log.log.size());
     EXPECT_TRUE(remove_snap.empty());
     EXPECT_TRUE(t.empty());
@@ -1124,7 +1133,7 @@ TEST_F(PGLogTest, merge_log) {
        to be divergent.
     */
     EXPECT_TRUE(missing.is_missing(divergent_object));
-    EXPECT_EQ(1U, log.objects.count(divergent_object));
+    EXPECT_TRUE(log.logged_object(divergent_object));
     EXPECT_EQ(4U, log.log.size());
     /* DELETE entries from olog that are appended to the hed of the
        log are also added to remove_snap.
@@ -1834,6 +1843,21 @@ TEST_F(PGLogTest, merge_log_2) {
   run_test_case(t);
 }
 
+TEST_F(PGLogTest, merge_log_ec_overwrite) {
+  // divergent ec overwrites are rolled back from their stashed extents
+  TestCase t;
+  t.base.push_back(mk_ple_mod_rb(mk_obj(1), mk_evt(10, 100), mk_evt(8, 80)));
+
+  t.div.push_back(mk_ple_ow_rb(mk_obj(1), mk_evt(10, 101), mk_evt(10, 100)));
+  t.div.push_back(mk_ple_ow_rb(mk_obj(1), mk_evt(10, 102), mk_evt(10, 101)));
+
+  t.torollback.insert(
+    t.torollback.begin(), t.div.rbegin(), t.div.rend());
+
+  t.setup();
+  run_test_case(t);
+}
+
 TEST_F(PGLogTest, merge_log_3) {
   TestCase t;
   t.base.push_back(mk_ple_mod_rb(mk_obj(1), mk_evt(10, 100), mk_evt(8, 80)));
@@ -2095,6 +2119,71 @@ TEST_F(PGLogTest, get_request) {
   }
 }
 
+static bool in_log(const list<pg_log_entry_t>& l, const pg_log_entry_t *e) {
+  for (auto& i : l) {
+    if (&i == e)
+      return true;
+  }
+  return false;
+}
+
+TEST_F(PGLogTest, IndexedLogCopy) {
+  clear();
+
+  hobject_t oid1(object_t("obj1"), "", 123, 1, 0, "");
+  hobject_t oid2(object_t("obj2"), "", 123, 2, 0, "");
+  hobject_t oid3(object_t("obj3"), "", 123, 3, 0, "");
+  osd_reqid_t req1(entity_name_t::CLIENT(777), 8, 1);
+  osd_reqid_t req2(entity_name_t::CLIENT(777), 8, 2);
+  osd_reqid_t req3(entity_name_t::CLIENT(777), 8, 3);
+  log.add(pg_log_entry_t(pg_log_entry_t::MODIFY, oid1, eversion_t(6,2),
+			 eversion_t(3,4), 1, req1, utime_t(1,2), 0));
+  log.add(pg_log_entry_t(pg_log_entry_t::MODIFY, oid2, eversion_t(6,3),
+			 eversion_t(3,4), 2, req2, utime_t(1,3), 0));
+
+  // build the indexes of the source before copying it
+  EXPECT_TRUE(log.logged_object(oid1));
+  EXPECT_TRUE(log.logged_req(req1));
+
+  {
+    PGLog::IndexedLog copy(log);
+    EXPECT_TRUE(in_log(copy.log, copy.get_object_entry(oid1)));
+    EXPECT_TRUE(in_log(copy.log, copy.get_object_entry(oid2)));
+    EXPECT_TRUE(copy.logged_req(req1));
+    EXPECT_TRUE(copy.logged_req(req2));
+    EXPECT_TRUE(in_log(copy.log, copy.caller_ops.at(req1)));
+    EXPECT_TRUE(in_log(copy.log, copy.caller_ops.at(req2)));
+
+    // the copy's indexes follow its own log, not the source's
+    copy.add(pg_log_entry_t(pg_log_entry_t::MODIFY, oid1, eversion_t(7,1),
+			    eversion_t(6,2), 3, req3, utime_t(2,1), 0));
+    EXPECT_EQ(eversion_t(7,1), copy.get_object_entry(oid1)->version);
+    EXPECT_EQ(eversion_t(6,2), log.get_object_entry(oid1)->version);
+    EXPECT_TRUE(copy.logged_req(req3));
+    EXPECT_FALSE(log.logged_req(req3));
+  }
+
+  {
+    PGLog::IndexedLog assigned;
+    assigned.add(pg_log_entry_t(pg_log_entry_t::MODIFY, oid3, eversion_t(5,1),
+				eversion_t(3,4), 1, req3, utime_t(1,1), 0));
+    EXPECT_TRUE(assigned.logged_object(oid3));
+    EXPECT_TRUE(assigned.logged_req(req3));
+
+    assigned = log;
+    EXPECT_FALSE(assigned.logged_object(oid3));
+    EXPECT_FALSE(assigned.logged_req(req3));
+    EXPECT_TRUE(in_log(assigned.log, assigned.get_object_entry(oid1)));
+    EXPECT_TRUE(in_log(assigned.log, assigned.get_object_entry(oid2)));
+    EXPECT_TRUE(assigned.logged_req(req1));
+    EXPECT_TRUE(in_log(assigned.log, assigned.caller_ops.at(req1)));
+  }
+
+  // the source is untouched
+  EXPECT_TRUE(in_log(log.log, log.get_object_entry(oid1)));
+  EXPECT_TRUE(in_log(log.log, log.caller_ops.at(req2)));
+}
+
 TEST_F(PGLogTest, ErrorNotIndexedByObject) {
   clear();
 
@@ -2114,7 +2203,7 @@ TEST_F(PGLogTest, ErrorNotIndexedByObject) {
   log.add(modify);
 
   EXPECT_TRUE(log.logged_object(oid));
-  pg_log_entry_t *entry = log.objects[oid];
+  const pg_log_entry_t *entry = log.get_object_entry(oid);
   EXPECT_EQ(modify.op, entry->op);
   EXPECT_EQ(modify.version, entry->version);
   EXPECT_EQ(modify.prior_version, entry->prior_version);
@@ -2128,7 +2217,7 @@ TEST_F(PGLogTest, ErrorNotIndexedByObject) {
   log.add(del);
 
   EXPECT_TRUE(log.logged_object(oid));
-  entry = log.objects[oid];
+  entry = log.get_object_entry(oid);
   EXPECT_EQ(del.op, entry->op);
   EXPECT_EQ(del.version, entry->version);
   EXPECT_EQ(del.prior_version, entry->prior_version);
@@ -2141,7 +2230,7 @@ TEST_F(PGLogTest, ErrorNotIndexedByObject) {
 		   utime_t(20,1), -ENOENT));
 
   EXPECT_TRUE(log.logged_object(oid));
-  entry = log.objects[oid];
+  entry = log.get_object_entry(oid);
   EXPECT_EQ(del.op, entry->op);
   EXPECT_EQ(del.version, entry->version);
   EXPECT_EQ(del.prior_version, entry->prior_version);
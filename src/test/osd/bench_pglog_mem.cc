@@ -0,0 +1,163 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+/*
+ * Ceph - scalable distributed file system
+ *
+ * This is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License version 2.1, as published by the Free Software
+ * Foundation.  See file COPYING.
+ *
+ */
+
+/*
+ * Measure the heap taken by the in-memory pg logs of an osd.  Fills
+ * --pgs logs with --entries modify entries each, spread over --objects
+ * rbd-like object names per pg, and reports the bytes per entry the
+ * heap grows by for
+ *
+ *  - the log alone, which is what a pg holds after read_log until
+ *    something needs an index;
+ *  - the caller_ops index that dup detection builds on the first write;
+ *  - the object index as it was, keyed by copies of the hobject_t;
+ *  - the object index as it is now, keyed by pointers to the soid of
+ *    the log entries.
+ *
+ * Both layouts keep full pg_log_entry_t objects in the log itself;
+ * nothing here interns names or delta-encodes versions.
+ *
+ * The heap is sampled with mallinfo(), so run it against the allocator
+ * the osd uses.
+ */
+
+#include <malloc.h>
+#include <iomanip>
+
+#include "global/global_init.h"
+#include "global/global_context.h"
+#include "common/ceph_argparse.h"
+#include "common/config.h"
+#include "common/debug.h"
+#include "osd/PGLog.h"
+
+#define dout_subsys ceph_subsys_osd
+
+static void usage()
+{
+  derr << "usage: ceph_bench_pglog_mem [flags]\n"
+      "	 --pgs <n>\n"
+      "	       pg logs to fill, default 100\n"
+      "	 --entries <n>\n"
+      "	       entries per log, default 3000\n"
+      "	 --objects <n>\n"
+      "	       distinct objects written per pg, default 1000\n" << dendl;
+  generic_client_usage();
+}
+
+static size_t heap_used()
+{
+  struct mallinfo mi = mallinfo();
+  return (size_t)(unsigned)mi.uordblks + (size_t)(unsigned)mi.hblkhd;
+}
+
+static void report(const char *what, size_t before, size_t after,
+		   uint64_t entries)
+{
+  double per = after > before ? (double)(after - before) / entries : 0;
+  cout << std::left << std::setw(32) << what << std::right
+       << std::setw(12) << (after > before ? after - before : 0) << " bytes\t"
+       << std::fixed << std::setprecision(1) << per << " bytes/entry"
+       << std::endl;
+}
+
+int main(int argc, const char **argv)
+{
+  vector<const char*> args;
+  argv_to_vec(argc, argv, args);
+  env_to_vec(args);
+
+  global_init(NULL, args, CEPH_ENTITY_TYPE_CLIENT, CODE_ENVIRONMENT_UTILITY, 0);
+
+  int num_pg = 100;
+  int num_entries = 3000;
+  int num_objects = 1000;
+
+  std::string val;
+  vector<const char*>::iterator i = args.begin();
+  while (i != args.end()) {
+    if (ceph_argparse_double_dash(args, i))
+      break;
+    if (ceph_argparse_witharg(args, i, &val, "--pgs", (char*)NULL)) {
+      num_pg = atoi(val.c_str());
+    } else if (ceph_argparse_witharg(args, i, &val, "--entries", (char*)NULL)) {
+      num_entries = atoi(val.c_str());
+    } else if (ceph_argparse_witharg(args, i, &val, "--objects", (char*)NULL)) {
+      num_objects = atoi(val.c_str());
+    } else if (ceph_argparse_flag(args, i, "-h", "--help", (char*)NULL)) {
+      usage();
+      return 0;
+    } else {
+      derr << "Error: can't understand argument: " << *i << "\n" << dendl;
+      usage();
+      return 1;
+    }
+  }
+  if (num_pg <= 0 || num_entries <= 0 || num_objects <= 0) {
+    usage();
+    return 1;
+  }
+
+  common_init_finish(g_ceph_context);
+
+  uint64_t total = (uint64_t)num_pg * num_entries;
+  vector<PGLog::IndexedLog> logs(num_pg);
+
+  size_t start = heap_used();
+  for (int pg = 0; pg < num_pg; ++pg) {
+    PGLog::IndexedLog &log = logs[pg];
+    for (int e = 1; e <= num_entries; ++e) {
+      char name[64];
+      snprintf(name, sizeof(name), "rbd_data.%012x.%016x",
+	       pg, e % num_objects);
+      hobject_t oid(object_t(name), "", CEPH_NOSNAP, pg * 4096 + e % num_objects,
+		    1, "");
+      log.add(pg_log_entry_t(pg_log_entry_t::MODIFY, oid, eversion_t(1, e),
+			     eversion_t(1, e - 1), e,
+			     osd_reqid_t(entity_name_t::CLIENT(pg), 0, e),
+			     utime_t(e, 0), 0));
+    }
+  }
+  size_t filled = heap_used();
+
+  eversion_t v;
+  version_t uv;
+  int rc;
+  for (auto& log : logs)
+    log.get_request(osd_reqid_t(), &v, &uv, &rc);
+  size_t with_caller_ops = heap_used();
+
+  vector<ceph::unordered_map<hobject_t, pg_log_entry_t*> > legacy(num_pg);
+  for (int pg = 0; pg < num_pg; ++pg) {
+    for (auto& e : logs[pg].log)
+      legacy[pg][e.soid] = &e;
+  }
+  size_t with_legacy = heap_used();
+  legacy.clear();
+  size_t legacy_freed = heap_used();
+
+  for (auto& log : logs)
+    log.logged_object(hobject_t());
+  size_t with_objects = heap_used();
+
+  cout << num_pg << " pgs, " << num_entries << " entries and "
+       << num_objects << " objects per pg" << std::endl;
+  report("log", start, filled, total);
+  report("caller_ops index", filled, with_caller_ops, total);
+  report("object index, hobject_t keys", with_caller_ops, with_legacy, total);
+  report("object index, soid ptr keys", legacy_freed, with_objects, total);
+  report("total, eager, hobject_t keys", start, with_legacy, total);
+  report("total, lazy", start, filled, total);
+  report("total, eager, soid ptr keys", start,
+	 with_caller_ops + (with_objects - legacy_freed), total);
+  return 0;
+}
@@ -1542,6 +1542,48 @@ TEST(pool_opts_t, deep_scrub_interval) {
   EXPECT_FALSE(opts.is_set(pool_opts_t::DEEP_SCRUB_INTERVAL));
 }
 
+TEST(ObjectModDesc, rollback_extents) {
+  struct Collector : public ObjectModDesc::Visitor {
+    unsigned appends = 0;
+    vector<pair<version_t, vector<pair<uint64_t, uint64_t> > > > stashed;
+    void append(uint64_t) override {
+      ++appends;
+    }
+    void rollback_extents(
+      version_t gen,
+      const vector<pair<uint64_t, uint64_t> > &extents) override {
+      stashed.push_back(make_pair(gen, extents));
+    }
+  };
+
+  vector<pair<uint64_t, uint64_t> > extents;
+  extents.push_back(make_pair(0, 4096));
+  extents.push_back(make_pair(65536, 8192));
+
+  ObjectModDesc desc;
+  desc.append(4096);
+  EXPECT_TRUE(desc.rollback_extents(7, extents));
+
+  bufferlist bl;
+  ::encode(desc, bl);
+  ObjectModDesc decoded;
+  bufferlist::iterator p = bl.begin();
+  ::decode(decoded, p);
+  EXPECT_TRUE(decoded.can_rollback());
+
+  Collector c;
+  decoded.visit(&c);
+  EXPECT_EQ(1u, c.appends);
+  ASSERT_EQ(1u, c.stashed.size());
+  EXPECT_EQ(7u, c.stashed[0].first);
+  EXPECT_EQ(extents, c.stashed[0].second);
+
+  // once the whole object is stashed there is nothing more to record
+  ObjectModDesc removed;
+  EXPECT_TRUE(removed.rmobject(8));
+  EXPECT_FALSE(removed.rollback_extents(8, extents));
+}
+
 /*
  * Local Variables:
  * compile-command: "cd ../.. ;
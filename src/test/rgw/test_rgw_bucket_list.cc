@@ -0,0 +1,265 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+/*
+ * Ceph - scalable distributed file system
+ *
+ * This is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License version 2.1, as published by the Free Software
+ * Foundation. See file COPYING.
+ *
+ */
+#include "rgw/rgw_bucket_list.h"
+#include "global/global_init.h"
+#include "global/global_context.h"
+#include "common/ceph_argparse.h"
+#include <gtest/gtest.h>
+#include <set>
+
+namespace {
+
+typedef std::set<string> shard_t;
+
+// lists an in-memory shard the way the rgw.bucket_list cls method does:
+// the keys after start that begin with prefix
+class MemReader : public RGWBucketListShardReader {
+  const shard_t& shard;
+  string oid;
+  string prefix;
+  int err;
+  uint32_t *max_read;
+  rgw_cls_list_ret *result = nullptr;
+
+public:
+  MemReader(const shard_t& s, const string& o, const string& p, int e,
+            uint32_t *m)
+    : shard(s), oid(o), prefix(p), err(e), max_read(m) {}
+
+  const string& get_oid() override {
+    return oid;
+  }
+
+  int aio_list(const cls_rgw_obj_key& start, uint32_t num,
+               rgw_cls_list_ret *r) override {
+    result = r;
+    *max_read = std::max(*max_read, num);
+    auto i = shard.upper_bound(start.name);
+    for (; i != shard.end(); ++i) {
+      if (i->compare(0, prefix.size(), prefix) != 0)
+        continue;
+      if (result->dir.m.size() == num)
+        break;
+      rgw_bucket_dir_entry& e = result->dir.m[*i];
+      e.key.name = *i;
+      e.exists = true;
+    }
+    for (; i != shard.end(); ++i) {
+      if (i->compare(0, prefix.size(), prefix) == 0) {
+        result->is_truncated = true;
+        break;
+      }
+    }
+    return 0;
+  }
+
+  int aio_wait() override {
+    result = nullptr;
+    return err;
+  }
+};
+
+struct Listing {
+  vector<string> keys;
+  bool truncated = false;
+  uint32_t max_read = 0;
+};
+
+// merge the shards the way RGWRados::cls_bucket_list() does
+int list_shards(const vector<shard_t>& shards, const string& marker,
+                const string& prefix, uint32_t num, Listing *out,
+                uint32_t chunk = 2, int err = 0)
+{
+  RGWBucketListMerge merge;
+  for (size_t i = 0; i < shards.size(); ++i) {
+    merge.add(new RGWBucketListShardCursor(
+                g_ceph_context,
+                new MemReader(shards[i], "shard." + std::to_string(i), prefix,
+                              i == 0 ? err : 0, &out->max_read),
+                chunk, num));
+  }
+  int r = merge.start(cls_rgw_obj_key(marker), num);
+  if (r < 0)
+    return r;
+  while (out->keys.size() < num && merge.valid()) {
+    out->keys.push_back(merge.cursor()->key());
+    r = merge.next(num - out->keys.size());
+    if (r < 0)
+      return r;
+  }
+  out->truncated = merge.truncated();
+  return 0;
+}
+
+// spread keys over n shards by a stable hash, like the bucket index
+vector<shard_t> make_shards(const vector<string>& keys, size_t n)
+{
+  vector<shard_t> shards(n);
+  for (auto& k : keys)
+    shards[std::hash<string>()(k) % n].insert(k);
+  return shards;
+}
+
+vector<string> make_keys(const string& prefix, int n)
+{
+  vector<string> keys;
+  char buf[32];
+  for (int i = 0; i < n; ++i) {
+    snprintf(buf, sizeof(buf), "%04d", i);
+    keys.push_back(prefix + buf);
+  }
+  return keys;
+}
+
+} // anonymous namespace
+
+TEST(BucketListMerge, Ordered)
+{
+  vector<string> keys = make_keys("obj", 100);
+  vector<shard_t> shards = make_shards(keys, 7);
+
+  Listing l;
+  ASSERT_EQ(0, list_shards(shards, "", "", 1000, &l));
+  EXPECT_EQ(keys, l.keys);
+  EXPECT_FALSE(l.truncated);
+  // no shard is asked for more than the listing wants
+  EXPECT_LE(l.max_read, 1000u);
+}
+
+TEST(BucketListMerge, Truncated)
+{
+  vector<string> keys = make_keys("obj", 20);
+  vector<shard_t> shards = make_shards(keys, 3);
+
+  // exactly everything: nothing left in any shard
+  Listing all;
+  ASSERT_EQ(0, list_shards(shards, "", "", 20, &all));
+  EXPECT_EQ(keys, all.keys);
+  EXPECT_FALSE(all.truncated);
+
+  Listing part;
+  ASSERT_EQ(0, list_shards(shards, "", "", 19, &part));
+  EXPECT_EQ(vector<string>(keys.begin(), keys.begin() + 19), part.keys);
+  EXPECT_TRUE(part.truncated);
+
+  // the shard holding the last key is consumed, the others were already
+  Listing tail;
+  ASSERT_EQ(0, list_shards(shards, keys[18], "", 1, &tail));
+  EXPECT_EQ(vector<string>(1, keys[19]), tail.keys);
+  EXPECT_FALSE(tail.truncated);
+}
+
+TEST(BucketListMerge, MarkerContinuation)
+{
+  vector<string> keys = make_keys("obj", 50);
+  vector<shard_t> shards = make_shards(keys, 4);
+
+  // page through with the last key as the next marker
+  vector<string> got;
+  string marker;
+  for (;;) {
+    Listing l;
+    ASSERT_EQ(0, list_shards(shards, marker, "", 3, &l));
+    got.insert(got.end(), l.keys.begin(), l.keys.end());
+    if (!l.truncated)
+      break;
+    ASSERT_EQ(3u, l.keys.size());
+    marker = l.keys.back();
+  }
+  EXPECT_EQ(keys, got);
+
+  // a marker between keys resumes at the next one
+  Listing l;
+  ASSERT_EQ(0, list_shards(shards, "obj0010a", "", 2, &l));
+  EXPECT_EQ(vector<string>({"obj0011", "obj0012"}), l.keys);
+  EXPECT_TRUE(l.truncated);
+
+  // a marker past the end
+  Listing end;
+  ASSERT_EQ(0, list_shards(shards, "zzz", "", 2, &end));
+  EXPECT_TRUE(end.keys.empty());
+  EXPECT_FALSE(end.truncated);
+}
+
+TEST(BucketListMerge, DuplicateKeys)
+{
+  // stale copies of entries in other shards, as after a reshard
+  vector<shard_t> shards = {
+    {"a", "b", "c"},
+    {"b", "d"},
+    {"c", "d", "e"},
+  };
+
+  Listing l;
+  ASSERT_EQ(0, list_shards(shards, "", "", 10, &l, 1));
+  EXPECT_EQ(vector<string>({"a", "b", "c", "d", "e"}), l.keys);
+  EXPECT_FALSE(l.truncated);
+
+  // duplicates do not count against the limit, nor stall a shard
+  Listing first;
+  ASSERT_EQ(0, list_shards(shards, "", "", 4, &first, 1));
+  EXPECT_EQ(vector<string>({"a", "b", "c", "d"}), first.keys);
+  EXPECT_TRUE(first.truncated);
+  Listing rest;
+  ASSERT_EQ(0, list_shards(shards, first.keys.back(), "", 4, &rest, 1));
+  EXPECT_EQ(vector<string>({"e"}), rest.keys);
+  EXPECT_FALSE(rest.truncated);
+}
+
+TEST(BucketListMerge, PrefixAndDelimiter)
+{
+  vector<string> keys = {"a", "dir/1", "dir/2", "dir/3", "dir/sub/1",
+                         "dir1", "e", "f", "g"};
+  vector<shard_t> shards = make_shards(keys, 3);
+
+  Listing dir;
+  ASSERT_EQ(0, list_shards(shards, "", "dir/", 10, &dir));
+  EXPECT_EQ(vector<string>({"dir/1", "dir/2", "dir/3", "dir/sub/1"}), dir.keys);
+  EXPECT_FALSE(dir.truncated);
+
+  // with delimiter "/", Bucket::List::list_objects() turns "dir/1" into
+  // the common prefix "dir/" and lists on from "dir" + ('/' + 1): all of
+  // dir/, in every shard, is skipped
+  Listing first;
+  ASSERT_EQ(0, list_shards(shards, "", "", 2, &first));
+  EXPECT_EQ(vector<string>({"a", "dir/1"}), first.keys);
+  EXPECT_TRUE(first.truncated);
+  Listing after;
+  ASSERT_EQ(0, list_shards(shards, "dir0", "", 10, &after));
+  EXPECT_EQ(vector<string>({"dir1", "e", "f", "g"}), after.keys);
+  EXPECT_FALSE(after.truncated);
+
+  // nested: prefix "dir/", delimiter "/" skips past "dir/sub/"
+  Listing sub;
+  ASSERT_EQ(0, list_shards(shards, "dir/sub0", "dir/", 10, &sub));
+  EXPECT_TRUE(sub.keys.empty());
+  EXPECT_FALSE(sub.truncated);
+}
+
+TEST(BucketListMerge, ShardError)
+{
+  vector<shard_t> shards = make_shards(make_keys("obj", 10), 3);
+  Listing l;
+  EXPECT_EQ(-EIO, list_shards(shards, "", "", 10, &l, 2, -EIO));
+}
+
+int main(int argc, char** argv)
+{
+  vector<const char*> args;
+  argv_to_vec(argc, (const char **)argv, args);
+
+  global_init(NULL, args, CEPH_ENTITY_TYPE_CLIENT, CODE_ENVIRONMENT_UTILITY, 0);
+  common_init_finish(g_ceph_context);
+
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
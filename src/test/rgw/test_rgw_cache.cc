@@ -0,0 +1,271 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+/*
+ * Ceph - scalable distributed file system
+ *
+ * This is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License version 2.1, as published by the Free Software
+ * Foundation. See file COPYING.
+ *
+ */
+#include "rgw/rgw_cache.h"
+#include "rgw/rgw_data_cache.h"
+#include "global/global_init.h"
+#include "global/global_context.h"
+#include "common/ceph_argparse.h"
+#include "include/stringify.h"
+#include <gtest/gtest.h>
+#include <stdlib.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace {
+
+// set up a cache with the given limits
+void init_cache(ObjectCache& cache, int shards, int lru_size,
+                uint64_t max_bytes)
+{
+  md_config_t *conf = g_ceph_context->_conf;
+  conf->set_val("rgw_cache_shards", stringify(shards).c_str());
+  conf->set_val("rgw_cache_lru_size", stringify(lru_size).c_str());
+  conf->set_val("rgw_cache_max_bytes", stringify(max_bytes).c_str());
+  conf->apply_changes(NULL);
+
+  cache.set_ctx(g_ceph_context);
+  cache.set_enabled(true);
+}
+
+void put(ObjectCache& cache, const string& name, unsigned len)
+{
+  ObjectCacheInfo info;
+  info.flags = CACHE_FLAG_DATA;
+  info.data.append(string(len, 'a'));
+  string n(name);
+  cache.put(n, info, NULL);
+}
+
+bool cached(ObjectCache& cache, const string& name)
+{
+  ObjectCacheInfo info;
+  string n(name);
+  return cache.get(n, info, CACHE_FLAG_DATA, NULL) == 0;
+}
+
+} // anonymous namespace
+
+TEST(ObjectCache, Bytes)
+{
+  ObjectCache cache;
+  init_cache(cache, 4, 1000, 0);
+  ASSERT_EQ(0u, cache.get_bytes());
+
+  put(cache, "a", 100);
+  uint64_t one = cache.get_bytes();
+  ASSERT_LT(100u, one);
+
+  // a bigger update is charged the difference
+  put(cache, "a", 300);
+  ASSERT_EQ(one + 200, cache.get_bytes());
+
+  put(cache, "b", 300);
+  ASSERT_LT(one + 200, cache.get_bytes());
+
+  string a("a"), b("b");
+  cache.remove(a);
+  ASSERT_TRUE(cached(cache, "b"));
+  cache.remove(b);
+  ASSERT_EQ(0u, cache.get_bytes());
+}
+
+TEST(ObjectCache, EvictEntries)
+{
+  ObjectCache cache;
+  init_cache(cache, 1, 4, 0);
+
+  for (int i = 0; i < 10; ++i) {
+    put(cache, "obj" + stringify(i), 10);
+  }
+  ASSERT_FALSE(cached(cache, "obj0"));
+  ASSERT_FALSE(cached(cache, "obj1"));
+  ASSERT_TRUE(cached(cache, "obj9"));
+}
+
+TEST(ObjectCache, EvictBytes)
+{
+  ObjectCache cache;
+  init_cache(cache, 1, 1000, 16384);
+
+  for (int i = 0; i < 10; ++i) {
+    put(cache, "obj" + stringify(i), 4096);
+  }
+  // the entry being put is never evicted, so allow for one over the limit
+  ASSERT_GE(16384u + 4096 + 1024, cache.get_bytes());
+  ASSERT_FALSE(cached(cache, "obj0"));
+  ASSERT_FALSE(cached(cache, "obj1"));
+  ASSERT_TRUE(cached(cache, "obj9"));
+}
+
+TEST(ObjectCache, RemoveBatch)
+{
+  ObjectCache cache;
+  init_cache(cache, 4, 1000, 0);
+
+  list<string> names;
+  for (int i = 0; i < 10; ++i) {
+    string name = "obj" + stringify(i);
+    put(cache, name, 10);
+    if (i % 2 == 0)
+      names.push_back(name);
+  }
+  names.push_back("missing");
+  cache.remove(names);
+
+  for (int i = 0; i < 10; ++i) {
+    ASSERT_EQ(i % 2 != 0, cached(cache, "obj" + stringify(i)));
+  }
+
+  names.clear();
+  for (int i = 1; i < 10; i += 2) {
+    names.push_back("obj" + stringify(i));
+  }
+  cache.remove(names);
+  ASSERT_EQ(0u, cache.get_bytes());
+}
+
+TEST(ObjectCache, NotifyApplied)
+{
+  bufferlist reply;
+  map<pair<uint64_t, uint64_t>, bufferlist> acks;
+  set<pair<uint64_t, uint64_t> > missed;
+  ::encode((int32_t)0, acks[make_pair(1, 1)]);
+  ::encode(acks, reply);
+  ::encode(missed, reply);
+  ASSERT_TRUE(rgw_cache_notify_applied(reply));
+
+  // an older gateway acks with an empty payload
+  acks[make_pair(2, 2)];
+  reply.clear();
+  ::encode(acks, reply);
+  ::encode(missed, reply);
+  ASSERT_FALSE(rgw_cache_notify_applied(reply));
+
+  acks.erase(make_pair(2, 2));
+  missed.insert(make_pair(3, 3));
+  reply.clear();
+  ::encode(acks, reply);
+  ::encode(missed, reply);
+  ASSERT_FALSE(rgw_cache_notify_applied(reply));
+}
+
+class TestDataCache : public ::testing::Test {
+public:
+  string dir;
+
+  void SetUp() {
+    char tmpl[] = "/tmp/test_rgw_data_cache.XXXXXX";
+    ASSERT_TRUE(mkdtemp(tmpl) != NULL);
+    dir = tmpl;
+  }
+
+  void TearDown() {
+    string cmd = "rm -rf " + dir;
+    ASSERT_EQ(0, system(cmd.c_str()));
+  }
+
+  bool exists(const string& name) {
+    struct stat st;
+    return ::stat((dir + "/" + name).c_str(), &st) == 0;
+  }
+
+  bool get(RGWDataCache& cache, const string& obj, const string& tag,
+           off_t ofs, const bufferlist& expected) {
+    bufferlist bl;
+    if (!cache.get(obj, tag, ofs, expected.length(), &bl))
+      return false;
+    return bl.contents_equal(expected);
+  }
+};
+
+TEST_F(TestDataCache, InitKeepsForeignFiles)
+{
+  bufferlist bl;
+  bl.append("x");
+  string stale = string(RGWDataCache::CHUNK_PREFIX) + "7";
+  ASSERT_EQ(0, bl.write_file((dir + "/" + stale).c_str()));
+  ASSERT_EQ(0, bl.write_file((dir + "/keep").c_str()));
+
+  RGWDataCache cache(g_ceph_context, dir, 1 << 20, 1 << 20);
+  ASSERT_EQ(0, cache.init());
+  ASSERT_FALSE(exists(stale));
+  ASSERT_TRUE(exists("keep"));
+}
+
+TEST_F(TestDataCache, PutGet)
+{
+  RGWDataCache cache(g_ceph_context, dir, 1 << 20, 1 << 20);
+  ASSERT_EQ(0, cache.init());
+
+  bufferlist bl;
+  bl.append(string(4096, 'a'));
+  bufferlist data(bl);
+  cache.queue_put("obj", "tag1", 0, data);
+  cache.flush();
+
+  ASSERT_TRUE(get(cache, "obj", "tag1", 0, bl));
+  ASSERT_FALSE(get(cache, "obj", "tag1", 4096, bl));
+
+  // a new version drops what was cached for the old one
+  ASSERT_FALSE(get(cache, "obj", "tag2", 0, bl));
+  ASSERT_FALSE(get(cache, "obj", "tag1", 0, bl));
+
+  data = bl;
+  cache.queue_put("obj", "tag2", 0, data);
+  cache.flush();
+  cache.invalidate("obj");
+  ASSERT_FALSE(get(cache, "obj", "tag2", 0, bl));
+}
+
+TEST_F(TestDataCache, Evict)
+{
+  RGWDataCache cache(g_ceph_context, dir, 16384, 1 << 20);
+  ASSERT_EQ(0, cache.init());
+
+  bufferlist bl;
+  bl.append(string(4096, 'a'));
+  for (int i = 0; i < 8; ++i) {
+    bufferlist data(bl);
+    cache.queue_put("obj", "tag", i * 4096, data);
+  }
+  cache.flush();
+
+  ASSERT_FALSE(get(cache, "obj", "tag", 0, bl));
+  ASSERT_FALSE(get(cache, "obj", "tag", 3 * 4096, bl));
+  ASSERT_TRUE(get(cache, "obj", "tag", 4 * 4096, bl));
+  ASSERT_TRUE(get(cache, "obj", "tag", 7 * 4096, bl));
+}
+
+TEST_F(TestDataCache, PendingLimit)
+{
+  RGWDataCache cache(g_ceph_context, dir, 1 << 20, 4096);
+  ASSERT_EQ(0, cache.init());
+
+  // too big to ever be queued
+  bufferlist bl;
+  bl.append(string(8192, 'a'));
+  cache.queue_put("obj", "tag", 0, bl);
+  cache.flush();
+  ASSERT_FALSE(get(cache, "obj", "tag", 0, bl));
+}
+
+int main(int argc, char** argv)
+{
+  vector<const char*> args;
+  argv_to_vec(argc, (const char **)argv, args);
+
+  global_init(NULL, args, CEPH_ENTITY_TYPE_CLIENT, CODE_ENVIRONMENT_UTILITY, 0);
+  common_init_finish(g_ceph_context);
+
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}